@@ -1,134 +1,289 @@
 #include "Fields.h"
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <string>
 
 using namespace std;
 
-int main(int argc, char *argv[])
+/**
+ * log-Euclidean average of a population of tensor fields
+ *
+ * The volumes are streamed through in slabs of z-slices. For every slab the
+ * subjects are read in turn, the next one while the current one is taken
+ * to the log domain and added to the running sums in double precision.
+ */
+
+// voxels per work item of the threads
+#define TILE 4096
+
+static bool readSlab(const std::string &name, int Xdim, int Ydim, int Zdim, int endian_be,
+		     TensorField *slab, int z0, int nz)
 {
+  FieldReader<float, 6> reader;
 
-  char str[200];
-  int i;
+  if(!reader.open(FieldFileInfo(name, Xdim, Ydim, Zdim, endian_be ? !hostIsBigEndian() : hostIsBigEndian())))
+    return false;
+
+  return reader.readSlab(slab->getDataPtr(), z0, nz);
+}
 
-  int SUB;
+int main(int argc, char *argv[])
+{
 
   if(argc<7 )
     {
-      std::cout<<"Usage: AverDTI  xsize ysize zsize input_dtfiles_txt output_dt_file switch_endian_input(0/1)\n";
+      std::cout<<"Usage: AverDTI  xsize ysize zsize input_dtfiles_txt output_dt_file switch_endian_input(0/1) [output_var_file] [output_cov_file] [slices_per_slab]\n";
+      std::cout<<"       input_dtfiles_txt has one file per line, optionally followed by its weight\n";
+      std::cout<<"       the variance is the trace of the covariance of the logs, the covariance has 21 components (upper triangle, xx yy zz xy xz yz)\n";
+      std::cout<<"       give none to skip an output\n";
       exit(0);
     }
-   
+
   int Xdim= atoi(argv[1]);
   int Ydim= atoi(argv[2]);
   int Zdim= atoi(argv[3]);
 
-  TensorField dti;
-  
-  dti.init(Xdim,Ydim,Zdim);
-  
   int endian_be=0; endian_be= atoi(argv[6]);
 
+  const char *var_file= (argc>7 && strcmp(argv[7],"none")) ? argv[7] : NULL;
+  const char *cov_file= (argc>8 && strcmp(argv[8],"none")) ? argv[8] : NULL;
+  int slab_size= (argc>9) ? atoi(argv[9]) : 16;
+  if(slab_size<1 || slab_size>Zdim)
+    slab_size= Zdim;
+
   std::vector< std::string > DTIfilenames;
-  std::string DTIfilename;
+  std::vector< double > weights;
+  std::string line;
 
   std::ifstream DTIf;
   DTIf.open(argv[4]);
-  
-  int k;
-  
-  int ix, iy, iz;
 
-  TensorField dti_avg;
-  dti_avg.init(Xdim,Ydim,Zdim);
-  
-  unsigned char *mask= (unsigned char *)calloc(Xdim*Ydim*Zdim, sizeof(unsigned char));
+  while(std::getline(DTIf, line))
+    {
+      std::istringstream fields(line);
+      std::string DTIfilename;
+      double w= 1.0;
+
+      if(!(fields>>DTIfilename))
+	continue;
+      fields>>w;
+
+      DTIfilenames.push_back(DTIfilename);
+      weights.push_back(w);
+    }
+
+  DTIf.close();
+
+  int SUB = DTIfilenames.size();
+  cout<<SUB<<" subjects listed\n";
+
+  if(SUB==0)
+    {
+      std::cout<<"No input DTI files\n";
+      exit(0);
+    }
+
+  // mask and threshold from the first subject
+  // note magic number 0.001
+  TensorField dti;
+  dti.init(Xdim,Ydim,1);
 
-  for(k=0; !DTIf.eof(); k++)
+  if(!readSlab(DTIfilenames[0], Xdim, Ydim, Zdim, endian_be, &dti, Zdim/2, 1))
     {
-      if(DTIf.eof())
-	    break;
+      std::cout<<"Unable to read "<<DTIfilenames[0]<<"\n";
+      exit(0);
+    }
+  float *cen= dti.getAt(Xdim/2,Ydim/2,0);
+  float threshold= 0.001*(cen[0]+cen[1]+cen[2]);
 
-       DTIf>>DTIfilename;
-       
-       DTIfilenames.push_back(DTIfilename);
+  // two slabs of input, the next subject is read into one while the other is summed
+  TensorField dti_in[2], dti_log;
+  dti_in[0].init(Xdim,Ydim,slab_size);
+  dti_in[1].init(Xdim,Ydim,slab_size);
+  dti_log.init(Xdim,Ydim,slab_size);
+  dti_in[0].traceTensorThreshold= dti_in[1].traceTensorThreshold= threshold;
 
-      if(endian_be)
-	{
-	  std::cout<<"Reading "<< DTIfilename<<" in big endian format\n";
-	  dti.importRawFieldFromFile_BE(DTIfilename.c_str());
-	}
-      else
-	{
-	  std::cout<<"Reading "<< DTIfilename<<" in little endian format\n";
-	  dti.importRawFieldFromFile(DTIfilename.c_str());
-	}
+  long slab_vox= (long)Xdim*Ydim*slab_size;
+  int nsq= cov_file ? 21 : (var_file ? 6 : 0);
 
-      if(k==0)
+  unsigned char *mask= (unsigned char *)calloc(slab_vox, sizeof(unsigned char));
+  double *sum= new double[6*slab_vox];
+  double *sumsq= new double[nsq*slab_vox + 1];
+  double *wsum= new double[slab_vox];
+
+  ScalarField var;
+  Field<float, 21> cov;
+  if(var_file)
+    var.init(Xdim,Ydim,slab_size);
+  if(cov_file)
+    cov.init(Xdim,Ydim,slab_size);
+
+  FieldWriter<float, 6> avg_out;
+  FieldWriter<float, 1> var_out;
+  FieldWriter<float, 21> cov_out;
+
+  if(!avg_out.open(FieldFileInfo(argv[5], Xdim, Ydim, Zdim)) ||
+     (var_file && !var_out.open(FieldFileInfo(var_file, Xdim, Ydim, Zdim))) ||
+     (cov_file && !cov_out.open(FieldFileInfo(cov_file, Xdim, Ydim, Zdim))))
+    {
+      std::cout<<"Unable to open the output files\n";
+      exit(0);
+    }
+
+  // entry (p,q) of the covariance of the 6 log components, p<=q
+  int cp[21], cq[21], cdiag[6];
+  for(int p=0, c=0; p<6; p++)
+    for(int q=p; q<6; q++, c++)
+      {
+	cp[c]= p; cq[c]= q;
+	if(p==q)
+	  cdiag[p]= c;
+      }
+
+  for(int z0=0; z0<Zdim; z0+=slab_size)
+    {
+      int nz= (Zdim-z0 < slab_size) ? Zdim-z0 : slab_size;
+      long nvox= (long)Xdim*Ydim*nz;
+
+      cout<<"Slices "<<z0<<" to "<<z0+nz-1<<"\n";
+
+      memset(sum, 0, 6*nvox*sizeof(double));
+      memset(sumsq, 0, nsq*nvox*sizeof(double));
+      memset(wsum, 0, nvox*sizeof(double));
+
+      if(!readSlab(DTIfilenames[0], Xdim, Ydim, Zdim, endian_be, &dti_in[0], z0, nz))
 	{
-	  // mask computed from first DTI
-	  // note magic number 0.001
-	  dti.computeNZmask(mask,0.001);
+	  std::cout<<"Unable to read "<<DTIfilenames[0]<<"\n";
+	  exit(0);
 	}
+      dti_in[0].computeNZmask(mask);
 
-      TensorField dti_tmp;
-      dti_tmp.init(Xdim,Ydim,Zdim);
-  
-      // compute log of tensor 
-      dti.logTField(&dti_tmp, mask);
+      for(int k=0; k<SUB; k++)
+	{
+	  TensorField &dti_cur= dti_in[k%2];
+	  TensorField &dti_next= dti_in[(k+1)%2];
+	  const float *in_data= dti_cur.getDataPtr();
+	  const float *log_data= dti_log.getDataPtr();
+	  double w= weights[k];
+	  bool read_ok= true;
 
-      for(ix=0; ix<Xdim; ix++)
-	for(iy=0; iy<Ydim; iy++)
-	  for(iz=0; iz<Zdim; iz++)
+#pragma omp parallel
+	  {
+	    // one thread reads ahead and then joins the others
+#pragma omp single nowait
 	    {
-	      int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	      	     
-	      if(mask[ind]==0)
-		{	  
-		  continue;
-		}
-	     
-	      float *val_sub= dti_tmp.getAt(ix,iy,iz);
+	      if(k+1<SUB)
+		read_ok= readSlab(DTIfilenames[k+1], Xdim, Ydim, Zdim, endian_be, &dti_next, z0, nz);
+	    }
 
-	      float *val_avg= dti_avg.getAt(ix,iy,iz);
+#pragma omp for schedule(dynamic)
+	    for(long b=0; b<nvox; b+=TILE)
+	      {
+		long e= (nvox-b < TILE) ? nvox : b+TILE;
 
-	      for(i=0; i<6; i++)
-		val_avg[i] += val_sub[i];
-	      
-	    }
-    }
+		dti_cur.logTField(&dti_log, mask, b, e);
 
-  DTIf.close();
+		for(long ind=b; ind<e; ind++)
+		  {
+		    const float *t= in_data + 6*ind;
 
-  SUB = k;
-  cout<<SUB<<" subjects read\n";
+		    // a subject only counts where it has a tensor
+		    if(mask[ind]==0 || (double)t[0]+t[1]+t[2] < threshold)
+		      continue;
 
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
+		    const float *l= log_data + 6*ind;
+		    double *s= sum + 6*ind;
+		    double *sq= sumsq + nsq*ind;
+
+		    wsum[ind] += w;
+		    for(int j=0; j<6; j++)
+		      s[j] += w*l[j];
+		    if(nsq==6)
+		      for(int j=0; j<6; j++)
+			sq[j] += w*l[j]*l[j];
+		    else if(nsq==21)
+		      for(int j=0; j<21; j++)
+			sq[j] += w*l[cp[j]]*l[cq[j]];
+		  }
+	      }
+	  }
+
+	  if(!read_ok)
+	    {
+	      std::cout<<"Unable to read "<<DTIfilenames[k+1]<<"\n";
+	      exit(0);
+	    }
+	}
+
+      // weighted mean and (co)variance of the logs
+      float *mean_data= dti_log.getDataPtr();
+      float *var_data= var_file ? var.getDataPtr() : NULL;
+      float *cov_data= cov_file ? cov.getDataPtr() : NULL;
+
+#pragma omp parallel for schedule(static)
+      for(long ind=0; ind<nvox; ind++)
 	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  
-	  if(mask[ind]==0)
-	    {	  
+	  float *m= mean_data + 6*ind;
+	  double mu[6];
+	  int i;
+
+	  if(mask[ind]==0 || wsum[ind]<=0)
+	    {
+	      for(i=0; i<6; i++)
+		m[i]= 0;
+	      if(var_data)
+		var_data[ind]= 0;
+	      if(cov_data)
+		for(i=0; i<21; i++)
+		  cov_data[21*ind+i]= 0;
 	      continue;
 	    }
-	  
-	  float *val_avg= dti_avg.getAt(ix,iy,iz);
-	  
+
 	  for(i=0; i<6; i++)
-	    val_avg[i] /= SUB;
-	  
+	    {
+	      mu[i]= sum[6*ind+i]/wsum[ind];
+	      m[i]= mu[i];
+	    }
+
+	  const double *sq= sumsq + nsq*ind;
+	  if(cov_data)
+	    for(i=0; i<21; i++)
+	      cov_data[21*ind+i]= sq[i]/wsum[ind] - mu[cp[i]]*mu[cq[i]];
+
+	  if(var_data)
+	    {
+	      // mean squared log-Euclidean distance, the off-diagonal entries count twice
+	      double v= 0;
+	      for(i=0; i<6; i++)
+		{
+		  double vi= sq[(nsq==21) ? cdiag[i] : i]/wsum[ind] - mu[i]*mu[i];
+		  v += (i<3) ? vi : 2*vi;
+		}
+	      var_data[ind]= (v>0) ? v : 0;
+	    }
 	}
-  
-  TensorField dti_tmp;
-  dti_tmp.init(Xdim,Ydim,Zdim);
-  
-  dti_avg.expTField(&dti_tmp, mask);
-
-  sprintf(str,"%s",argv[5]);
-  dti_tmp.exportRawFieldToFile(str);
+
+      dti_log.expTField(&dti_in[0], mask);
+
+      avg_out.writeSlab(dti_in[0].getDataPtr(), nz);
+      if(var_file)
+	var_out.writeSlab(var_data, nz);
+      if(cov_file)
+	cov_out.writeSlab(cov_data, nz);
+    }
+
+  if(!avg_out.close() || (var_file && !var_out.close()) || (cov_file && !cov_out.close()))
+    {
+      std::cout<<"Unable to write the output files\n";
+      exit(0);
+    }
+
+  free(mask);
+  delete [] sum;
+  delete [] sumsq;
+  delete [] wsum;
 
   return 0;
 
@@ -0,0 +1,574 @@
+#include "DTIPipeline.h"
+#include <iostream>
+using namespace std;
+
+// voxels per work item of the threads, a multiple of SymEigen3::BatchSize
+#define TILE 4096
+
+/**
+ * a raw tensor file, read a slab at a time. The file is only open from the
+ * first read to the next release(), so the sources of a mean (released after
+ * every slab) do not hold a file each, as AverDTI.
+ */
+class DTISource : public DTINode
+{
+ public:
+  DTISource(const std::string &fileName_, int endian_be_, float threshold_factor_, DTISource *thresholdFrom_)
+    : DTINode(6), fileName(fileName_), endian_be(endian_be_), threshold_factor(threshold_factor_),
+      thresholdFrom(thresholdFrom_), thresholdKnown(false) {}
+
+  /// the trace threshold of the mask, from the centre voxel of the volume
+  float threshold()
+  {
+    if(thresholdFrom)
+      return thresholdFrom->threshold();
+
+    if(!thresholdKnown)
+      {
+	// note magic number 0.001 (the default factor), as in logESmooth
+	std::vector<float> slice(6L*m_Dims[0]*m_Dims[1]);
+	if(!file().readSlab(&slice[0], m_Dims[2]/2, 1))
+	  {
+	    std::cout<<"Unable to read "<<fileName<<"\n";
+	    exit(1);
+	  }
+	const float *cen = &slice[6L*(m_Dims[1]/2*m_Dims[0] + m_Dims[0]/2)];
+	thresholdValue = threshold_factor*(cen[0]+cen[1]+cen[2]);
+	thresholdKnown = true;
+      }
+    return thresholdValue;
+  }
+
+ protected:
+  FieldFileInfo info() const
+  {
+    return FieldFileInfo(fileName, m_Dims[0], m_Dims[1], m_Dims[2], endian_be ? !hostIsBigEndian() : hostIsBigEndian());
+  }
+
+  bool open()
+  {
+    bool ok = reader.open(info());
+    reader.close();
+    return ok;
+  }
+
+  void close()
+  {
+    reader.close();
+  }
+
+  /// the reader, opened if needed
+  FieldReader<float, 6> &file()
+  {
+    if(!reader.isOpen() && !reader.open(info()))
+      {
+	std::cout<<"Unable to open "<<fileName<<"\n";
+	exit(1);
+      }
+    return reader;
+  }
+
+  void compute(int z0, int nz)
+  {
+    long nvox = (long)m_Dims[0]*m_Dims[1]*nz;
+    float thr = threshold();
+
+    m_Slab.data.resize(6*nvox);
+    m_Slab.mask.resize(nvox);
+
+    if(!file().readSlab(&m_Slab.data[0], z0, nz))
+      {
+	std::cout<<"Unable to read "<<fileName<<"\n";
+	exit(1);
+      }
+
+    const float *t = &m_Slab.data[0];
+    unsigned char *mask = &m_Slab.mask[0];
+
+    // as computeNZmask
+#pragma omp parallel for schedule(static)
+    for(long i=0; i<nvox; i++)
+      mask[i] = (t[6*i] + t[6*i+1] + t[6*i+2] > thr) ? 1 : 0;
+  }
+
+  std::string fileName;
+  int endian_be;
+  float threshold_factor;
+  DTISource *thresholdFrom;
+  bool thresholdKnown;
+  float thresholdValue;
+  FieldReader<float, 6> reader;
+};
+
+/**
+ * the voxel-wise operations
+ */
+class DTILog : public DTINode
+{
+ public:
+  DTILog() : DTINode(6) {}
+
+ protected:
+  bool voxelwise() const { return true; }
+
+  // the source has already applied the trace threshold to the mask
+  void apply(const float *in, float *out, const unsigned char *mask, long n) const
+  {
+    TensorField::logTensors(in, out, mask, n, -HUGE_VAL);
+  }
+};
+
+class DTIExp : public DTINode
+{
+ public:
+  DTIExp() : DTINode(6) {}
+
+ protected:
+  bool voxelwise() const { return true; }
+
+  void apply(const float *in, float *out, const unsigned char *mask, long n) const
+  {
+    TensorField::expTensors(in, out, mask, n);
+  }
+};
+
+class DTIFA : public DTINode
+{
+ public:
+  DTIFA() : DTINode(1) {}
+
+ protected:
+  bool voxelwise() const { return true; }
+
+  void apply(const float *in, float *out, const unsigned char *mask, long n) const
+  {
+    TensorField::faTensors(in, out, n);
+  }
+};
+
+class DTITrace : public DTINode
+{
+ public:
+  DTITrace() : DTINode(1) {}
+
+ protected:
+  bool voxelwise() const { return true; }
+
+  void apply(const float *in, float *out, const unsigned char *mask, long n) const
+  {
+    for(long i=0; i<n; i++)
+      out[i] = in[i*6] + in[i*6+1] + in[i*6+2];
+  }
+};
+
+/**
+ * smoothing of a slab with a halo of input slices, the output slices are
+ * the same as those of the whole volume smoothed at once
+ */
+class DTISmooth : public DTINode
+{
+ public:
+  DTISmooth(int channels, const Smoother &smoother_) : DTINode(channels), smoother(smoother_) {}
+
+ protected:
+  /// the slices za .. zb-1 of the input needed for the slices z0 .. z0+nz-1
+  void haloRange(int z0, int nz, int &za, int &zb) const
+  {
+    int halo = smoother.support(2);
+    za = (z0-halo > 0) ? z0-halo : 0;
+    zb = (z0+nz+halo < m_Dims[2]) ? z0+nz+halo : m_Dims[2];
+  }
+
+  void requestInputs(int z0, int nz)
+  {
+    int za, zb;
+    haloRange(z0, nz, za, zb);
+    inputs[0]->request(za, zb-za);
+  }
+
+  void compute(int z0, int nz)
+  {
+    int za, zb;
+    haloRange(z0, nz, za, zb);
+    int dims[3] = { m_Dims[0], m_Dims[1], zb-za };
+
+    const DTISlab &in = inputs[0]->pull(za, zb-za);
+    long first = in.voxel(za);
+
+    long slice = (long)m_Dims[0]*m_Dims[1];
+    block.resize(m_Channels*slice*dims[2]);
+    smoother.apply(&in.data[m_Channels*first], &block[0], dims, m_Channels, &in.mask[first]);
+
+    m_Slab.data.assign(block.begin() + m_Channels*slice*(z0-za), block.begin() + m_Channels*slice*(z0-za+nz));
+    m_Slab.mask.assign(in.mask.begin() + in.voxel(z0), in.mask.begin() + in.voxel(z0+nz));
+  }
+
+  Smoother smoother;
+  std::vector<float> block;
+};
+
+/**
+ * weighted mean of the inputs, accumulated in double precision
+ */
+class DTIMean : public DTINode
+{
+ public:
+  DTIMean(int channels, const std::vector<double> &weights_) : DTINode(channels), weights(weights_) {}
+
+ protected:
+  void compute(int z0, int nz)
+  {
+    long nvox = (long)m_Dims[0]*m_Dims[1]*nz;
+    int nc = m_Channels;
+
+    sum.assign(nc*nvox, 0.0);
+    wsum.assign(nvox, 0.0);
+
+    for(unsigned int k=0; k<inputs.size(); k++)
+      {
+	const DTISlab &in = inputs[k]->pull(z0, nz);
+	if(k==0)
+	  m_Slab.mask.assign(in.mask.begin() + in.voxel(z0), in.mask.begin() + in.voxel(z0+nz));
+
+	const float *d = &in.data[nc*in.voxel(z0)];
+	const unsigned char *m = &in.mask[in.voxel(z0)];
+	const unsigned char *mask = &m_Slab.mask[0];
+	double w = weights[k];
+
+#pragma omp parallel for schedule(static)
+	for(long i=0; i<nvox; i++)
+	  {
+	    if(mask[i]==0 || m[i]==0)
+	      continue;
+	    wsum[i] += w;
+	    for(int c=0; c<nc; c++)
+	      sum[nc*i+c] += w*d[nc*i+c];
+	  }
+
+	// the next input is computed into the memory of this one
+	if(inputs[k]->consumers()==1)
+	  inputs[k]->release();
+      }
+
+    m_Slab.data.resize(nc*nvox);
+    float *out = &m_Slab.data[0];
+
+#pragma omp parallel for schedule(static)
+    for(long i=0; i<nvox; i++)
+      for(int c=0; c<nc; c++)
+	out[nc*i+c] = (wsum[i]>0) ? sum[nc*i+c]/wsum[i] : 0.0;
+  }
+
+  std::vector<double> weights;
+  std::vector<double> sum;
+  std::vector<double> wsum;
+};
+
+
+//----
+DTINode::DTINode(int channels)
+//----
+{
+  m_Channels = channels;
+  m_Dims[0] = m_Dims[1] = m_Dims[2] = 0;
+  m_Consumers = 0;
+  m_Fused = false;
+  m_RequestZ0 = m_RequestNz = 0;
+}
+
+//----
+void DTINode::request(int z0, int nz)
+//----
+{
+  if(m_RequestNz==0)
+    {
+      m_RequestZ0 = z0;
+      m_RequestNz = nz;
+    }
+  else
+    {
+      int zb = (z0+nz > m_RequestZ0+m_RequestNz) ? z0+nz : m_RequestZ0+m_RequestNz;
+      if(z0 < m_RequestZ0)
+	m_RequestZ0 = z0;
+      m_RequestNz = zb-m_RequestZ0;
+    }
+
+  requestInputs(z0, nz);
+}
+
+//----
+void DTINode::requestInputs(int z0, int nz)
+//----
+{
+  for(unsigned int i=0; i<inputs.size(); i++)
+    inputs[i]->request(z0, nz);
+}
+
+//----
+const DTISlab &DTINode::pull(int z0, int nz)
+//----
+{
+  if(!m_Slab.contains(z0, nz))
+    {
+      // the other consumers get their slices from the same slab
+      if(m_RequestNz>0 && z0>=m_RequestZ0 && z0+nz<=m_RequestZ0+m_RequestNz)
+	{
+	  z0 = m_RequestZ0;
+	  nz = m_RequestNz;
+	}
+      compute(z0, nz);
+      m_Slab.z0 = z0;
+      m_Slab.nz = nz;
+      m_Slab.slice = (long)m_Dims[0]*m_Dims[1];
+    }
+
+  return m_Slab;
+}
+
+//----
+void DTINode::release()
+//----
+{
+  m_Slab.nz = 0;
+  std::vector<float>().swap(m_Slab.data);
+  std::vector<unsigned char>().swap(m_Slab.mask);
+  close();
+
+  for(unsigned int i=0; i<inputs.size(); i++)
+    if(inputs[i]->m_Consumers==1)
+      inputs[i]->release();
+}
+
+//----
+void DTINode::compute(int z0, int nz)
+//----
+{
+  // this node and the fused nodes below it, the last one is applied first
+  std::vector<const DTINode *> chain;
+  DTINode *base = this;
+  int maxc = 0;
+  do
+    {
+      chain.push_back(base);
+      if(base->m_Channels > maxc)
+	maxc = base->m_Channels;
+      base = base->inputs[0];
+    }
+  while(base->m_Fused);
+
+  const DTISlab &in = base->pull(z0, nz);
+  long nvox = (long)m_Dims[0]*m_Dims[1]*nz;
+  int nin = base->m_Channels;
+  int nchain = chain.size();
+
+  m_Slab.data.resize(m_Channels*nvox);
+  m_Slab.mask.assign(in.mask.begin() + in.voxel(z0), in.mask.begin() + in.voxel(z0+nz));
+
+  const float *in_data = &in.data[nin*in.voxel(z0)];
+  float *out_data = &m_Slab.data[0];
+  const unsigned char *mask = &m_Slab.mask[0];
+
+#pragma omp parallel
+  {
+    std::vector<float> buf[2];
+    buf[0].resize((long)maxc*TILE);
+    buf[1].resize((long)maxc*TILE);
+
+#pragma omp for schedule(dynamic)
+    for(long b=0; b<nvox; b+=TILE)
+      {
+	long n = (nvox-b < TILE) ? nvox-b : TILE;
+	const float *src = in_data + nin*b;
+
+	for(int i=nchain-1; i>=0; i--)
+	  {
+	    float *dst = (i==0) ? out_data + m_Channels*b : &buf[i%2][0];
+	    chain[i]->apply(src, dst, mask+b, n);
+	    src = dst;
+	  }
+      }
+  }
+}
+
+
+//----
+DTIPipeline::DTIPipeline(int Xdim, int Ydim, int Zdim, int slabSize)
+//----
+{
+  m_Dims[0] = Xdim;
+  m_Dims[1] = Ydim;
+  m_Dims[2] = Zdim;
+
+  m_SlabSize = slabSize;
+  if(m_SlabSize<1 || m_SlabSize>Zdim)
+    m_SlabSize = Zdim;
+}
+
+//----
+DTIPipeline::~DTIPipeline()
+//----
+{
+  for(unsigned int i=0; i<m_Nodes.size(); i++)
+    delete m_Nodes[i];
+}
+
+//----
+DTINode *DTIPipeline::add(DTINode *node)
+//----
+{
+  for(int d=0; d<3; d++)
+    node->m_Dims[d] = m_Dims[d];
+
+  for(unsigned int i=0; i<node->inputs.size(); i++)
+    node->inputs[i]->m_Consumers++;
+
+  m_Nodes.push_back(node);
+  return node;
+}
+
+//----
+DTINode *DTIPipeline::source(const std::string &fileName, int endian_be, float threshold_factor, DTINode *thresholdFrom)
+//----
+{
+  return add(new DTISource(fileName, endian_be, threshold_factor, dynamic_cast<DTISource *>(thresholdFrom)));
+}
+
+//----
+DTINode *DTIPipeline::log(DTINode *in)
+//----
+{
+  DTINode *node = new DTILog;
+  node->inputs.push_back(in);
+  return add(node);
+}
+
+//----
+DTINode *DTIPipeline::exp(DTINode *in)
+//----
+{
+  DTINode *node = new DTIExp;
+  node->inputs.push_back(in);
+  return add(node);
+}
+
+//----
+DTINode *DTIPipeline::smooth(DTINode *in, const Smoother &smoother)
+//----
+{
+  DTINode *node = new DTISmooth(in->channels(), smoother);
+  node->inputs.push_back(in);
+  return add(node);
+}
+
+//----
+DTINode *DTIPipeline::mean(const std::vector<DTINode *> &in, const std::vector<double> &weights)
+//----
+{
+  DTINode *node = new DTIMean(in[0]->channels(), weights);
+  node->inputs = in;
+  return add(node);
+}
+
+//----
+DTINode *DTIPipeline::fa(DTINode *in)
+//----
+{
+  DTINode *node = new DTIFA;
+  node->inputs.push_back(in);
+  return add(node);
+}
+
+//----
+DTINode *DTIPipeline::trace(DTINode *in)
+//----
+{
+  DTINode *node = new DTITrace;
+  node->inputs.push_back(in);
+  return add(node);
+}
+
+//----
+void DTIPipeline::sink(DTINode *in, const std::string &fileName, int endian_be)
+//----
+{
+  Sink s;
+  s.node = in;
+  s.fileName = fileName;
+  s.endian_be = endian_be;
+
+  in->m_Consumers++;
+  m_Sinks.push_back(s);
+}
+
+//----
+bool DTIPipeline::run()
+//----
+{
+  unsigned int i;
+
+  // a voxel-wise node is fused into its consumer if that is its only one
+  // and is voxel-wise as well
+  for(i=0; i<m_Nodes.size(); i++)
+    for(unsigned int j=0; j<m_Nodes[i]->inputs.size(); j++)
+      {
+	DTINode *in = m_Nodes[i]->inputs[j];
+	in->m_Fused = m_Nodes[i]->voxelwise() && in->voxelwise() && in->m_Consumers==1;
+      }
+
+  for(i=0; i<m_Nodes.size(); i++)
+    if(!m_Nodes[i]->open())
+      {
+	std::cout<<"Unable to open the input files\n";
+	return false;
+      }
+
+  // the slabs are written as a field of one channel with channels*Xdim values
+  // per row, the file is the same
+  std::vector< FieldWriter<float, 1> > writers(m_Sinks.size());
+  for(i=0; i<m_Sinks.size(); i++)
+    {
+      const Sink &s = m_Sinks[i];
+      if(!writers[i].open(FieldFileInfo(s.fileName, s.node->channels()*m_Dims[0], m_Dims[1], m_Dims[2],
+					s.endian_be ? !hostIsBigEndian() : hostIsBigEndian())))
+	{
+	  std::cout<<"Unable to open "<<s.fileName<<"\n";
+	  return false;
+	}
+    }
+
+  for(int z0=0; z0<m_Dims[2]; z0+=m_SlabSize)
+    {
+      int nz = (m_Dims[2]-z0 < m_SlabSize) ? m_Dims[2]-z0 : m_SlabSize;
+
+      std::cout<<"Slices "<<z0<<" to "<<z0+nz-1<<"\n";
+
+      for(i=0; i<m_Nodes.size(); i++)
+	m_Nodes[i]->m_RequestNz = 0;
+      for(i=0; i<m_Sinks.size(); i++)
+	m_Sinks[i].node->request(z0, nz);
+
+      for(i=0; i<m_Sinks.size(); i++)
+	{
+	  DTINode *node = m_Sinks[i].node;
+	  const DTISlab &slab = node->pull(z0, nz);
+	  if(!writers[i].writeSlab(&slab.data[node->channels()*slab.voxel(z0)], nz))
+	    {
+	      std::cout<<"Unable to write "<<m_Sinks[i].fileName<<"\n";
+	      return false;
+	    }
+	}
+    }
+
+  for(i=0; i<m_Nodes.size(); i++)
+    m_Nodes[i]->close();
+
+  bool ok = true;
+  for(i=0; i<m_Sinks.size(); i++)
+    if(!writers[i].close())
+      {
+	std::cout<<"Unable to write "<<m_Sinks[i].fileName<<"\n";
+	ok = false;
+      }
+
+  return ok;
+}
@@ -0,0 +1,200 @@
+/**
+ * @file DTIPipeline.h
+ * @brief Lazily evaluated pipelines of tensor field operations, streamed
+ * through the volume a slab of z-slices at a time
+ *
+ * A pipeline is a graph of nodes (sources, operations and sinks) that is
+ * built first and evaluated by run(), e.g. the Log-Euclidean smoothing of
+ * smoothDTI:
+ *
+ *   DTIPipeline p(Xdim, Ydim, Zdim);
+ *   DTINode *dti = p.exp(p.smooth(p.log(p.source(in, 0)), smoother));
+ *   p.sink(dti, out);
+ *   p.sink(p.fa(dti), fa_out);
+ *   p.run();
+ *
+ * The output files are written slab by slab. For every slab, run() first
+ * passes the slices each consumer needs down the graph (request()), then
+ * pulls the sinks. A node computes the union of the slices requested from it
+ * on the first pull and serves all its consumers from it, so nothing is read
+ * or computed twice for the same slab and the memory is bounded by the slab
+ * size. Smoothing asks its input for a halo of slices on either side, which
+ * are computed again with the next slab.
+ *
+ * Consecutive voxel-wise operations (log, exp, fa, trace) are fused: a chain
+ * of them is applied a tile of voxels at a time, the intermediate results
+ * stay in a small per-thread buffer and only the last one is stored.
+ *
+ * Every slab carries the mask of the voxels that hold a tensor, set by the
+ * source (trace above a threshold) and passed on by the operations.
+ */
+
+#ifndef _DTI_PIPELINE_H_
+#define _DTI_PIPELINE_H_
+
+#include "Fields.h"
+#include <vector>
+#include <string>
+
+/**
+ * @brief the slices z0 .. z0+nz-1 of the output of a node
+ */
+struct DTISlab
+{
+  DTISlab() : z0(0), nz(0), slice(0) {}
+
+  /// the slices z .. z+n-1 are in the slab
+  bool contains(int z, int n) const { return z >= z0 && z+n <= z0+nz; }
+
+  /// the index of the first voxel of slice z
+  long voxel(int z) const { return (z-z0)*slice; }
+
+  int z0, nz;
+  /// voxels per slice
+  long slice;
+  /// channels*Xdim*Ydim*nz values, interleaved as in Field
+  std::vector<float> data;
+  std::vector<unsigned char> mask;
+};
+
+/**
+ * @brief a node of a DTIPipeline, created by the pipeline
+ */
+class DTINode
+{
+ public:
+  DTINode(int channels);
+  virtual ~DTINode() {}
+
+  /// the values per voxel of the output
+  int channels() const { return m_Channels; }
+
+  /// the nodes and sinks that take the output of this node
+  int consumers() const { return m_Consumers; }
+
+  /**
+   * the slices z0 .. z0+nz-1 will be pulled for the current slab
+   */
+  void request(int z0, int nz);
+
+  /**
+   * a slab that contains the slices z0 .. z0+nz-1 (see DTISlab::voxel()),
+   * computed for the union of the requests if they include these slices
+   */
+  const DTISlab &pull(int z0, int nz);
+
+  /**
+   * frees the slab of this node, and of the inputs that have no other consumer
+   */
+  void release();
+
+  std::vector<DTINode *> inputs;
+
+ protected:
+  friend class DTIPipeline;
+
+  /// checks the files of the node, called by run() before the first slab
+  virtual bool open() { return true; }
+
+  /**
+   * closes the files of the node, called by release() and at the end of
+   * run(), the next compute() opens them again
+   */
+  virtual void close() {}
+
+  /// requests the slices of the inputs needed for the slices z0 .. z0+nz-1
+  virtual void requestInputs(int z0, int nz);
+
+  /// the output only depends on the input at the same voxel
+  virtual bool voxelwise() const { return false; }
+
+  /**
+   * a voxel-wise node applied to n voxels, with the mask of the input
+   */
+  virtual void apply(const float *in, float *out, const unsigned char *mask, long n) const {}
+
+  /**
+   * computes m_Slab for the slices z0 .. z0+nz-1, by default as the end of
+   * a chain of fused voxel-wise nodes
+   */
+  virtual void compute(int z0, int nz);
+
+  int m_Channels;
+  int m_Dims[3];
+  int m_Consumers;
+  /// evaluated within the compute() of its (voxel-wise) consumer
+  bool m_Fused;
+  /// the union of the requests for the current slab
+  int m_RequestZ0, m_RequestNz;
+  DTISlab m_Slab;
+};
+
+/**
+ * @brief a graph of DTINodes, evaluated by run()
+ */
+class DTIPipeline
+{
+ public:
+  /**
+   * the volumes are Xdim x Ydim x Zdim and the output is written
+   * slabSize slices at a time
+   */
+  DTIPipeline(int Xdim, int Ydim, int Zdim, int slabSize=16);
+  ~DTIPipeline();
+
+  /**
+   * a raw tensor file, with the bytes swapped if endian_be. The mask is the
+   * voxels with a trace above threshold_factor times the trace at the centre
+   * of the volume, or of the volume of thresholdFrom (another source) if given.
+   */
+  DTINode *source(const std::string &fileName, int endian_be, float threshold_factor=0.001, DTINode *thresholdFrom=0);
+
+  /// the matrix logarithm, zero outside the mask
+  DTINode *log(DTINode *in);
+
+  /// the matrix exponential, zero outside the mask
+  DTINode *exp(DTINode *in);
+
+  /// the normalized convolution with the smoother within the mask
+  DTINode *smooth(DTINode *in, const Smoother &smoother);
+
+  /**
+   * the weighted mean of the inputs, each counted where its mask is set.
+   * The mask of the mean is that of the first input. The inputs are
+   * evaluated one after the other, so only one of them is held at a time.
+   */
+  DTINode *mean(const std::vector<DTINode *> &in, const std::vector<double> &weights);
+
+  /// the FA of the tensors
+  DTINode *fa(DTINode *in);
+
+  /// the sum of the diagonal
+  DTINode *trace(DTINode *in);
+
+  /// writes the output of in to a raw file, with the bytes swapped if endian_be
+  void sink(DTINode *in, const std::string &fileName, int endian_be=0);
+
+  /**
+   * evaluates the pipeline and writes all the sinks
+   * @return false if a file could not be opened or written, a read error
+   * within a source ends the program
+   */
+  bool run();
+
+ private:
+  DTINode *add(DTINode *node);
+
+  int m_Dims[3];
+  int m_SlabSize;
+  std::vector<DTINode *> m_Nodes;
+
+  struct Sink
+  {
+    DTINode *node;
+    std::string fileName;
+    int endian_be;
+  };
+  std::vector<Sink> m_Sinks;
+};
+
+#endif
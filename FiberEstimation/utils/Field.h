@@ -10,6 +10,7 @@
 #define _FIELD_H_
 
 #include <string>
+#include "FieldIO.h"
 
 /**
 *  @brief	Container class to hold a 3D vector image,  like velocity, displacement 
@@ -105,6 +106,19 @@ class Field {
     **/
     T* getAt(int x, int y, int z) const { return m_Data + n*(m_Dims[0]*(z*m_Dims[1] + y) +x) ; }
 
+    /**
+     *  @brief		applies a row operator to every x-row of the field.
+     *  @param		op	called as op(y, z, ind), with ind the voxel index
+     *				of (0,y,z). It processes the getSize(0) voxels
+     *				of the row, which are contiguous in memory.
+     *
+     *  The rows are split in contiguous blocks between the OpenMP threads, so
+     *  every thread sweeps its part of the field in storage order. op is
+     *  called concurrently and may only write to the voxels of its row.
+    **/
+    template <typename Op>
+    void forEachRow(const Op &op) const;
+
     /**
      *  @brief		Exports the raw field into a file.
      *  @param		fileName The filename as a STL string.
@@ -119,10 +133,14 @@ class Field {
     **/
     bool importRawFieldFromFile(std::string fileName);
 
-
+    /**
+     *  @brief		Exports the raw field into a big endian file, exits on failure.
+    **/
     bool exportRawFieldToFile_BE(std::string fileName);
 
-
+    /**
+     *  @brief		Imports a raw field from a big endian file, exits on failure.
+    **/
     bool importRawFieldFromFile_BE(std::string fileName);
 
 
@@ -173,152 +191,77 @@ bool Field<T, n>::init(int sizeX, int sizeY, int sizeZ) {
   m_RawFileName = std::string("none");
   m_Dims[0] = sizeX; m_Dims[1] = sizeY; m_Dims[2] = sizeZ;
   m_VoxelSize[0] = 1.0; m_VoxelSize[1] = 1.0; m_VoxelSize[2] = 1.0;
+  if (m_Data)
+    delete [] m_Data;
   m_Data = new T[n*sizeX*sizeY*sizeZ];
   return true;
 }
 
 template <typename T, int n>
-bool Field<T, n>::importRawFieldFromFile(std::string fileName) {
-  FILE * pFile;
-  long lSize;
+template <typename Op>
+void Field<T, n>::forEachRow(const Op &op) const {
+  long nrows = (long)m_Dims[1]*m_Dims[2];
 
-  pFile = fopen ( fileName.c_str() , "rb" );
-  if (pFile==NULL) 
-    return false;
+#pragma omp parallel for schedule(static)
+  for (long r=0; r<nrows; r++)
+    op(r % m_Dims[1], r / m_Dims[1], r*m_Dims[0]);
+}
 
-  // obtain file size.
-  fseek (pFile , 0 , SEEK_END);
-  lSize = ftell (pFile);
-  rewind (pFile);
+template <typename T, int n>
+bool Field<T, n>::importRawFieldFromFile(std::string fileName) {
+  FieldReader<T, n> reader;
 
-  if ( lSize != n*m_Dims[0]*m_Dims[1]*m_Dims[2]*sizeof(T) ) {
-    fclose(pFile);
+  if ( !reader.open(FieldFileInfo(fileName, m_Dims[0], m_Dims[1], m_Dims[2])) )
     return false;
-  }
-
-  // copy the file into the buffer.
-  fread (m_Data, 1, lSize, pFile);
 
-  // terminate
-  fclose (pFile);
-
-  return true;
+  return reader.readSlab(m_Data, 0, m_Dims[2]);
 }
 
 template <typename T, int n>
 bool Field<T, n>::exportRawFieldToFile(std::string fileName) {
-  FILE * pFile;
-  long lSize;
-
-  lSize = n*m_Dims[0]*m_Dims[1]*m_Dims[2]*sizeof(T);
+  FieldWriter<T, n> writer;
 
-  pFile = fopen ( fileName.c_str() , "wb" );
-  if (pFile==NULL) 
+  if ( !writer.open(FieldFileInfo(fileName, m_Dims[0], m_Dims[1], m_Dims[2])) )
     return false;
 
   // write the data to file ...
-  fwrite (m_Data, 1, lSize, pFile);
-
-  // terminate
-  fclose (pFile);
+  if ( !writer.writeSlab(m_Data, m_Dims[2]) )
+    return false;
 
-  return true;
+  return writer.close();
 }
 
 template <typename T, int n>
 bool Field<T, n>::init(std::string filename) {
-  char tmp[256];
-  char tmp2[256]; /* for scanning the .mhd file and getting the volume
-                     dimensions */
-  char temp[256]; /* a dummy string */
-
-  // std::cout << "Opening file: " << str << std::endl;
-
-  FILE *fp_dat;  /* pointer to the FILE structure for the corresponding .mhd
-  */
-  if ((fp_dat = fopen(filename.c_str(), "r")) == NULL) 
-  { 
-    // std::cout << "Could not open file" << std::endl;
+  FieldFileInfo info;
+
+  if ( !info.readMetaIOHeader(filename) )
     return false;
-  } 
-
-  char fName[256];
-  char c[8];
-  while (!feof(fp_dat)) 
-  {
-    fgets(temp, 255, fp_dat); 
-    // std::cout << ">>: " << std::string(temp) << std::endl;
-    if (ferror(fp_dat))
-    {
-      //wxLogMessage(wxT("Error reading Volume header file"));
+
+  // only float or double components, as many as the field has
+  if ( info.nChannels != n )
+    return false;
+  if ( info.elementType == std::string("MET_FLOAT") ) {
+    if ( sizeof(T) != sizeof(float) )
       return false;
-    } 
-    if (strncmp(temp, "ElementDataFile =", strlen("ElementDataFile =")) ==
-        0) 
-    {
-      sscanf(temp, "%s %s %s", tmp2, c, fName);
-    }
-    if (strncmp(temp, "DimSize =", strlen("DimSize =")) == 0) 
-    {
-      sscanf(temp, "%s %s %d %d %d", tmp2, c, &m_Dims[0], &m_Dims[1],
-          &m_Dims[2]);
-    }
-    if (strncmp(temp, "ElementSpacing =", strlen("ElementSpacing =")) == 0) 
-    {
-      sscanf(temp, "%s %s %lf %lf %lf", tmp2, c, &m_VoxelSize[0],
-          &m_VoxelSize[1], &m_VoxelSize[2]);
-    }
-    if (strncmp(temp, "ElementType =", strlen("ElementType =")) == 0) 
-    {
-      sscanf(temp, "%s %s %s", tmp2, c, tmp);
-      if ( !strncmp(tmp, "MET_FLOAT", strlen("MET_FLOAT")) && ( sizeof(T) != sizeof(float) ) ) {
-        return false; // crudely done to support only float or double ... can crash at runtime with wrong type ...
-      } else if ( !strncmp(tmp, "MET_DOUBLE", strlen("MET_DOUBLE")) && ( sizeof(T) != sizeof(double) ) ) {
-        return false; // crudely done to support only float or double ... can crash at runtime with wrong type ...
-      } else {
-        return false;
-      }
-    }
-    if (strncmp(temp, "NDims =", strlen("NDims =")) == 0) 
-    {
-      int ndim;
-      sscanf(temp, "%s %s %d", tmp2, c, &ndim);
-      if (ndim != n)
-        return false;
-    } /*
-         if (strncmp(temp, "Position =", strlen("Position =")) == 0) 
-         {
-         sscanf(temp, "%s %s %lf %lf %lf", tmp2, c, &m_Corner000[0],
-         &m_Corner000[1], &m_Corner000[2]);
-         }
-         if (strncmp(temp, "Orientation =", strlen("Orientation =")) == 0) 
-         {
-         sscanf(temp, "%s %s %lf %lf %lf %lf %lf %lf %lf %lf %lf", tmp2,
-         c, &m_OrientationX[0], &m_OrientationX[1],
-         &m_OrientationX[2],
-         &m_OrientationY[0], &m_OrientationY[1],
-         &m_OrientationY[2], &m_OrientationZ[0], &m_OrientationZ[1],
-         &m_OrientationZ[2]);
-         } */
+  } else if ( info.elementType == std::string("MET_DOUBLE") ) {
+    if ( sizeof(T) != sizeof(double) )
+      return false;
+  } else {
+    return false;
   }
 
-  fclose(fp_dat);
-
-  m_Data = 0;
-  int numOfEntries = m_Dims[0] * m_Dims[1] * m_Dims[2];
+  init(info.dims[0], info.dims[1], info.dims[2]);
+  for (int i=0; i<3; i++)
+    m_VoxelSize[i] = info.voxelSize[i];
+  m_RawFileName = info.dataFile;
 
-  // allocate memory ... 
-  m_Data = new T[n*m_Dims[0]*m_Dims[1]*m_Dims[2]];
-
-  // strip the header name on the end and replace with image name.
-  std::string imgname = filename;
-  std::string::size_type pos = imgname.rfind ('/', 0);
-  imgname = imgname.substr(0, pos);
-  imgname += std::string("/");
-  imgname += std::string(fName);
+  FieldReader<T, n> reader;
 
-  return importRawFieldFromFile( imgname );
+  if ( !reader.open(info) )
+    return false;
 
+  return reader.readSlab(m_Data, 0, m_Dims[2]);
 }
 
 template <typename T, int n>
@@ -428,20 +371,29 @@ int Field<T, n>::save_data_BE(const char *fname, void *buf, int size)
 }
 template <typename T, int n>
 bool Field<T, n>::importRawFieldFromFile_BE(std::string fileName) {
-  FILE * pFile;
-  long lSize;
+  FieldReader<T, n> reader;
 
-  load_data_BE(fileName.c_str(), m_Data, n*m_Dims[0]*m_Dims[1]*m_Dims[2]);
+  // swapped a slab at a time in m_Data, without a second buffer
+  if ( !reader.open(FieldFileInfo(fileName, m_Dims[0], m_Dims[1], m_Dims[2], !hostIsBigEndian())) ||
+       !reader.readSlab(m_Data, 0, m_Dims[2]) )
+    {
+      printf("Unable to read file :%s\n", fileName.c_str());
+      exit(1);
+    }
 
   return true;
 }
 
 template <typename T, int n>
 bool Field<T, n>::exportRawFieldToFile_BE(std::string fileName) {
-  FILE * pFile;
-  long lSize;
+  FieldWriter<T, n> writer;
 
-  save_data_BE(fileName.c_str(), m_Data, n*m_Dims[0]*m_Dims[1]*m_Dims[2]);
+  if ( !writer.open(FieldFileInfo(fileName, m_Dims[0], m_Dims[1], m_Dims[2], !hostIsBigEndian())) ||
+       !writer.writeSlab(m_Data, m_Dims[2]) || !writer.close() )
+    {
+      printf("Unable to write file :%s\n", fileName.c_str());
+      exit(1);
+    }
 
   return true;
 }
@@ -0,0 +1,394 @@
+/**
+*  @file	FieldIO.h
+*  @brief	Chunked readers and writers for the files of a Field.
+*
+*  A field file is read or written a slab of z-slices at a time, so a tool
+*  can stream through a volume that is larger than the memory. The byte
+*  order is converted on each slab as it is read or written.
+*/
+
+#ifndef _FIELD_IO_H_
+#define _FIELD_IO_H_
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <sys/types.h>
+
+/**
+ *  @brief	returns true on a big endian machine.
+**/
+inline bool hostIsBigEndian() {
+  const int one = 1;
+  return *(const char *)&one == 0;
+}
+
+/**
+ *  @brief	reverses the bytes of count values of type T in place.
+**/
+template <typename T>
+inline void swapBytes(T *buf, long count) {
+  unsigned char *b = (unsigned char *)buf;
+  for (long i=0; i<count; i++, b+=sizeof(T))
+    for (int j=0; j<(int)sizeof(T)/2; j++) {
+      unsigned char t = b[j];
+      b[j] = b[sizeof(T)-1-j];
+      b[sizeof(T)-1-j] = t;
+    }
+}
+
+/**
+ *  @brief	describes how a field is stored on disk.
+ *
+ *  The raw files of the DTI and HAMMER tools have no header, their layout
+ *  is given on the command line. A MetaIO (.mhd) header carries the same
+ *  information and is parsed by readMetaIOHeader(), so both kinds of files
+ *  are read and written through the same FieldReader and FieldWriter.
+**/
+struct FieldFileInfo {
+  FieldFileInfo();
+  /// a headerless file, in the byte order of the machine unless given
+  FieldFileInfo(const std::string &rawFileName, int sizeX, int sizeY, int sizeZ, bool bigEndian=hostIsBigEndian());
+
+  /**
+   *  @brief	fills the info from a MetaIO header.
+   *  @param	fileName	the .mhd file, ElementDataFile is relative to it
+   *				and may be LOCAL.
+   *  @return	true if successful, false otherwise.
+  **/
+  bool readMetaIOHeader(const std::string &fileName);
+
+  /**
+   *  @brief	writes a MetaIO header that points to dataFile.
+   *  @param	fileName	the .mhd file.
+   *  @param	ncomp		the number of components per voxel.
+   *  @return	true if successful, false otherwise.
+  **/
+  bool writeMetaIOHeader(const std::string &fileName, int ncomp) const;
+
+  /// the raw data file (with full path)
+  std::string dataFile;
+  /// the bytes before the data, non-zero for LOCAL MetaIO files. -1 (MetaIO
+  /// HeaderSize = -1) puts the data at the end of the file, the size of the
+  /// header is then found by FieldReader::open().
+  long long headerSize;
+  int dims[3];
+  double voxelSize[3];
+  /// MET_FLOAT, MET_DOUBLE, ...
+  std::string elementType;
+  /// components per voxel, 1 if not given in the header
+  int nChannels;
+  bool bigEndian;
+};
+
+inline FieldFileInfo::FieldFileInfo() {
+  headerSize = 0;
+  dims[0] = 0; dims[1] = 0; dims[2] = 0;
+  voxelSize[0] = 1.0; voxelSize[1] = 1.0; voxelSize[2] = 1.0;
+  elementType = std::string("MET_FLOAT");
+  nChannels = 1;
+  bigEndian = hostIsBigEndian();
+}
+
+inline FieldFileInfo::FieldFileInfo(const std::string &rawFileName, int sizeX, int sizeY, int sizeZ, bool bigEnd) {
+  dataFile = rawFileName;
+  headerSize = 0;
+  dims[0] = sizeX; dims[1] = sizeY; dims[2] = sizeZ;
+  voxelSize[0] = 1.0; voxelSize[1] = 1.0; voxelSize[2] = 1.0;
+  elementType = std::string("MET_FLOAT");
+  nChannels = 1;
+  bigEndian = bigEnd;
+}
+
+inline bool FieldFileInfo::readMetaIOHeader(const std::string &fileName) {
+  char line[1024], key[256], val[768];
+  int ndims = 3;
+  bool local = false;
+
+  FILE *fp = fopen(fileName.c_str(), "r");
+  if (fp == NULL)
+    return false;
+
+  dataFile = std::string("");
+  headerSize = 0;
+  nChannels = 1;
+  // MetaIO files are little endian unless the header says otherwise
+  bigEndian = false;
+
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    // "Key = value", the value may contain blanks
+    char *eq = strchr(line, '=');
+    if (eq == NULL)
+      continue;
+    *eq = 0;
+    if (sscanf(line, "%255s", key) != 1)
+      continue;
+    char *v = eq + 1;
+    while (*v == ' ' || *v == '\t')
+      v++;
+    strncpy(val, v, sizeof(val)-1); val[sizeof(val)-1] = 0;
+    for (int l = strlen(val); l>0 && (val[l-1] == '\n' || val[l-1] == '\r' || val[l-1] == ' '); l--)
+      val[l-1] = 0;
+
+    if (!strcmp(key, "NDims"))
+      ndims = atoi(val);
+    else if (!strcmp(key, "DimSize"))
+      sscanf(val, "%d %d %d", &dims[0], &dims[1], &dims[2]);
+    else if (!strcmp(key, "ElementSpacing"))
+      sscanf(val, "%lf %lf %lf", &voxelSize[0], &voxelSize[1], &voxelSize[2]);
+    else if (!strcmp(key, "ElementType"))
+      elementType = std::string(val);
+    else if (!strcmp(key, "ElementNumberOfChannels"))
+      nChannels = atoi(val);
+    else if (!strcmp(key, "ElementByteOrderMSB") || !strcmp(key, "BinaryDataByteOrderMSB"))
+      bigEndian = (!strcmp(val, "True") || !strcmp(val, "true") || !strcmp(val, "1"));
+    else if (!strcmp(key, "HeaderSize")) {
+      headerSize = atoll(val);
+      // -1 is the only negative size MetaIO defines
+      if (headerSize < -1) {
+        fclose(fp);
+        return false;
+      }
+    }
+    else if (!strcmp(key, "ElementDataFile")) {
+      // the last entry of a header, LOCAL data follows it
+      if (!strcmp(val, "LOCAL")) {
+        local = true;
+        headerSize = ftell(fp);
+      } else {
+        dataFile = std::string(val);
+      }
+      break;
+    }
+  }
+
+  fclose(fp);
+
+  if (ndims != 3 || (!local && dataFile.empty()))
+    return false;
+
+  if (local) {
+    dataFile = fileName;
+  } else if (dataFile[0] != '/') {
+    // relative to the directory of the header
+    std::string::size_type pos = fileName.rfind('/');
+    if (pos != std::string::npos)
+      dataFile = fileName.substr(0, pos+1) + dataFile;
+  }
+
+  return true;
+}
+
+inline bool FieldFileInfo::writeMetaIOHeader(const std::string &fileName, int ncomp) const {
+  FILE *fp = fopen(fileName.c_str(), "w");
+  if (fp == NULL)
+    return false;
+
+  // the data file is referred to without its path if it sits next to the header
+  std::string data = dataFile;
+  std::string::size_type pos = fileName.rfind('/');
+  std::string dir = (pos == std::string::npos) ? std::string("") : fileName.substr(0, pos+1);
+  if (!dir.empty() && data.compare(0, dir.size(), dir) == 0)
+    data = data.substr(dir.size());
+
+  fprintf(fp, "ObjectType = Image\n");
+  fprintf(fp, "NDims = 3\n");
+  fprintf(fp, "BinaryData = True\n");
+  fprintf(fp, "BinaryDataByteOrderMSB = %s\n", bigEndian ? "True" : "False");
+  fprintf(fp, "DimSize = %d %d %d\n", dims[0], dims[1], dims[2]);
+  fprintf(fp, "ElementSpacing = %g %g %g\n", voxelSize[0], voxelSize[1], voxelSize[2]);
+  if (ncomp > 1)
+    fprintf(fp, "ElementNumberOfChannels = %d\n", ncomp);
+  fprintf(fp, "ElementType = %s\n", elementType.c_str());
+  fprintf(fp, "ElementDataFile = %s\n", data.c_str());
+
+  fclose(fp);
+  return true;
+}
+
+/**
+ *  @brief	reads a field file a slab of z-slices at a time.
+ *
+ *  A slab of nz slices is stored like a Field of size X x Y x nz, so it can
+ *  be read straight into such a field and processed with its methods.
+**/
+template <typename T, int n>
+class FieldReader {
+  public:
+    FieldReader() : m_File(NULL), m_Swap(false) {};
+    ~FieldReader() { close(); };
+
+    /**
+     *  @brief	opens the data file of info.
+     *  @return	false if it can not be opened or its size does not match.
+    **/
+    bool open(const FieldFileInfo &info);
+
+    void close();
+
+    bool isOpen() const { return m_File != NULL; };
+
+    const FieldFileInfo& getInfo() const { return m_Info; };
+
+    /**
+     *  @brief	reads the slices z0 .. z0+nz-1 into buf, which holds
+     *		n*X*Y*nz values, in the byte order of the machine.
+     *  @return	true if successful, false otherwise.
+    **/
+    bool readSlab(T *buf, int z0, int nz);
+
+  protected:
+    FILE *m_File;
+    FieldFileInfo m_Info;
+    /// the file is not in the byte order of the machine
+    bool m_Swap;
+    long long m_SliceSize;
+};
+
+template <typename T, int n>
+bool FieldReader<T, n>::open(const FieldFileInfo &info) {
+  close();
+
+  m_Info = info;
+  m_Swap = (info.bigEndian != hostIsBigEndian());
+  m_SliceSize = (long long)n*info.dims[0]*info.dims[1];
+
+  m_File = fopen(info.dataFile.c_str(), "rb");
+  if (m_File == NULL)
+    return false;
+
+  fseeko(m_File, 0, SEEK_END);
+  long long lSize = ftello(m_File);
+  long long dataSize = m_SliceSize*info.dims[2]*(long long)sizeof(T);
+
+  if (m_Info.headerSize < 0)
+    m_Info.headerSize = lSize - dataSize;
+
+  if (m_Info.headerSize < 0 || lSize != m_Info.headerSize + dataSize) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+template <typename T, int n>
+void FieldReader<T, n>::close() {
+  if (m_File)
+    fclose(m_File);
+  m_File = NULL;
+}
+
+template <typename T, int n>
+bool FieldReader<T, n>::readSlab(T *buf, int z0, int nz) {
+  if (m_File == NULL || z0 < 0 || z0+nz > m_Info.dims[2])
+    return false;
+
+  long long count = m_SliceSize*nz;
+
+  if (fseeko(m_File, (off_t)(m_Info.headerSize + m_SliceSize*z0*(long long)sizeof(T)), SEEK_SET))
+    return false;
+  if ((long long)fread(buf, sizeof(T), count, m_File) != count)
+    return false;
+
+  if (m_Swap)
+    swapBytes(buf, count);
+
+  return true;
+}
+
+/**
+ *  @brief	writes a field file a slab of z-slices at a time, from z = 0 on.
+**/
+template <typename T, int n>
+class FieldWriter {
+  public:
+    FieldWriter() : m_File(NULL), m_Swap(false), m_Slice(0) {};
+    ~FieldWriter() { close(); };
+
+    /**
+     *  @brief	creates the data file of info, info.headerSize is ignored.
+     *  @return	true if successful, false otherwise.
+    **/
+    bool open(const FieldFileInfo &info);
+
+    /**
+     *  @brief	closes the file.
+     *  @return	false if fewer than Z slices were written.
+    **/
+    bool close();
+
+    /**
+     *  @brief	appends the next nz slices, buf holds n*X*Y*nz values in
+     *		the byte order of the machine and is not modified.
+     *  @return	true if successful, false otherwise.
+    **/
+    bool writeSlab(const T *buf, int nz);
+
+  protected:
+    FILE *m_File;
+    FieldFileInfo m_Info;
+    bool m_Swap;
+    /// the next slice to write
+    int m_Slice;
+    long long m_SliceSize;
+};
+
+template <typename T, int n>
+bool FieldWriter<T, n>::open(const FieldFileInfo &info) {
+  close();
+
+  m_Info = info;
+  m_Swap = (info.bigEndian != hostIsBigEndian());
+  m_SliceSize = (long long)n*info.dims[0]*info.dims[1];
+  m_Slice = 0;
+
+  m_File = fopen(info.dataFile.c_str(), "wb");
+  return (m_File != NULL);
+}
+
+template <typename T, int n>
+bool FieldWriter<T, n>::close() {
+  if (m_File == NULL)
+    return true;
+
+  bool complete = (m_Slice == m_Info.dims[2]);
+  if (fclose(m_File))
+    complete = false;
+  m_File = NULL;
+
+  return complete;
+}
+
+template <typename T, int n>
+bool FieldWriter<T, n>::writeSlab(const T *buf, int nz) {
+  if (m_File == NULL || m_Slice+nz > m_Info.dims[2])
+    return false;
+
+  long long count = m_SliceSize*nz;
+
+  if (!m_Swap) {
+    if ((long long)fwrite(buf, sizeof(T), count, m_File) != count)
+      return false;
+  } else {
+    // swapped through a small buffer, the caller's data stays as it is
+    const long chunk = 1<<16;
+    T *tmp = new T[chunk];
+    for (long long i=0; i<count; i+=chunk) {
+      long c = (count-i < chunk) ? (long)(count-i) : chunk;
+      memcpy(tmp, buf+i, c*sizeof(T));
+      swapBytes(tmp, c);
+      if ((long)fwrite(tmp, sizeof(T), c, m_File) != c) {
+        delete [] tmp;
+        return false;
+      }
+    }
+    delete [] tmp;
+  }
+
+  m_Slice += nz;
+  return true;
+}
+
+#endif /*_FIELD_IO_H_*/
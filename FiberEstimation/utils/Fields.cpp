@@ -7,73 +7,956 @@
 
 # include "Fields.h"
 #include <iostream>
+#include <vector>
 using namespace std;
 
 
+/**
+ * row operators for Field::forEachRow()
+ */
+
+/**
+ * the 3-d convolution of the nc components of in with a filter, zero within
+ * half a filter of the border and, with a mask, outside the mask
+ */
+template <int nc>
+struct ConvolveRow
+{
+  ConvolveRow(const float *in_, float *out_, const int *dims_, ScalarField *filter, const unsigned char *mask_=0)
+    : in(in_), out(out_), dims(dims_), kernel(filter->getDataPtr()), mask(mask_)
+  {
+    for(int d=0; d<3; d++)
+      {
+	fdims[d] = filter->getSize(d);
+	order[d] = (fdims[d]-1)/2;
+      }
+  }
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    int Xdim= dims[0];
+    int Ydim= dims[1];
+    int Zdim= dims[2];
+
+    float *val = out + nc*ind;
+    for(long j=0; j<(long)nc*Xdim; j++)
+      val[j] = 0.0;
+
+    if(iy<order[1] || iy >= Ydim- order[1] || iz<order[2] || iz>=Zdim- order[2])
+      return;
+
+    for(int ix=order[0]; ix<Xdim-order[0]; ix++)
+      {
+	if(mask && mask[ind+ix]==0)
+	  continue;
+
+	float *v = val + nc*ix;
+	for(int iz1=0; iz1<fdims[2]; iz1++)
+	  for(int iy1=0; iy1<fdims[1]; iy1++)
+	    {
+	      // the voxels (ix -ix1 + order_x, iy -iy1 + order_y, iz -iz1 + order_z)
+	      const float *k = kernel + (iz1*fdims[1] + iy1)*fdims[0];
+	      const float *s = in + nc*(((long)(iz-iz1+order[2])*Ydim + iy-iy1+order[1])*Xdim + ix+order[0]);
+	      for(int ix1=0; ix1<fdims[0]; ix1++)
+		for(int j=0; j<nc; j++)
+		  v[j] += k[ix1]*s[j - nc*ix1];
+	    }
+      }
+  }
+
+  const float *in;
+  float *out;
+  const int *dims;
+  const float *kernel;
+  const unsigned char *mask;
+  int fdims[3], order[3];
+};
+
+/**
+ * divides the nc components by a positive weight, within the mask if any
+ */
+template <int nc>
+struct NormalizeRow
+{
+  NormalizeRow(float *data_, const float *weight_, int Xdim_, const unsigned char *mask_=0)
+    : data(data_), weight(weight_), Xdim(Xdim_), mask(mask_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    for(long i=ind; i<ind+Xdim; i++)
+      {
+	if((mask && mask[i]==0) || !(weight[i]>0))
+	  continue;
+	for(int j=0; j<nc; j++)
+	  data[i*nc+j] /= weight[i];
+      }
+  }
+
+  float *data;
+  const float *weight;
+  int Xdim;
+  const unsigned char *mask;
+};
+
+/**
+ * adds sign*(x,y,z) to the vectors
+ */
+struct OffsetRow
+{
+  OffsetRow(float *data_, int Xdim_, float sign_) : data(data_), Xdim(Xdim_), sign(sign_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    float *v = data + 3*ind;
+    for(int ix=0; ix<Xdim; ix++)
+      {
+	v[ix*3+0] += sign*ix;
+	v[ix*3+1] += sign*iy;
+	v[ix*3+2] += sign*iz;
+      }
+  }
+
+  float *data;
+  int Xdim;
+  float sign;
+};
+
+/**
+ * negates one component of the vectors
+ */
+struct FlipRow
+{
+  FlipRow(float *data_, int Xdim_, int comp_) : data(data_), Xdim(Xdim_), comp(comp_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    float *v = data + 3*ind + comp;
+    for(int ix=0; ix<Xdim; ix++)
+      v[ix*3] = - v[ix*3];
+  }
+
+  float *data;
+  int Xdim, comp;
+};
+
+/**
+ * scales the vectors to unit length
+ */
+struct UnitRow
+{
+  UnitRow(float *data_, int Xdim_) : data(data_), Xdim(Xdim_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    float *v = data + 3*ind;
+    for(int ix=0; ix<Xdim; ix++, v+=3)
+      {
+	float VecNorm = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+	for(int j=0; j<3; j++)
+	  v[j] /= VecNorm;
+      }
+  }
+
+  float *data;
+  int Xdim;
+};
+
+/**
+ * copies between the 6 scalar component fields and the interleaved tensors
+ */
+struct InterleaveRow
+{
+  InterleaveRow(float *tensor_, ScalarField **comp_, int Xdim_, bool toTensor_)
+    : tensor(tensor_), Xdim(Xdim_), toTensor(toTensor_)
+  {
+    for(int j=0; j<6; j++)
+      comp[j] = comp_[j]->getDataPtr();
+  }
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    for(long i=ind; i<ind+Xdim; i++)
+      for(int j=0; j<6; j++)
+	{
+	  if(toTensor)
+	    tensor[i*6+j] = comp[j][i];
+	  else
+	    comp[j][i] = tensor[i*6+j];
+	}
+  }
+
+  float *tensor;
+  float *comp[6];
+  int Xdim;
+  bool toTensor;
+};
+
+/**
+ * the trace of the tensors
+ */
+struct TraceRow
+{
+  TraceRow(const float *tensor_, float *trace_, int Xdim_) : tensor(tensor_), trace(trace_), Xdim(Xdim_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    for(long i=ind; i<ind+Xdim; i++)
+      trace[i] = tensor[i*6] + tensor[i*6+1] + tensor[i*6+2];
+  }
+
+  const float *tensor;
+  float *trace;
+  int Xdim;
+};
+
+/**
+ * mask of the tensors with a trace above a threshold
+ */
+struct TraceMaskRow
+{
+  TraceMaskRow(const float *tensor_, unsigned char *mask_, int Xdim_, float threshold_)
+    : tensor(tensor_), mask(mask_), Xdim(Xdim_), threshold(threshold_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    for(long i=ind; i<ind+Xdim; i++)
+      {
+	float trace = tensor[i*6] + tensor[i*6+1] + tensor[i*6+2];
+	mask[i] = (trace > threshold) ? 1 : 0;
+      }
+  }
+
+  const float *tensor;
+  unsigned char *mask;
+  int Xdim;
+  float threshold;
+};
+
+/**
+ * zeroes the tensors with a trace below a threshold
+ */
+struct DropTraceRow
+{
+  DropTraceRow(float *tensor_, int Xdim_, float threshold_) : tensor(tensor_), Xdim(Xdim_), threshold(threshold_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    for(long i=ind; i<ind+Xdim; i++)
+      {
+	float *val = tensor + 6*i;
+	if(val[0]+val[1]+val[2] < threshold)
+	  for(int j=0; j<6; j++)
+	    val[j] = 0.0f;
+      }
+  }
+
+  float *tensor;
+  int Xdim;
+  float threshold;
+};
+
+/**
+ * swaps the x and y components, between the HAMMER and the (x,y,z) order
+ */
+struct SwapXYRow
+{
+  SwapXYRow(float *data_, int Xdim_) : data(data_), Xdim(Xdim_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    float *v = data + 3*ind;
+    for(int ix=0; ix<Xdim; ix++)
+      {
+	float t = v[ix*3];
+	v[ix*3] = v[ix*3+1];
+	v[ix*3+1] = t;
+      }
+  }
+
+  float *data;
+  int Xdim;
+};
+
+/**
+ * trilinear interpolation of a vector field, the position is clamped to the volume;
+ * P is zero if the position is not a number (a diverging iterate)
+ */
+static inline void ClampedVectorAt(VectorField *field, float px, float py, float pz, struct Pt3d &P)
+{
+  P.x = P.y = P.z = 0.0f;
+
+  // a NaN fails every comparison, it would get past the clamps and the bounds check of the lookup
+  if(px != px || py != py || pz != pz)
+    return;
+
+  float hi[3] = { field->getSize(0)-1.0f, field->getSize(1)-1.0f, field->getSize(2)-1.0f };
+
+  px = (px < 0) ? 0 : ((px > hi[0]) ? hi[0] : px);
+  py = (py < 0) ? 0 : ((py > hi[1]) ? hi[1] : py);
+  pz = (pz < 0) ? 0 : ((pz > hi[2]) ? hi[2] : pz);
+
+  if(!field->getVectorAtAnyPosition(px, py, pz, P))
+    P.x = P.y = P.z = 0.0f;
+}
+
+/**
+ * the displacement field averaged over 2x2x2 blocks, in voxels of the coarse grid
+ */
+struct DownsampleRow
+{
+  DownsampleRow(const VectorField *fine_, VectorField *coarse_) : fine(fine_), coarse(coarse_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    for(int ix=0; ix<coarse->getSize(0); ix++)
+      {
+	float *val = coarse->getAt(ix,iy,iz);
+	int count = 0;
+	val[0] = val[1] = val[2] = 0.0f;
+
+	for(int k=2*iz; k<2*iz+2 && k<fine->getSize(2); k++)
+	  for(int l=2*iy; l<2*iy+2 && l<fine->getSize(1); l++)
+	    for(int i=2*ix; i<2*ix+2 && i<fine->getSize(0); i++, count++)
+	      {
+		float *f = fine->getAt(i,l,k);
+		for(int j=0; j<3; j++)
+		  val[j] += f[j];
+	      }
+
+	for(int j=0; j<3; j++)
+	  val[j] /= 2*count;
+      }
+  }
+
+  const VectorField *fine;
+  VectorField *coarse;
+};
+
+/**
+ * the inverse displacement interpolated from the coarse grid, as a starting point
+ */
+struct UpsampleRow
+{
+  UpsampleRow(VectorField *coarse_, VectorField *fine_) : coarse(coarse_), fine(fine_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    struct Pt3d P;
+    for(int ix=0; ix<fine->getSize(0); ix++)
+      {
+	// coarse voxel i covers the fine voxels 2i and 2i+1
+	ClampedVectorAt(coarse, 0.5f*ix-0.25f, 0.5f*iy-0.25f, 0.5f*iz-0.25f, P);
+
+	float *val = fine->getAt(ix,iy,iz);
+	val[0] = 2*P.x; val[1] = 2*P.y; val[2] = 2*P.z;
+      }
+  }
+
+  VectorField *coarse;
+  VectorField *fine;
+};
+
+/**
+ * the fixed-point iteration v(x) <- -u(x + v(x)) for the inverse v of the displacement
+ * u, voxel by voxel until the residual |v(x) + u(x + v(x))| is below tolerance; the
+ * iterate with the smallest residual is kept
+ */
+struct FixedPointInverseRow
+{
+  FixedPointInverseRow(VectorField *u_, VectorField *v_, float *residual_, int maxIterations_, float tolerance_)
+    : u(u_), v(v_), residual(residual_), maxIterations(maxIterations_), tolerance(tolerance_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    struct Pt3d P;
+    for(int ix=0; ix<u->getSize(0); ix++)
+      {
+	float *val = v->getAt(ix,iy,iz);
+	float cur[3] = { val[0], val[1], val[2] };
+	float best = -1.0f;
+
+	for(int it=0; it<maxIterations; it++)
+	  {
+	    ClampedVectorAt(u, ix+cur[0], iy+cur[1], iz+cur[2], P);
+
+	    float r[3] = { cur[0]+P.x, cur[1]+P.y, cur[2]+P.z };
+	    float res = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+
+	    if(best < 0 || res < best)
+	      {
+		best = res;
+		val[0] = cur[0]; val[1] = cur[1]; val[2] = cur[2];
+	      }
+	    if(res < tolerance)
+	      break;
+
+	    cur[0] = -P.x; cur[1] = -P.y; cur[2] = -P.z;
+	  }
+
+	residual[ind+ix] = best;
+      }
+  }
+
+  VectorField *u;
+  VectorField *v;
+  float *residual;
+  int maxIterations;
+  float tolerance;
+};
+
+/**
+ * the unit quaternion (w,x,y,z) of a rotation matrix R (row major)
+ */
+static void RotMat2Quaternion(const double *R, float *q)
+{
+  double tr = R[0] + R[4] + R[8];
+  double w, x, y, z;
+
+  // the largest of the four is computed first, for accuracy
+  if(tr > R[0] && tr > R[4] && tr > R[8])
+    {
+      double s = 2*sqrt(1.0 + tr);
+      w = 0.25*s; x = (R[7]-R[5])/s; y = (R[2]-R[6])/s; z = (R[3]-R[1])/s;
+    }
+  else if(R[0] > R[4] && R[0] > R[8])
+    {
+      double s = 2*sqrt(1.0 + R[0] - R[4] - R[8]);
+      w = (R[7]-R[5])/s; x = 0.25*s; y = (R[1]+R[3])/s; z = (R[2]+R[6])/s;
+    }
+  else if(R[4] > R[8])
+    {
+      double s = 2*sqrt(1.0 + R[4] - R[0] - R[8]);
+      w = (R[2]-R[6])/s; x = (R[1]+R[3])/s; y = 0.25*s; z = (R[5]+R[7])/s;
+    }
+  else
+    {
+      double s = 2*sqrt(1.0 + R[8] - R[0] - R[4]);
+      w = (R[3]-R[1])/s; x = (R[2]+R[6])/s; y = (R[5]+R[7])/s; z = 0.25*s;
+    }
+
+  double n = sqrt(w*w + x*x + y*y + z*z);
+  q[0] = w/n; q[1] = x/n; q[2] = y/n; q[3] = z/n;
+}
+
+/**
+ * the rotation matrix (row major) of a unit quaternion (w,x,y,z)
+ */
+static inline void Quaternion2RotMat(const float *q, double *R)
+{
+  double w = q[0], x = q[1], y = q[2], z = q[3];
+
+  R[0] = 1-2*(y*y+z*z); R[1] = 2*(x*y-w*z);   R[2] = 2*(x*z+w*y);
+  R[3] = 2*(x*y+w*z);   R[4] = 1-2*(x*x+z*z); R[5] = 2*(y*z-w*x);
+  R[6] = 2*(x*z-w*y);   R[7] = 2*(y*z+w*x);   R[8] = 1-2*(x*x+y*y);
+}
+
+/**
+ * the finite-strain rotations of a warp field: the rotation of the polar
+ * decomposition J = R S of the forward-difference Jacobian, with R = J V diag(1/s) V^T
+ * from the eigen decomposition J^T J = V diag(s^2) V^T
+ */
+struct FSRotationRow
+{
+  FSRotationRow(const VectorField *warpField_, float *quat_) : warpField(warpField_), quat(quat_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    int Xdim= warpField->getSize(0);
+    int Ydim= warpField->getSize(1);
+    int Zdim= warpField->getSize(2);
+
+    SymEigen3 eig;
+    double J[SymEigen3::BatchSize][9];
+    double JtJ[6*SymEigen3::BatchSize];
+
+    for(int b=0; b<Xdim; b+=SymEigen3::BatchSize)
+      {
+	int n = (Xdim-b < SymEigen3::BatchSize) ? Xdim-b : SymEigen3::BatchSize;
+
+	for(int k=0; k<n; k++)
+	  {
+	    int ix = b+k;
+	    double *Jk = J[k];
+
+	    // J[j*3+i] = d warp_j / d x_i, the identity on the upper border
+	    for(int i=0; i<9; i++)
+	      Jk[i] = (i%4==0) ? 1.0 : 0.0;
+
+	    if(ix<Xdim-1 && iy<Ydim-1 && iz<Zdim-1)
+	      {
+		const float *w0 = warpField->getAt(ix,iy,iz);
+		const float *w1[3] = { warpField->getAt(ix+1,iy,iz), warpField->getAt(ix,iy+1,iz), warpField->getAt(ix,iy,iz+1) };
+		for(int i=0; i<3; i++)
+		  for(int j=0; j<3; j++)
+		    Jk[j*3+i] = w1[i][j] - w0[j];
+	      }
+
+	    double C[9];
+	    for(int i=0; i<3; i++)
+	      for(int j=0; j<3; j++)
+		C[i*3+j] = Jk[i]*Jk[j] + Jk[3+i]*Jk[3+j] + Jk[6+i]*Jk[6+j];
+
+	    double *c = JtJ + 6*k;
+	    c[0] = C[0]; c[1] = C[4]; c[2] = C[8]; c[3] = C[1]; c[4] = C[2]; c[5] = C[5];
+	  }
+
+	eig.compute(JtJ, n);
+
+	for(int k=0; k<n; k++)
+	  {
+	    const double *Jk = J[k];
+	    double u[3][3], v[3][3];
+	    int rank = 0;
+
+	    // u_i = J v_i / s_i, completed to a right-handed basis where J is singular
+	    for(int i=0; i<3; i++)
+	      {
+		for(int j=0; j<3; j++)
+		  v[i][j] = eig.evec[i][j][k];
+		for(int j=0; j<3; j++)
+		  u[i][j] = Jk[j*3]*v[i][0] + Jk[j*3+1]*v[i][1] + Jk[j*3+2]*v[i][2];
+		double s = sqrt(u[i][0]*u[i][0] + u[i][1]*u[i][1] + u[i][2]*u[i][2]);
+		if(s > 1e-6*sqrt(fabs(eig.eval[0][k])) && s > 0)
+		  {
+		    for(int j=0; j<3; j++)
+		      u[i][j] /= s;
+		    rank++;
+		  }
+		else
+		  break;
+	      }
+
+	    double R[9];
+	    if(rank < 2)
+	      {
+		for(int i=0; i<9; i++)
+		  R[i] = (i%4==0) ? 1.0 : 0.0;
+	      }
+	    else
+	      {
+		if(rank == 2)
+		  {
+		    u[2][0] = u[0][1]*u[1][2] - u[0][2]*u[1][1];
+		    u[2][1] = u[0][2]*u[1][0] - u[0][0]*u[1][2];
+		    u[2][2] = u[0][0]*u[1][1] - u[0][1]*u[1][0];
+		  }
+
+		for(int i=0; i<3; i++)
+		  for(int j=0; j<3; j++)
+		    R[i*3+j] = u[0][i]*v[0][j] + u[1][i]*v[1][j] + u[2][i]*v[2][j];
+
+		// a reflection (folding warp) rotates a tensor as its negative does
+		double det = R[0]*(R[4]*R[8]-R[5]*R[7]) - R[1]*(R[3]*R[8]-R[5]*R[6]) + R[2]*(R[3]*R[7]-R[4]*R[6]);
+		if(det < 0)
+		  for(int i=0; i<9; i++)
+		    R[i] = -R[i];
+	      }
+
+	    RotMat2Quaternion(R, quat + 4*(ind+b+k));
+	  }
+      }
+  }
+
+  const VectorField *warpField;
+  float *quat;
+};
+
+/**
+ * rotates the tensors, R M R^T, with the rotation field
+ */
+struct RotateRow
+{
+  RotateRow(const float *tensor_, const float *quat_, float *out_, int Xdim_) : tensor(tensor_), quat(quat_), out(out_), Xdim(Xdim_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    for(long i=ind; i<ind+Xdim; i++)
+      {
+	const float *t = tensor + 6*i;
+	double R[9], RM[9];
+	double M[9] = { t[0], t[3], t[4],
+			t[3], t[1], t[5],
+			t[4], t[5], t[2] };
+
+	Quaternion2RotMat(quat + 4*i, R);
+
+	for(int r=0; r<3; r++)
+	  for(int c=0; c<3; c++)
+	    RM[r*3+c] = R[r*3]*M[c] + R[r*3+1]*M[3+c] + R[r*3+2]*M[6+c];
+
+	// only the upper triangle of R M R^T
+	float *val = out + 6*i;
+	val[0] = RM[0]*R[0] + RM[1]*R[1] + RM[2]*R[2];
+	val[1] = RM[3]*R[3] + RM[4]*R[4] + RM[5]*R[5];
+	val[2] = RM[6]*R[6] + RM[7]*R[7] + RM[8]*R[8];
+	val[3] = RM[0]*R[3] + RM[1]*R[4] + RM[2]*R[5];
+	val[4] = RM[0]*R[6] + RM[1]*R[7] + RM[2]*R[8];
+	val[5] = RM[3]*R[6] + RM[4]*R[7] + RM[5]*R[8];
+      }
+  }
+
+  const float *tensor;
+  const float *quat;
+  float *out;
+  int Xdim;
+};
+
+/**
+ * the tensors of the subject at the positions given by the inverse field,
+ * trilinearly interpolated
+ */
+struct TrilinearRow
+{
+  TrilinearRow(const TensorField *subject_, const VectorField *warpField_, TensorField *out_)
+    : subject(subject_), warpField(warpField_), out(out_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    int Xdim= subject->getSize(0);
+    int Ydim= subject->getSize(1);
+    int Zdim= subject->getSize(2);
+
+    for(int ix=0; ix<Xdim; ix++)
+      {
+	float *val= out->getAt(ix,iy,iz);
+	for(int j=0; j<6; j++)
+	  val[j] = 0.0f;
+
+	float *warpField_val = warpField->getAt(ix,iy,iz);
+	int ix_subject = floor(warpField_val[0]);
+	int iy_subject = floor(warpField_val[1]);
+	int iz_subject = floor(warpField_val[2]);
+
+	if(ix_subject < 0 || ix_subject >= Xdim || iy_subject< 0 || iy_subject >= Ydim || iz_subject< 0 || iz_subject>=Zdim)
+	  continue;
+
+	float tl_x = warpField_val[0]- ix_subject;
+	float tl_y = warpField_val[1]- iy_subject;
+	float tl_z = warpField_val[2]- iz_subject;
+
+	float ww[8];
+
+	ww[0] = (1-tl_x)*(1-tl_y)*(1-tl_z);
+	ww[1] = tl_x*(1-tl_y)*(1-tl_z);
+	ww[2] = tl_x*tl_y*(1-tl_z);
+	ww[3] = (1-tl_x)*tl_y*(1-tl_z);
+	ww[4] = (1-tl_x)*(1-tl_y)*tl_z;
+	ww[5] = tl_x*(1-tl_y)*tl_z;
+	ww[6] = tl_x*tl_y*tl_z;
+	ww[7] = (1-tl_x)*tl_y*tl_z;
+
+	// the last voxel is repeated past the upper border
+	int ix_next = (ix_subject+1 < Xdim) ? ix_subject+1 : ix_subject;
+	int iy_next = (iy_subject+1 < Ydim) ? iy_subject+1 : iy_subject;
+	int iz_next = (iz_subject+1 < Zdim) ? iz_subject+1 : iz_subject;
+
+	float *dt_val0= subject->getAt(ix_subject, iy_subject, iz_subject);
+	float *dt_val1= subject->getAt(ix_next, iy_subject, iz_subject);
+	float *dt_val2= subject->getAt(ix_next, iy_next, iz_subject);
+	float *dt_val3= subject->getAt(ix_subject, iy_next, iz_subject);
+	float *dt_val4= subject->getAt(ix_subject, iy_subject, iz_next);
+	float *dt_val5= subject->getAt(ix_next, iy_subject, iz_next);
+	float *dt_val6= subject->getAt(ix_next, iy_next, iz_next);
+	float *dt_val7= subject->getAt(ix_subject, iy_next, iz_next);
+
+	for(int i=0; i<6; i++)
+	  val[i] = ww[0]*dt_val0[i] + ww[1]*dt_val1[i] + ww[2]*dt_val2[i] + ww[3]*dt_val3[i] + ww[4]*dt_val4[i] + ww[5]*dt_val5[i] + ww[6]*dt_val6[i] + ww[7]*dt_val7[i] ;
+      }
+  }
+
+  const TensorField *subject;
+  const VectorField *warpField;
+  TensorField *out;
+};
+
+/**
+ * the half widths in voxels of the truncated Gaussian of the displace functions,
+ * the filter covers the volume divided by filter_size_red_factor but is cut at
+ * 6 sigma, beyond which the weights are below float precision
+ */
+static void GaussianHalfWidths(const int *dims, const double *res, float sigma, float filter_size_red_factor, int *half)
+{
+  for(int d=0; d<3; d++)
+    {
+      int fdim = dims[d]/filter_size_red_factor/res[d];
+      if(fdim%2==0) fdim +=1;
+
+      half[d] = (fdim-1)/2;
+      int cut = (int)ceil(6*sigma/res[d]);
+      if(half[d] > cut) half[d] = cut;
+    }
+}
+
+/**
+ * the tensors at the positions given by the inverse field, with truncated-Gaussian
+ * interpolation normalized by the weight of the valid voxels under the filter
+ */
+struct GaussianGatherRow
+{
+  GaussianGatherRow(const float *tensor_, const unsigned char *valid_, const int *dims_, const double *res_, const VectorField *warpField_, float *out_, unsigned char *outValid_, float sigma_, const int *half_)
+    : tensor(tensor_), valid(valid_), dims(dims_), res(res_), warpField(warpField_), out(out_), outValid(outValid_), sigma(sigma_), half(half_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    int Xdim= dims[0];
+    int Ydim= dims[1];
+    int Zdim= dims[2];
+
+    // the filter is separable, one 1-d weight table per direction
+    std::vector<double> g[3];
+    for(int d=0; d<3; d++)
+      g[d].resize(2*half[d]+1);
+
+    for(int ix=0; ix<Xdim; ix++)
+      {
+	float *val= out + 6*(ind+ix);
+	for(int j=0; j<6; j++)
+	  val[j] = 0.0f;
+	if(outValid)
+	  outValid[ind+ix] = 0;
+
+	const float *w = warpField->getDataPtr() + 3*(ind+ix);
+	int r[3] = { (int)rint(w[0]), (int)rint(w[1]), (int)rint(w[2]) };
+
+	if(r[0] < 0 || r[0] >= Xdim || r[1]< 0 || r[1] >= Ydim || r[2]< 0 || r[2]>=Zdim)
+	  continue;
+
+	for(int d=0; d<3; d++)
+	  for(int i=-half[d]; i<=half[d]; i++)
+	    {
+	      int q = r[d]+i;
+	      double x = (q-w[d])*res[d];
+	      g[d][i+half[d]] = (q>=0 && q<dims[d]) ? exp(-x*x/(2*sigma*sigma)) : 0.0;
+	    }
+
+	double acc[6] = {0, 0, 0, 0, 0, 0};
+	double weight = 0.0;
+
+	for(int k=-half[2]; k<=half[2]; k++)
+	  {
+	    double gz = g[2][k+half[2]];
+	    if(gz==0.0)
+	      continue;
+	    for(int l=-half[1]; l<=half[1]; l++)
+	      {
+		double gzy = gz*g[1][l+half[1]];
+		if(gzy==0.0)
+		  continue;
+		long rowInd = ((long)(r[2]+k)*Ydim + r[1]+l)*Xdim;
+		for(int i=-half[0]; i<=half[0]; i++)
+		  {
+		    int q = r[0]+i;
+		    if(q<0 || q>=Xdim || (valid && valid[rowInd+q]==0))
+		      continue;
+		    double wt = gzy*g[0][i+half[0]];
+		    const float *t = tensor + 6*(rowInd+q);
+		    for(int j=0; j<6; j++)
+		      acc[j] += wt*t[j];
+		    weight += wt;
+		  }
+	      }
+	  }
+
+	if(weight > 0)
+	  {
+	    for(int j=0; j<6; j++)
+	      val[j] = acc[j]/weight;
+	    if(outValid)
+	      outValid[ind+ix] = 1;
+	  }
+      }
+  }
+
+  const float *tensor;
+  const unsigned char *valid;
+  const int *dims;
+  const double *res;
+  const VectorField *warpField;
+  float *out;
+  unsigned char *outValid;
+  float sigma;
+  const int *half;
+};
+
+/**
+ * the voxels of a forward field binned by the row (y,z) of the voxel they are
+ * moved to, with the normalization of the Gaussian they are spread with
+ */
+struct SplatHash
+{
+  SplatHash(const VectorField *warpField, const double *res, float sigma, const int *half)
+  {
+    int Xdim= warpField->getSize(0);
+    int Ydim= warpField->getSize(1);
+    int Zdim= warpField->getSize(2);
+    long nvox = (long)Xdim*Ydim*Zdim;
+    const float *w = warpField->getDataPtr();
+
+    std::vector<long> rowOf(nvox);
+    start.assign((long)Ydim*Zdim+1, 0);
+    invNorm.resize(nvox);
+
+#pragma omp parallel for schedule(static)
+    for(long s=0; s<nvox; s++)
+      {
+	int r[3] = { (int)rint(w[3*s]), (int)rint(w[3*s+1]), (int)rint(w[3*s+2]) };
+
+	rowOf[s] = -1;
+	if(r[0] < 0 || r[0] >= Xdim || r[1]< 0 || r[1] >= Ydim || r[2]< 0 || r[2]>=Zdim)
+	  continue;
+	rowOf[s] = (long)r[2]*Ydim + r[1];
+
+	// each voxel is spread with a filter of unit sum over the whole box
+	double norm = 1.0;
+	for(int d=0; d<3; d++)
+	  {
+	    double sd = 0.0;
+	    for(int i=-half[d]; i<=half[d]; i++)
+	      {
+		double x = (r[d]+i-w[3*s+d])*res[d];
+		sd += exp(-x*x/(2*sigma*sigma));
+	      }
+	    norm *= sd;
+	  }
+	// all the weights underflow for a sigma much smaller than the voxel
+	invNorm[s] = (norm > 0) ? 1.0/norm : 0.0;
+      }
+
+    // counting sort of the voxels by row
+    for(long s=0; s<nvox; s++)
+      if(rowOf[s]>=0)
+	start[rowOf[s]+1]++;
+    for(size_t b=1; b<start.size(); b++)
+      start[b] += start[b-1];
+
+    std::vector<long> next(start.begin(), start.end()-1);
+    source.resize(start.back());
+    for(long s=0; s<nvox; s++)
+      if(rowOf[s]>=0)
+	source[next[rowOf[s]]++] = s;
+  }
+
+  /// the voxels moved to row b are source[start[b]] .. source[start[b+1]-1]
+  std::vector<long> start;
+  std::vector<long> source;
+  std::vector<double> invNorm;
+};
+
+/**
+ * the tensors spread by the forward field with a truncated Gaussian and normalized
+ * by the spread weight; a row gathers from the hashed rows within reach, so there
+ * is no scatter between threads and no separate weight field
+ */
+struct GaussianSplatRow
+{
+  GaussianSplatRow(const float *tensor_, const unsigned char *valid_, const int *dims_, const double *res_, const VectorField *warpField_, const SplatHash *hash_, float *out_, unsigned char *outValid_, float sigma_, const int *half_)
+    : tensor(tensor_), valid(valid_), dims(dims_), res(res_), warpField(warpField_), hash(hash_), out(out_), outValid(outValid_), sigma(sigma_), half(half_) {}
+
+  void operator()(int iy, int iz, long ind) const
+  {
+    int Xdim= dims[0];
+    const float *wf = warpField->getDataPtr();
+    double c[3];
+    for(int d=0; d<3; d++)
+      c[d] = res[d]*res[d]/(2*sigma*sigma);
+    // the Gaussian along x by recurrence, g(x+1) = g(x)*ratio, ratio *= step.
+    // For a sigma much smaller than the voxel the ratio overflows while g
+    // underflows (0*inf = NaN), the taps are then evaluated one by one.
+    double step = exp(-2*c[0]);
+    bool recurrence = c[0]*(half[0]+1)*(2*half[0]+2) < 600;
+
+    std::vector<double> acc(6*Xdim, 0.0), weight(Xdim, 0.0);
+
+    for(int k=-half[2]; k<=half[2]; k++)
+      for(int l=-half[1]; l<=half[1]; l++)
+	{
+	  int y = iy+l, z = iz+k;
+	  if(y<0 || y>=dims[1] || z<0 || z>=dims[2])
+	    continue;
+
+	  long b = (long)z*dims[1] + y;
+	  for(long e=hash->start[b]; e<hash->start[b+1]; e++)
+	    {
+	      long s = hash->source[e];
+	      if(valid && valid[s]==0)
+		continue;
+
+	      const float *w = wf + 3*s;
+	      int rx = (int)rint(w[0]);
+	      int x0 = (rx-half[0] > 0) ? rx-half[0] : 0;
+	      int x1 = (rx+half[0] < Xdim) ? rx+half[0] : Xdim-1;
+
+	      double dy = iy-w[1], dz = iz-w[2], dx = x0-w[0];
+	      double gyz = exp(-c[1]*dy*dy - c[2]*dz*dz)*hash->invNorm[s];
+	      double g = gyz*exp(-c[0]*dx*dx);
+	      double ratio = recurrence ? exp(-c[0]*(2*dx+1)) : 0.0;
+	      const float *t = tensor + 6*s;
+
+	      for(int x=x0; x<=x1; x++)
+		{
+		  double *a = &acc[6*x];
+		  for(int j=0; j<6; j++)
+		    a[j] += g*t[j];
+		  weight[x] += g;
+		  if(recurrence)
+		    {
+		      g *= ratio;
+		      ratio *= step;
+		    }
+		  else
+		    {
+		      dx = x+1-w[0];
+		      g = gyz*exp(-c[0]*dx*dx);
+		    }
+		}
+	    }
+	}
+
+    for(int ix=0; ix<Xdim; ix++)
+      {
+	float *val = out + 6*(ind+ix);
+	for(int j=0; j<6; j++)
+	  val[j] = (weight[ix] > 0) ? acc[6*ix+j]/weight[ix] : 0.0f;
+	if(outValid)
+	  outValid[ind+ix] = (weight[ix] > 0) ? 1 : 0;
+      }
+  }
+
+  const float *tensor;
+  const unsigned char *valid;
+  const int *dims;
+  const double *res;
+  const VectorField *warpField;
+  const SplatHash *hash;
+  float *out;
+  unsigned char *outValid;
+  float sigma;
+  const int *half;
+};
+
+
 
 //------
 void ScalarField::ComputeSmoothingFilter(float sigma)
 //------
 {  
-  int ix, iy, iz, i, j;
-  
   int Xdim= m_Dims[0];
   int Ydim= m_Dims[1];
   int Zdim= m_Dims[2];
-  
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-  
-  float total_sm= 0.0;
 
   if(Xdim%2 ==0) { std::cout<<"ComputeSmoothingFilter: Kernel size "<<Xdim<<" should be odd\n"; exit(0); }
   if(Ydim%2 ==0) { std::cout<<"ComputeSmoothingFilter: Kernel size "<<Ydim<<" should be odd\n"; exit(0); }
   if(Zdim%2 ==0) { std::cout<<"ComputeSmoothingFilter: Kernel size "<<Zdim<<" should be odd\n"; exit(0); }
 
   // assume all sizes are odd
-  int cen_x = (Xdim-1)/2;
-  int cen_y = (Ydim-1)/2;
-  int cen_z = (Zdim-1)/2; 
- 
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	 
-	  float x= (ix-cen_x)*Xres;
-	  float y= (iy-cen_y)*Yres;
-	  float z= (iz-cen_z)*Zres;
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-
-	  m_Data[ind] = exp(-(x*x + y*y + z*z)/(2*sigma*sigma));
-
-	  total_sm += m_Data[ind];
-
-	}
-    
-  // normalize
-  
-  for(iz=0; iz<Zdim; iz++)
-    for(ix=0; ix<Xdim; ix++)
-      {
-	for(iy=0; iy<Ydim; iy++)
-	  {
-	    int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	    m_Data[ind] = m_Data[ind]/total_sm;
-	    //  if(iz==Zdim/2) std::cout<<m_Data[ind]<< " ";
-	  }
-	//	std::cout<<"\n";
-      }
-  //std::cout<<"Smoothing filter of width "<<sigma<<" computed\n";
-
+  ComputeSmoothingFilter(sigma, (Xdim-1)/2, (Ydim-1)/2, (Zdim-1)/2);
 }
 
 //------
 void ScalarField::ComputeSmoothingFilter(float sigma, float cen_x, float cen_y, float cen_z)
 //------
 {  
-  int ix, iy, iz, i, j;
+  int ix, iy, iz;
   
   int Xdim= m_Dims[0];
   int Ydim= m_Dims[1];
@@ -84,38 +967,24 @@ void ScalarField::ComputeSmoothingFilter(float sigma, float cen_x, float cen_y,
   float Zres = m_VoxelSize[2];
   
   float total_sm= 0.0;
+  int ind = 0;
 
-  for(ix=0; ix<Xdim; ix++)
+  for(iz=0; iz<Zdim; iz++)
     for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
+      for(ix=0; ix<Xdim; ix++, ind++)
 	{
-	 
 	  float x= (ix-cen_x)*Xres;
 	  float y= (iy-cen_y)*Yres;
 	  float z= (iz-cen_z)*Zres;
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
 
 	  m_Data[ind] = exp(-(x*x + y*y + z*z)/(2*sigma*sigma));
 
 	  total_sm += m_Data[ind];
-
 	}
     
   // normalize
-  
-  for(iz=0; iz<Zdim; iz++)
-    for(ix=0; ix<Xdim; ix++)
-      {
-	for(iy=0; iy<Ydim; iy++)
-	  {
-	    int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	    m_Data[ind] = m_Data[ind]/total_sm;
-	    //  if(iz==Zdim/2) std::cout<<m_Data[ind]<< " ";
-	  }
-	//	std::cout<<"\n";
-      }
-  //std::cout<<"Smoothing filter of width "<<sigma<<" computed\n";
-
+  for(ind=0; ind<Xdim*Ydim*Zdim; ind++)
+    m_Data[ind] = m_Data[ind]/total_sm;
 }
 
 
@@ -124,76 +993,30 @@ void ScalarField::ComputeSmoothingFilter(float sigma, float cen_x, float cen_y,
 void ScalarField::Smooth(ScalarField *smoothingFilter, ScalarField *out)
 //----
 {
+  // a Gaussian filter is applied as three 1-d passes
+  Smoother smoother;
+  if(smoother.init(smoothingFilter))
+    {
+      Smooth(smoother, out);
+      return;
+    }
 
-  // should consider doing this computation in the Fourier domain
-
-  int ix, iy, iz, i, j;
-  
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-  
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-  
-
-  int ix1, iy1, iz1;
-  int ix2, iy2, iz2;
-
-  int fXdim = smoothingFilter->getSize(0);
-  int fYdim = smoothingFilter->getSize(1);
-  int fZdim = smoothingFilter->getSize(2);
-
-  /*--
-  TensorField dti_out;
-  dti_out.init(Xdim,Ydim,Zdim);
-  dti_out.setVoxelSize(0,Xres); dti_out.setVoxelSize(1,Yres); dti_out.setVoxelSize(2,Zres);
-  --*/
-
-  if(fXdim%2 ==0) { std::cout<<"Smooth: Kernel size should be odd\n"; exit(0); }
-  if(fYdim%2 ==0) { std::cout<<"Smooth: Kernel size should be odd\n"; exit(0); }
-  if(fZdim%2 ==0) { std::cout<<"Smooth: Kernel size should be odd\n"; exit(0); }
-
-  // assume kernel sizes are odd
-  
-  float *kernel_Data = smoothingFilter->getAt(0,0,0);
-  int order_x= (fXdim-1)/2;
-  int order_y= (fYdim-1)/2;
-  int order_z= (fZdim-1)/2;
 
-  for(ix=0; ix<Xdim; ix++)
-    {
-      for(iy=0; iy<Ydim; iy++)
-	for(iz=0; iz<Zdim; iz++)
-	  {
-	  
-	 
-	  float *val= out->getAt(ix,iy,iz);
-	  val[0] = 0.0;
+  // should consider doing this computation in the Fourier domain
 
-	  if(ix < order_x || ix >= Xdim- order_x || iy<order_y || iy >= Ydim- order_y || iz<order_z || iz>=Zdim- order_z )
-	    continue;
+  if(smoothingFilter->getSize(0)%2 ==0) { std::cout<<"Smooth: Kernel size should be odd\n"; exit(0); }
+  if(smoothingFilter->getSize(1)%2 ==0) { std::cout<<"Smooth: Kernel size should be odd\n"; exit(0); }
+  if(smoothingFilter->getSize(2)%2 ==0) { std::cout<<"Smooth: Kernel size should be odd\n"; exit(0); }
 
-	  for(ix1=0; ix1<fXdim; ix1++)
-	    for(iy1=0; iy1<fYdim; iy1++)
-	      for(iz1=0; iz1<fZdim; iz1++)
-		{
-		  int ind1 = iz1*fXdim*fYdim + iy1*fXdim + ix1;
+  forEachRow(ConvolveRow<1>(m_Data, out->getDataPtr(), m_Dims, smoothingFilter));
+}
 
-		  ix2 = ix -ix1 + order_x;
-		  iy2 = iy -iy1 + order_y;
-		  iz2 = iz -iz1 + order_z;
-		  
-		  int ind = iz2*Xdim*Ydim + iy2*Xdim + ix2;
-		  		
-		  val[0] += kernel_Data[ind1]*m_Data[ind];
 
-     		}
-	  }
-      //std::cout<<ix<<" YZ slice smoothing done\n";
-    }
-  
+//----
+void ScalarField::Smooth(const Smoother &smoother, ScalarField *out)
+//----
+{
+  smoother.apply(m_Data, out->getDataPtr(), m_Dims, 1);
 }
 
 
@@ -213,19 +1036,9 @@ void VectorField::AddOffset()
   ix=Xdim/2; iy=Ydim/2; iz= Zdim/2;
   count= iz*Xdim*Ydim + iy*Xdim + ix;
   std::cout<<"\nCentral Original Vector: "<<vec_data[count*3]<<" "<<vec_data[count*3+1]<<" "<<vec_data[count*3+2]<<"\n";
-  count=0; 
-  
-  for(iz=0; iz<Zdim; iz++)
-    for(iy=0; iy<Ydim; iy++)
-      for(ix=0; ix<Xdim; ix++)
-	{
-	  vec_data[count*3+0] = vec_data[count*3+0] + ix;
-	  vec_data[count*3+1] = vec_data[count*3+1] + iy;
-	  vec_data[count*3+2] = vec_data[count*3+2] + iz;
-	  count++;
-	} 
-  ix=Xdim/2; iy=Ydim/2; iz= Zdim/2;
-  count= iz*Xdim*Ydim + iy*Xdim + ix;
+
+  forEachRow(OffsetRow(m_Data, Xdim, 1.0f));
+
   std::cout<<"Central Modified Vector: "<<vec_data[count*3]<<" "<<vec_data[count*3+1]<<" "<<vec_data[count*3+2]<<"\n";
   
 }
@@ -244,19 +1057,9 @@ void VectorField::SubtractOffset()
   ix=Xdim/2; iy=Ydim/2; iz= Zdim/2;
   count= iz*Xdim*Ydim + iy*Xdim + ix;
   std::cout<<"\nCentral Original Vector: "<<vec_data[count*3]<<" "<<vec_data[count*3+1]<<" "<<vec_data[count*3+2]<<"\n";
-  count=0; 
-  
-  for(iz=0; iz<Zdim; iz++)
-    for(iy=0; iy<Ydim; iy++)
-      for(ix=0; ix<Xdim; ix++)
-	{
-	  vec_data[count*3+0] = vec_data[count*3+0] - ix;
-	  vec_data[count*3+1] = vec_data[count*3+1] - iy;
-	  vec_data[count*3+2] = vec_data[count*3+2] - iz;
-	  count++;
-	} 
-  ix=Xdim/2; iy=Ydim/2; iz= Zdim/2;
-  count= iz*Xdim*Ydim + iy*Xdim + ix;
+
+  forEachRow(OffsetRow(m_Data, Xdim, -1.0f));
+
   std::cout<<"Central Modified Vector: "<<vec_data[count*3]<<" "<<vec_data[count*3+1]<<" "<<vec_data[count*3+2]<<"\n";
   
 }
@@ -265,399 +1068,138 @@ void VectorField::SubtractOffset()
 void VectorField::FlipComp(int FlipDirn)
 //----
 {
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-
-  int ix,iy,iz,count, j;
-  count=0;
-  for(iz=0; iz<Zdim; iz++)
-    for(iy=0; iy<Ydim; iy++)
-      for(ix=0; ix<Xdim; ix++)
-	{
-	  m_Data[count*3+FlipDirn] = - m_Data[count*3+FlipDirn];
-	  count++;
-	}
+  forEachRow(FlipRow(m_Data, m_Dims[0], FlipDirn));
 }
 
 //----
 void VectorField::Normalize()
 //----
 {
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-
-  int ix,iy,iz,count,j;
-  count=0;
-  for(iz=0; iz<Zdim; iz++)
-    for(iy=0; iy<Ydim; iy++)
-      for(ix=0; ix<Xdim; ix++)
-	{
-	  float VecNorm= 0.0;
-
-	  for(j=0; j<3; j++)
-	    VecNorm += m_Data[count*3+j]*m_Data[count*3+j];
-
-	  VecNorm = sqrt(VecNorm);
-
-	  for(j=0; j<3; j++)
-	    m_Data[count*3+j] /= VecNorm;
-
-	  count++;
-	}
+  forEachRow(UnitRow(m_Data, m_Dims[0]));
 }
 
 // takes a forward mapping and returns a reverse mapping
 //-----
 void VectorField::reverseWarpField(VectorField *out)
-//-----
-{ 
-  // starts 
-  // estimate reverse vector field
-  // this is a simple reverser : a more complex one is implemented by DGS
-  // unfortunately, this simple one does not follow HAMMER coordinate conventions
-  // reverseWarpFieldHAMMER follows these conventions
-
-  float eps = 1e-5;
-
-  // assume fwd field is from subject to template
-
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-  
-  int ix,iy,iz,count,j;
-  int ix_template,iy_template,iz_template;
-
-  ScalarField FwdVoxelCounts;
-  
-  FwdVoxelCounts.init(Xdim,Ydim,Zdim);
-  FwdVoxelCounts.setVoxelSize(0,Xres); 
-  FwdVoxelCounts.setVoxelSize(1,Yres); 
-  FwdVoxelCounts.setVoxelSize(2,Zres);
-  
-  // initialize to zero
-  // (ix,iy,iz) is a position in template domain
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  
-	  float *val= out->getAt(ix,iy,iz);	  
-	  for(j=0; j < 3; j++)
-	    val[j] = 0.0f;
-
-	  val= FwdVoxelCounts.getAt(ix,iy,iz);
-	  val[0] = 0.0f;
-	  
-	}
-
-  int mutliply_mapped_voxels= 0;
-  int unmapped_voxels= 0;
-  int outside_voxels = 0;
-  int singly_mapped_voxels= 0;
-
-
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  
-	  float *warpField_val = getAt(ix,iy,iz);
-	  ix_template = rint(warpField_val[0]);
-	  iy_template = rint(warpField_val[1]);
-	  iz_template = rint(warpField_val[2]);
-	  
-	  if(ix_template < 0 || iy_template < 0 || iz_template < 0 || ix_template >= Xdim || iy_template >= Ydim || iz_template >= Zdim )
-	    {	     
-	      outside_voxels++;
-	      continue;	      
-	    }
-	  
-	  float *rev_warpField_val = out->getAt(ix_template,iy_template,iz_template);
-	  rev_warpField_val[0] += ix;
-	  rev_warpField_val[1] += iy;
-	  rev_warpField_val[2] += iz;
-	  
-	  float *FwdVoxelCounts_val = FwdVoxelCounts.getAt(ix_template,iy_template,iz_template);
-	  FwdVoxelCounts_val[0] += 1.0f;
-	  
-	}
-
-  std::cout<<"Step 1 (mapping) done "<<"\n";
-  std::cout<<"Outside voxels count: "<<outside_voxels<<"\n";
-
-  // average the displacements when >1 voxel in subject gets mapped to one voxel in template
-  
-   for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  float *FwdVoxelCounts_val = FwdVoxelCounts.getAt(ix,iy,iz);
-	  if(FwdVoxelCounts_val[0]>1+eps) //>1
-	    {
-	      mutliply_mapped_voxels++;
-	      float *rev_warpField_val = out->getAt(ix,iy,iz);
-	      for(int tempi=0; tempi<3; tempi++)
-		rev_warpField_val[tempi] /= FwdVoxelCounts_val[0];
-	      continue;
-	    }
-	  
-	  if(FwdVoxelCounts_val[0]>eps) //==1
-	    {
-	      singly_mapped_voxels++;
-	      continue;
-	    }
-	  
-	  if(FwdVoxelCounts_val[0]>-1+eps) //==0
-	    {
-	      unmapped_voxels++;
-	      float *rev_warpField_val = out->getAt(ix,iy,iz);
-	      rev_warpField_val[0] = ix;
-	      rev_warpField_val[1] = iy;
-	      rev_warpField_val[2] = iz;
-	      continue;
-	    }
-	  
-	}
-
-   std::cout<<"Step 2 (averaging) done\n";
-   
-   std::cout<<"\nMultiply mapped voxels count: "<<mutliply_mapped_voxels<<"\nSingly mapped voxels count: "<<singly_mapped_voxels<<"\nUnmapped voxels count: "<<unmapped_voxels<<"\n";
-
-   if(mutliply_mapped_voxels+ singly_mapped_voxels+ unmapped_voxels != Xdim*Ydim*Zdim)
-     std::cout<<"\nError in voxel processing in computing reverse vector field\n";
-
-}  
-
-// takes a forward displacement field and returns a reverse displacement field
-//-----
-void VectorField::reverseWarpFieldHAMMER(VectorField *out)
-//-----
-{ 
-  // estimate reverse vector field
-  // this is a simple reverser : a more complex one is implemented by DGS
-
-  float eps = 1e-5;
-
-  // assume fwd field is from subject to template
-
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-  
-  int ix,iy,iz,count,j;
-  int ix_template,iy_template,iz_template;
-
-  ScalarField FwdVoxelCounts;
-  
-  FwdVoxelCounts.init(Xdim,Ydim,Zdim);
-  FwdVoxelCounts.setVoxelSize(0,Xres); 
-  FwdVoxelCounts.setVoxelSize(1,Yres); 
-  FwdVoxelCounts.setVoxelSize(2,Zres);
-  
-  // initialize to zero
-  // (ix,iy,iz) is a position in template domain
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  
-	  float *val= out->getAt(ix,iy,iz);	  
-	  for(j=0; j < 3; j++)
-	    val[j] = 0.0f;
-
-	  val= FwdVoxelCounts.getAt(ix,iy,iz);
-	  val[0] = 0.0f;
-	  
-	}
-
-  int mutliply_mapped_voxels= 0;
-  int unmapped_voxels= 0;
-  int outside_voxels = 0;
-  int singly_mapped_voxels= 0;
-
-  // field from subject 2 template
-
-  // (ix,iy,iz) now in subject
+//-----
+{ 
+  // the fwd field holds the template position of every subject voxel,
+  // the reverse field the subject position of every template voxel
+  // this reverser does not follow HAMMER coordinate conventions
+  // reverseWarpFieldHAMMER follows these conventions
 
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  
-	  float *warpField_val = getAt(ix,iy,iz);
-
-	  // note that the (1,0) switch is needed to deal with HAMMER conventions
-
-	  ix_template = rint(warpField_val[1] + ix);
-	  iy_template = rint(warpField_val[0] + iy);
-	  iz_template = rint(warpField_val[2] + iz);
-	  
-	  if(ix_template < 0 || iy_template < 0 || iz_template < 0 || ix_template >= Xdim || iy_template >= Ydim || iz_template >= Zdim )
-	    {	     
-	      outside_voxels++;
-	      continue;	      
-	    }
-	  
-	  float *rev_warpField_val = out->getAt(ix_template,iy_template,iz_template);
-	  rev_warpField_val[0] += ix;
-	  rev_warpField_val[1] += iy;
-	  rev_warpField_val[2] += iz;
-	  
-	  float *FwdVoxelCounts_val = FwdVoxelCounts.getAt(ix_template,iy_template,iz_template);
-	  FwdVoxelCounts_val[0] += 1.0f;
-	  
-	}
+  VectorField disp;
+  disp.init(m_Dims[0],m_Dims[1],m_Dims[2]);
+  for(int d=0; d<3; d++)
+    disp.setVoxelSize(d, m_VoxelSize[d]);
 
-  std::cout<<"Step 1 (mapping) done "<<"\n";
-  std::cout<<"Outside voxels count: "<<outside_voxels<<"\n";
+  memcpy(disp.getDataPtr(), m_Data, 3*sizeof(float)*m_Dims[0]*m_Dims[1]*m_Dims[2]);
+  disp.forEachRow(OffsetRow(disp.getDataPtr(), m_Dims[0], -1.0f));
 
-  // average the displacements when >1 voxel in subject gets mapped to one voxel in template
-  
-   for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  float *FwdVoxelCounts_val = FwdVoxelCounts.getAt(ix,iy,iz);
-	  if(FwdVoxelCounts_val[0]>1+eps) //>1
-	    {
-	      mutliply_mapped_voxels++;
-	      float *rev_warpField_val = out->getAt(ix,iy,iz);
-	      for(int tempi=0; tempi<3; tempi++)
-		rev_warpField_val[tempi] /= FwdVoxelCounts_val[0];
-	      continue;
-	    }
-	  
-	  if(FwdVoxelCounts_val[0]>eps) //==1
-	    {
-	      singly_mapped_voxels++;
-	      continue;
-	    }
-	  
-	  if(FwdVoxelCounts_val[0]>-1+eps) //==0
-	    {
-	      unmapped_voxels++;
-	      float *rev_warpField_val = out->getAt(ix,iy,iz);
-	      rev_warpField_val[0] = ix;
-	      rev_warpField_val[1] = iy;
-	      rev_warpField_val[2] = iz;
-	      continue;
-	    }
-	  
-	}
+  disp.invertDisplacementField(out);
 
-   std::cout<<"Step 2 (averaging) done\n";
+  out->forEachRow(OffsetRow(out->getDataPtr(), m_Dims[0], 1.0f));
+}  
 
-   // return to hammer convention
+// takes a forward displacement field and returns a reverse displacement field
+//-----
+void VectorField::reverseWarpFieldHAMMER(VectorField *out)
+//-----
+{ 
+  // note that the (1,0) switch is needed to deal with HAMMER conventions
 
-   for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  float *rev_warpField_val = out->getAt(ix,iy,iz);
-	  float tmpx= rev_warpField_val[0];
-	  float tmpy= rev_warpField_val[1];
-	  float tmpz= rev_warpField_val[2];
-	  rev_warpField_val[0]= tmpy - iy;
-	  rev_warpField_val[1]= tmpx - ix;
-	  rev_warpField_val[2]= tmpz - iz;
-	}
+  VectorField disp;
+  disp.init(m_Dims[0],m_Dims[1],m_Dims[2]);
+  for(int d=0; d<3; d++)
+    disp.setVoxelSize(d, m_VoxelSize[d]);
 
-   std::cout<<"\nMultiply mapped voxels count: "<<mutliply_mapped_voxels<<"\nSingly mapped voxels count: "<<singly_mapped_voxels<<"\nUnmapped voxels count: "<<unmapped_voxels<<"\n";
+  memcpy(disp.getDataPtr(), m_Data, 3*sizeof(float)*m_Dims[0]*m_Dims[1]*m_Dims[2]);
+  disp.forEachRow(SwapXYRow(disp.getDataPtr(), m_Dims[0]));
 
-   if(mutliply_mapped_voxels+ singly_mapped_voxels+ unmapped_voxels != Xdim*Ydim*Zdim)
-     std::cout<<"\nError in voxel processing in computing reverse vector field\n";
+  disp.invertDisplacementField(out);
 
+  // return to hammer convention
+  out->forEachRow(SwapXYRow(out->getDataPtr(), m_Dims[0]));
 }  
 
-//----
-void VectorField::Smooth(ScalarField *smoothingFilter, VectorField *out)
-//----
+//-----
+float VectorField::invertDisplacementField(VectorField *out, int maxIterations, float tolerance, long *unconverged)
+//-----
 {
-
-  // should consider doing this computation in the Fourier domain
-
-  int ix, iy, iz, i, j;
-  
   int Xdim= m_Dims[0];
   int Ydim= m_Dims[1];
   int Zdim= m_Dims[2];
-  
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-  
+  long nvox = (long)Xdim*Ydim*Zdim;
 
-  int ix1, iy1, iz1;
-  int ix2, iy2, iz2;
+  // starting point: the inverse at half resolution, or -u on a small grid
+  if(Xdim>=32 && Ydim>=32 && Zdim>=32)
+    {
+      VectorField coarse, coarse_inv;
+      coarse.init((Xdim+1)/2,(Ydim+1)/2,(Zdim+1)/2);
+      coarse_inv.init((Xdim+1)/2,(Ydim+1)/2,(Zdim+1)/2);
 
-  int fXdim = smoothingFilter->getSize(0);
-  int fYdim = smoothingFilter->getSize(1);
-  int fZdim = smoothingFilter->getSize(2);
+      coarse.forEachRow(DownsampleRow(this, &coarse));
+      coarse.invertDisplacementField(&coarse_inv, maxIterations, 0.5f*tolerance);
 
-  /*--
-  TensorField dti_out;
-  dti_out.init(Xdim,Ydim,Zdim);
-  dti_out.setVoxelSize(0,Xres); dti_out.setVoxelSize(1,Yres); dti_out.setVoxelSize(2,Zres);
-  --*/
+      forEachRow(UpsampleRow(&coarse_inv, out));
+    }
+  else
+    {
+      float *out_data = out->getDataPtr();
+      for(long i=0; i<3*nvox; i++)
+	out_data[i] = -m_Data[i];
+    }
 
-  if(fXdim%2 ==0) { std::cout<<"Smooth: Kernel size should be odd\n"; exit(0); }
-  if(fYdim%2 ==0) { std::cout<<"Smooth: Kernel size should be odd\n"; exit(0); }
-  if(fZdim%2 ==0) { std::cout<<"Smooth: Kernel size should be odd\n"; exit(0); }
+  ScalarField residual;
+  residual.init(Xdim,Ydim,Zdim);
 
-  // assume kernel sizes are odd
-  
-  float *kernel_Data = smoothingFilter->getAt(0,0,0);
-  int order_x= (fXdim-1)/2;
-  int order_y= (fYdim-1)/2;
-  int order_z= (fZdim-1)/2;
+  forEachRow(FixedPointInverseRow(this, out, residual.getDataPtr(), maxIterations, tolerance));
 
-  for(ix=0; ix<Xdim; ix++)
+  float max_residual = 0.0f;
+  long above = 0;
+  float *res_data = residual.getDataPtr();
+  for(long i=0; i<nvox; i++)
     {
-      for(iy=0; iy<Ydim; iy++)
-	for(iz=0; iz<Zdim; iz++)
-	  {
-	  
-	 
-	  float *val= out->getAt(ix,iy,iz);
-	  for(j=0; j<3; j++)
-	    val[j] = 0.0;
+      if(res_data[i] > max_residual)
+	max_residual = res_data[i];
+      // a NaN residual counts as not converged
+      if(!(res_data[i] < tolerance))
+	above++;
+    }
 
-	  if(ix < order_x || ix >= Xdim- order_x || iy<order_y || iy >= Ydim- order_y || iz<order_z || iz>=Zdim- order_z )
-	    continue;
+  if(unconverged)
+    *unconverged = above;
 
-	  for(ix1=0; ix1<fXdim; ix1++)
-	    for(iy1=0; iy1<fYdim; iy1++)
-	      for(iz1=0; iz1<fZdim; iz1++)
-		{
-		  int ind1 = iz1*fXdim*fYdim + iy1*fXdim + ix1;
+  return max_residual;
+}
 
-		  ix2 = ix -ix1 + order_x;
-		  iy2 = iy -iy1 + order_y;
-		  iz2 = iz -iz1 + order_z;
-		  
-		  int ind = iz2*Xdim*Ydim + iy2*Xdim + ix2;
+//----
+void VectorField::Smooth(ScalarField *smoothingFilter, VectorField *out)
+//----
+{
+  Smoother smoother;
+  if(smoother.init(smoothingFilter))
+    {
+      Smooth(smoother, out);
+      return;
+    }
 
-		  for(j=0; j<3; j++)
-		    val[j] += kernel_Data[ind1]*m_Data[ind*3 + j];
 
-     		}
-	  }
-      //std::cout<<ix<<" YZ slice smoothing done\n";
-    }
-  
+  // should consider doing this computation in the Fourier domain
+
+  if(smoothingFilter->getSize(0)%2 ==0) { std::cout<<"Smooth: Kernel size should be odd\n"; exit(0); }
+  if(smoothingFilter->getSize(1)%2 ==0) { std::cout<<"Smooth: Kernel size should be odd\n"; exit(0); }
+  if(smoothingFilter->getSize(2)%2 ==0) { std::cout<<"Smooth: Kernel size should be odd\n"; exit(0); }
+
+  forEachRow(ConvolveRow<3>(m_Data, out->getDataPtr(), m_Dims, smoothingFilter));
+}
+
+
+//----
+void VectorField::Smooth(const Smoother &smoother, VectorField *out)
+//----
+{
+  smoother.apply(m_Data, out->getDataPtr(), m_Dims, 3);
 }
 
 
@@ -744,621 +1286,123 @@ int VectorField::getVectorAtAnyPosition(float px, float py, float pz, struct Pt3
     v1.y = tx*v2.y+(1-tx)*v1.y;
     v1.z = tx*v2.z+(1-tx)*v1.z; 
     v3.x = tx*v4.x+(1-tx)*v3.x;
-    v3.y = tx*v4.y+(1-tx)*v3.y;
-    v3.z = tx*v4.z+(1-tx)*v3.z;
-
-    // v5 & v7
-    v5.x = tx*v6.x+(1-tx)*v5.x;
-    v5.y = tx*v6.y+(1-tx)*v5.y;
-    v5.z = tx*v6.z+(1-tx)*v5.z;
-    v7.x = tx*v8.x+(1-tx)*v7.x;
-    v7.y = tx*v8.y+(1-tx)*v7.y;
-    v7.z = tx*v8.z+(1-tx)*v7.z;
-
-    v1.x = ty*v3.x+(1-ty)*v1.x;
-    v1.y = ty*v3.y+(1-ty)*v1.y;
-    v1.z = ty*v3.z+(1-ty)*v1.z;
-    v5.x = ty*v7.x+(1-ty)*v5.x;
-    v5.y = ty*v7.y+(1-ty)*v5.y;
-    v5.z = ty*v7.z+(1-ty)*v5.z;
-
-    v1.x = tz*v5.x+(1-tz)*v1.x;
-    v1.y = tz*v5.y+(1-tz)*v1.y;
-    v1.z = tz*v5.z+(1-tz)*v1.z;
-
-    P.x=v1.x;  P.y=v1.y;  P.z=v1.z;
-
-    return 1;
-}
-
-
-//-------------------------------------------------------------
-
-//----
-void TensorField::createInterleavedDTI(ScalarField *Dxx, ScalarField *Dyy, ScalarField *Dzz, ScalarField *Dxy, ScalarField *Dxz, ScalarField *Dyz)
-//----
-{
-
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-
-  int ix, iy, iz;
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  float *Dxxval= Dxx->getAt(ix,iy,iz);
-	  float *Dyyval= Dyy->getAt(ix,iy,iz);
-	  float *Dzzval= Dzz->getAt(ix,iy,iz);
-	  float *Dxyval= Dxy->getAt(ix,iy,iz);
-	  float *Dxzval= Dxz->getAt(ix,iy,iz);
-	  float *Dyzval= Dyz->getAt(ix,iy,iz);
-	  
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  m_Data[ind*6]= Dxxval[0];
-	  m_Data[ind*6+1]= Dyyval[0];
-	  m_Data[ind*6+2]= Dzzval[0];
-	  m_Data[ind*6+3]= Dxyval[0];
-	  m_Data[ind*6+4]= Dxzval[0];
-	  m_Data[ind*6+5]= Dyzval[0];
-
-	}
-}
-
-//----
-void TensorField::extractDTIcomponents(ScalarField *Dxx, ScalarField *Dyy, ScalarField *Dzz, ScalarField *Dxy, ScalarField *Dxz, ScalarField *Dyz)
-//----
-{
-
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-
-  int ix, iy, iz;
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  float *Dxxval= Dxx->getAt(ix,iy,iz);
-	  float *Dyyval= Dyy->getAt(ix,iy,iz);
-	  float *Dzzval= Dzz->getAt(ix,iy,iz);
-	  float *Dxyval= Dxy->getAt(ix,iy,iz);
-	  float *Dxzval= Dxz->getAt(ix,iy,iz);
-	  float *Dyzval= Dyz->getAt(ix,iy,iz);
-	  
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  Dxxval[0]= m_Data[ind*6];
-	  Dyyval[0]= m_Data[ind*6+1];
-	  Dzzval[0]= m_Data[ind*6+2] ;
-	  Dxyval[0]= m_Data[ind*6+3];
-	  Dxzval[0]= m_Data[ind*6+4];
-	  Dyzval[0]= m_Data[ind*6+5];
-
-	}
-}
-
-
-
-//----
-void TensorField::ComputeFA(ScalarField *faField)
-//----
-{
-int ix, iy, iz, i, j;
-
-  double M[9];
-  double eigVal[3], fa, DTtrace;
-
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-
-  gsl_vector *eval ;
-  gsl_matrix *evec ;
-  
-  gsl_eigen_symmv_workspace  *w ;
-  
-  eval = gsl_vector_alloc (3);
-  evec = gsl_matrix_alloc (3, 3);
-   
-  w = gsl_eigen_symmv_alloc (3);
-    
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-
-	  M[0]= (double) m_Data[ind*6];
-	  M[4]= (double) m_Data[ind*6+1];
-	  M[8]= (double) m_Data[ind*6+2];
-	  M[1]= (double) m_Data[ind*6+3];
-	  M[2]= (double) m_Data[ind*6+4];
-	  M[5]= (double) m_Data[ind*6+5];
-	  M[3]= M[1];
-	  M[6]= M[2];
-	  M[7]= M[5];
-
-	  gsl_matrix_view m 
-	    = gsl_matrix_view_array (M, 3, 3);
-     
-	  gsl_eigen_symmv (&m.matrix, eval, evec, w);
-    
-	  gsl_eigen_symmv_sort (eval, evec, GSL_EIGEN_SORT_ABS_DESC);
-
-	  
-	  DTtrace=0;
-	  for(i=0; i<3; i++)
-	    {
-	      eigVal[i] = gsl_vector_get (eval, i);
-	      DTtrace += eigVal[i];
-	    }
-
-	  
-#ifdef _V2_
-	  double DTtrace2= M[0]+M[4]+M[8];  
-	  if(fabs(DTtrace2)<1e-20)
-	    DTtrace= 0;
-#endif
-
-	  if(DTtrace>0)
-	    fa = sqrt(3.0/2.0*((eigVal[0]-DTtrace/3)*(eigVal[0]-DTtrace/3) +  (eigVal[1]-DTtrace/3)*(eigVal[1]-DTtrace/3) + (eigVal[2]-DTtrace/3)*(eigVal[2]-DTtrace/3))/((eigVal[0]*eigVal[0]) +  (eigVal[1]*eigVal[1]) + (eigVal[2]*eigVal[2])));	  	  
-	  else
-	    fa=0;
-
-	  // this can only happen due to negative eigenvalues
-	  if(fa>1.0)
-	    fa=1.0;
-
-	  //faField->setVal(ind,fa);
-	  float *val= faField->getAt(ix,iy,iz);
-	  *val = fa;
-
-	}
-
-  gsl_eigen_symmv_free ( w);
-  gsl_vector_free( eval);
-  gsl_matrix_free( evec);
-  
-}
-
-//----
-void TensorField::ComputeTrace(ScalarField *traceField)
-//----
-{
-int ix, iy, iz, i, j;
-
-  double  DTtrace;
-
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-
-  
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	
-	  DTtrace=m_Data[ind*6] + m_Data[ind*6+1]+ m_Data[ind*6+2];
-	  	 
-	  float *val= traceField->getAt(ix,iy,iz);
-	  *val = DTtrace;
-	}
- 
-}
-
-//----
-void TensorField::ComputePD(VectorField *PDField, int d_index, int weight_flag)
-//----
-{
-int ix, iy, iz, i, j;
-
-  double M[9];
-  double eigVal[3], fa, PD[3], DTtrace;
-
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-
-
-  gsl_vector *eval ;
-  gsl_matrix *evec ;
-  
-  gsl_eigen_symmv_workspace  *w ;
-  
-  eval = gsl_vector_alloc (3);
-  evec = gsl_matrix_alloc (3, 3);
-   
-  w = gsl_eigen_symmv_alloc (3);
-    
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-
-	  M[0]= (double) m_Data[ind*6];
-	  M[4]= (double) m_Data[ind*6+1];
-	  M[8]= (double) m_Data[ind*6+2];
-	  M[1]= (double) m_Data[ind*6+3];
-	  M[2]= (double) m_Data[ind*6+4];
-	  M[5]= (double) m_Data[ind*6+5];
-	  M[3]= M[1];
-	  M[6]= M[2];
-	  M[7]= M[5];
-
-	  gsl_matrix_view m 
-	    = gsl_matrix_view_array (M, 3, 3);
-     
-	  gsl_eigen_symmv (&m.matrix, eval, evec, w);
-    
-	  gsl_eigen_symmv_sort (eval, evec, GSL_EIGEN_SORT_ABS_DESC);
-
-	  
-	  DTtrace=0;
-	  for(i=0; i<3; i++)
-	    {
-	      eigVal[i] = gsl_vector_get (eval, i);	      
-	      DTtrace += eigVal[i];
-	    }
-	 
-#ifdef _V2_
-	  double DTtrace2= M[0]+M[4]+M[8];  
-	  if(fabs(DTtrace2)<1e-20)
-	    DTtrace= 0;
-#endif
-
-
-	  if(DTtrace>0)
-	    {
-	      /*
-	       for(i=0; i<3; i++)
-		 printf("%1.2f ",eigVal[i]);
-	       printf("\n");
-	      */
-
-	      gsl_vector_view evec_i = gsl_matrix_column (evec, d_index);
-	      
-	      float PDnorm=0;
-	      for(j=0; j<3; j++)
-		{
-		  PD[j] = gsl_vector_get (&evec_i.vector, j);		     
-		  PDnorm += PD[j]*PD[j];
-		}
-	      
-	      //std::cout<<"PDnorm: "<<PDnorm<<"\n"; //checked and always 1
-	      if(weight_flag>0)	
-		{
-		  PDnorm=0.;
-		   
-		  fa = sqrt(3.0/2.0*((eigVal[0]-DTtrace/3)*(eigVal[0]-DTtrace/3) +  (eigVal[1]-DTtrace/3)*(eigVal[1]-DTtrace/3) + (eigVal[2]-DTtrace/3)*(eigVal[2]-DTtrace/3))/((eigVal[0]*eigVal[0]) +  (eigVal[1]*eigVal[1]) + (eigVal[2]*eigVal[2])));
-	  	  
-		  //clip fa: this can only be caused by negative eigenvalues
-		  if(fa>1.0)
-		    fa=1.0;
-		  
-		  for(j=0; j<3; j++)
-		    {
-		      PD[j] = fa*PD[j];
-		      //   PDnorm += PD[j]*PD[j];
-		    }
-		  //  PDnorm = sqrt(PDnorm);
-		  
-		  //   std::cout<<"FA: "<<fa<<" "<<"PDnorm: "<<PDnorm<<"\n"; //checked and always equal
-		}
-	     
-	    }
-      
-	  float *val= PDField->getAt(ix,iy,iz);
-	  for(j=0; j<3; j++)
-	    {
-	      //PDField->setVal(ind*3+j,PD[j]);
-	     
-	      if(DTtrace>0)
-		val[j] = PD[j];	     
-	      else 
-		val[j]= 0;
-	    }
-	  
-	}
-  
-  gsl_eigen_symmv_free ( w);
-  gsl_vector_free( eval);
-  gsl_matrix_free( evec);
-  
-}
-  
-//----
-void TensorField::ComputeEigD(ScalarField *e1Field,ScalarField *e2Field,ScalarField *e3Field,VectorField *PD1Field,VectorField *PD2Field,VectorField *PD3Field)
-//----
-{
-  int ix, iy, iz, i, j;
-
-  double M[9];
-  double eigVal[3], eigVec[9], fa, DTtrace;
-
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-
-
-  gsl_vector *eval ;
-  gsl_matrix *evec ;
-  
-  gsl_eigen_symmv_workspace  *w ;
-  
-  eval = gsl_vector_alloc (3);
-  evec = gsl_matrix_alloc (3, 3);
-   
-  w = gsl_eigen_symmv_alloc (3);
-    
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-
-	  M[0]= (double) m_Data[ind*6];
-	  M[4]= (double) m_Data[ind*6+1];
-	  M[8]= (double) m_Data[ind*6+2];
-	  M[1]= (double) m_Data[ind*6+3];
-	  M[2]= (double) m_Data[ind*6+4];
-	  M[5]= (double) m_Data[ind*6+5];
-	  M[3]= M[1];
-	  M[6]= M[2];
-	  M[7]= M[5];
-
-	  gsl_matrix_view m 
-	    = gsl_matrix_view_array (M, 3, 3);
-     
-	  gsl_eigen_symmv (&m.matrix, eval, evec, w);
-    
-	  gsl_eigen_symmv_sort (eval, evec, GSL_EIGEN_SORT_ABS_DESC);
-	 
-	  DTtrace= 0;
-	  for(i=0; i<3; i++)
-	    {
-	      eigVal[i] = gsl_vector_get (eval, i);
-	      DTtrace += eigVal[i];
-
-	      gsl_vector_view evec_i 
-                = gsl_matrix_column (evec, i);
-
-	      for(j=0; j<3; j++)
-		eigVec[i*3+j] = gsl_vector_get (&evec_i.vector, j);	     
-		  
-	    }
-
-#ifdef _V2_
-	  double DTtrace2= M[0]+M[4]+M[8];  
-	  if(fabs(DTtrace2)<1e-20)
-	    DTtrace= 0;
-#endif
-
+    v3.y = tx*v4.y+(1-tx)*v3.y;
+    v3.z = tx*v4.z+(1-tx)*v3.z;
 
-	  float *val;
-	  //e1Field->setVal(ind, eigVal[0]);
-	  val= e1Field->getAt(ix,iy,iz);
-	  *val = eigVal[0];
-	  //e2Field->setVal(ind, eigVal[1]);
-	  val= e2Field->getAt(ix,iy,iz);
-	  *val = eigVal[1];
-	  //e3Field->setVal(ind, eigVal[2]);
-	  val= e3Field->getAt(ix,iy,iz);
-	  *val = eigVal[2];
+    // v5 & v7
+    v5.x = tx*v6.x+(1-tx)*v5.x;
+    v5.y = tx*v6.y+(1-tx)*v5.y;
+    v5.z = tx*v6.z+(1-tx)*v5.z;
+    v7.x = tx*v8.x+(1-tx)*v7.x;
+    v7.y = tx*v8.y+(1-tx)*v7.y;
+    v7.z = tx*v8.z+(1-tx)*v7.z;
 
-	  for(j=0; j<3; j++)
-	    {
-	      //PD1Field->setVal(ind*3+j,eigVec[0*3+j]);
-	      val= PD1Field->getAt(ix,iy,iz);
-	      val[j] = eigVec[0*3+j];
-	      //PD2Field->setVal(ind*3+j,eigVec[1*3+j]);
-	      val= PD2Field->getAt(ix,iy,iz);
-	      val[j] = eigVec[1*3+j];
-	      //PD3Field->setVal(ind*3+j,eigVec[2*3+j]);
-	      val= PD3Field->getAt(ix,iy,iz);
-	      val[j] = eigVec[2*3+j];
-	    }
+    v1.x = ty*v3.x+(1-ty)*v1.x;
+    v1.y = ty*v3.y+(1-ty)*v1.y;
+    v1.z = ty*v3.z+(1-ty)*v1.z;
+    v5.x = ty*v7.x+(1-ty)*v5.x;
+    v5.y = ty*v7.y+(1-ty)*v5.y;
+    v5.z = ty*v7.z+(1-ty)*v5.z;
 
-#ifdef _V2_
-	  if(DTtrace==0)
-	    {
-	       //e1Field->setVal(ind, eigVal[0]);
-	      val= e1Field->getAt(ix,iy,iz);
-	      *val = 0;
-	      //e2Field->setVal(ind, eigVal[1]);
-	      val= e2Field->getAt(ix,iy,iz);
-	      *val = 0;
-	      //e3Field->setVal(ind, eigVal[2]);
-	      val= e3Field->getAt(ix,iy,iz);
-	      *val = 0;
-	      
-	      for(j=0; j<3; j++)
-		{
-		  //PD1Field->setVal(ind*3+j,eigVec[0*3+j]);
-		  val= PD1Field->getAt(ix,iy,iz);
-		  val[j] = 0;
-		  //PD2Field->setVal(ind*3+j,eigVec[1*3+j]);
-		  val= PD2Field->getAt(ix,iy,iz);
-		  val[j] = 0;
-		  //PD3Field->setVal(ind*3+j,eigVec[2*3+j]);
-		  val= PD3Field->getAt(ix,iy,iz);
-		  val[j] = 0;
-		}
-	    }  
-#endif
+    v1.x = tz*v5.x+(1-tz)*v1.x;
+    v1.y = tz*v5.y+(1-tz)*v1.y;
+    v1.z = tz*v5.z+(1-tz)*v1.z;
 
-	}	 
+    P.x=v1.x;  P.y=v1.y;  P.z=v1.z;
 
-  gsl_eigen_symmv_free ( w);
-  gsl_vector_free( eval);
-  gsl_matrix_free( evec);
-  
+    return 1;
 }
 
 
+//-------------------------------------------------------------
 
 //----
-void TensorField::ComputeEigD(ScalarField *e1Field,ScalarField *e2Field,ScalarField *e3Field,VectorField *PD1Field,VectorField *PD2Field,VectorField *PD3Field, ScalarField *traceField, ScalarField *faField, int FAweighting)
+void TensorField::createInterleavedDTI(ScalarField *Dxx, ScalarField *Dyy, ScalarField *Dzz, ScalarField *Dxy, ScalarField *Dxz, ScalarField *Dyz)
 //----
 {
-  int ix, iy, iz, i, j;
+  ScalarField *comp[6] = { Dxx, Dyy, Dzz, Dxy, Dxz, Dyz };
 
-  double M[9];
-  double eigVal[3], eigVec[9], fa, DTtrace;
+  forEachRow(InterleaveRow(m_Data, comp, m_Dims[0], true));
+}
 
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
+//----
+void TensorField::extractDTIcomponents(ScalarField *Dxx, ScalarField *Dyy, ScalarField *Dzz, ScalarField *Dxy, ScalarField *Dxz, ScalarField *Dyz)
+//----
+{
+  ScalarField *comp[6] = { Dxx, Dyy, Dzz, Dxy, Dxz, Dyz };
 
+  forEachRow(InterleaveRow(m_Data, comp, m_Dims[0], false));
+}
 
-  gsl_vector *eval ;
-  gsl_matrix *evec ;
-  
-  gsl_eigen_symmv_workspace  *w ;
-  
-  eval = gsl_vector_alloc (3);
-  evec = gsl_matrix_alloc (3, 3);
-   
-  w = gsl_eigen_symmv_alloc (3);
-    
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-
-	  M[0]= (double) m_Data[ind*6];
-	  M[4]= (double) m_Data[ind*6+1];
-	  M[8]= (double) m_Data[ind*6+2];
-	  M[1]= (double) m_Data[ind*6+3];
-	  M[2]= (double) m_Data[ind*6+4];
-	  M[5]= (double) m_Data[ind*6+5];
-	  M[3]= M[1];
-	  M[6]= M[2];
-	  M[7]= M[5];
-
-	  gsl_matrix_view m 
-	    = gsl_matrix_view_array (M, 3, 3);
-     
-	  gsl_eigen_symmv (&m.matrix, eval, evec, w);
-    
-	  gsl_eigen_symmv_sort (eval, evec, GSL_EIGEN_SORT_ABS_DESC);
-	 
-	  DTtrace= 0;
-	  for(i=0; i<3; i++)
-	    {
-	      eigVal[i] = gsl_vector_get (eval, i);
-	      DTtrace += eigVal[i];
 
-	      gsl_vector_view evec_i 
-                = gsl_matrix_column (evec, i);
 
-	      for(j=0; j<3; j++)
-		eigVec[i*3+j] = gsl_vector_get (&evec_i.vector, j);	     
-		  
-	    }
+/**
+ * the trace as the sum of the eigenvalues of the k-th tensor t of the batch
+ */
+static inline double eigTrace(const SymEigen3 &eig, int k, const float *t)
+{
+  double DTtrace = eig.eval[0][k] + eig.eval[1][k] + eig.eval[2][k];
 
 #ifdef _V2_
-	  double DTtrace2= M[0]+M[4]+M[8];  
-	  if(fabs(DTtrace2)<1e-20)
-	    DTtrace= 0;
+  double DTtrace2= (double) t[0] + t[1] + t[2];
+  if(fabs(DTtrace2)<1e-20)
+    DTtrace= 0;
 #endif
 
+  return DTtrace;
+}
 
-	  float *val;
-	  
-	  val= e1Field->getAt(ix,iy,iz);
-	  *val = eigVal[0];
-	  
-	  val= e2Field->getAt(ix,iy,iz);
-	  *val = eigVal[1];
-	  
-	  val= e3Field->getAt(ix,iy,iz);
-	  *val = eigVal[2];
+/**
+ * the FA of the k-th tensor of the batch, 0 for a non positive trace
+ */
+static inline double eigFA(const SymEigen3 &eig, int k, double DTtrace)
+{
+  if(!(DTtrace>0))
+    return 0;
 
-	  val= traceField->getAt(ix,iy,iz);
-	  *val = DTtrace;
+  double l0 = eig.eval[0][k], l1 = eig.eval[1][k], l2 = eig.eval[2][k];
+  double m = DTtrace/3;
+  double fa = sqrt(3.0/2.0*((l0-m)*(l0-m) + (l1-m)*(l1-m) + (l2-m)*(l2-m))/(l0*l0 + l1*l1 + l2*l2));
 
-	  if(DTtrace>0)
-	    fa = sqrt(3.0/2.0*((eigVal[0]-DTtrace/3)*(eigVal[0]-DTtrace/3) +  (eigVal[1]-DTtrace/3)*(eigVal[1]-DTtrace/3) + (eigVal[2]-DTtrace/3)*(eigVal[2]-DTtrace/3))/((eigVal[0]*eigVal[0]) +  (eigVal[1]*eigVal[1]) + (eigVal[2]*eigVal[2])));	  	  
-	  else
-	    fa=0;
+  // this can only happen due to negative eigenvalues
+  if(fa>1.0)
+    fa=1.0;
 
-	  // this can only happen due to negative eigenvalues
-	  if(fa>1.0)
-	    fa=1.0;
+  return fa;
+}
 
-	  //faField->setVal(ind,fa);
-	  val= faField->getAt(ix,iy,iz);
-	  *val = fa;
+/**
+ * V diag(d) V^T for the eigenvectors V of the k-th tensor of the batch,
+ * stored as (xx, yy, zz, xy, xz, yz)
+ */
+static inline void eigRecompose(const SymEigen3 &eig, int k, const double *d, float *val)
+{
+  double T[6] = {0, 0, 0, 0, 0, 0};
 
-	  for(j=0; j<3; j++)
-	    {
-	      val= PD1Field->getAt(ix,iy,iz);
-	      if(FAweighting)
-		val[j] = fa*eigVec[0*3+j];
-	      else
-		val[j] = eigVec[0*3+j];
-	  
-	      val= PD2Field->getAt(ix,iy,iz);
-	      if(FAweighting)
-		val[j] = fa*eigVec[1*3+j];
-	      else
-		val[j] = eigVec[1*3+j];
-	  
-	      val= PD3Field->getAt(ix,iy,iz);
-	      if(FAweighting)
-		val[j] = fa*eigVec[2*3+j];
-	      else
-		val[j] = eigVec[2*3+j];
-	    }
-	  
+  for(int i=0; i<3; i++)
+    {
+      double x = eig.evec[i][0][k], y = eig.evec[i][1][k], z = eig.evec[i][2][k];
+      T[0] += d[i]*x*x;
+      T[1] += d[i]*y*y;
+      T[2] += d[i]*z*z;
+      T[3] += d[i]*x*y;
+      T[4] += d[i]*x*z;
+      T[5] += d[i]*y*z;
+    }
 
-#ifdef _V2_
-	  if(DTtrace==0)
-	    {
-	      
-	      val= e1Field->getAt(ix,iy,iz);
-	      *val = 0;
-	      
-	      val= e2Field->getAt(ix,iy,iz);
-	      *val = 0;
-	      
-	      val= e3Field->getAt(ix,iy,iz);
-	      *val = 0;
-	      
-	      val= traceField->getAt(ix,iy,iz);
-	      *val = 0;
-
-	      val= faField->getAt(ix,iy,iz);
-	      *val = 0;
-
-	      for(j=0; j<3; j++)
-		{
-		  //PD1Field->setVal(ind*3+j,eigVec[0*3+j]);
-		  val= PD1Field->getAt(ix,iy,iz);
-		  val[j] = 0;
-		  //PD2Field->setVal(ind*3+j,eigVec[1*3+j]);
-		  val= PD2Field->getAt(ix,iy,iz);
-		  val[j] = 0;
-		  //PD3Field->setVal(ind*3+j,eigVec[2*3+j]);
-		  val= PD3Field->getAt(ix,iy,iz);
-		  val[j] = 0;
-		}
-	    }  
-#endif
+  for(int j=0; j<6; j++)
+    val[j] = (float) T[j];
+}
 
 
-	} 
+//----
+void TensorField::ComputeTrace(ScalarField *traceField)
+//----
+{
+  forEachRow(TraceRow(m_Data, traceField->getDataPtr(), m_Dims[0]));
+}
 
-  gsl_eigen_symmv_free ( w);
-  gsl_vector_free( eval);
-  gsl_matrix_free( evec);
   
-}
 
 
 void TensorField::EulerAngles2RotMat(double *RotMat, float phi, float theta, float psi)
@@ -1414,191 +1458,200 @@ void TensorField::RotMat2EulerAngles(const double *RotMat, float &phi, float &th
 }
 
 //----
-void TensorField::ComputeEigD(ScalarField *e1Field,ScalarField *e2Field,ScalarField *e3Field,VectorField *PD1Field,VectorField *PD2Field,VectorField *PD3Field, ScalarField *traceField, ScalarField *faField, int FAweighting, ScalarField *PhiField, ScalarField *ThetaField, ScalarField *PsiField)
+DTIMaps::DTIMaps()
 //----
 {
-  int ix, iy, iz, i, j;
-
-  double M[9];
-  double eigVal[3], eigVec[9], fa, DTtrace;
-
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-
-  gsl_vector *eval ;
-  gsl_matrix *evec ;
-  
-  gsl_eigen_symmv_workspace  *w ;
-  
-  eval = gsl_vector_alloc (3);
-  evec = gsl_matrix_alloc (3, 3);
-   
-  w = gsl_eigen_symmv_alloc (3);
-    
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-
-	  M[0]= (double) m_Data[ind*6];
-	  M[4]= (double) m_Data[ind*6+1];
-	  M[8]= (double) m_Data[ind*6+2];
-	  M[1]= (double) m_Data[ind*6+3];
-	  M[2]= (double) m_Data[ind*6+4];
-	  M[5]= (double) m_Data[ind*6+5];
-	  M[3]= M[1];
-	  M[6]= M[2];
-	  M[7]= M[5];
-
-	  gsl_matrix_view m 
-	    = gsl_matrix_view_array (M, 3, 3);
-     
-	  gsl_eigen_symmv (&m.matrix, eval, evec, w);
-    
-	  gsl_eigen_symmv_sort (eval, evec, GSL_EIGEN_SORT_ABS_DESC);
-	 
-	  DTtrace= 0;
-	  for(i=0; i<3; i++)
-	    {
-	      eigVal[i] = gsl_vector_get (eval, i);
-	      DTtrace += eigVal[i];
-
-	      gsl_vector_view evec_i 
-                = gsl_matrix_column (evec, i);
-
-	      for(j=0; j<3; j++)
-		eigVec[i*3+j] = gsl_vector_get (&evec_i.vector, j);	     
-		  
-	    }
+  fa = trace = 0;
+  for(int i=0; i<3; i++)
+    {
+      eigVal[i] = 0;
+      eigVec[i] = 0;
+      euler[i] = 0;
+    }
+  eigVecFAweighting = 0;
+  pd = 0;
+  pdIndex = 0;
+  pdFAweighting = 0;
+  rgba = 0;
+}
 
-#ifdef _V2_
-	  double DTtrace2= M[0]+M[4]+M[8];  
-	  if(fabs(DTtrace2)<1e-20)
-	    DTtrace= 0;
-#endif
+//----
+void TensorField::ComputeMaps(DTIMaps &maps)
+//----
+{
+  long nvox = (long) m_Dims[0]*m_Dims[1]*m_Dims[2];
 
+  float *fa_data = maps.fa ? maps.fa->getDataPtr() : 0;
+  float *trace_data = maps.trace ? maps.trace->getDataPtr() : 0;
+  float *pd_data = maps.pd ? maps.pd->getDataPtr() : 0;
+  float *e_data[3], *ev_data[3], *angle_data[3];
+  bool vectors = maps.pd || maps.rgba;
+  bool angles = false;
 
+  for(int i=0; i<3; i++)
+    {
+      e_data[i] = maps.eigVal[i] ? maps.eigVal[i]->getDataPtr() : 0;
+      ev_data[i] = maps.eigVec[i] ? maps.eigVec[i]->getDataPtr() : 0;
+      angle_data[i] = maps.euler[i] ? maps.euler[i]->getDataPtr() : 0;
+      vectors = vectors || ev_data[i] || angle_data[i];
+      angles = angles || angle_data[i];
+    }
 
-	  float *val;
-	  
-	  val= e1Field->getAt(ix,iy,iz);
-	  *val = eigVal[0];
-	  
-	  val= e2Field->getAt(ix,iy,iz);
-	  *val = eigVal[1];
-	  
-	  val= e3Field->getAt(ix,iy,iz);
-	  *val = eigVal[2];
+  // one pass over the tensors, decomposed SymEigen3::BatchSize at a time in
+  // storage order, fills all the requested maps
+#pragma omp parallel
+  {
+    SymEigen3 eig;
 
-	  val= traceField->getAt(ix,iy,iz);
-	  *val = DTtrace;
+#pragma omp for schedule(static)
+    for(long b=0; b<nvox; b+=SymEigen3::BatchSize)
+      {
+	int n = (nvox-b < SymEigen3::BatchSize) ? (int)(nvox-b) : SymEigen3::BatchSize;
+	const float *t = m_Data + 6*b;
 
-	  if(DTtrace>0)
-	    fa = sqrt(3.0/2.0*((eigVal[0]-DTtrace/3)*(eigVal[0]-DTtrace/3) +  (eigVal[1]-DTtrace/3)*(eigVal[1]-DTtrace/3) + (eigVal[2]-DTtrace/3)*(eigVal[2]-DTtrace/3))/((eigVal[0]*eigVal[0]) +  (eigVal[1]*eigVal[1]) + (eigVal[2]*eigVal[2])));	  	  
-	  else
-	    fa=0;
+	eig.compute(t, n, vectors);
 
-	  // this can only happen due to negative eigenvalues
-	  if(fa>1.0)
-	    fa=1.0;
+	for(int k=0; k<n; k++)
+	  {
+	    long ind = b+k;
+	    double DTtrace = eigTrace(eig, k, t+6*k);
+	    double fa = eigFA(eig, k, DTtrace);
 
-	  //faField->setVal(ind,fa);
-	  val= faField->getAt(ix,iy,iz);
-	  *val = fa;
+	    // the eigen system of a zero tensor is zeroed
+	    double s = 1.0;
+#ifdef _V2_
+	    if(DTtrace==0)
+	      s = 0;
+#endif
 
-	  for(j=0; j<3; j++)
-	    {
-	      val= PD1Field->getAt(ix,iy,iz);
-	      if(FAweighting)
-		val[j] = fa*eigVec[0*3+j];
-	      else
-		val[j] = eigVec[0*3+j];
-	  
-	      val= PD2Field->getAt(ix,iy,iz);
-	      if(FAweighting)
-		val[j] = fa*eigVec[1*3+j];
-	      else
-		val[j] = eigVec[1*3+j];
-	  
-	      val= PD3Field->getAt(ix,iy,iz);
-	      if(FAweighting)
-		val[j] = fa*eigVec[2*3+j];
-	      else
-		val[j] = eigVec[2*3+j];
-	    }
-	  
-	  float phi, theta, psi;
-	  RotMat2EulerAngles(eigVec, phi, theta, psi);
-	  val= PhiField->getAt(ix,iy,iz);
-	  val[0]= phi;
-	  val= ThetaField->getAt(ix,iy,iz);
-	  val[0]= theta;
-	  val= PsiField->getAt(ix,iy,iz);
-	  val[0]= psi;
+	    if(fa_data)
+	      fa_data[ind] = s*fa;
+	    if(trace_data)
+	      trace_data[ind] = s*DTtrace;
 
-#ifdef _V2_
-	  if(DTtrace==0)
-	    {
-	      
-	      val= e1Field->getAt(ix,iy,iz);
-	      *val = 0;
-	      
-	      val= e2Field->getAt(ix,iy,iz);
-	      *val = 0;
-	      
-	      val= e3Field->getAt(ix,iy,iz);
-	      *val = 0;
-	      
-	      val= traceField->getAt(ix,iy,iz);
-	      *val = 0;
-
-	      val= faField->getAt(ix,iy,iz);
-	      *val = 0;
-
-	      for(j=0; j<3; j++)
-		{
-		  //PD1Field->setVal(ind*3+j,eigVec[0*3+j]);
-		  val= PD1Field->getAt(ix,iy,iz);
-		  val[j] = 0;
-		  //PD2Field->setVal(ind*3+j,eigVec[1*3+j]);
-		  val= PD2Field->getAt(ix,iy,iz);
-		  val[j] = 0;
-		  //PD3Field->setVal(ind*3+j,eigVec[2*3+j]);
-		  val= PD3Field->getAt(ix,iy,iz);
-		  val[j] = 0;
-		}
+	    double w = maps.eigVecFAweighting ? s*fa : s;
+	    for(int i=0; i<3; i++)
+	      {
+		if(e_data[i])
+		  e_data[i][ind] = s*eig.eval[i][k];
+		if(ev_data[i])
+		  for(int j=0; j<3; j++)
+		    ev_data[i][ind*3+j] = w*eig.evec[i][j][k];
+	      }
 
-	       val= PhiField->getAt(ix,iy,iz);
-	       val[0]= 0;
-	       val= ThetaField->getAt(ix,iy,iz);
-	       val[0]= 0;
-	       val= PsiField->getAt(ix,iy,iz);
-	       val[0]= 0;
+	    if(angles)
+	      {
+		double eigVec[9];
+		float angle[3];
 
+		for(int i=0; i<3; i++)
+		  for(int j=0; j<3; j++)
+		    eigVec[i*3+j] = eig.evec[i][j][k];
+		RotMat2EulerAngles(eigVec, angle[0], angle[1], angle[2]);
 
-	    }  
-#endif
+		for(int i=0; i<3; i++)
+		  if(angle_data[i])
+		    angle_data[i][ind] = s*angle[i];
+	      }
 
-	  
+	    // the principal direction is zero for a non positive trace
+	    if(pd_data || maps.rgba)
+	      {
+		float PD[3] = {0, 0, 0};
+		if(DTtrace>0)
+		  {
+		    double wpd = (maps.pdFAweighting>0) ? fa : 1.0;
+		    for(int j=0; j<3; j++)
+		      PD[j] = wpd*eig.evec[maps.pdIndex][j][k];
+		  }
+
+		if(pd_data)
+		  for(int j=0; j<3; j++)
+		    pd_data[ind*3+j] = PD[j];
+
+		if(maps.rgba)
+		  {
+		    // as PDcolorMap: alpha, blue, green, red
+		    char *c = maps.rgba + 4*ind;
+		    float a = fabs(PD[0]), bb = fabs(PD[1]), cc = fabs(PD[2]);
+		    c[0] = c[1] = c[2] = c[3] = 0;
+		    if(a>0 || bb>0 || cc>0)
+		      {
+			// through int, a float above 127 does not fit a char
+			c[3] = (char)(int)(255.0f*a);
+			c[2] = (char)(int)(255.0f*bb);
+			c[1] = (char)(int)(255.0f*cc);
+			c[0] = (char)255;
+		      }
+		  }
+	      }
+	  }
+      }
+  }
+}
 
-	} 
+//----
+void TensorField::ComputeFA(ScalarField *faField)
+//----
+{
+  DTIMaps maps;
+  maps.fa = faField;
+  ComputeMaps(maps);
+}
 
-  gsl_eigen_symmv_free ( w);
-  gsl_vector_free( eval);
-  gsl_matrix_free( evec);
+//----
+void TensorField::ComputePD(VectorField *PDField, int d_index, int weight_flag)
+//----
+{
+  DTIMaps maps;
+  maps.pd = PDField;
+  maps.pdIndex = d_index;
+  maps.pdFAweighting = weight_flag;
+  ComputeMaps(maps);
+}
   
+//----
+void TensorField::ComputeEigD(ScalarField *e1Field,ScalarField *e2Field,ScalarField *e3Field,VectorField *PD1Field,VectorField *PD2Field,VectorField *PD3Field)
+//----
+{
+  DTIMaps maps;
+  maps.eigVal[0] = e1Field; maps.eigVal[1] = e2Field; maps.eigVal[2] = e3Field;
+  maps.eigVec[0] = PD1Field; maps.eigVec[1] = PD2Field; maps.eigVec[2] = PD3Field;
+  ComputeMaps(maps);
+}
+
+//----
+void TensorField::ComputeEigD(ScalarField *e1Field,ScalarField *e2Field,ScalarField *e3Field,VectorField *PD1Field,VectorField *PD2Field,VectorField *PD3Field, ScalarField *traceField, ScalarField *faField, int FAweighting)
+//----
+{
+  DTIMaps maps;
+  maps.eigVal[0] = e1Field; maps.eigVal[1] = e2Field; maps.eigVal[2] = e3Field;
+  maps.eigVec[0] = PD1Field; maps.eigVec[1] = PD2Field; maps.eigVec[2] = PD3Field;
+  maps.trace = traceField;
+  maps.fa = faField;
+  maps.eigVecFAweighting = FAweighting;
+  ComputeMaps(maps);
 }
 
+//----
+void TensorField::ComputeEigD(ScalarField *e1Field,ScalarField *e2Field,ScalarField *e3Field,VectorField *PD1Field,VectorField *PD2Field,VectorField *PD3Field, ScalarField *traceField, ScalarField *faField, int FAweighting, ScalarField *PhiField, ScalarField *ThetaField, ScalarField *PsiField)
+//----
+{
+  DTIMaps maps;
+  maps.eigVal[0] = e1Field; maps.eigVal[1] = e2Field; maps.eigVal[2] = e3Field;
+  maps.eigVec[0] = PD1Field; maps.eigVec[1] = PD2Field; maps.eigVec[2] = PD3Field;
+  maps.trace = traceField;
+  maps.fa = faField;
+  maps.eigVecFAweighting = FAweighting;
+  maps.euler[0] = PhiField; maps.euler[1] = ThetaField; maps.euler[2] = PsiField;
+  ComputeMaps(maps);
+}
 
 
 //----
 void TensorField::computeNZmask(unsigned char *mask, float threshold_factor)
 //----
 {
-  int ix, iy, iz, i, j;
-  
   int Xdim= m_Dims[0];
   int Ydim= m_Dims[1];
   int Zdim= m_Dims[2];
@@ -1608,488 +1661,217 @@ void TensorField::computeNZmask(unsigned char *mask, float threshold_factor)
 
   traceTensorThreshold = threshold_factor*cen_trace ;
 
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  float *val = getAt(ix,iy,iz);
-	  float trace = val[0]+val[1]+val[2];
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  
-	  if(trace > traceTensorThreshold)
-	    mask[ind]=1;
-	  else
-	    mask[ind]=0;
-	}
+  computeNZmask(mask);
 }
 
-
 //----
-void TensorField::logTField(TensorField *dti_out, unsigned char *mask)
+void TensorField::computeNZmask(unsigned char *mask)
 //----
 {
-  int ix, iy, iz, i, j;
-  
-  double M[9];
-  double eigVal[3], eigVec[9], logMat[9], fa, DTtrace;
-  
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-  
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-  
-  /*
-  TensorField dti_out;
-  
-  dti_out.init(Xdim,Ydim,Zdim);
-  dti_out.setVoxelSize(0,Xres); dti_out.setVoxelSize(1,Yres); dti_out.setVoxelSize(2,Zres);
-  */  
-  
-  gsl_vector *eval ;
-  gsl_matrix *evec ;
-  gsl_matrix *evec_trans ;
-  gsl_matrix *eval_mat ;
-  gsl_matrix *temp_mat ;
-  gsl_matrix *log_mat ;
-  gsl_eigen_symmv_workspace  *w ;
-  
-  eval = gsl_vector_alloc (3);
-  evec = gsl_matrix_alloc (3, 3);
-  evec_trans = gsl_matrix_alloc (3, 3);
-  eval_mat = gsl_matrix_alloc(3,3);
-  temp_mat = gsl_matrix_alloc(3,3);
-  log_mat = gsl_matrix_alloc(3,3);  
-
-  w = gsl_eigen_symmv_alloc (3);
-  
-  // first compute log of tensor 
-  // we store it temporarily into log
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  
-	  M[0]= (double) m_Data[ind*6];
-	  M[4]= (double) m_Data[ind*6+1];
-	  M[8]= (double) m_Data[ind*6+2];
-	  M[1]= (double) m_Data[ind*6+3];
-	  M[2]= (double) m_Data[ind*6+4];
-	  M[5]= (double) m_Data[ind*6+5];
-	  M[3]= M[1];
-	  M[6]= M[2];
-	  M[7]= M[5];	  	  
-
-	  DTtrace= M[0] +  M[4] +  M[8];
-
-	  if(mask[ind]==0 || DTtrace < traceTensorThreshold)
-	    {
-	      float *val= dti_out->getAt(ix,iy,iz);
-	      for(j=0; j<6; j++)
-		val[j]=0;
-	      continue;
-	    }
-
-
-	  gsl_matrix_view m 
-	    = gsl_matrix_view_array (M, 3, 3);
-	  
-	  gsl_eigen_symmv (&m.matrix, eval, evec, w);
-	  
-	  gsl_eigen_symmv_sort (eval, evec, GSL_EIGEN_SORT_ABS_DESC);
-	  
-	 
-	  for(i=0; i<3; i++)
-	    for(j=0; j<3; j++)
-	      gsl_matrix_set(eval_mat, i,j,0.0);
+  forEachRow(TraceMaskRow(m_Data, mask, m_Dims[0], traceTensorThreshold));
+}
 
 
-	  for(i=0; i<3; i++)
-	    {
-	      eigVal[i] = gsl_vector_get (eval, i);
-	      
-	      if(eigVal[i]>0.0)		
-		gsl_matrix_set(eval_mat, i,i,log(eigVal[i]));
-
-	      /*--
-	      gsl_vector_view evec_i 
-		= gsl_matrix_column (evec, i);
-	      
-	      for(j=0; j<3; j++)
-		eigVec[i*3+j] = gsl_vector_get (&evec_i.vector, j);	     
-		--*/
-	    }
-	  
-	  //form the log tensor and insert into dti_out
-	  //evec*eval_mat*evec_t;
-	  gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, evec, eval_mat, 0.0, temp_mat);	  
-	  gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, temp_mat, evec, 0.0, log_mat);
-	  for(i=0; i<3; i++)
-	    {	     	     
-	      for(j=0; j<3; j++)
-		logMat[i*3+j] = gsl_matrix_get (log_mat, i, j);	     
-	    }
-	  
-	  float *val= dti_out->getAt(ix,iy,iz);
-	  val[0]= (float) logMat[0] ;
-	  val[1]= (float) logMat[4] ;
-	  val[2]= (float) logMat[8] ;
-	  val[3]= (float) logMat[1] ;
-	  val[4]= (float) logMat[2] ;
-	  val[5]= (float) logMat[5] ;
+//----
+void TensorField::logTField(TensorField *dti_out, unsigned char *mask)
+//----
+{
+  long nvox = (long) m_Dims[0]*m_Dims[1]*m_Dims[2];
 
-	}
- 
+#pragma omp parallel for schedule(static)
+  for(long b=0; b<nvox; b+=SymEigen3::BatchSize)
+    logTField(dti_out, mask, b, (nvox-b < SymEigen3::BatchSize) ? nvox : b+SymEigen3::BatchSize);
+}
 
-  gsl_eigen_symmv_free ( w);
-  gsl_vector_free( eval);
-  gsl_matrix_free( evec);
-  gsl_matrix_free( eval_mat);
-  gsl_matrix_free( temp_mat);
-  gsl_matrix_free( log_mat);
+//----
+void TensorField::logTField(TensorField *dti_out, unsigned char *mask, long begin, long end)
+//----
+{
+  logTensors(m_Data + 6*begin, dti_out->getDataPtr() + 6*begin, mask + begin, end-begin, traceTensorThreshold);
+}
 
-  //  return(dti_out);
+//----
+void TensorField::expTField(TensorField *dti_out, unsigned char *mask)
+//----
+{
+  long nvox = (long) m_Dims[0]*m_Dims[1]*m_Dims[2];
+  float *out_data = dti_out->getDataPtr();
 
+#pragma omp parallel for schedule(static)
+  for(long b=0; b<nvox; b+=SymEigen3::BatchSize)
+    {
+      long n = (nvox-b < SymEigen3::BatchSize) ? nvox-b : SymEigen3::BatchSize;
+      expTensors(m_Data + 6*b, out_data + 6*b, mask + b, n);
+    }
 }
 
 //----
-void TensorField::expTField(TensorField *dti_out, unsigned char *mask)
+void TensorField::logTensors(const float *in, float *out, const unsigned char *mask, long nvox, float threshold)
 //----
 {
-  int ix, iy, iz, i, j;
-  
-  double M[9];
-  double eigVal[3], eigVec[9], expMat[9], fa;
-  
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-  
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-  
-  /*
-  TensorField dti_out;
-  
-  dti_out.init(Xdim,Ydim,Zdim);
-  dti_out.setVoxelSize(0,Xres); dti_out.setVoxelSize(1,Yres); dti_out.setVoxelSize(2,Zres);
-  */
-  
-  gsl_vector *eval ;
-  gsl_matrix *evec ;
-  gsl_matrix *evec_trans ;
-  gsl_matrix *eval_mat ;
-  gsl_matrix *temp_mat ;
-  gsl_matrix *exp_mat ;
-  gsl_eigen_symmv_workspace  *w ;
-  
-  eval = gsl_vector_alloc (3);
-  evec = gsl_matrix_alloc (3, 3);
-  evec_trans = gsl_matrix_alloc (3, 3);
-  eval_mat = gsl_matrix_alloc(3,3);
-  temp_mat = gsl_matrix_alloc(3,3);
-  exp_mat = gsl_matrix_alloc(3,3);  
-
-  w = gsl_eigen_symmv_alloc (3);
-  
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
+  SymEigen3 eig;
+
+  // a batch is decomposed before it is written, so out may be in
+  for(long b=0; b<nvox; b+=SymEigen3::BatchSize)
+    {
+      int n = (nvox-b < SymEigen3::BatchSize) ? (int)(nvox-b) : SymEigen3::BatchSize;
+      const float *t = in + 6*b;
+
+      eig.compute(t, n);
+
+      for(int k=0; k<n; k++)
 	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  
-	  M[0]= (double) m_Data[ind*6];
-	  M[4]= (double) m_Data[ind*6+1];
-	  M[8]= (double) m_Data[ind*6+2];
-	  M[1]= (double) m_Data[ind*6+3];
-	  M[2]= (double) m_Data[ind*6+4];
-	  M[5]= (double) m_Data[ind*6+5];
-	  M[3]= M[1];
-	  M[6]= M[2];
-	  M[7]= M[5];
-	  
-	  if(mask[ind]==0 || (M[0] +  M[4] +  M[8])==0)
+	  long ind = b+k;
+	  const float *tk = t + 6*k;
+	  float *val = out + 6*ind;
+	  double DTtrace = (double) tk[0] + tk[1] + tk[2];
+
+	  if(mask[ind]==0 || DTtrace < threshold)
 	    {
-	      float *val= dti_out->getAt(ix,iy,iz);
-	      for(j=0; j<6; j++)
+	      for(int j=0; j<6; j++)
 		val[j]=0;
 	      continue;
 	    }
 
+	  double d[3];
+	  for(int i=0; i<3; i++)
+	    d[i] = (eig.eval[i][k]>0.0) ? log(eig.eval[i][k]) : 0.0;
+
+	  eigRecompose(eig, k, d, val);
+	}
+    }
+}
 
-	  gsl_matrix_view m 
-	    = gsl_matrix_view_array (M, 3, 3);
-	  
-	  gsl_eigen_symmv (&m.matrix, eval, evec, w);
-	  
-	  gsl_eigen_symmv_sort (eval, evec, GSL_EIGEN_SORT_ABS_DESC);
-	  
-	  for(i=0; i<3; i++)
-	    for(j=0; j<3; j++)
-	      gsl_matrix_set(eval_mat, i,j,0.0);
+//----
+void TensorField::expTensors(const float *in, float *out, const unsigned char *mask, long nvox)
+//----
+{
+  SymEigen3 eig;
 
-	  for(i=0; i<3; i++)
-	    {
-	      eigVal[i] = gsl_vector_get (eval, i);
-	      
-	      gsl_matrix_set(eval_mat, i,i,exp(eigVal[i]));
-
-	      /*--
-	      gsl_vector_view evec_i 
-		= gsl_matrix_column (evec, i);
-	      
-	      for(j=0; j<3; j++)
-		eigVec[i*3+j] = gsl_vector_get (&evec_i.vector, j);	     
-		--*/
-	    }
-	  
-	  //form the exp tensor and insert into dti_out
-	  //evec*eval_mat*evec_t;
-	  gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, evec, eval_mat, 0.0, temp_mat);	  
-	  gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, temp_mat, evec, 0.0, exp_mat);
-	  for(i=0; i<3; i++)
-	    {	     	     
-	      for(j=0; j<3; j++)
-		expMat[i*3+j] = gsl_matrix_get (exp_mat, i, j);	     
-	    }
-	  	  
-	  float *val= dti_out->getAt(ix,iy,iz);
-	  val[0]= (float) expMat[0] ;
-	  val[1]= (float) expMat[4] ;
-	  val[2]= (float) expMat[8] ;
-	  val[3]= (float) expMat[1] ;
-	  val[4]= (float) expMat[2] ;
-	  val[5]= (float) expMat[5] ;
+  for(long b=0; b<nvox; b+=SymEigen3::BatchSize)
+    {
+      int n = (nvox-b < SymEigen3::BatchSize) ? (int)(nvox-b) : SymEigen3::BatchSize;
+      const float *t = in + 6*b;
 
-	}
+      eig.compute(t, n);
+
+      for(int k=0; k<n; k++)
+	{
+	  long ind = b+k;
+	  const float *tk = t + 6*k;
+	  float *val = out + 6*ind;
 
-  gsl_eigen_symmv_free ( w);
-  gsl_vector_free( eval);
-  gsl_matrix_free( evec);
-  gsl_matrix_free( eval_mat);
-  gsl_matrix_free( temp_mat);
-  gsl_matrix_free( exp_mat);
+	  if(mask[ind]==0 || ((double) tk[0] + tk[1] + tk[2])==0)
+	    {
+	      for(int j=0; j<6; j++)
+		val[j]=0;
+	      continue;
+	    }
 
-  // return(dti_out);
+	  double d[3];
+	  for(int i=0; i<3; i++)
+	    d[i] = exp(eig.eval[i][k]);
 
+	  eigRecompose(eig, k, d, val);
+	}
+    }
 }
 
 //----
-void TensorField::ESmooth(ScalarField *smoothingFilter, TensorField *dti_out)
+void TensorField::faTensors(const float *in, float *fa, long nvox)
 //----
 {
+  SymEigen3 eig;
 
-  int ix, iy, iz, i, j;
-  
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-  
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-  
-
-  int ix1, iy1, iz1;
-  int ix2, iy2, iz2;
-
-  int fXdim = smoothingFilter->getSize(0);
-  int fYdim = smoothingFilter->getSize(1);
-  int fZdim = smoothingFilter->getSize(2);
-
-  /*--
-  TensorField dti_out;
-  dti_out.init(Xdim,Ydim,Zdim);
-  dti_out.setVoxelSize(0,Xres); dti_out.setVoxelSize(1,Yres); dti_out.setVoxelSize(2,Zres);
-  --*/
+  // as ComputeMaps with only the FA map
+  for(long b=0; b<nvox; b+=SymEigen3::BatchSize)
+    {
+      int n = (nvox-b < SymEigen3::BatchSize) ? (int)(nvox-b) : SymEigen3::BatchSize;
+      const float *t = in + 6*b;
 
-  if(fXdim%2 ==0) { std::cout<<"Kernel size should be odd\n"; exit(0); }
-  if(fYdim%2 ==0) { std::cout<<"Kernel size should be odd\n"; exit(0); }
-  if(fZdim%2 ==0) { std::cout<<"Kernel size should be odd\n"; exit(0); }
+      eig.compute(t, n, false);
 
-  // assume kernel sizes are odd
-  
-  float *kernel_Data = smoothingFilter->getAt(0,0,0);
-  int order_x= (fXdim-1)/2;
-  int order_y= (fYdim-1)/2;
-  int order_z= (fZdim-1)/2;
+      for(int k=0; k<n; k++)
+	fa[b+k] = eigFA(eig, k, eigTrace(eig, k, t+6*k));
+    }
+}
 
-  for(ix=0; ix<Xdim; ix++)
+//----
+void TensorField::ESmooth(ScalarField *smoothingFilter, TensorField *dti_out)
+//----
+{
+  Smoother smoother;
+  if(smoother.init(smoothingFilter))
     {
-      for(iy=0; iy<Ydim; iy++)
-	for(iz=0; iz<Zdim; iz++)
-	  {
-	  
-	 
-	  float *val= dti_out->getAt(ix,iy,iz);
-	  for(j=0; j<6; j++)
-	    val[j] = 0.0;
+      ESmooth(smoother, dti_out);
+      return;
+    }
 
-	  if(ix < order_x || ix >= Xdim- order_x || iy<order_y || iy >= Ydim- order_y || iz<order_z || iz>=Zdim- order_z )
-	    continue;
 
-	  for(ix1=0; ix1<fXdim; ix1++)
-	    for(iy1=0; iy1<fYdim; iy1++)
-	      for(iz1=0; iz1<fZdim; iz1++)
-		{
-		  int ind1 = iz1*fXdim*fYdim + iy1*fXdim + ix1;
-
-		  ix2 = ix -ix1 + order_x;
-		  iy2 = iy -iy1 + order_y;
-		  iz2 = iz -iz1 + order_z;
-		  
-		  int ind = iz2*Xdim*Ydim + iy2*Xdim + ix2;
-		  
-		  for(j=0; j<6; j++)
-		    val[j] += kernel_Data[ind1]*m_Data[ind*6+j];
-     		}
-	  }
-      //std::cout<<ix<<" YZ slice smoothing done\n";
-    }
-  
+  if(smoothingFilter->getSize(0)%2 ==0) { std::cout<<"Kernel size should be odd\n"; exit(0); }
+  if(smoothingFilter->getSize(1)%2 ==0) { std::cout<<"Kernel size should be odd\n"; exit(0); }
+  if(smoothingFilter->getSize(2)%2 ==0) { std::cout<<"Kernel size should be odd\n"; exit(0); }
+
+  forEachRow(ConvolveRow<6>(m_Data, dti_out->getDataPtr(), m_Dims, smoothingFilter));
 }
 
 //----
 void TensorField::ESmooth(ScalarField *smoothingFilter, TensorField *dti_out,  unsigned char *mask)
 //----
 {
+  Smoother smoother;
+  if(smoother.init(smoothingFilter))
+    {
+      ESmooth(smoother, dti_out, mask);
+      return;
+    }
+
 
-  int ix, iy, iz, i, j;
-  
   int Xdim= m_Dims[0];
   int Ydim= m_Dims[1];
   int Zdim= m_Dims[2];
   
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-  
-  int ix1, iy1, iz1;
-  int ix2, iy2, iz2;
-
-  int fXdim = smoothingFilter->getSize(0);
-  int fYdim = smoothingFilter->getSize(1);
-  int fZdim = smoothingFilter->getSize(2);
-
-  
-
-  /*--
-  TensorField dti_out;
-  dti_out.init(Xdim,Ydim,Zdim);
-  dti_out.setVoxelSize(0,Xres); dti_out.setVoxelSize(1,Yres); dti_out.setVoxelSize(2,Zres);
-  --*/
-
-  if(fXdim%2 ==0) { std::cout<<"ESmooth: Kernel size should be odd\n"; exit(0); }
-  if(fYdim%2 ==0) { std::cout<<"ESmooth: Kernel size should be odd\n"; exit(0); }
-  if(fZdim%2 ==0) { std::cout<<"ESmooth: Kernel size should be odd\n"; exit(0); }
+  if(smoothingFilter->getSize(0)%2 ==0) { std::cout<<"ESmooth: Kernel size should be odd\n"; exit(0); }
+  if(smoothingFilter->getSize(1)%2 ==0) { std::cout<<"ESmooth: Kernel size should be odd\n"; exit(0); }
+  if(smoothingFilter->getSize(2)%2 ==0) { std::cout<<"ESmooth: Kernel size should be odd\n"; exit(0); }
 
 
   // first smooth the mask
   ScalarField mask_float;
   mask_float.init(Xdim,Ydim,Zdim);
-  mask_float.setVoxelSize(0,Xres); 
-  mask_float.setVoxelSize(1,Yres); 
-  mask_float.setVoxelSize(2,Zres);
+  mask_float.setVoxelSize(0,m_VoxelSize[0]); 
+  mask_float.setVoxelSize(1,m_VoxelSize[1]); 
+  mask_float.setVoxelSize(2,m_VoxelSize[2]);
 
   ScalarField mask_float_smooth;
   mask_float_smooth.init(Xdim,Ydim,Zdim);
-  mask_float_smooth.setVoxelSize(0,Xres); 
-  mask_float_smooth.setVoxelSize(1,Yres); 
-  mask_float_smooth.setVoxelSize(2,Zres);
-
+  mask_float_smooth.setVoxelSize(0,m_VoxelSize[0]); 
+  mask_float_smooth.setVoxelSize(1,m_VoxelSize[1]); 
+  mask_float_smooth.setVoxelSize(2,m_VoxelSize[2]);
 
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  float *mask_val = mask_float.getAt(ix,iy,iz);
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  mask_val[0] = (float) mask[ind];
-	}
+  float *mask_val = mask_float.getDataPtr();
+  for(long ind=0; ind<(long)Xdim*Ydim*Zdim; ind++)
+    mask_val[ind] = (float) mask[ind];
 	
   mask_float.Smooth(smoothingFilter, &mask_float_smooth);
-  // std::cout<<"Smooth mask computed\n";
-
-  // assume kernel sizes are odd
-  
-  float *kernel_Data = smoothingFilter->getAt(0,0,0);
-  int order_x= (fXdim-1)/2;
-  int order_y= (fYdim-1)/2;
-  int order_z= (fZdim-1)/2;
-
-  for(ix=0; ix<Xdim; ix++)
-    {
-      for(iy=0; iy<Ydim; iy++)
-	for(iz=0; iz<Zdim; iz++)
-	  {
-	  
-	 
-	  float *val= dti_out->getAt(ix,iy,iz);
-	  for(j=0; j<6; j++)
-	    val[j] = 0.0;
-
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  if(mask[ind]==0)
-	    continue;
-
-	  if(ix < order_x || ix >= Xdim- order_x || iy<order_y || iy >= Ydim- order_y || iz<order_z || iz>=Zdim- order_z )
-	    continue;
 
-	  for(ix1=0; ix1<fXdim; ix1++)
-	    for(iy1=0; iy1<fYdim; iy1++)
-	      for(iz1=0; iz1<fZdim; iz1++)
-		{
-		  int ind1 = iz1*fXdim*fYdim + iy1*fXdim + ix1;
-
-		  ix2 = ix -ix1 + order_x;
-		  iy2 = iy -iy1 + order_y;
-		  iz2 = iz -iz1 + order_z;
-		  
-		  int ind = iz2*Xdim*Ydim + iy2*Xdim + ix2;
-		  
-		  for(j=0; j<6; j++)
-		    val[j] += kernel_Data[ind1]*m_Data[ind*6+j];
-     		}
-	  }
-      //std::cout<<ix<<" YZ slice smoothing done\n";
-    }
+  forEachRow(ConvolveRow<6>(m_Data, dti_out->getDataPtr(), m_Dims, smoothingFilter, mask));
   
   // normalize with smooth mask
-  for(ix=0; ix<Xdim; ix++)
-    {
-      for(iy=0; iy<Ydim; iy++)
-	for(iz=0; iz<Zdim; iz++)
-	  {
-	    float *val= dti_out->getAt(ix,iy,iz);
-	    
-	    int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	    if(mask[ind]==0)
-	      continue;
-
-	    float *mask_smooth_val = mask_float_smooth.getAt(ix,iy,iz);
-	    
-	    if(mask_smooth_val[0]>0)
-	      for(j=0; j<6; j++)
-		val[j] /= mask_smooth_val[0];
-	  }
-    }
-  // std::cout<<"Normalization with smooth mask done\n";
-
+  forEachRow(NormalizeRow<6>(dti_out->getDataPtr(), mask_float_smooth.getDataPtr(), Xdim, mask));
 }
 
 //----
 void TensorField::logESmooth(ScalarField *smoothingFilter, TensorField *dti_out)
 //----
 {
-  int ix, iy, iz, i, j;
-  
-  double M[9];
-  double eigVal[3], eigVec[9], logMat[9], fa;
-  
+  Smoother smoother;
+  if(smoother.init(smoothingFilter))
+    {
+      logESmooth(smoother, dti_out);
+      return;
+    }
+
   int Xdim= m_Dims[0];
   int Ydim= m_Dims[1];
   int Zdim= m_Dims[2];
@@ -2115,8 +1897,6 @@ void TensorField::logESmooth(ScalarField *smoothingFilter, TensorField *dti_out)
   // note magic number 0.001
   computeNZmask(mask,0.001);
 
-  char str[200];
-
   // first compute log of tensor 
   logTField(&dti_out1, mask);
   //std::cout<<"Log Tensor Field computed\n";  
@@ -2144,188 +1924,67 @@ void TensorField::logESmooth(ScalarField *smoothingFilter, TensorField *dti_out)
 }
 
 //----
-void TensorField::reOrientTensorFieldFS(VectorField *warpField, TensorField *dti_out)
+void TensorField::ESmooth(const Smoother &smoother, TensorField *dti_out, unsigned char *mask)
+//----
+{
+  smoother.apply(m_Data, dti_out->getDataPtr(), m_Dims, 6, mask);
+}
+
+//----
+void TensorField::logESmooth(const Smoother &smoother, TensorField *dti_out)
 //----
 {
-  int ix, iy, iz, i, j;
- 
-  double M[9];
-  
   int Xdim= m_Dims[0];
   int Ydim= m_Dims[1];
   int Zdim= m_Dims[2];
   
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-     
-  double U[9]; double outMat[9];
-  
-  gsl_vector *temp_vec1 ;
-  gsl_vector *temp_vec2 ;
-  gsl_matrix *temp_mat1 ;
-  gsl_matrix *temp_mat2 ;
-  gsl_matrix *temp_mat3 ;
-  gsl_eigen_symmv_workspace  *w ;
-  
-  temp_vec1 = gsl_vector_alloc(3);
-  temp_vec2 = gsl_vector_alloc(3);
-  temp_mat1 = gsl_matrix_alloc(3,3);
-  temp_mat2 = gsl_matrix_alloc(3,3);
-  temp_mat3 = gsl_matrix_alloc(3,3);  
-  w = gsl_eigen_symmv_alloc (3);
-  
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	
-	  //Step 1: estimate rotation with the Finite Strain approximation----
-	  
-	  // Step 1a: get Jacobian
-	  // here we assume warp field vectors map old grid to new grid
-	  // here we store transpose of Jacobian in temp_mat1
-	  for(i=0; i<3; i++)
-	    for(j=0; j<3; j++)
-	      {
-		if(i==j)
-		  gsl_matrix_set(temp_mat1,i,j,1.0);
-		else
-		  gsl_matrix_set(temp_mat1,i,j,0.0);
-	      }
-
-	  if(ix<Xdim-1 && iy<Ydim-1 && iz<Zdim-1)
-	    {
-	      float *warpField_val = warpField->getAt(ix,iy,iz);
-	      float *warpField_val2;
-	      for(i=0; i<3; i++) // index column: old grid
-		{ 
-		  switch(i)
-		    {
-		    case 0:
-		      warpField_val2 = warpField->getAt(ix+1,iy,iz);
-		      break;
-		    case 1:
-		      warpField_val2 = warpField->getAt(ix,iy+1,iz);
-		      break;
-		    case 2:
-		      warpField_val2 = warpField->getAt(ix,iy,iz+1);
-		      break;
-		    }
-		  for(j=0; j<3; j++) // index row: new grid
-		    {
-		      float diff = warpField_val2[j] - warpField_val[j]; 
-		      gsl_matrix_set(temp_mat1,i,j,diff);
-		    }
-
-		   if(ix== Xdim/2+13 && iy== Ydim/2+13 && iz==Zdim/2+13)
-		     {
-		       std::cout<<"Field at "<<ix << "," << iy << "," <<iz<< "\n";
-		       for(j=0; j<3; j++)
-			 std::cout<<warpField_val2[j]<<" ";
-		       std::cout<<"\n";
-		     }
-		}
-	    }
-	    
-	  // for debug
-	  if(ix== Xdim/2+13 && iy== Ydim/2+13 && iz==Zdim/2+13)
-	    {
-	      
-	      std::cout<<"Estimated Jacobian at "<< ix << "," << iy << "," <<iz<< "\n";
-	      for(int pi=0; pi<3; pi++)
-		std::cout<<gsl_matrix_get(temp_mat1,0,pi)<<" "<<gsl_matrix_get(temp_mat1,1,pi)<<" "<<gsl_matrix_get(temp_mat1,2,pi)<<"\n";
-	      
-	    }
-
-	  // Step 1b: get rotation component
-
-	  gsl_linalg_SV_decomp (temp_mat1, temp_mat3, temp_vec1, temp_vec2);
-	  gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, temp_mat1, temp_mat3, 0.0, temp_mat2);
-
-	    /*-- this was a wrong idea --- QR of Jac*OrigEV is related to PPD 
-	  gsl_linalg_QR_decomp (temp_mat1, temp_vec1);
-	  gsl_linalg_QR_unpack (temp_mat1, temp_vec1, temp_mat2, temp_mat3);
-	  --*/
-
-	  for(i=0; i<3; i++)
-	    for(j=0; j<3; j++)
-	      U[i*3+j] = gsl_matrix_get(temp_mat2, j,i);
-	      //U[i*3+j] = gsl_matrix_get(temp_mat2, i,j);
-	  
+  TensorField dti_log;
+  dti_log.init(Xdim,Ydim,Zdim);
+  dti_log.setVoxelSize(0,m_VoxelSize[0]); 
+  dti_log.setVoxelSize(1,m_VoxelSize[1]); 
+  dti_log.setVoxelSize(2,m_VoxelSize[2]);
 
-	  // for debug
-	  if(ix== Xdim/2+13 && iy== Ydim/2+13 && iz==Zdim/2+13)
-	    {
-	      std::cout<<"Estimated Rotation at "<<ix<<","<<iy<<","<<iz<<"\n";
-	      for(int pi=0; pi<3; pi++)
-		std::cout<<gsl_matrix_get(temp_mat2,0,pi)<<" "<<gsl_matrix_get(temp_mat2,1,pi)<<" "<<gsl_matrix_get(temp_mat2,2,pi)<<"\n";
-	      
-	    }
-
-
-	  //Step 2: apply rotation ----
+  unsigned char *mask= (unsigned char *)calloc(Xdim*Ydim*Zdim, sizeof(unsigned char));
 
-	  M[0]= (double) m_Data[ind*6];
-	  M[4]= (double) m_Data[ind*6+1];
-	  M[8]= (double) m_Data[ind*6+2];
-	  M[1]= (double) m_Data[ind*6+3];
-	  M[2]= (double) m_Data[ind*6+4];
-	  M[5]= (double) m_Data[ind*6+5];
-	  M[3]= M[1];
-	  M[6]= M[2];
-	  M[7]= M[5];
+  // note magic number 0.001, as in logESmooth with a 3-d filter
+  computeNZmask(mask,0.001);
 
-	   for(i=0; i<3; i++)
-	    for(j=0; j<3; j++)
-	      {
-		gsl_matrix_set(temp_mat1, i,j, U[i*3+j]); //rotation
-		gsl_matrix_set(temp_mat2, i,j, M[i*3+j]); // original tensor
-	      }
+  logTField(&dti_log, mask);
 
-	  gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, temp_mat1, temp_mat2, 0.0, temp_mat3);
-	  gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, temp_mat3, temp_mat1, 0.0, temp_mat2);
+  // the log tensors are smoothed in place
+  dti_log.ESmooth(smoother, &dti_log, mask);
 
-	  
-	  for(i=0; i<3; i++)
-	    {	     	     
-	      for(j=0; j<3; j++)
-		outMat[i*3+j] = gsl_matrix_get (temp_mat2, i, j);	     
-	    }
-	  
-	   // for debug
-	  if(ix== Xdim/2+13 && iy== Ydim/2+13 && iz==Zdim/2+13)
-	    {
-	      std::cout<<"Original Tensor at "<<ix<<","<<iy<<","<<iz<<"\n";
-	      for(int pi=0; pi<3; pi++)
-		std::cout<<M[pi*3]<<" "<<M[pi*3+1]<<" "<<M[pi*3+2]<<"\n";
-
-	      std::cout<<"Rotated Tensor at "<<ix<<","<<iy<<","<<iz<<"\n";
-	      for(int pi=0; pi<3; pi++)
-		std::cout<<outMat[pi*3]<<" "<<outMat[pi*3+1]<<" "<<outMat[pi*3+2]<<"\n";
-	      
-	    }
+  dti_log.expTField(dti_out, mask );
 
-	  
-	  float *val= dti_out->getAt(ix,iy,iz);
-	  val[0]= (float) outMat[0] ;
-	  val[1]= (float) outMat[4] ;
-	  val[2]= (float) outMat[8] ;
-	  val[3]= (float) outMat[1] ;
-	  val[4]= (float) outMat[2] ;
-	  val[5]= (float) outMat[5] ;
+  free(mask);
+}
 
+//----
+void TensorField::reOrientTensorFieldFS(VectorField *warpField, TensorField *dti_out)
+//----
+{
+  RotationField rotField;
+  rotField.init(m_Dims[0],m_Dims[1],m_Dims[2]);
 
-	}
+  rotField.ComputeFSRotations(warpField);
+  reOrientTensorField(&rotField, dti_out);
+}
 
-  gsl_eigen_symmv_free ( w);  
-  gsl_vector_free( temp_vec1);
-  gsl_vector_free( temp_vec2);
-  gsl_matrix_free( temp_mat1);
-  gsl_matrix_free( temp_mat2);
-  gsl_matrix_free( temp_mat3);
+//----
+void TensorField::reOrientTensorField(RotationField *rotField, TensorField *dti_out)
+//----
+{
+  // a voxel is read before it is written, so dti_out may be this field
+  forEachRow(RotateRow(m_Data, rotField->getDataPtr(), dti_out->getDataPtr(), m_Dims[0]));
+}
 
+//----
+void RotationField::ComputeFSRotations(VectorField *warpField)
+//----
+{
+  // Step 1: estimate rotation with the Finite Strain approximation
+  // here we assume warp field vectors map old grid to new grid
+  forEachRow(FSRotationRow(warpField, m_Data));
 }
 
 //----
@@ -2334,397 +1993,90 @@ void TensorField::displaceTensorFieldUsingInvFieldTL(VectorField *warpField, Ten
 // here, we warp subject to template using template2subject field
 //  we use tri-linear interpolation here
 {
-  int ix, iy, iz, i, j;
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-  
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-
-  
-  int ix_subject, iy_subject, iz_subject;
-  int ix1, iy1, iz1, ix2, iy2, iz2;
- 
   // (ix,iy,iz) is a position in template domain
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  
-	  float *val= dti_out->getAt(ix,iy,iz);
-	  for(j=0; j<6; j++)
-	    val[j] = 0.0f;
-
-	 
-	  float *warpField_val = warpField->getAt(ix,iy,iz);
-	  ix_subject = floor(warpField_val[0]);
-	  iy_subject = floor(warpField_val[1]);
-	  iz_subject = floor(warpField_val[2]);
-	  
-	  if(ix_subject < 0 || ix_subject >= Xdim || iy_subject< 0 || iy_subject >= Ydim || iz_subject< 0 || iz_subject>=Zdim)
-	    {	      
-	      continue;
-	    }
-	
-	  float tl_x = warpField_val[0]- ix_subject;
-	  float tl_y = warpField_val[1]- iy_subject;
-	  float tl_z = warpField_val[2]- iz_subject;
-				
-	  float ww[8];
-	  
-	  ww[0] = (1-tl_x)*(1-tl_y)*(1-tl_z);
-	  ww[1] = tl_x*(1-tl_y)*(1-tl_z);
-	  ww[2] = tl_x*tl_y*(1-tl_z);
-	  ww[3] = (1-tl_x)*tl_y*(1-tl_z);
-	  ww[4] = (1-tl_x)*(1-tl_y)*tl_z;
-	  ww[5] = tl_x*(1-tl_y)*tl_z;
-	  ww[6] = tl_x*tl_y*tl_z;
-	  ww[7] = (1-tl_x)*tl_y*tl_z;
-	  
-	  for(i=0; i<6; i++)		  
-	    {
-	      float *dt_val0= this->getAt(ix_subject, iy_subject, iz_subject);
-	      float *dt_val1= this->getAt(ix_subject+1, iy_subject, iz_subject);
-	      float *dt_val2= this->getAt(ix_subject+1, iy_subject+1, iz_subject);
-	      float *dt_val3= this->getAt(ix_subject, iy_subject+1, iz_subject);
-	      float *dt_val4= this->getAt(ix_subject, iy_subject, iz_subject+1);
-	      float *dt_val5= this->getAt(ix_subject+1, iy_subject, iz_subject+1);
-	      float *dt_val6= this->getAt(ix_subject+1, iy_subject+1, iz_subject+1);
-	      float *dt_val7= this->getAt(ix_subject, iy_subject+1, iz_subject+1);
-	      
-	      val[i] = ww[0]*dt_val0[i] + ww[1]*dt_val1[i] + ww[2]*dt_val2[i] + ww[3]*dt_val3[i] + ww[4]*dt_val4[i] + ww[5]*dt_val5[i] + ww[6]*dt_val6[i] + ww[7]*dt_val7[i] ;
-
-	    }
-  	
-	}
-
+  forEachRow(TrilinearRow(this, warpField, dti_out));
 }
 
 
 //----
-void TensorField::displaceTensorFieldUsingInvField(VectorField *warpField, TensorField *dti_out, float sigma, float filter_size_red_factor)
+void TensorField::displaceTensorFieldUsingInvField(VectorField *warpField, TensorField *dti_out, float sigma, float filter_size_red_factor, bool logEuclidean)
 //----
 // here, we warp subject to template using template2subject field
 //  do trunc-Gaussian interpolation with appropriate normalization
-// (in future we may do trunc-Gaussian interpolation in Log-Euclidean domain) 
 {
-  int ix, iy, iz, i, j;
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-  
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-
-  int fXdim = Xdim/filter_size_red_factor/Xres;
-  int fYdim = Ydim/filter_size_red_factor/Yres;
-  int fZdim = Zdim/filter_size_red_factor/Zres;
-   
-  if(fXdim%2==0) fXdim +=1;
-  if(fYdim%2==0) fYdim +=1;
-  if(fZdim%2==0) fZdim +=1;
-  
-  ScalarField smoothFilter;
-  
-  smoothFilter.init(fXdim,fYdim,fZdim);
-  smoothFilter.setVoxelSize(0,Xres); 
-  smoothFilter.setVoxelSize(1,Yres); 
-  smoothFilter.setVoxelSize(2,Zres);
- 
-  smoothFilter.ComputeSmoothingFilter(sigma);
-    
-  // assume kernel sizes are odd
-  
-  float *kernel_Data = smoothFilter.getAt(0,0,0);
-  int order_x= (fXdim-1)/2;
-  int order_y= (fYdim-1)/2;
-  int order_z= (fZdim-1)/2;
-
-  int ix_subject, iy_subject, iz_subject;
-  int ix1, iy1, iz1, ix2, iy2, iz2;
-
-  // create a unity mask for normalization
-  
-  ScalarField mask_float;
-  mask_float.init(Xdim,Ydim,Zdim);
-  mask_float.setVoxelSize(0,Xres); 
-  mask_float.setVoxelSize(1,Yres); 
-  mask_float.setVoxelSize(2,Zres);
-
-  ScalarField mask_float_smooth;
-  mask_float_smooth.init(Xdim,Ydim,Zdim);
-  mask_float_smooth.setVoxelSize(0,Xres); 
-  mask_float_smooth.setVoxelSize(1,Yres); 
-  mask_float_smooth.setVoxelSize(2,Zres);
+  int half[3];
+  GaussianHalfWidths(m_Dims, m_VoxelSize, sigma, filter_size_red_factor, half);
 
-
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  float *mask_val = mask_float.getAt(ix,iy,iz);	  
-	  mask_val[0] = (float) 1.0;
-	}
-	
   // (ix,iy,iz) is a position in template domain
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  
-	  float *val= dti_out->getAt(ix,iy,iz);
-	  for(j=0; j<6; j++)
-	    val[j] = 0.0f;
-
-	  float *mask_float_smooth_val = mask_float_smooth.getAt(ix,iy,iz);
-	  
-	  float *warpField_val = warpField->getAt(ix,iy,iz);
-	  ix_subject = rint(warpField_val[0]);
-	  iy_subject = rint(warpField_val[1]);
-	  iz_subject = rint(warpField_val[2]);
-
-	  
-	  if(ix_subject < 0 || ix_subject >= Xdim || iy_subject< 0 || iy_subject >= Ydim || iz_subject< 0 || iz_subject>=Zdim)
-	    {
-	      //std::cout<<"Voxel ("<<ix<<","<<iy<<","<<iz<<") mapped outside\n";
-	      continue;
-	    }
-	  
-	  smoothFilter.ComputeSmoothingFilter(sigma, warpField_val[0]-ix_subject + order_x, warpField_val[1]-iy_subject + order_y, warpField_val[2]-iz_subject + order_z );    
-
-
-	  // do trunc-Gaussian interpolation
-	  for(ix1=0; ix1<fXdim; ix1++)
-	    for(iy1=0; iy1<fYdim; iy1++)
-	      for(iz1=0; iz1<fZdim; iz1++)
-		{
-		  int ind1 = iz1*fXdim*fYdim + iy1*fXdim + ix1;
-		  
-		  ix2 = ix_subject -ix1 + order_x;
-		  iy2 = iy_subject -iy1 + order_y;
-		  iz2 = iz_subject -iz1 + order_z;
-		  
-		  if(ix2 < 0 || ix2 >= Xdim || iy2< 0 || iy2 >= Ydim || iz2< 0 || iz2>=Zdim)
-		    continue;
-
-		  float *val_subject= getAt(ix2,iy2,iz2);
-		  
-		  for(j=0; j<6; j++)
-		    val[j] += kernel_Data[ind1]*val_subject[j];
-
+  if(!logEuclidean)
+    forEachRow(GaussianGatherRow(m_Data, 0, m_Dims, m_VoxelSize, warpField, dti_out->getDataPtr(), 0, sigma, half));
+  else
+    {
+      // only the non-zero tensors are interpolated
+      long nvox = (long)m_Dims[0]*m_Dims[1]*m_Dims[2];
+      unsigned char *mask = (unsigned char *)calloc(nvox, sizeof(unsigned char));
+      unsigned char *mask_out = (unsigned char *)calloc(nvox, sizeof(unsigned char));
 
-		  float *mask_float_val = mask_float.getAt(ix2,iy2,iz2);
+      TensorField dti_log;
+      dti_log.init(m_Dims[0],m_Dims[1],m_Dims[2]);
+      computeNZmask(mask, 0.001);
+      logTField(&dti_log, mask);
 
-		  mask_float_smooth_val[0] += kernel_Data[ind1]*mask_float_val[0];
-		}
-	  
-	  // pointwise division for normalization
-	  if(mask_float_smooth_val[0] > 0)
-	    for(j=0; j<6; j++)
-	      val[j] /= mask_float_smooth_val[0];
+      forEachRow(GaussianGatherRow(dti_log.getDataPtr(), mask, m_Dims, m_VoxelSize, warpField, dti_out->getDataPtr(), mask_out, sigma, half));
+      dti_out->expTField(dti_out, mask_out);
 
-	}
+      free(mask);
+      free(mask_out);
+    }
 
   // drop all tensors where trace falls below a threshold
 
-  float *test_trace_val = dti_out->getAt(Zdim/2,Ydim/2,Zdim/2);
+  float *test_trace_val = dti_out->getAt(m_Dims[0]/2,m_Dims[1]/2,m_Dims[2]/2);
   float trace_cen = test_trace_val[0] + test_trace_val[1] + test_trace_val[2] ;
 
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  
-	  float *val= dti_out->getAt(ix,iy,iz);
-	  
-	  float trace = val[0]+val[1]+val[2];
-
-	  if(trace < 0.01*trace_cen)
-	    
-	  for(j=0; j<6; j++)
-	    val[j] = 0.0f;
-
-	}
-
-
+  forEachRow(DropTraceRow(dti_out->getDataPtr(), m_Dims[0], 0.01*trace_cen));
 }
 
 
 //----
-void TensorField::displaceTensorFieldUsingFwdField(VectorField *warpField, TensorField *dti_out, float sigma, float filter_size_red_factor)
+void TensorField::displaceTensorFieldUsingFwdField(VectorField *warpField, TensorField *dti_out, float sigma, float filter_size_red_factor, bool logEuclidean)
 //----
 // here, we warp subject to template using subject2template field
 // do trunc-Gaussian interpolation  with appropriate normalization
-// (in future we may do trunc-Gaussian interpolation in Log-Euclidean domain)  
 {
-  int ix, iy, iz, i, j;
-  int Xdim= m_Dims[0];
-  int Ydim= m_Dims[1];
-  int Zdim= m_Dims[2];
-  
-  float Xres = m_VoxelSize[0];
-  float Yres = m_VoxelSize[1];
-  float Zres = m_VoxelSize[2];
-  
-  int fXdim = Xdim/filter_size_red_factor/Xres;
-  int fYdim = Ydim/filter_size_red_factor/Yres;
-  int fZdim = Zdim/filter_size_red_factor/Zres;
-   
-  if(fXdim%2==0) fXdim +=1;
-  if(fYdim%2==0) fYdim +=1;
-  if(fZdim%2==0) fZdim +=1;
-  
-  ScalarField smoothFilter;
-  
-  smoothFilter.init(fXdim,fYdim,fZdim);
-  smoothFilter.setVoxelSize(0,Xres); 
-  smoothFilter.setVoxelSize(1,Yres); 
-  smoothFilter.setVoxelSize(2,Zres);
- 
-  smoothFilter.ComputeSmoothingFilter(sigma);
-    
-  // assume kernel sizes are odd
-  
-  float *kernel_Data = smoothFilter.getAt(0,0,0);
-  int order_x= (fXdim-1)/2;
-  int order_y= (fYdim-1)/2;
-  int order_z= (fZdim-1)/2;
+  int half[3];
+  GaussianHalfWidths(m_Dims, m_VoxelSize, sigma, filter_size_red_factor, half);
 
-  int ix_template, iy_template, iz_template;
-  int ix1, iy1, iz1, ix2, iy2, iz2;
+  // the subject voxels binned by the template row they land in
+  SplatHash hash(warpField, m_VoxelSize, sigma, half);
 
-  // initialize to zero
   // (ix,iy,iz) is a position in template domain
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  
-	  float *val= dti_out->getAt(ix,iy,iz);
-	  for(j=0; j<6; j++)
-	    val[j] = 0.0f;
-	}
-
-  // create a unity mask for normalization
-  
-  ScalarField mask_float;
-  mask_float.init(Xdim,Ydim,Zdim);
-  mask_float.setVoxelSize(0,Xres); 
-  mask_float.setVoxelSize(1,Yres); 
-  mask_float.setVoxelSize(2,Zres);
-
-  ScalarField mask_float_smooth;
-  mask_float_smooth.init(Xdim,Ydim,Zdim);
-  mask_float_smooth.setVoxelSize(0,Xres); 
-  mask_float_smooth.setVoxelSize(1,Yres); 
-  mask_float_smooth.setVoxelSize(2,Zres);
-
-
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  float *mask_val = mask_float.getAt(ix,iy,iz);	  
-	  mask_val[0] = (float) 1.0;
-	}
-	
-
-  // (ix,iy,iz) is now a position in subject domain
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  
-	  float *warpField_val = warpField->getAt(ix,iy,iz);
-	  ix_template = rint(warpField_val[0]);
-	  iy_template = rint(warpField_val[1]);
-	  iz_template = rint(warpField_val[2]);
-	  
-	  if(ix_template < 0 || ix_template >= Xdim || iy_template< 0 || iy_template >= Ydim || iz_template< 0 || iz_template>=Zdim)
-	     continue;
-
-	  smoothFilter.ComputeSmoothingFilter(sigma, warpField_val[0]-ix_template + order_x, warpField_val[1]-iy_template + order_y, warpField_val[2]-iz_template + order_z );    
-
-
-	  float *mask_float_val= mask_float.getAt(ix,iy,iz);
-
-	  // do trunc-Gaussian interpolation
-	  for(ix1=0; ix1<fXdim; ix1++)
-	    for(iy1=0; iy1<fYdim; iy1++)
-	      for(iz1=0; iz1<fZdim; iz1++)
-		{
-		  int ind1 = iz1*fXdim*fYdim + iy1*fXdim + ix1;
-		  
-		  ix2 = ix_template -ix1 + order_x;
-		  iy2 = iy_template -iy1 + order_y;
-		  iz2 = iz_template -iz1 + order_z;
-		  
-		  if(ix2 < 0 || ix2 >= Xdim || iy2< 0 || iy2 >= Ydim || iz2< 0 || iz2>=Zdim)
-		    continue;
-
-
-		  float *val= dti_out->getAt(ix2,iy2,iz2);
-		  for(j=0; j<6; j++)
-		    val[j] += kernel_Data[ind1]*m_Data[ind*6+j];
-
-
-		  float *mask_float_smooth_val= mask_float_smooth.getAt(ix2,iy2,iz2);
+  if(!logEuclidean)
+    forEachRow(GaussianSplatRow(m_Data, 0, m_Dims, m_VoxelSize, warpField, &hash, dti_out->getDataPtr(), 0, sigma, half));
+  else
+    {
+      // only the non-zero tensors are interpolated
+      long nvox = (long)m_Dims[0]*m_Dims[1]*m_Dims[2];
+      unsigned char *mask = (unsigned char *)calloc(nvox, sizeof(unsigned char));
+      unsigned char *mask_out = (unsigned char *)calloc(nvox, sizeof(unsigned char));
 
-		  mask_float_smooth_val[0] += kernel_Data[ind1]*mask_float_val[0];
+      TensorField dti_log;
+      dti_log.init(m_Dims[0],m_Dims[1],m_Dims[2]);
+      computeNZmask(mask, 0.001);
+      logTField(&dti_log, mask);
 
-		}	  
-	  
-	}
+      forEachRow(GaussianSplatRow(dti_log.getDataPtr(), mask, m_Dims, m_VoxelSize, warpField, &hash, dti_out->getDataPtr(), mask_out, sigma, half));
+      dti_out->expTField(dti_out, mask_out);
 
-  // point-wise normalization
+      free(mask);
+      free(mask_out);
+    }
 
-  // (ix,iy,iz) is a position in template domain
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  
-	  float *val= dti_out->getAt(ix,iy,iz);
-	  
-	  float *mask_float_smooth_val= mask_float_smooth.getAt(ix,iy,iz);
-	  
-	  if(mask_float_smooth_val[0]>0)
-	  for(j=0; j<6; j++)
-	    val[j] /= mask_float_smooth_val[0];
-	}
-  
   // drop all tensors where trace falls below a threshold
 
-  float *test_trace_val = dti_out->getAt(Zdim/2,Ydim/2,Zdim/2);
+  float *test_trace_val = dti_out->getAt(m_Dims[0]/2,m_Dims[1]/2,m_Dims[2]/2);
   float trace_cen = test_trace_val[0] + test_trace_val[1] + test_trace_val[2] ;
 
-  for(ix=0; ix<Xdim; ix++)
-    for(iy=0; iy<Ydim; iy++)
-      for(iz=0; iz<Zdim; iz++)
-	{
-	  int ind = iz*Xdim*Ydim + iy*Xdim + ix;
-	  
-	  float *val= dti_out->getAt(ix,iy,iz);
-	  
-	  float trace = val[0]+val[1]+val[2];
-
-	  if(trace < 0.01*trace_cen)
-	    
-	  for(j=0; j<6; j++)
-	    val[j] = 0.0f;
-
-	}
-
-
+  forEachRow(DropTraceRow(dti_out->getDataPtr(), m_Dims[0], 0.01*trace_cen));
 }
 
@@ -4,6 +4,8 @@
 */
 
 #include "Field.h"
+#include "Smoother.h"
+#include "SymEigen3.h"
 //#include "Ellipsoid.h" 
 #include <gsl/gsl_linalg.h>
 #include <gsl/gsl_math.h>
@@ -36,6 +38,11 @@ class ScalarField : public Field<float, 1>
    * smooths a scalar field using the specified scalar field filter
    */
   void Smooth(ScalarField *smoothingFilter, ScalarField *out);
+
+  /** 
+   * smooths a scalar field with separable 1-d passes
+   */
+  void Smooth(const Smoother &smoother, ScalarField *out);
 };
 
 /**
@@ -79,14 +86,68 @@ class VectorField : public Field<float, 3>
    */
   void reverseWarpFieldHAMMER(VectorField *out);
 
+  /**
+   * Inverts a displacement field (in voxels) with the fixed-point iteration
+   * v(x) = -u(x + v(x)), started from the inverse at half resolution, voxel by
+   * voxel until the residual |v(x) + u(x + v(x))| is below tolerance.
+   * Returns the largest residual, and the number of voxels at or above
+   * tolerance in unconverged if given.
+   */
+  float invertDisplacementField(VectorField *out, int maxIterations=30, float tolerance=0.01, long *unconverged=0);
+
   /** 
    * smooths vector field using the specified scalar field filter
    */
   void Smooth(ScalarField *smoothingFilter, VectorField *out);
+
+  /** 
+   * smooths vector field with separable 1-d passes
+   */
+  void Smooth(const Smoother &smoother, VectorField *out);
 };
 
 class TensorField;
 
+/**
+ * @brief  A field of rotations, stored as unit quaternions (w,x,y,z)
+ */
+class RotationField : public Field<float, 4>
+{
+ public:
+  /**
+   * computes the finite-strain rotation of every voxel of a warp field (the rotation
+   * of the polar decomposition of its Jacobian), to re-orient any number of tensor fields
+   */
+  void ComputeFSRotations(VectorField *warpField);
+};
+
+/**
+ * @brief the scalar and vector maps of a tensor field computed by
+ * TensorField::ComputeMaps(), the maps that are NULL are not computed
+ */
+struct DTIMaps
+{
+  DTIMaps();
+
+  ScalarField *fa;
+  /// the sum of the eigenvalues
+  ScalarField *trace;
+  ScalarField *eigVal[3];
+  VectorField *eigVec[3];
+  /// weight the eigVec fields by FA
+  int eigVecFAweighting;
+  /// phi, theta and psi of the eigenvector matrix
+  ScalarField *euler[3];
+
+  /// the pdIndex-th eigenvector, zero where the trace is not positive
+  VectorField *pd;
+  int pdIndex;
+  /// weight pd (and rgba) by FA
+  int pdFAweighting;
+  /// 4 bytes per voxel: the colour of pd in the byteRGBA layout of PDcolorMap
+  char *rgba;
+};
+
 
 /**
  *@brief  A tensor field class of symmetric matrices represented as 6-d vectors
@@ -139,6 +200,13 @@ class TensorField : public Field<float, 6>
    */
   void ComputeEigD(ScalarField *e1Field,ScalarField *e2Field,ScalarField *e3Field,VectorField *PD1Field,VectorField *PD2Field,VectorField *PD3Field, ScalarField *traceField,ScalarField *faField, int FAweighting, ScalarField *PhiField, ScalarField *ThetaField, ScalarField *PsiField);
 
+  /**
+   * computes any subset of the FA, trace, eigenvalue, eigenvector, Euler angle,
+   * principal direction and colour maps with a single eigen decomposition
+   * of every tensor. ComputeFA, ComputePD and ComputeEigD are special cases.
+   */
+  void ComputeMaps(DTIMaps &maps);
+
   /**
    * converts Euler angles to a rotation matrix 
    */
@@ -154,6 +222,11 @@ class TensorField : public Field<float, 6>
    */
   void logESmooth(ScalarField *smoothingFilter, TensorField *dti_out);
 
+  /** 
+   * smooths tensor field with separable 1-d passes in Log-Euclidean domain
+   */
+  void logESmooth(const Smoother &smoother, TensorField *dti_out);
+
   /** 
    * smooths tensor field using the specified scalar field filter
    */
@@ -164,16 +237,44 @@ class TensorField : public Field<float, 6>
    */
   void ESmooth(ScalarField *smoothingFilter, TensorField *dti_out, unsigned char *mask) ;
 
+  /** 
+   * smooths tensor field with separable 1-d passes, all 6 components in one sweep,
+   * within a mask of non-zero tensors if given
+   */
+  void ESmooth(const Smoother &smoother, TensorField *dti_out, unsigned char *mask=0) ;
+
   /**
    * computes symmetric matrix logarithm of tensor field within a mask of non-zero tensors
    */
   void logTField(TensorField *dti_out, unsigned char *mask);
 
+  /**
+   * computes the logarithm of the voxels begin..end-1 as logTField does, without
+   * starting threads of its own, to be called from inside a parallel region
+   */
+  void logTField(TensorField *dti_out, unsigned char *mask, long begin, long end);
+
   /**
    * computes matrix exponential of input symmetric matrix field
    */
   void expTField(TensorField *dti_out, unsigned char *mask);
 
+  /**
+   * the logarithm of nvox interleaved tensors, zero where the mask is zero or the
+   * trace is below threshold; out may be in
+   */
+  static void logTensors(const float *in, float *out, const unsigned char *mask, long nvox, float threshold);
+
+  /**
+   * the exponential of nvox interleaved symmetric matrices, zero where the mask is zero
+   */
+  static void expTensors(const float *in, float *out, const unsigned char *mask, long nvox);
+
+  /**
+   * the FA of nvox interleaved tensors, as ComputeFA
+   */
+  static void faTensors(const float *in, float *fa, long nvox);
+
   /**
    * computes non-zero tensor mask using a trace-based threshold
    * a threshold factor is applied to the 
@@ -181,6 +282,12 @@ class TensorField : public Field<float, 6>
    */
   void computeNZmask(unsigned char *mask, float threshold_factor); 
 
+  /**
+   * computes non-zero tensor mask with the threshold already in traceTensorThreshold,
+   * e.g. one taken from another field of the same population
+   */
+  void computeNZmask(unsigned char *mask); 
+
   float traceTensorThreshold;  // a public variable to store trace threshold fordeciding non-zero tensor
 
   /**
@@ -189,16 +296,23 @@ class TensorField : public Field<float, 6>
    */
   void reOrientTensorFieldFS(VectorField *warpField, TensorField *dti_out);
 
-  // these are two slow, but accurate functions
+  /**
+   * re-orients the tensor field with precomputed rotations, dti_out may be this field
+   */
+  void reOrientTensorField(RotationField *rotField, TensorField *dti_out);
+
+  // these two do truncated-Gaussian interpolation
   /**
    * displace the tensor field using input forward deformation field and sigma specifying kernel for Gaussian interpolation
+   * optionally the interpolation is done in the Log-Euclidean domain
    */
-  void displaceTensorFieldUsingFwdField(VectorField *warpField, TensorField *dti_out, float sigma, float filter_size_red_factor);
+  void displaceTensorFieldUsingFwdField(VectorField *warpField, TensorField *dti_out, float sigma, float filter_size_red_factor, bool logEuclidean=false);
 
   /**
    * displace the tensor field using input inverse deformation field and sigma specifying kernel for Gaussian interpolation
+   * optionally the interpolation is done in the Log-Euclidean domain
    */
-  void displaceTensorFieldUsingInvField(VectorField *warpField, TensorField *dti_out, float sigma, float filter_size_red_factor);
+  void displaceTensorFieldUsingInvField(VectorField *warpField, TensorField *dti_out, float sigma, float filter_size_red_factor, bool logEuclidean=false);
 
   // this is a faster function
   /**
@@ -0,0 +1,363 @@
+
+# include "Fields.h"
+# include "Smoother.h"
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+float Smoother::recursiveThreshold = 3.0;
+
+//------
+Smoother::Smoother()
+//------
+{
+  for(int d=0; d<3; d++)
+    {
+      m_Recursive[d] = false;
+      m_Order[d] = 0;
+      m_Sigma[d] = 0;
+      m_Kernel[d].assign(1, 1.0);
+    }
+}
+
+//------
+void Smoother::init(float sigma, const double *res, const int *ksize, Method method)
+//------
+{
+  for(int d=0; d<3; d++)
+    {
+      if(ksize[d]%2 ==0) { std::cout<<"Smoother: Kernel size "<<ksize[d]<<" should be odd\n"; exit(0); }
+
+      m_Order[d] = (ksize[d]-1)/2;
+
+      // same samples as ComputeSmoothingFilter, the 3-d normalization is
+      // the product of the 1-d ones
+      m_Kernel[d].resize(ksize[d]);
+      double total= 0.0;
+      for(int i=0; i<ksize[d]; i++)
+	{
+	  float x= (i-m_Order[d])*res[d];
+	  m_Kernel[d][i] = exp(-x*x/(2*sigma*sigma));
+	  total += m_Kernel[d][i];
+	}
+      for(int i=0; i<ksize[d]; i++)
+	m_Kernel[d][i] /= total;
+
+      // Young - van Vliet, valid for sigma >= 0.5 voxels
+      double s = sigma/res[d];
+      m_Sigma[d] = s;
+      m_Recursive[d] = (s >= 0.5) && (method == RECURSIVE || (method == AUTO && s > recursiveThreshold));
+
+      double q;
+      if(s >= 2.5)
+	q = 0.98711*s - 0.96330;
+      else
+	q = 3.97156 - 4.14554*sqrt(1.0 - 0.26891*s);
+
+      double b0 = 1.57825 + 2.44413*q + 1.4281*q*q + 0.422205*q*q*q;
+      double b1 = 2.44413*q + 2.85619*q*q + 1.26661*q*q*q;
+      double b2 = -(1.4281*q*q + 1.26661*q*q*q);
+      double b3 = 0.422205*q*q*q;
+
+      m_Coef[d][0] = 1.0 - (b1 + b2 + b3)/b0;
+      m_Coef[d][1] = b1/b0;
+      m_Coef[d][2] = b2/b0;
+      m_Coef[d][3] = b3/b0;
+    }
+}
+
+//------
+bool Smoother::init(ScalarField *smoothingFilter)
+//------
+{
+  int fdims[3];
+  for(int d=0; d<3; d++)
+    {
+      fdims[d] = smoothingFilter->getSize(d);
+      if(fdims[d]%2 ==0)
+	return false;
+    }
+
+  float *f = smoothingFilter->getDataPtr();
+
+  // the marginals of a normalized separable filter are its 1-d factors
+  for(int d=0; d<3; d++)
+    {
+      m_Order[d] = (fdims[d]-1)/2;
+      m_Kernel[d].assign(fdims[d], 0.0);
+      m_Recursive[d] = false;
+      m_Sigma[d] = 0;
+    }
+
+  float fmax = 0.0;
+  for(int iz=0; iz<fdims[2]; iz++)
+    for(int iy=0; iy<fdims[1]; iy++)
+      for(int ix=0; ix<fdims[0]; ix++)
+	{
+	  float v = f[(iz*fdims[1] + iy)*fdims[0] + ix];
+	  m_Kernel[0][ix] += v;
+	  m_Kernel[1][iy] += v;
+	  m_Kernel[2][iz] += v;
+	  if(v > fmax) fmax = v;
+	}
+
+  for(int iz=0; iz<fdims[2]; iz++)
+    for(int iy=0; iy<fdims[1]; iy++)
+      for(int ix=0; ix<fdims[0]; ix++)
+	{
+	  float v = f[(iz*fdims[1] + iy)*fdims[0] + ix];
+	  if(fabs(v - m_Kernel[0][ix]*m_Kernel[1][iy]*m_Kernel[2][iz]) > 1e-5*fmax)
+	    return false;
+	}
+
+  return true;
+}
+
+//------
+int Smoother::support(int axis) const
+//------
+{
+  if(!m_Recursive[axis])
+    return m_Order[axis];
+
+  // the response of the recursive filter is not truncated, its tail decays
+  // more slowly than the Gaussian and is at the float rounding 8 sigma out
+  int h = (int) ceil(8.0*m_Sigma[axis]);
+  return (h > m_Order[axis]) ? h : m_Order[axis];
+}
+
+//------
+void Smoother::apply(const float *in, float *out, const int *dims, int nc, const unsigned char *mask) const
+//------
+{
+  long N = (long)dims[0]*dims[1]*dims[2];
+  int nw = mask ? nc+1 : nc;
+
+  // the mask is smoothed as one more component
+  std::vector<float> work(N*nw), tmp(N*nw);
+  if(mask)
+    {
+      for(long i=0; i<N; i++)
+	{
+	  for(int c=0; c<nc; c++)
+	    work[i*nw + c] = in[i*nc + c];
+	  work[i*nw + nc] = (float) mask[i];
+	}
+    }
+  else
+    memcpy(&work[0], in, N*nc*sizeof(float));
+
+  for(int d=0; d<3; d++)
+    {
+      if(m_Recursive[d])
+	iirPass(d, &work[0], dims, nw);
+      else
+	{
+	  firPass(d, &work[0], &tmp[0], dims, nw);
+	  work.swap(tmp);
+	}
+    }
+
+  zeroBorder(&work[0], dims, nw);
+
+  if(!mask)
+    {
+      memcpy(out, &work[0], N*nc*sizeof(float));
+      return;
+    }
+
+  for(long i=0; i<N; i++)
+    {
+      float m = work[i*nw + nc];
+      for(int c=0; c<nc; c++)
+	{
+	  if(mask[i]==0)
+	    out[i*nc + c] = 0.0;
+	  else if(m > 0)
+	    out[i*nc + c] = work[i*nw + c]/m;
+	  else
+	    out[i*nc + c] = work[i*nw + c];
+	}
+    }
+}
+
+//------
+void Smoother::firPass(int axis, const float *src, float *dst, const int *dims, int nc) const
+//------
+{
+  int Xdim= dims[0];
+  int Ydim= dims[1];
+  int Zdim= dims[2];
+
+  int order = m_Order[axis];
+  int ksize = m_Kernel[axis].size();
+  const float *K = &m_Kernel[axis][0];
+
+  long row = (long)Xdim*nc;
+  long slice = row*Ydim;
+
+  if(axis == 0)
+    {
+      // dst[x] = sum_k K[k] src[x-k+order], all components at once
+#pragma omp parallel for schedule(static)
+      for(int iz=0; iz<Zdim; iz++)
+	for(int iy=0; iy<Ydim; iy++)
+	  {
+	    const float *s = src + iz*slice + iy*row;
+	    float *t = dst + iz*slice + iy*row;
+	    for(long j=0; j<row; j++)
+	      t[j] = 0.0;
+	    for(int k=0; k<ksize; k++)
+	      {
+		float w = K[k];
+		long sh = (long)(order-k)*nc;
+		for(long j=(long)order*nc; j<(long)(Xdim-order)*nc; j++)
+		  t[j] += w*s[j+sh];
+	      }
+	  }
+    }
+  else if(axis == 1)
+    {
+#pragma omp parallel for schedule(static)
+      for(int iz=0; iz<Zdim; iz++)
+	for(int iy=0; iy<Ydim; iy++)
+	  {
+	    float *t = dst + iz*slice + iy*row;
+	    for(long j=0; j<row; j++)
+	      t[j] = 0.0;
+	    if(iy < order || iy >= Ydim-order)
+	      continue;
+	    for(int k=0; k<ksize; k++)
+	      {
+		float w = K[k];
+		const float *s = src + iz*slice + (iy-k+order)*row;
+		for(long j=0; j<row; j++)
+		  t[j] += w*s[j];
+	      }
+	  }
+    }
+  else
+    {
+#pragma omp parallel for schedule(static)
+      for(int iy=0; iy<Ydim; iy++)
+	for(int iz=0; iz<Zdim; iz++)
+	  {
+	    float *t = dst + iz*slice + iy*row;
+	    for(long j=0; j<row; j++)
+	      t[j] = 0.0;
+	    if(iz < order || iz >= Zdim-order)
+	      continue;
+	    for(int k=0; k<ksize; k++)
+	      {
+		float w = K[k];
+		const float *s = src + (iz-k+order)*slice + iy*row;
+		for(long j=0; j<row; j++)
+		  t[j] += w*s[j];
+	      }
+	  }
+    }
+}
+
+/**
+ * forward and backward recursions along n elements of len floats, stride
+ * apart. The signal is extended by its end values.
+ */
+static void iirLine(float *p, int n, long stride, long len, const double *coef, float *pad)
+{
+  float B = coef[0], b1 = coef[1], b2 = coef[2], b3 = coef[3];
+
+  memcpy(pad, p, len*sizeof(float));
+  for(int i=0; i<n; i++)
+    {
+      float *c = p + i*stride;
+      const float *m1 = (i>0) ? c - stride : pad;
+      const float *m2 = (i>1) ? c - 2*stride : pad;
+      const float *m3 = (i>2) ? c - 3*stride : pad;
+      for(long j=0; j<len; j++)
+	c[j] = B*c[j] + b1*m1[j] + b2*m2[j] + b3*m3[j];
+    }
+
+  memcpy(pad, p + (n-1)*stride, len*sizeof(float));
+  for(int i=n-1; i>=0; i--)
+    {
+      float *c = p + i*stride;
+      const float *p1 = (i<n-1) ? c + stride : pad;
+      const float *p2 = (i<n-2) ? c + 2*stride : pad;
+      const float *p3 = (i<n-3) ? c + 3*stride : pad;
+      for(long j=0; j<len; j++)
+	c[j] = B*c[j] + b1*p1[j] + b2*p2[j] + b3*p3[j];
+    }
+}
+
+//------
+void Smoother::iirPass(int axis, float *data, const int *dims, int nc) const
+//------
+{
+  int Xdim= dims[0];
+  int Ydim= dims[1];
+  int Zdim= dims[2];
+
+  long row = (long)Xdim*nc;
+  long slice = row*Ydim;
+
+  if(axis == 0)
+    {
+      // sequential in x, the components are the vector
+#pragma omp parallel for schedule(static)
+      for(int iz=0; iz<Zdim; iz++)
+	{
+	  std::vector<float> pad(nc);
+	  for(int iy=0; iy<Ydim; iy++)
+	    iirLine(data + iz*slice + iy*row, Xdim, nc, nc, m_Coef[0], &pad[0]);
+	}
+    }
+  else if(axis == 1)
+    {
+      // whole x-rows are the vector
+#pragma omp parallel for schedule(static)
+      for(int iz=0; iz<Zdim; iz++)
+	{
+	  std::vector<float> pad(row);
+	  iirLine(data + iz*slice, Ydim, row, row, m_Coef[1], &pad[0]);
+	}
+    }
+  else
+    {
+#pragma omp parallel for schedule(static)
+      for(int iy=0; iy<Ydim; iy++)
+	{
+	  std::vector<float> pad(row);
+	  iirLine(data + iy*row, Zdim, slice, row, m_Coef[2], &pad[0]);
+	}
+    }
+}
+
+//------
+void Smoother::zeroBorder(float *data, const int *dims, int nc) const
+//------
+{
+  int Xdim= dims[0];
+  int Ydim= dims[1];
+  int Zdim= dims[2];
+
+  long row = (long)Xdim*nc;
+  long slice = row*Ydim;
+
+#pragma omp parallel for schedule(static)
+  for(int iz=0; iz<Zdim; iz++)
+    for(int iy=0; iy<Ydim; iy++)
+      {
+	float *t = data + iz*slice + iy*row;
+	if(iz < m_Order[2] || iz >= Zdim-m_Order[2] || iy < m_Order[1] || iy >= Ydim-m_Order[1])
+	  {
+	    for(long j=0; j<row; j++)
+	      t[j] = 0.0;
+	    continue;
+	  }
+	for(long j=0; j<(long)m_Order[0]*nc && j<row; j++)
+	  t[j] = 0.0;
+	for(long j=(long)(Xdim-m_Order[0])*nc; j<row; j++)
+	  if(j >= 0)
+	    t[j] = 0.0;
+      }
+}
@@ -0,0 +1,86 @@
+/**
+ * @file Smoother.h
+ * @brief Separable Gaussian smoothing of scalar, vector and tensor fields
+ */
+
+#ifndef _SMOOTHER_H_
+#define _SMOOTHER_H_
+
+#include <vector>
+
+class ScalarField;
+
+/**
+ * @brief Gaussian smoothing as three 1-d passes over an interleaved field.
+ *
+ * The field is stored as in Field<float,n>, with the n components of a voxel
+ * next to each other and x the fastest axis. Every pass works on whole
+ * x-rows (n*Xdim contiguous floats), so all components are smoothed in the
+ * same sweep and the inner loops vectorize. The z slices (x and y passes)
+ * and the y rows (z pass) are split between OpenMP threads.
+ *
+ * Two kernels are supported:
+ *  - FIR: the truncated, normalized, sampled Gaussian of
+ *    ScalarField::ComputeSmoothingFilter(), as three 1-d kernels. The result
+ *    is the same as the 3-d convolution (up to rounding), including the
+ *    convention that the output is zero within half a kernel of the border.
+ *  - RECURSIVE: the Young - van Vliet 3rd order recursive filter, whose cost
+ *    does not depend on sigma. The output is zeroed next to the border as
+ *    for the FIR kernel of the same size.
+ */
+class Smoother
+{
+ public:
+  enum Method { FIR, RECURSIVE, AUTO };
+
+  Smoother();
+
+  /**
+   * Gaussian of width sigma (in mm), truncated to ksize voxels (odd) along
+   * each axis. AUTO uses the recursive filter once sigma is larger than
+   * recursiveThreshold voxels along an axis.
+   */
+  void init(float sigma, const double *res, const int *ksize, Method method=AUTO);
+
+  /**
+   * The 1-d kernels of a 3-d filter from ScalarField::ComputeSmoothingFilter().
+   * Returns false if the filter is not separable (or not odd sized), in
+   * which case it has to be applied as a 3-d convolution.
+   */
+  bool init(ScalarField *smoothingFilter);
+
+  /**
+   * smooths the nc interleaved components of in into out (which may be in).
+   * With a mask, the result is the normalized convolution
+   * K*in / K*mask on the voxels of the mask and zero elsewhere.
+   */
+  void apply(const float *in, float *out, const int *dims, int nc, const unsigned char *mask=0) const;
+
+  /**
+   * the slices on either side of an output slice along the axis that
+   * determine it (to float precision), the halo a slab of the field needs
+   * to be smoothed on its own
+   */
+  int support(int axis) const;
+
+  /// sigma in voxels above which AUTO selects the recursive filter
+  static float recursiveThreshold;
+
+ private:
+  void firPass(int axis, const float *src, float *dst, const int *dims, int nc) const;
+  void iirPass(int axis, float *data, const int *dims, int nc) const;
+  void zeroBorder(float *data, const int *dims, int nc) const;
+
+  /// use the recursive filter along the axis
+  bool m_Recursive[3];
+  /// half widths of the kernels
+  int m_Order[3];
+  /// the 1-d FIR kernels
+  std::vector<float> m_Kernel[3];
+  /// sigma in voxels
+  double m_Sigma[3];
+  /// the recursive filter coefficients, b[0] is B and b[1..3] are divided by b0
+  double m_Coef[3][4];
+};
+
+#endif
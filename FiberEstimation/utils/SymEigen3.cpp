@@ -0,0 +1,224 @@
+
+# include "SymEigen3.h"
+#include <math.h>
+
+double SymEigen3::degenerateTolerance = 1e-4;
+
+//------
+template <typename T>
+void SymEigen3::decompose(const T *tensors, int n, bool vectors)
+//------
+{
+  int k;
+
+  // eigenvalues, descending, in the normalized matrix
+#pragma omp simd
+  for(k=0; k<n; k++)
+    {
+      const T *t = tensors + 6*k;
+      double a00 = t[0], a11 = t[1], a22 = t[2], a01 = t[3], a02 = t[4], a12 = t[5];
+
+      double s = fabs(a00);
+      s = fabs(a11) > s ? fabs(a11) : s;
+      s = fabs(a22) > s ? fabs(a22) : s;
+      s = fabs(a01) > s ? fabs(a01) : s;
+      s = fabs(a02) > s ? fabs(a02) : s;
+      s = fabs(a12) > s ? fabs(a12) : s;
+      double is = (s > 0) ? 1.0/s : 0.0;
+      a00 *= is; a11 *= is; a22 *= is; a01 *= is; a02 *= is; a12 *= is;
+
+      double q = (a00 + a11 + a22)/3.0;
+      double b00 = a00 - q, b11 = a11 - q, b22 = a22 - q;
+      double p1 = a01*a01 + a02*a02 + a12*a12;
+      double p2 = b00*b00 + b11*b11 + b22*b22 + 2.0*p1;
+      double p = sqrt(p2/6.0);
+      double ip = (p > 0) ? 1.0/p : 0.0;
+
+      // r = det((A - qI)/p)/2
+      double det = b00*(b11*b22 - a12*a12) - a01*(a01*b22 - a12*a02) + a02*(a01*a12 - b11*a02);
+      double r = 0.5*det*ip*ip*ip;
+      r = r < -1.0 ? -1.0 : (r > 1.0 ? 1.0 : r);
+      double phi = acos(r)/3.0;
+
+      double l0 = q + 2.0*p*cos(phi);
+      double l2 = q + 2.0*p*cos(phi + 2.0*M_PI/3.0);
+      double l1 = 3.0*q - l0 - l2;
+
+      eval[0][k] = l0*s;
+      eval[1][k] = l1*s;
+      eval[2][k] = l2*s;
+
+      double gap = (l0 - l1) < (l1 - l2) ? (l0 - l1) : (l1 - l2);
+      m_Fallback[k] = (gap < degenerateTolerance);
+    }
+
+  if(vectors)
+    {
+#pragma omp simd
+      for(k=0; k<n; k++)
+	{
+	  const T *t = tensors + 6*k;
+	  double a00 = t[0], a11 = t[1], a22 = t[2], a01 = t[3], a02 = t[4], a12 = t[5];
+	  double v[2][3];
+
+	  // the largest and the smallest eigenvalues are the best separated
+	  for(int e=0; e<2; e++)
+	    {
+	      double l = eval[2*e][k];
+	      double r0[3] = { a00 - l, a01, a02 };
+	      double r1[3] = { a01, a11 - l, a12 };
+	      double r2[3] = { a02, a12, a22 - l };
+
+	      double c01[3] = { r0[1]*r1[2] - r0[2]*r1[1], r0[2]*r1[0] - r0[0]*r1[2], r0[0]*r1[1] - r0[1]*r1[0] };
+	      double c02[3] = { r0[1]*r2[2] - r0[2]*r2[1], r0[2]*r2[0] - r0[0]*r2[2], r0[0]*r2[1] - r0[1]*r2[0] };
+	      double c12[3] = { r1[1]*r2[2] - r1[2]*r2[1], r1[2]*r2[0] - r1[0]*r2[2], r1[0]*r2[1] - r1[1]*r2[0] };
+
+	      double n01 = c01[0]*c01[0] + c01[1]*c01[1] + c01[2]*c01[2];
+	      double n02 = c02[0]*c02[0] + c02[1]*c02[1] + c02[2]*c02[2];
+	      double n12 = c12[0]*c12[0] + c12[1]*c12[1] + c12[2]*c12[2];
+
+	      double nm = n01;
+	      double c[3] = { c01[0], c01[1], c01[2] };
+	      if(n02 > nm) { nm = n02; c[0] = c02[0]; c[1] = c02[1]; c[2] = c02[2]; }
+	      if(n12 > nm) { nm = n12; c[0] = c12[0]; c[1] = c12[1]; c[2] = c12[2]; }
+
+	      double in = (nm > 0) ? 1.0/sqrt(nm) : 0.0;
+	      v[e][0] = c[0]*in; v[e][1] = c[1]*in; v[e][2] = c[2]*in;
+	      if(nm <= 0)
+		m_Fallback[k] = 1;
+	    }
+
+	  evec[0][0][k] = v[0][0]; evec[0][1][k] = v[0][1]; evec[0][2][k] = v[0][2];
+	  evec[2][0][k] = v[1][0]; evec[2][1][k] = v[1][1]; evec[2][2][k] = v[1][2];
+	  // v1 = v2 x v0
+	  evec[1][0][k] = v[1][1]*v[0][2] - v[1][2]*v[0][1];
+	  evec[1][1][k] = v[1][2]*v[0][0] - v[1][0]*v[0][2];
+	  evec[1][2][k] = v[1][0]*v[0][1] - v[1][1]*v[0][0];
+	}
+
+      for(k=0; k<n; k++)
+	{
+	  if(!m_Fallback[k])
+	    continue;
+
+	  const T *t = tensors + 6*k;
+	  double M[9] = { t[0], t[3], t[4], t[3], t[1], t[5], t[4], t[5], t[2] };
+	  double eigVal[3], eigVec[9];
+	  jacobi(M, eigVal, eigVec);
+	  for(int i=0; i<3; i++)
+	    {
+	      eval[i][k] = eigVal[i];
+	      for(int j=0; j<3; j++)
+		evec[i][j][k] = eigVec[i*3+j];
+	    }
+	}
+    }
+
+  // sort by decreasing absolute value, the value order is kept for ties
+  for(k=0; k<n; k++)
+    {
+      for(int pass=0; pass<2; pass++)
+	for(int i=0; i<2-pass; i++)
+	  {
+	    if(fabs(eval[i][k]) >= fabs(eval[i+1][k]))
+	      continue;
+	    double tmp = eval[i][k]; eval[i][k] = eval[i+1][k]; eval[i+1][k] = tmp;
+	    if(vectors)
+	      for(int j=0; j<3; j++)
+		{
+		  // the swap changes the handedness
+		  tmp = evec[i][j][k]; evec[i][j][k] = evec[i+1][j][k]; evec[i+1][j][k] = -tmp;
+		}
+	  }
+    }
+}
+
+//------
+void SymEigen3::compute(const float *tensors, int n, bool vectors)
+//------
+{
+  decompose(tensors, n, vectors);
+}
+
+//------
+void SymEigen3::compute(const double *tensors, int n, bool vectors)
+//------
+{
+  decompose(tensors, n, vectors);
+}
+
+//------
+void SymEigen3::jacobi(const double *M, double *eigVal, double *eigVec)
+//------
+{
+  double A[3][3], V[3][3];
+  int i, j;
+
+  for(i=0; i<3; i++)
+    for(j=0; j<3; j++)
+      {
+	A[i][j] = M[i*3+j];
+	V[i][j] = (i==j) ? 1.0 : 0.0;
+      }
+
+  for(int sweep=0; sweep<50; sweep++)
+    {
+      double off = A[0][1]*A[0][1] + A[0][2]*A[0][2] + A[1][2]*A[1][2];
+      double dia = A[0][0]*A[0][0] + A[1][1]*A[1][1] + A[2][2]*A[2][2];
+      if(off <= 1e-32*dia || off == 0)
+	break;
+
+      for(int p=0; p<2; p++)
+	for(int q=p+1; q<3; q++)
+	  {
+	    if(A[p][q] == 0)
+	      continue;
+	    double theta = (A[q][q] - A[p][p])/(2.0*A[p][q]);
+	    double t = (theta >= 0 ? 1.0 : -1.0)/(fabs(theta) + sqrt(theta*theta + 1.0));
+	    double c = 1.0/sqrt(t*t + 1.0), s = t*c;
+
+	    for(int r=0; r<3; r++)
+	      {
+		double arp = A[r][p], arq = A[r][q];
+		A[r][p] = c*arp - s*arq;
+		A[r][q] = s*arp + c*arq;
+	      }
+	    for(int r=0; r<3; r++)
+	      {
+		double apr = A[p][r], aqr = A[q][r];
+		A[p][r] = c*apr - s*aqr;
+		A[q][r] = s*apr + c*aqr;
+	      }
+	    for(int r=0; r<3; r++)
+	      {
+		double vrp = V[r][p], vrq = V[r][q];
+		V[r][p] = c*vrp - s*vrq;
+		V[r][q] = s*vrp + c*vrq;
+	      }
+	  }
+    }
+
+  // descending values, the columns of V are the eigenvectors
+  int order[3] = { 0, 1, 2 };
+  for(int pass=0; pass<2; pass++)
+    for(i=0; i<2-pass; i++)
+      if(A[order[i]][order[i]] < A[order[i+1]][order[i+1]])
+	{
+	  int tmp = order[i]; order[i] = order[i+1]; order[i+1] = tmp;
+	}
+
+  for(i=0; i<3; i++)
+    {
+      eigVal[i] = A[order[i]][order[i]];
+      for(j=0; j<3; j++)
+	eigVec[i*3+j] = V[j][order[i]];
+    }
+
+  // right handed, v2 = v0 x v1
+  double d = eigVec[6]*(eigVec[1]*eigVec[5] - eigVec[2]*eigVec[4])
+    + eigVec[7]*(eigVec[2]*eigVec[3] - eigVec[0]*eigVec[5])
+    + eigVec[8]*(eigVec[0]*eigVec[4] - eigVec[1]*eigVec[3]);
+  if(d < 0)
+    for(j=0; j<3; j++)
+      eigVec[6+j] = -eigVec[6+j];
+}
@@ -0,0 +1,68 @@
+/**
+ * @file SymEigen3.h
+ * @brief Eigen decomposition of batches of symmetric 3x3 matrices (tensors)
+ */
+
+#ifndef _SYMEIGEN3_H_
+#define _SYMEIGEN3_H_
+
+/**
+ * @brief Closed form eigen decomposition of symmetric 3x3 matrices, a batch at a time.
+ *
+ * The tensors are read as stored in TensorField (xx, yy, zz, xy, xz, yz) and
+ * the results are kept in structure-of-arrays layout, so the loops over a
+ * batch vectorize. The eigenvalues are computed with the trigonometric form
+ * of Cardano's formula, and the eigenvectors of the largest and smallest
+ * eigenvalues as cross products of the rows of (A - lambda I). Matrices with
+ * (nearly) repeated eigenvalues, for which the cross products are
+ * inaccurate, are diagonalized with Jacobi rotations instead.
+ *
+ * The eigenvalues are sorted by decreasing absolute value as with
+ * gsl_eigen_symmv_sort(..., GSL_EIGEN_SORT_ABS_DESC). The eigenvectors are
+ * orthonormal and right handed (evec is a rotation).
+ */
+class SymEigen3
+{
+ public:
+  enum { BatchSize = 64 };
+
+  /**
+   * decomposes n <= BatchSize tensors, the eigenvectors are only computed
+   * if vectors is true
+   */
+  void compute(const float *tensors, int n, bool vectors=true);
+
+  /// as above, for tensors computed in double precision
+  void compute(const double *tensors, int n, bool vectors=true);
+
+  /**
+   * cyclic Jacobi rotations, used for the (nearly) degenerate cases. M is
+   * 3x3 row major, the eigenvalues are descending and eigVec[i*3+j] is the
+   * j-th component of the i-th eigenvector
+   */
+  static void jacobi(const double *M, double *eigVal, double *eigVec);
+
+  /**
+   * the i-th eigenvalue of the k-th tensor of the batch
+   */
+  double eval[3][BatchSize];
+
+  /**
+   * the j-th component of the i-th eigenvector of the k-th tensor of the batch
+   */
+  double evec[3][3][BatchSize];
+
+  /**
+   * eigenvalue gap (relative to the largest entry) below which the Jacobi
+   * rotations are used
+   */
+  static double degenerateTolerance;
+
+ private:
+  template <typename T>
+  void decompose(const T *tensors, int n, bool vectors);
+
+  int m_Fallback[BatchSize];
+};
+
+#endif
@@ -0,0 +1,148 @@
+
+#include "Fields.h"
+#include <iostream>
+#include <cstdlib>
+#include <omp.h>
+using namespace std;
+
+/**
+ * times the per-voxel operations of the fields on a synthetic tensor volume
+ */
+
+static void report(const char *name, double t, int repeats)
+{
+  printf("%-32s %10.2f ms\n", name, 1000.0*t/repeats);
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc<4 )
+    {
+      std::cout<<"Usage: benchFields xsize ysize zsize [repeats] [filter_size]\n";
+      exit(0);
+    }
+
+  int Xdim= atoi(argv[1]);
+  int Ydim= atoi(argv[2]);
+  int Zdim= atoi(argv[3]);
+  int repeats= (argc>4) ? atoi(argv[4]) : 3;
+  int fsize= (argc>5) ? atoi(argv[5]) : 5;
+  long nvox= (long)Xdim*Ydim*Zdim;
+
+  std::cout<<"Volume "<<Xdim<<"x"<<Ydim<<"x"<<Zdim<<", "<<omp_get_max_threads()<<" threads\n";
+
+  TensorField dti, dti_out;
+  dti.init(Xdim,Ydim,Zdim);
+  dti_out.init(Xdim,Ydim,Zdim);
+
+  // random positive definite tensors, zero outside a centered ellipsoid
+  srand(1);
+  for(int iz=0; iz<Zdim; iz++)
+    for(int iy=0; iy<Ydim; iy++)
+      for(int ix=0; ix<Xdim; ix++)
+	{
+	  float *val= dti.getAt(ix,iy,iz);
+	  float x= (2.0*ix-Xdim)/Xdim, y= (2.0*iy-Ydim)/Ydim, z= (2.0*iz-Zdim)/Zdim;
+	  for(int j=0; j<6; j++)
+	    val[j]= 0;
+	  if(x*x + y*y + z*z > 0.8)
+	    continue;
+	  for(int j=0; j<3; j++)
+	    val[j]= 1e-3*(1.0 + rand()/(float)RAND_MAX);
+	  for(int j=3; j<6; j++)
+	    val[j]= 2e-4*(rand()/(float)RAND_MAX - 0.5);
+	}
+
+  ScalarField scalar, scalar2, comp[6];
+  scalar.init(Xdim,Ydim,Zdim);
+  scalar2.init(Xdim,Ydim,Zdim);
+  for(int j=0; j<6; j++)
+    comp[j].init(Xdim,Ydim,Zdim);
+
+  VectorField vec, vec2;
+  vec.init(Xdim,Ydim,Zdim);
+  vec2.init(Xdim,Ydim,Zdim);
+  for(long i=0; i<3*nvox; i++)
+    vec.getDataPtr()[i]= rand()/(float)RAND_MAX - 0.5;
+
+  unsigned char *mask= (unsigned char *)calloc(nvox, sizeof(unsigned char));
+
+  // a filter that is not separable, to time the 3-d convolutions
+  ScalarField filter;
+  filter.init(fsize,fsize,fsize);
+  filter.ComputeSmoothingFilter(1.0);
+  filter.getAt(fsize/2,fsize/2,fsize/2)[0] *= 2.0;
+
+  double t;
+  int r;
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) dti.ComputeTrace(&scalar);
+  report("TensorField::ComputeTrace", omp_get_wtime()-t, repeats);
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) dti.ComputeFA(&scalar);
+  report("TensorField::ComputeFA", omp_get_wtime()-t, repeats);
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) dti.computeNZmask(mask, 0.001);
+  report("TensorField::computeNZmask", omp_get_wtime()-t, repeats);
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) dti.extractDTIcomponents(&comp[0],&comp[1],&comp[2],&comp[3],&comp[4],&comp[5]);
+  report("TensorField::extractDTIcomponents", omp_get_wtime()-t, repeats);
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) dti_out.createInterleavedDTI(&comp[0],&comp[1],&comp[2],&comp[3],&comp[4],&comp[5]);
+  report("TensorField::createInterleavedDTI", omp_get_wtime()-t, repeats);
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) dti.logTField(&dti_out, mask);
+  report("TensorField::logTField", omp_get_wtime()-t, repeats);
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) vec.FlipComp(1);
+  report("VectorField::FlipComp", omp_get_wtime()-t, repeats);
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) vec.Normalize();
+  report("VectorField::Normalize", omp_get_wtime()-t, repeats);
+
+  // an inverse field close to the identity
+  for(int iz=0; iz<Zdim; iz++)
+    for(int iy=0; iy<Ydim; iy++)
+      for(int ix=0; ix<Xdim; ix++)
+	{
+	  float *val= vec2.getAt(ix,iy,iz);
+	  val[0]= ix + 0.3; val[1]= iy + 0.2; val[2]= iz + 0.1;
+	}
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) dti.displaceTensorFieldUsingInvFieldTL(&vec2, &dti_out);
+  report("displaceTensorFieldUsingInvFieldTL", omp_get_wtime()-t, repeats);
+
+  // sigma of one voxel, a 7 voxel wide filter
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) dti.displaceTensorFieldUsingInvField(&vec2, &dti_out, 1.0, Xdim/7.0);
+  report("displaceTensorFieldUsingInvField", omp_get_wtime()-t, repeats);
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) dti.displaceTensorFieldUsingFwdField(&vec2, &dti_out, 1.0, Xdim/7.0);
+  report("displaceTensorFieldUsingFwdField", omp_get_wtime()-t, repeats);
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) scalar.Smooth(&filter, &scalar2);
+  report("ScalarField::Smooth (3-d filter)", omp_get_wtime()-t, repeats);
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) vec.Smooth(&filter, &vec2);
+  report("VectorField::Smooth (3-d filter)", omp_get_wtime()-t, repeats);
+
+  t= omp_get_wtime();
+  for(r=0; r<repeats; r++) dti.ESmooth(&filter, &dti_out, mask);
+  report("TensorField::ESmooth (3-d filter)", omp_get_wtime()-t, repeats);
+
+  free(mask);
+
+  return 0;
+}
@@ -0,0 +1,182 @@
+#include "Fields.h"
+#include <iostream>
+using namespace std;
+
+#include "RGBAcolorMap.h"
+
+/**
+ * reads a tensor field once and writes any of the maps of dtiFA, dtiTrace,
+ * dtiPD, dtiEigD and PDcolorMap, with one eigen decomposition per voxel
+ */
+
+static bool wanted(const char *maps, const char *name)
+{
+  char list[200];
+  strncpy(list, maps, 199); list[199]= 0;
+
+  for(char *tok= strtok(list, ","); tok; tok= strtok(NULL, ","))
+    if(!strcmp(tok, name) || !strcmp(tok, "all"))
+      return true;
+  return false;
+}
+
+int main(int argc, char *argv[])
+{
+
+  char str[200];
+  int i;
+
+
+  if(argc<11)
+    {
+      std::cout<<"Usage: dtiMaps switch_endian_input(0/1) xsize ysize zsize input_dtfile output_dir maps faweighting(0/1) pd_dirn(1/2/3) addoffsetPD(0/1)\n";
+      std::cout<<"       maps is a comma separated list of fa,trace,eig,evec,euler,pd,rgb or all\n";
+      exit(0);
+    }
+
+  int Xdim= atoi(argv[2]);
+  int Ydim= atoi(argv[3]);
+  int Zdim= atoi(argv[4]);
+  long nvox= (long)Xdim*Ydim*Zdim;
+
+  // these values do not matter
+  float Xres= 1.72;
+  float Yres= 1.72;
+  float Zres= 3.0;
+
+  const char *maps= argv[7];
+  int faweighting= atoi(argv[8]);
+  int dirn= atoi(argv[9]);
+  int addoffset= atoi(argv[10]);
+
+  if(dirn<1 || dirn >3)
+    {
+      cout<<"Dirn should be 1/2/3"<<endl;
+      exit(0);
+    }
+
+  TensorField dti;
+
+  dti.init(Xdim,Ydim,Zdim);
+  dti.setVoxelSize(0,Xres); dti.setVoxelSize(1,Yres); dti.setVoxelSize(2,Zres);
+
+  int endian_be=0; endian_be= atoi(argv[1]);
+
+  if(endian_be)
+    dti.importRawFieldFromFile_BE(argv[5]);
+  else
+    dti.importRawFieldFromFile(argv[5]);
+  std::cout<<"DTI read\n";
+
+  ScalarField Fa, Tr, e[3], angle[3];
+  VectorField pd[3], PD;
+  struct byteRGBA *rgba= NULL;
+  DTIMaps dtimaps;
+
+  if(wanted(maps, "fa"))
+    {
+      Fa.init(Xdim,Ydim,Zdim);
+      dtimaps.fa= &Fa;
+    }
+  if(wanted(maps, "trace"))
+    {
+      Tr.init(Xdim,Ydim,Zdim);
+      dtimaps.trace= &Tr;
+    }
+  for(i=0; i<3; i++)
+    {
+      if(wanted(maps, "eig"))
+	{
+	  e[i].init(Xdim,Ydim,Zdim);
+	  dtimaps.eigVal[i]= &e[i];
+	}
+      if(wanted(maps, "evec"))
+	{
+	  pd[i].init(Xdim,Ydim,Zdim);
+	  dtimaps.eigVec[i]= &pd[i];
+	}
+      if(wanted(maps, "euler"))
+	{
+	  angle[i].init(Xdim,Ydim,Zdim);
+	  dtimaps.euler[i]= &angle[i];
+	}
+    }
+  dtimaps.eigVecFAweighting= faweighting;
+
+  if(wanted(maps, "pd"))
+    {
+      PD.init(Xdim,Ydim,Zdim);
+      dtimaps.pd= &PD;
+    }
+  if(wanted(maps, "rgb"))
+    {
+      rgba= new byteRGBA[nvox];
+      dtimaps.rgba= rgba[0].rgba;
+    }
+  dtimaps.pdIndex= dirn-1;
+  dtimaps.pdFAweighting= faweighting;
+
+  dti.ComputeMaps(dtimaps);
+  std::cout<<"Maps computed\n";
+
+  if(dtimaps.fa)
+    {
+      sprintf(str,"%s/FA%d.img",argv[6],Xdim);
+      Fa.exportRawFieldToFile(str);
+    }
+  if(dtimaps.trace)
+    {
+      sprintf(str,"%s/ADC%d.img",argv[6],Xdim);
+      Tr.exportRawFieldToFile(str);
+    }
+  for(i=0; i<3; i++)
+    {
+      if(dtimaps.eigVal[i])
+	{
+	  sprintf(str,"%s/e%d%d.img",argv[6],i+1,Xdim);
+	  e[i].exportRawFieldToFile(str);
+	}
+      if(dtimaps.eigVec[i])
+	{
+	  if(addoffset==1)
+	    pd[i].AddOffset();
+	  sprintf(str,"%s/pd%d%d.img",argv[6],i+1,Xdim);
+	  pd[i].exportRawFieldToFile(str);
+	}
+    }
+  if(dtimaps.euler[0])
+    {
+      sprintf(str,"%s/Phi%d.img",argv[6],Xdim);
+      angle[0].exportRawFieldToFile(str);
+      sprintf(str,"%s/Theta%d.img",argv[6],Xdim);
+      angle[1].exportRawFieldToFile(str);
+      sprintf(str,"%s/Psi%d.img",argv[6],Xdim);
+      angle[2].exportRawFieldToFile(str);
+    }
+  if(dtimaps.pd)
+    {
+      if(addoffset==1)
+	PD.AddOffset();
+      sprintf(str,"%s/PD%d_%d.img",argv[6],dirn,Xdim);
+      PD.exportRawFieldToFile(str);
+    }
+  // the same file as PDcolorMap writes (RGBAcolorMap::saveVolume), byteRGBA
+  // voxels in x-fastest order
+  if(rgba)
+    {
+      sprintf(str,"%s/PDcolor%d_%d.img",argv[6],dirn,Xdim);
+      FILE *fp= fopen(str, "wb");
+      if(fp == NULL)
+	{
+	  std::cout<<"Unable to open file "<<str<<"\n";
+	  exit(0);
+	}
+      fwrite(rgba, sizeof(struct byteRGBA), nvox, fp);
+      fclose(fp);
+      delete [] rgba;
+    }
+  std::cout<<"Maps written\n";
+
+  return 0;
+
+}
@@ -0,0 +1,184 @@
+#include "DTIPipeline.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+using namespace std;
+
+/**
+ * runs a pipeline of tensor field operations given as a postfix program:
+ * every operation takes its input from the top of a stack and puts its
+ * output there, write leaves the top in place. The volumes are streamed
+ * through a slab at a time, without full-volume intermediate files.
+ *
+ *  smoothDTI: read:in.dti log smooth:2,1.72,1.72,3 exp write:out.dti fa write:out.dti.FA.img
+ *  AverDTI:   average:subjects.txt write:avg.dti
+ *  dtiFA:     read:in.dti fa write:fa.img
+ *  dtiTrace:  read:in.dti trace write:trace.img
+ */
+
+static void usage()
+{
+  std::cout<<"Usage: dtiPipe xsize ysize zsize switch_endian_input(0/1) op [op ...]\n";
+  std::cout<<"       read:file                     push a tensor file\n";
+  std::cout<<"       average:list_file             push the log-Euclidean mean of the tensor files listed, one per line,\n";
+  std::cout<<"                                     optionally followed by its weight, as AverDTI\n";
+  std::cout<<"       log exp fa trace              replace the top by its log, exp, FA or trace\n";
+  std::cout<<"       smooth:sigma,Xres,Yres,Zres[,filter(0 truncated/1 recursive/2 auto)]\n";
+  std::cout<<"                                     replace the top by its smoothing within the mask, as smoothDTI\n";
+  std::cout<<"       write:file                    write the top\n";
+  std::cout<<"       slices:n                      slices per slab (default 16)\n";
+  exit(0);
+}
+
+/**
+ * the smoothing filter of smoothDTI
+ */
+static void initSmoother(Smoother &smoother, const char *args, const int *dims)
+{
+  float sigma, res[3];
+  int filter= 0;
+
+  if(sscanf(args, "%f,%f,%f,%f,%d", &sigma, &res[0], &res[1], &res[2], &filter) < 4)
+    {
+      std::cout<<"smooth needs sigma,Xres,Yres,Zres\n";
+      exit(0);
+    }
+
+  // note magic number 5.0:
+  int ksize[3];
+  double dres[3];
+  for(int d=0; d<3; d++)
+    {
+      ksize[d] = 5.0/res[d]*sigma;
+      if(ksize[d]%2==0) ksize[d] +=1;
+      if(ksize[d] > dims[d]) ksize[d] = dims[d];
+      dres[d] = res[d];
+    }
+
+  std::cout<<"Size of smoothing filter: "<<ksize[0]<<"x"<<ksize[1]<<"x"<<ksize[2]<<"\n";
+
+  smoother.init(sigma, dres, ksize, (Smoother::Method)filter);
+}
+
+int main(int argc, char *argv[])
+{
+
+  if(argc<6 )
+    usage();
+
+  int dims[3];
+  dims[0]= atoi(argv[1]);
+  dims[1]= atoi(argv[2]);
+  dims[2]= atoi(argv[3]);
+
+  int endian_be=0; endian_be= atoi(argv[4]);
+
+  int slab_size= 16;
+  for(int i=5; i<argc; i++)
+    if(!strncmp(argv[i], "slices:", 7))
+      slab_size= atoi(argv[i]+7);
+
+  DTIPipeline pipeline(dims[0], dims[1], dims[2], slab_size);
+  std::vector< DTINode * > stack;
+
+  for(int i=5; i<argc; i++)
+    {
+      std::string op(argv[i]);
+      std::string arg;
+      size_t colon= op.find(':');
+      if(colon != std::string::npos)
+	{
+	  arg= op.substr(colon+1);
+	  op= op.substr(0, colon);
+	}
+
+      if(op=="slices")
+	continue;
+
+      if(op=="read")
+	{
+	  stack.push_back(pipeline.source(arg, endian_be));
+	  continue;
+	}
+
+      if(op=="average")
+	{
+	  std::vector< DTINode * > logs;
+	  std::vector< double > weights;
+	  std::string line;
+	  DTINode *first= 0;
+
+	  std::ifstream DTIf(arg.c_str());
+	  while(std::getline(DTIf, line))
+	    {
+	      std::istringstream fields(line);
+	      std::string DTIfilename;
+	      double w= 1.0;
+
+	      if(!(fields>>DTIfilename))
+		continue;
+	      fields>>w;
+
+	      // the masks of all the subjects use the threshold of the first
+	      DTINode *dti= pipeline.source(DTIfilename, endian_be, 0.001, first);
+	      if(!first)
+		first= dti;
+	      logs.push_back(pipeline.log(dti));
+	      weights.push_back(w);
+	    }
+
+	  if(logs.size()==0)
+	    {
+	      std::cout<<"No input DTI files in "<<arg<<"\n";
+	      exit(0);
+	    }
+	  cout<<logs.size()<<" subjects listed\n";
+
+	  stack.push_back(pipeline.exp(pipeline.mean(logs, weights)));
+	  continue;
+	}
+
+      if(stack.empty())
+	{
+	  std::cout<<op<<": nothing to operate on\n";
+	  exit(0);
+	}
+      DTINode *top= stack.back();
+
+      if(op=="write")
+	pipeline.sink(top, arg);
+      else if(op=="smooth")
+	{
+	  Smoother smoother;
+	  initSmoother(smoother, arg.c_str(), dims);
+	  stack.back()= pipeline.smooth(top, smoother);
+	}
+      else if(op=="log" || op=="exp" || op=="fa" || op=="trace")
+	{
+	  if(top->channels()!=6)
+	    {
+	      std::cout<<op<<" needs tensors\n";
+	      exit(0);
+	    }
+	  if(op=="log")
+	    stack.back()= pipeline.log(top);
+	  else if(op=="exp")
+	    stack.back()= pipeline.exp(top);
+	  else if(op=="fa")
+	    stack.back()= pipeline.fa(top);
+	  else
+	    stack.back()= pipeline.trace(top);
+	}
+      else
+	{
+	  std::cout<<"Unknown operation "<<argv[i]<<"\n";
+	  usage();
+	}
+    }
+
+  if(!pipeline.run())
+    exit(1);
+
+  return 0;
+
+}
@@ -11,7 +11,7 @@ int main(int argc, char *argv[])
 
   if(argc<11 )
     {
-      std::cout<<"Usage: smoothDTI  sigma xsize ysize zsize input_dtfile output_dtfile Xres Yres Zres switch_endian_input(0/1)\n";
+      std::cout<<"Usage: smoothDTI  sigma xsize ysize zsize input_dtfile output_dtfile Xres Yres Zres switch_endian_input(0/1) [filter(0 truncated/1 recursive/2 auto)]\n";
       exit(0);
     }
   
@@ -26,6 +26,10 @@ int main(int argc, char *argv[])
   int endian_be= 0;
   endian_be=atoi(argv[10]);
 
+  int filter= 0;
+  if(argc>11)
+    filter=atoi(argv[11]);
+
   TensorField dti;
   
  
@@ -55,21 +59,17 @@ int main(int argc, char *argv[])
     dti.importRawFieldFromFile(argv[5]);
   std::cout<<"DTI read\n";
 
-  ScalarField smoothFilter;
-  
- 
-  smoothFilter.init(sXdim,sYdim,sZdim);
-  smoothFilter.setVoxelSize(0,Xres); 
-  smoothFilter.setVoxelSize(1,Yres); 
-  smoothFilter.setVoxelSize(2,Zres);
- 
-  smoothFilter.ComputeSmoothingFilter(sigma);
+  // the Gaussian is separable, the 3-d filter is applied as 1-d passes
+  Smoother smoother;
+  int ksize[3] = { sXdim, sYdim, sZdim };
+  double res[3] = { Xres, Yres, Zres };
+  smoother.init(sigma, res, ksize, (Smoother::Method)filter);
     
   TensorField dti2 ;
   dti2.init(Xdim,Ydim,Zdim);
   dti2.setVoxelSize(0,Xres); dti2.setVoxelSize(1,Yres); dti2.setVoxelSize(2,Zres);
   
-  dti.logESmooth(&smoothFilter, &dti2);
+  dti.logESmooth(smoother, &dti2);
   
   std::cout<<"Log-Euclidean Smoothing done\n";  
   
@@ -1,5 +1,5 @@
 #include <iostream>
-#include <fstream>
+#include "FieldIO.h"
 
 using namespace std;
 
@@ -14,20 +14,30 @@ int main (int argc, char ** argv) {
 	int x,y,z;
 	x = atoi(argv[3]); y = atoi(argv[4]); z = atoi(argv[5]);
 	
-	float * A = new float[x*y*z*3];
-	float * B = new float[x*y*z*3];
+	// one slice in memory at a time
+	FieldReader<float, 3> A_in;
+	FieldWriter<float, 3> out;
 
-	// read in ....
-	ifstream A_in(argv[1]);
-	A_in.read((char *)A, x*y*z*3*sizeof(float));
-	A_in.close();
+	if (!A_in.open(FieldFileInfo(argv[1], x, y, z))) {
+		cerr << "Unable to read " << argv[1] << endl;
+		return 1;
+	}
+	if (!out.open(FieldFileInfo(argv[2], x, y, z))) {
+		cerr << "Unable to write " << argv[2] << endl;
+		return 1;
+	}
+
+	float * A = new float[x*y*3];
+	float * B = new float[x*y*3];
 
 	for (int k=0; k<z; k++) {
-	  //cout << "Processing slice " << k << endl;
+		if (!A_in.readSlab(A, k, 1)) {
+			cerr << "Unable to read " << argv[1] << endl;
+			exit(1);
+		}
 		for (int j=0; j<y; j++)
 		for (int i=0; i<x; i++) { 
-		  
-			int ii = 3*(k*x*y + j*x + i);
+			int ii = 3*(j*x + i);
 			B[ii+1] = -i + A[ii];
 			B[ii] = -j + A[ii+1];
 			B[ii+2] = -k + A[ii+2];
@@ -38,12 +48,17 @@ int main (int argc, char ** argv) {
 			    std::cout<<"\nCentral slice In "<<A[ii]<<" "<<A[ii+1]<<" "<<A[ii+2]<<"\n";
 			  }
 		}
+		if (!out.writeSlab(B, 1)) {
+			cerr << "Unable to write " << argv[2] << endl;
+			exit(1);
+		}
+	}
+
+	A_in.close();
+	if (!out.close()) {
+		cerr << "Unable to write " << argv[2] << endl;
+		exit(1);
 	}
-	
-	// write out ...
-	ofstream out(argv[2]);
-	out.write((char *)B, x*y*z*3*sizeof(float));
-	out.close();
 
 	delete [] A;
 	delete [] B;
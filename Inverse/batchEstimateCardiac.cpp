@@ -0,0 +1,565 @@
+static char help[] = "Batch driver to estimate cardiac activations for many cases sharing a geometry";
+
+/**
+ *  @file   batchEstimateCardiac.cpp
+ *  @brief  Solves many independent inversions that share the same geometry.
+ *  @author Hari Sundar
+ *  @date   2/21/08
+ *
+ *  The geometry (DAs, material properties, fibers), the operators and the
+ *  Newmark work vectors are set up once, as in estimateCardiac, and are then
+ *  reused for every case listed in the file given by -cases (one case prefix
+ *  per line, lines starting with % are skipped).
+ *
+ *  For every case, the observations are read from <case>.<Ns>.<t>.obs (nodal
+ *  displacements, 3 doubles per node) if present. Otherwise they are generated
+ *  by a forward solve with the activations in <case>.<Ns>.<t>.fld. The
+ *  estimated parameters are written to <case>.params and a one line summary
+ *  per case to <pn>.batch.<group>.txt.
+ *
+ *  With -batch_groups g, the processors are split into g groups that solve
+ *  different cases concurrently. Each group has its own copy of the geometry
+ *  and operators, and case i is solved by group i % g. The option is read
+ *  before PetscInitialize, so it must be given on the command line.
+ **/
+
+#include "mpi.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+#include "petscksp.h"
+#include "petscda.h"
+
+#include "timeInfo.h"
+#include "feMatrix.h"
+#include "feVector.h"
+#include "femUtils.h"
+#include "timeStepper.h"
+#include "newmark.h"
+#include "elasStiffness.h"
+#include "elasMass.h"
+#include "raleighDamping.h"
+#include "cardiacFiberForce.h"
+#include "parametricActivationInverse.h"
+#include "lbfgsActivationInverse.h"
+#include "radialBasis.h"
+#include "bSplineBasis.h"
+#include "perfLog.h"
+
+/**
+ *  @brief reads the elemental activations of a case and converts them to the (already allocated) nodal vectors tau.
+ **/
+int readActivations(DA da, int Ns, const char *prefix, std::vector<Vec> &tau) {
+  int x, y, z, m, n, p;
+  int mx, my, mz, xne, yne, zne;
+  char filename[PETSC_MAX_PATH_LEN];
+  unsigned int elemSize = Ns*Ns*Ns;
+
+  CHKERRQ( DAGetCorners(da, &x, &y, &z, &m, &n, &p) );
+  CHKERRQ( DAGetInfo(da,0, &mx, &my, &mz, 0,0,0,0,0,0,0) );
+  xne = (x+m == mx) ? m-1 : m;
+  yne = (y+n == my) ? n-1 : n;
+  zne = (z+p == mz) ? p-1 : p;
+
+  double *tmp_tau = new double[elemSize];
+  PetscScalar ***tauArray;
+  std::vector<Vec> tmpTau(tau.size());
+  std::ifstream fin;
+
+  for (unsigned int t=0; t<tau.size(); t++) {
+    CHKERRQ( DACreateGlobalVector(da, &tmpTau[t]) );
+    CHKERRQ( VecSet( tmpTau[t], 0.0) );
+    CHKERRQ( DAVecGetArray(da, tmpTau[t], &tauArray) );
+
+    sprintf(filename, "%s.%d.%.3d.fld", prefix, Ns, t);
+    fin.open(filename); fin.read((char *)tmp_tau, elemSize*sizeof(double)); fin.close();
+    for (int k = z; k < z + zne ; k++) {
+      for (int j = y; j < y + yne; j++) {
+        for (int i = x; i < x + xne; i++) {
+          int indx = (k*(Ns) + j)*(Ns) + i;
+          tauArray[k][j][i] = -tmp_tau[indx];
+        }
+      }
+    }
+    CHKERRQ( DAVecRestoreArray ( da, tmpTau[t], &tauArray ) );
+  }
+  // all timesteps in one batch
+  elementToNode(da, tmpTau, tau);
+  for (unsigned int t=0; t<tmpTau.size(); t++) {
+    CHKERRQ( VecDestroy( tmpTau[t] ) );
+  }
+  delete [] tmp_tau;
+
+  return(0);
+}
+
+/**
+ *  @brief reads the observed nodal displacements of a case, returns false if the case has none.
+ **/
+bool readObservations(DA da3d, int Ns, const char *prefix, unsigned int numFrames, std::vector<Vec> &obs) {
+  int x, y, z, m, n, p;
+  unsigned int dof = 3;
+  char filename[PETSC_MAX_PATH_LEN];
+  unsigned int nodeSize = (Ns+1)*(Ns+1)*(Ns+1);
+
+  sprintf(filename, "%s.%d.%.3d.obs", prefix, Ns, 0);
+  std::ifstream fin(filename, std::ios::binary);
+  if ( !fin.good() )
+    return false;
+  fin.close();
+
+  DAGetCorners(da3d, &x, &y, &z, &m, &n, &p);
+
+  double *tmp_obs = new double[dof*nodeSize];
+  PetscScalar ***obsArray;
+
+  // from the pool, as the synthetic observations of ts->getSolution(), so
+  // both are returned with vecPool::restore()
+  Vec templ;
+  DACreateGlobalVector(da3d, &templ);
+
+  for (unsigned int t=0; t<numFrames; t++) {
+    Vec v;
+    vecPool::get(templ, &v);
+    DAVecGetArray(da3d, v, &obsArray);
+
+    sprintf(filename, "%s.%d.%.3d.obs", prefix, Ns, t);
+    fin.open(filename, std::ios::binary); fin.read((char *)tmp_obs, dof*nodeSize*sizeof(double)); fin.close();
+    for (int k = z; k < z + p ; k++) {
+      for (int j = y; j < y + n; j++) {
+        for (int i = x; i < x + m; i++) {
+          int indx = dof*((k*(Ns+1) + j)*(Ns+1) + i);
+          obsArray[k][j][dof*i] = tmp_obs[indx];
+          obsArray[k][j][dof*i+1] = tmp_obs[indx+1];
+          obsArray[k][j][dof*i+2] = tmp_obs[indx+2];
+        }
+      }
+    }
+    DAVecRestoreArray(da3d, v, &obsArray);
+    obs.push_back(v);
+  }
+  VecDestroy(templ);
+  delete [] tmp_obs;
+
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  // split into groups before PETSc is initialized ...
+  int numGroups = 1;
+  for (int i=1; i<argc-1; i++) {
+    if ( !strcmp(argv[i], "-batch_groups") ) {
+      numGroups = atoi(argv[i+1]);
+    }
+  }
+
+  MPI_Init(&argc, &argv);
+
+  int worldRank, worldSize;
+  MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+  MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+
+  if (numGroups < 1) numGroups = 1;
+  if (numGroups > worldSize) numGroups = worldSize;
+
+  int group = (worldRank*numGroups)/worldSize;
+  MPI_Comm groupComm;
+  MPI_Comm_split(MPI_COMM_WORLD, group, worldRank, &groupComm);
+
+  PETSC_COMM_WORLD = groupComm;
+  PetscInitialize(&argc, &argv, "elas.opt", help);
+  perfLog::init();
+
+  int rank;
+  MPI_Comm_rank(groupComm, &rank);
+
+  int Ns = 32;
+  unsigned int dof = 3;
+
+  char problemName[PETSC_MAX_PATH_LEN];
+  char caseFile[PETSC_MAX_PATH_LEN];
+  char filename[PETSC_MAX_PATH_LEN];
+
+  double t0 = 0.0;
+  double dt = 0.1;
+  double t1 = 1.0;
+  double beta = 0.000001;
+
+  // inexact Newton
+  PetscTruth inexact = PETSC_FALSE;
+  PetscTruth lsearch = PETSC_FALSE;
+  double etaMax = 0.5;
+  double gtol = 1e-6;
+
+  // L-BFGS
+  PetscTruth lbfgs = PETSC_FALSE;
+  PetscTruth hybrid = PETSC_FALSE;
+  int lbfgsHistory = 5;
+  int maxIter = 1;
+
+  DA  da;         // Underlying scalar DA - for scalar properties
+  DA  da3d;       // Underlying vector DA - for vector properties
+
+  Vec rho;        // density - elemental scalar
+  Vec lambda;     // Lame parameter - lambda - elemental scalar
+  Vec mu;         // Lame parameter - mu - elemental scalar
+  Vec fibers;     // Fiber orientations - elemental vector (3-dof)
+
+  std::vector<Vec> tau;        // the scalar activation - nodal scalar, reused for all cases
+
+  // Initial conditions
+  Vec initialDisplacement;
+  Vec initialVelocity;
+
+  timeInfo ti;
+
+  double nu, E;
+
+  PetscTruth mf = PETSC_FALSE;
+  PetscTruth casesSet = PETSC_FALSE;
+
+  PetscOptionsGetTruth(0, "-mfree", &mf, 0);
+  bool mfree = (mf == PETSC_TRUE);
+
+  double ctrst = 10.0;
+  int parFac = 2;
+  int numParams;
+
+  CHKERRQ ( PetscOptionsGetInt(0,"-pFac", &parFac,0) );
+  numParams = parFac*parFac*parFac*5;
+
+  CHKERRQ ( PetscOptionsGetInt(0,"-Ns",&Ns,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-ctrst",&ctrst,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-t0",&t0,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-t1",&t1,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-dt",&dt,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-beta",&beta,0) );
+  CHKERRQ ( PetscOptionsGetInt(0,"-maxit",&maxIter,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_inexact",&inexact,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_linesearch",&lsearch,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-inv_eta_max",&etaMax,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-inv_gtol",&gtol,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_lbfgs",&lbfgs,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_lbfgs_hybrid",&hybrid,0) );
+  CHKERRQ ( PetscOptionsGetInt(0,"-inv_lbfgs_m",&lbfgsHistory,0) );
+  CHKERRQ ( PetscOptionsGetString(PETSC_NULL,"-pn",problemName,PETSC_MAX_PATH_LEN-1,PETSC_NULL));
+  CHKERRQ ( PetscOptionsGetString(PETSC_NULL,"-cases",caseFile,PETSC_MAX_PATH_LEN-1,&casesSet));
+
+  if ( !casesSet ) {
+    PetscPrintf(0, "Usage: batchEstimateCardiac -pn <geometry> -cases <file> [-batch_groups g]\n");
+    PetscFinalize();
+    MPI_Comm_free(&groupComm);
+    MPI_Finalize();
+    return 1;
+  }
+
+  // read the list of cases, same on all processors
+  std::vector<std::string> cases;
+  {
+    std::ifstream fin(caseFile);
+    std::string line;
+    while ( std::getline(fin, line) ) {
+      if ( line.empty() || line[0] == '%' )
+        continue;
+      cases.push_back(line);
+    }
+    fin.close();
+  }
+
+  if (!worldRank) {
+    std::cout << "Batch of " << cases.size() << " cases on " << numGroups << " groups of ~" << worldSize/numGroups << " processors" << std::endl;
+  }
+
+  // Time info for timestepping
+  ti.start = t0;
+  ti.stop  = t1;
+  ti.step  = dt;
+
+  // SET UP THE GEOMETRY, ONCE PER GROUP ...
+  double setupTime = perfLog::now();
+
+  CHKERRQ ( DACreate3d ( PETSC_COMM_WORLD, DA_NONPERIODIC, DA_STENCIL_BOX,
+                         Ns+1, Ns+1, Ns+1, PETSC_DECIDE, PETSC_DECIDE, PETSC_DECIDE,
+                         1, 1, 0, 0, 0, &da) );
+  CHKERRQ ( DACreate3d ( PETSC_COMM_WORLD, DA_NONPERIODIC, DA_STENCIL_BOX,
+                         Ns+1, Ns+1, Ns+1, PETSC_DECIDE, PETSC_DECIDE, PETSC_DECIDE,
+                         dof, 1, 0, 0, 0, &da3d) );
+
+  elasMass *Mass = new elasMass(feMat::PETSC); // Mass Matrix
+  elasStiffness *Stiffness = new elasStiffness(feMat::PETSC); // Stiffness matrix
+  raleighDamping *Damping = new raleighDamping(feMat::PETSC); // Damping Matrix
+  // the names of the operators in the perfLog summary
+  Mass->setName("elasMass");
+  Stiffness->setName("elasStiffness");
+  Damping->setName("raleighDamping");
+
+  cardiacFiberForce *Force = new cardiacFiberForce(feVec::PETSC); // Force Vector
+
+  CHKERRQ( DACreateGlobalVector(da, &rho) );
+  CHKERRQ( DACreateGlobalVector(da, &mu) );
+  CHKERRQ( DACreateGlobalVector(da, &lambda) );
+
+  CHKERRQ( DACreateGlobalVector(da3d, &initialDisplacement) );
+  CHKERRQ( DACreateGlobalVector(da3d, &initialVelocity) );
+
+  CHKERRQ( VecSet ( initialDisplacement, 0.0) );
+  CHKERRQ( VecSet ( initialVelocity, 0.0) );
+
+  VecZeroEntries( mu );
+  VecZeroEntries( lambda );
+  VecZeroEntries( rho );
+
+  int x, y, z, m, n, p;
+  int mx,my,mz, xne, yne, zne;
+
+  CHKERRQ( DAGetCorners(da, &x, &y, &z, &m, &n, &p) );
+  CHKERRQ( DAGetInfo(da,0, &mx, &my, &mz, 0,0,0,0,0,0,0) );
+
+  xne = (x+m == mx) ? m-1 : m;
+  yne = (y+n == my) ? n-1 : n;
+  zne = (z+p == mz) ? p-1 : p;
+
+  // Generate the basis ...
+  std::vector < radialBasis > spatialBasis;
+  bSplineBasis temporalBasis(3, 5);
+
+  double fac = 1.0/parFac;
+  for (int k=0; k<parFac; k++) {
+    for (int j=0; j<parFac; j++) {
+      for (int i=0; i<parFac; i++) {
+        radialBasis tmp(Point( fac/2+i*fac,fac/2+j*fac,fac/2+k*fac), Point(fac/2,fac/2,fac/2));
+        spatialBasis.push_back(tmp);
+      }
+    }
+  }
+
+  // SET MATERIAL PROPERTIES ...
+  unsigned int elemSize = Ns*Ns*Ns;
+
+  unsigned char *tmp_mat = new unsigned char[elemSize];
+  double *tmp_fib = new double[dof*elemSize];
+
+  std::ifstream fin;
+
+  sprintf(filename, "%s.%d.img", problemName, Ns);
+  fin.open(filename, std::ios::binary); fin.read((char *)tmp_mat, elemSize); fin.close();
+
+  PetscScalar ***muArray, ***lambdaArray, ***rhoArray;
+
+  CHKERRQ(DAVecGetArray(da, mu, &muArray));
+  CHKERRQ(DAVecGetArray(da, lambda, &lambdaArray));
+  CHKERRQ(DAVecGetArray(da, rho, &rhoArray));
+
+  nu = 0.45; E = 1000;
+  double mmu = E/(2*(1+nu));
+  double llam = E*nu/((1+nu)*(1-2*nu));
+  nu = 0.45; E = 1000*ctrst;
+  double mmu2 = E/(2*(1+nu));
+  double llam2 = E*nu/((1+nu)*(1-2*nu));
+
+  for (int k=z; k<z+zne; k++) {
+    for (int j=y; j<y+yne; j++) {
+      for (int i=x; i<x+xne; i++) {
+        int indx = k*Ns*Ns + j*Ns + i;
+
+        if ( tmp_mat[indx] ) {
+          muArray[k][j][i] = mmu2;
+          lambdaArray[k][j][i] = llam2;
+          rhoArray[k][j][i] = 1.0;
+        } else {
+          muArray[k][j][i] = mmu;
+          lambdaArray[k][j][i] = llam;
+          rhoArray[k][j][i] = 1.0;
+        }
+      } // end i
+    } // end j
+  } // end k
+
+  CHKERRQ( DAVecRestoreArray ( da, mu, &muArray ) );
+  CHKERRQ( DAVecRestoreArray ( da, lambda, &lambdaArray ) );
+  CHKERRQ( DAVecRestoreArray ( da, rho, &rhoArray ) );
+
+  delete [] tmp_mat;
+
+  // read in the fibers
+  PetscScalar ***fibArray;
+  CHKERRQ( DACreateGlobalVector(da3d, &fibers) );
+  CHKERRQ( VecSet( fibers, 0.0));
+  CHKERRQ( DAVecGetArray(da3d, fibers, &fibArray) );
+
+  sprintf(filename, "%s.%d.fibers", problemName, Ns);
+  fin.open(filename); fin.read((char *)tmp_fib, dof*elemSize*sizeof(double)); fin.close();
+  for (int k = z; k < z + zne ; k++) {
+    for (int j = y; j < y + yne; j++) {
+      for (int i = x; i < x + xne; i++) {
+        int indx = dof*((k*(Ns) + j)*(Ns) + i);
+        fibArray[k][j][dof*i] = tmp_fib[indx];
+        fibArray[k][j][dof*i+1] = tmp_fib[indx+1];
+        fibArray[k][j][dof*i+2] = tmp_fib[indx+2];
+      }
+    }
+  }
+  CHKERRQ( DAVecRestoreArray ( da3d, fibers, &fibArray ) );
+  delete [] tmp_fib;
+
+  // activation vectors, allocated once and refilled for every case
+  unsigned int numSteps = (unsigned int)(ceil(( ti.stop - ti.start)/ti.step));
+  for (unsigned int t=0; t<numSteps+1; t++) {
+    Vec tauVec;
+    CHKERRQ( DACreateGlobalVector(da, &tauVec) );
+    CHKERRQ( VecZeroEntries(tauVec) );
+    tau.push_back(tauVec);
+  }
+
+  // Setup Matrices and Force Vector ...
+  Mass->setProblemDimensions(1.0, 1.0, 1.0);
+  Mass->setDA(da3d);
+  Mass->setDof(dof);
+  Mass->setDensity(rho);
+
+  Stiffness->setProblemDimensions(1.0, 1.0, 1.0);
+  Stiffness->setDA(da3d);
+  Stiffness->setDof(dof);
+  Stiffness->setLame(lambda, mu);
+
+  Damping->setAlpha(0.0);
+  Damping->setBeta(0.00075);
+  Damping->setMassMatrix(Mass);
+  Damping->setStiffnessMatrix(Stiffness);
+  Damping->setDA(da3d);
+  Damping->setDof(dof);
+
+  Force->setProblemDimensions(1.0,1.0,1.0);
+  Force->setDA(da3d);
+  Force->setDAScalar(da);
+  Force->setActivationVec(tau);
+  Force->setFiberOrientations(fibers);
+  Force->setTimeInfo(&ti);
+
+  PetscTruth adjTest = PETSC_FALSE;
+  PetscOptionsHasName(0, "-force_adjoint_test", &adjTest);
+  if (adjTest) {
+    double adjErr;
+    CHKERRQ( Force->adjointTest(adjErr) );
+  }
+
+  // Newmark time stepper, initialized once ...
+  newmark *ts = new newmark;
+
+  ts->setMassMatrix(Mass);
+  ts->setDampingMatrix(Damping);
+  ts->setStiffnessMatrix(Stiffness);
+  ts->damp(false);
+  ts->setTimeFrames(1);
+  ts->setForceVector(Force);
+  ts->setInitialDisplacement(initialDisplacement);
+  ts->setInitialVelocity(initialVelocity);
+  ts->storeVec(true);
+  ts->setTimeInfo(&ti);
+  ts->setAdjoint(false);
+  ts->useMatrixFree(mfree);
+
+  ts->init();
+
+  // Inverse solver, the reduced Hessian and the KSP are also reused ...
+  Vec guess;
+  VecCreateSeq(PETSC_COMM_SELF, numParams, &guess);
+  VecZeroEntries(guess);
+
+  parametricActivationInverse *hyperInv;
+  if (lbfgs || hybrid) {
+    lbfgsActivationInverse *qnInv = new lbfgsActivationInverse;
+    qnInv->setHistorySize(lbfgsHistory);
+    qnInv->setHybrid(hybrid == PETSC_TRUE);
+    hyperInv = qnInv;
+  } else {
+    hyperInv = new parametricActivationInverse;
+  }
+
+  hyperInv->setScalarDA(da);
+  hyperInv->setBasis(spatialBasis, temporalBasis);
+  hyperInv->setForwardInitialConditions(initialDisplacement, initialVelocity);
+  hyperInv->setTimeStepper(ts);
+  hyperInv->setInitialGuess(guess);
+  hyperInv->setRegularizationParameter(beta);
+  hyperInv->setMaximumNumberOfIterations(maxIter);
+  hyperInv->setInexactNewton(inexact == PETSC_TRUE);
+  hyperInv->setLineSearch(lsearch == PETSC_TRUE);
+  hyperInv->setMaxForcingTerm(etaMax);
+  hyperInv->setParamsTolerance(gtol);
+  hyperInv->init();
+
+  setupTime = perfLog::now() - setupTime;
+  PetscPrintf(0, "Group %d: shared setup took %g s\n", group, setupTime);
+
+  // per group summary
+  std::ofstream sout;
+  if (!rank) {
+    sprintf(filename, "%s.batch.%d.txt", problemName, group);
+    sout.open(filename);
+    sout << "% case iterations cost time" << std::endl;
+  }
+
+  // SOLVE THE CASES ASSIGNED TO THIS GROUP ...
+  for (unsigned int c=group; c<cases.size(); c+=numGroups) {
+    const char *caseName = cases[c].c_str();
+    double caseTime = perfLog::now();
+
+    PetscPrintf(0, "Group %d: starting case %s\n", group, caseName);
+
+    std::vector<Vec> obs;
+    if ( !readObservations(da3d, Ns, caseName, numSteps+1, obs) ) {
+      // synthetic data from the activations of the case
+      CHKERRQ( readActivations(da, Ns, caseName, tau) );
+      Force->setActivationVec(tau);
+      ts->setForceVector(Force);
+      ts->setInitialDisplacement(initialDisplacement);
+      ts->setInitialVelocity(initialVelocity);
+      ts->setAdjoint(false);
+      ts->clearMonitor();
+      ts->solve();
+      obs = ts->getSolution();
+    }
+
+    hyperInv->setObservations(obs);
+    hyperInv->solve();
+    hyperInv->getCurrentControl(guess);
+
+    caseTime = perfLog::now() - caseTime;
+
+    // write out the results for the case
+    if (!rank) {
+      PetscScalar *pArr;
+      sprintf(filename, "%s.params", caseName);
+      std::ofstream pout(filename, std::ios::binary);
+      CHKERRQ( VecGetArray(guess, &pArr) );
+      pout.write((char *)pArr, numParams*sizeof(PetscScalar));
+      CHKERRQ( VecRestoreArray(guess, &pArr) );
+      pout.close();
+
+      sout << caseName << " " << hyperInv->getFinalNumberOfIterations() << " "
+        << hyperInv->getCostFunctionValue() << " " << caseTime << std::endl;
+    }
+    PetscPrintf(0, "Group %d: finished case %s in %g s\n", group, caseName, caseTime);
+
+    // reused by the solves of the next case
+    vecPool::restore(obs);
+  }
+
+  if (!rank)
+    sout.close();
+
+  sprintf(filename, "%s.batch.%d", problemName, group);
+  perfLog::summary(filename, PETSC_COMM_WORLD);
+  vecPool::clear();
+
+  PetscFinalize();
+  MPI_Comm_free(&groupComm);
+  MPI_Finalize();
+}
@@ -0,0 +1,385 @@
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+
+#include "checkpoint.h"
+#include "colors.h"
+
+checkpoint::checkpoint()
+{
+  m_bPending = false;
+  m_szFileName[0] = '\0';
+}
+
+checkpoint::~checkpoint()
+{
+  // the buffers can only be released once the MPI-IO requests are complete
+  if ( m_bPending ) {
+    int finalized;
+    MPI_Finalized(&finalized);
+    if ( !finalized ) {
+      wait();
+    } else {
+      std::cerr << RED"checkpoint: a write was pending at MPI_Finalize, call wait() before"NRM << std::endl;
+    }
+  }
+  for (unsigned int i=0; i<m_buffers.size(); i++) {
+    delete [] m_buffers[i];
+  }
+  m_buffers.clear();
+}
+
+bool checkpoint::isSequential(Vec v)
+{
+  MPI_Comm comm;
+  int npes;
+  PetscObjectGetComm((PetscObject)v, &comm);
+  MPI_Comm_size(comm, &npes);
+
+  return (npes == 1);
+}
+
+bool checkpoint::checkHeader(checkpointHeader &hdr)
+{
+  if ( strncmp(hdr.magic, CHECKPOINT_MAGIC, 8) ) {
+    PetscPrintf(0, RED"Not a checkpoint file"NRM"\n");
+    return false;
+  }
+  if ( hdr.version > CHECKPOINT_VERSION ) {
+    PetscPrintf(0, RED"Checkpoint version %d is newer than supported (%d)"NRM"\n", hdr.version, CHECKPOINT_VERSION);
+    return false;
+  }
+  if ( (hdr.numVecs < 0) || (hdr.numVecs > CHECKPOINT_MAX_VECS) ) {
+    PetscPrintf(0, RED"Corrupt checkpoint header"NRM"\n");
+    return false;
+  }
+  return true;
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "checkpoint_write"
+int checkpoint::write(const char *fname, checkpointHeader &hdr, std::vector<Vec> &vecs)
+{
+  int ierr, rank, npes;
+  MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+  MPI_Comm_size(PETSC_COMM_WORLD, &npes);
+
+  if ( vecs.size() > CHECKPOINT_MAX_VECS ) {
+    PetscPrintf(0, RED"Too many vectors for checkpoint (%d)"NRM"\n", (int)vecs.size());
+    return 1;
+  }
+
+  // only one write in flight at any time
+  ierr = wait(); CHKERRQ(ierr);
+
+  m_header = hdr;
+  strncpy(m_header.magic, CHECKPOINT_MAGIC, 8);
+  m_header.version = CHECKPOINT_VERSION;
+  m_header.npes    = npes;
+  m_header.numVecs = vecs.size();
+  for (unsigned int i=0; i<vecs.size(); i++) {
+    ierr = VecGetSize(vecs[i], &(m_header.vecSize[i])); CHKERRQ(ierr);
+  }
+
+  strncpy(m_szFileName, fname, CHECKPOINT_MAX_PATH-1);
+  m_szFileName[CHECKPOINT_MAX_PATH-1] = '\0';
+
+  char tmpname[CHECKPOINT_MAX_PATH+8];
+  sprintf(tmpname, "%s.tmp", m_szFileName);
+
+  ierr = MPI_File_open(PETSC_COMM_WORLD, tmpname, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &m_file);
+  if (ierr != MPI_SUCCESS) {
+    PetscPrintf(0, RED"Unable to open %s for writing"NRM"\n", tmpname);
+    return 1;
+  }
+  // a left over .tmp might be longer than this checkpoint
+  MPI_File_set_size(m_file, 0);
+  m_bPending = true;
+
+  MPI_Request req;
+  if (!rank) {
+    MPI_File_iwrite_at(m_file, 0, &m_header, sizeof(checkpointHeader), MPI_BYTE, &req);
+    m_requests.push_back(req);
+  }
+
+  MPI_Offset offset = sizeof(checkpointHeader);
+  for (unsigned int i=0; i<vecs.size(); i++) {
+    int lo, hi;
+    ierr = VecGetOwnershipRange(vecs[i], &lo, &hi);
+    if (ierr) {
+      discard(); CHKERRQ(ierr);
+    }
+
+    // replicated Vecs are written only by rank 0
+    if ( rank && isSequential(vecs[i]) ) {
+      offset += m_header.vecSize[i]*sizeof(PetscScalar);
+      continue;
+    }
+
+    // snapshot the local part, the Vec is free to change after we return
+    PetscScalar *arr;
+    PetscScalar *buf = new PetscScalar[hi-lo];
+    m_buffers.push_back(buf);
+    ierr = VecGetArray(vecs[i], &arr);
+    if (ierr) {
+      discard(); CHKERRQ(ierr);
+    }
+    memcpy(buf, arr, (hi-lo)*sizeof(PetscScalar));
+    ierr = VecRestoreArray(vecs[i], &arr);
+    if (ierr) {
+      discard(); CHKERRQ(ierr);
+    }
+
+    MPI_File_iwrite_at(m_file, offset + lo*sizeof(PetscScalar), buf, (hi-lo)*sizeof(PetscScalar), MPI_BYTE, &req);
+    m_requests.push_back(req);
+
+    offset += m_header.vecSize[i]*sizeof(PetscScalar);
+  }
+
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "checkpoint_discard"
+void checkpoint::discard()
+{
+  if ( !m_bPending )
+    return;
+
+  int rank;
+  MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+
+  // the posted writes still use the buffers
+  if ( m_requests.size() ) {
+    MPI_Waitall(m_requests.size(), &(*(m_requests.begin())), MPI_STATUSES_IGNORE);
+  }
+  m_requests.clear();
+
+  MPI_File_close(&m_file);
+
+  for (unsigned int i=0; i<m_buffers.size(); i++) {
+    delete [] m_buffers[i];
+  }
+  m_buffers.clear();
+
+  // the previous checkpoint, if any, is left as it is
+  if (!rank) {
+    char tmpname[CHECKPOINT_MAX_PATH+8];
+    sprintf(tmpname, "%s.tmp", m_szFileName);
+    MPI_File_delete(tmpname, MPI_INFO_NULL);
+  }
+
+  m_bPending = false;
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "checkpoint_wait"
+int checkpoint::wait()
+{
+  if ( !m_bPending )
+    return(0);
+
+  int rank;
+  MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+
+  if ( m_requests.size() ) {
+    MPI_Waitall(m_requests.size(), &(*(m_requests.begin())), MPI_STATUSES_IGNORE);
+  }
+  m_requests.clear();
+
+  MPI_File_close(&m_file);
+
+  for (unsigned int i=0; i<m_buffers.size(); i++) {
+    delete [] m_buffers[i];
+  }
+  m_buffers.clear();
+
+  // only now is the checkpoint complete ...
+  if (!rank) {
+    char tmpname[CHECKPOINT_MAX_PATH+8];
+    sprintf(tmpname, "%s.tmp", m_szFileName);
+    if ( rename(tmpname, m_szFileName) ) {
+      std::cout << RED"Unable to rename checkpoint "NRM << tmpname << std::endl;
+    }
+  }
+
+  m_bPending = false;
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "checkpoint_readHeader"
+int checkpoint::readHeader(const char *fname, checkpointHeader &hdr)
+{
+  int ierr;
+  MPI_File fh;
+
+  ierr = MPI_File_open(PETSC_COMM_WORLD, (char *)fname, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+  if (ierr != MPI_SUCCESS) {
+    PetscPrintf(0, RED"Unable to open checkpoint %s"NRM"\n", fname);
+    return 1;
+  }
+  MPI_File_read_at_all(fh, 0, &hdr, sizeof(checkpointHeader), MPI_BYTE, MPI_STATUS_IGNORE);
+  MPI_File_close(&fh);
+
+  if ( !checkHeader(hdr) )
+    return 1;
+
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "checkpoint_read"
+int checkpoint::read(const char *fname, checkpointHeader &hdr, std::vector<Vec> &vecs)
+{
+  int ierr;
+  MPI_File fh;
+
+  ierr = MPI_File_open(PETSC_COMM_WORLD, (char *)fname, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+  if (ierr != MPI_SUCCESS) {
+    PetscPrintf(0, RED"Unable to open checkpoint %s"NRM"\n", fname);
+    return 1;
+  }
+  MPI_File_read_at_all(fh, 0, &hdr, sizeof(checkpointHeader), MPI_BYTE, MPI_STATUS_IGNORE);
+
+  if ( !checkHeader(hdr) || (hdr.numVecs != (int)vecs.size()) ) {
+    PetscPrintf(0, RED"Checkpoint %s does not match the solver"NRM"\n", fname);
+    MPI_File_close(&fh);
+    return 1;
+  }
+
+  MPI_Offset offset = sizeof(checkpointHeader);
+  for (unsigned int i=0; i<vecs.size(); i++) {
+    int sz, lo, hi;
+    ierr = VecGetSize(vecs[i], &sz); CHKERRQ(ierr);
+    if (sz != hdr.vecSize[i]) {
+      PetscPrintf(0, RED"Size mismatch for vector %d in checkpoint: %d vs %d"NRM"\n", i, hdr.vecSize[i], sz);
+      MPI_File_close(&fh);
+      return 1;
+    }
+    ierr = VecGetOwnershipRange(vecs[i], &lo, &hi); CHKERRQ(ierr);
+
+    PetscScalar *arr;
+    ierr = VecGetArray(vecs[i], &arr); CHKERRQ(ierr);
+    MPI_File_read_at_all(fh, offset + lo*sizeof(PetscScalar), arr, (hi-lo)*sizeof(PetscScalar), MPI_BYTE, MPI_STATUS_IGNORE);
+    ierr = VecRestoreArray(vecs[i], &arr); CHKERRQ(ierr);
+
+    offset += sz*sizeof(PetscScalar);
+  }
+
+  MPI_File_close(&fh);
+  return(0);
+}
+
+/*
+ * The octree is stored as a small header followed by (x, y, z, level) for
+ * every octant in global (Morton) order.
+ */
+struct octreeHeader {
+  char          magic[8];
+  int           version;
+  unsigned int  dim;
+  unsigned int  maxDepth;
+  unsigned int  numOctants;
+};
+
+#undef __FUNCT__
+#define __FUNCT__ "checkpoint_writeOctree"
+int checkpoint::writeOctree(const char *fname, std::vector<ot::TreeNode> &octs, MPI_Comm comm)
+{
+  int ierr, rank;
+  MPI_Comm_rank(comm, &rank);
+
+  unsigned int localSz = octs.size();
+  unsigned int globalSz, scanSz;
+
+  MPI_Allreduce(&localSz, &globalSz, 1, MPI_UNSIGNED, MPI_SUM, comm);
+  MPI_Scan(&localSz, &scanSz, 1, MPI_UNSIGNED, MPI_SUM, comm);
+
+  octreeHeader hdr;
+  memset(&hdr, 0, sizeof(octreeHeader));
+  strncpy(hdr.magic, OCTREE_MAGIC, 8);
+  hdr.version = OCTREE_VERSION;
+  hdr.numOctants = globalSz;
+
+  // rank 0 might be empty ...
+  unsigned int info[2] = {0, 0};
+  unsigned int gInfo[2];
+  if (localSz) {
+    info[0] = octs[0].getDim();
+    info[1] = octs[0].getMaxDepth();
+  }
+  MPI_Allreduce(info, gInfo, 2, MPI_UNSIGNED, MPI_MAX, comm);
+  hdr.dim = gInfo[0];
+  hdr.maxDepth = gInfo[1];
+
+  unsigned int *buf = new unsigned int[4*localSz+1];
+  for (unsigned int i=0; i<localSz; i++) {
+    buf[4*i]   = octs[i].getX();
+    buf[4*i+1] = octs[i].getY();
+    buf[4*i+2] = octs[i].getZ();
+    buf[4*i+3] = octs[i].getLevel();
+  }
+
+  MPI_File fh;
+  ierr = MPI_File_open(comm, (char *)fname, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+  if (ierr != MPI_SUCCESS) {
+    PetscPrintf(comm, RED"Unable to open %s for writing"NRM"\n", fname);
+    delete [] buf;
+    return 1;
+  }
+
+  if (!rank) {
+    MPI_File_write_at(fh, 0, &hdr, sizeof(octreeHeader), MPI_BYTE, MPI_STATUS_IGNORE);
+  }
+  MPI_Offset offset = sizeof(octreeHeader) + (MPI_Offset)(scanSz - localSz)*4*sizeof(unsigned int);
+  MPI_File_write_at_all(fh, offset, buf, 4*localSz, MPI_UNSIGNED, MPI_STATUS_IGNORE);
+  MPI_File_close(&fh);
+
+  delete [] buf;
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "checkpoint_readOctree"
+int checkpoint::readOctree(const char *fname, std::vector<ot::TreeNode> &octs, MPI_Comm comm)
+{
+  int ierr, rank, npes;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &npes);
+
+  MPI_File fh;
+  ierr = MPI_File_open(comm, (char *)fname, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+  if (ierr != MPI_SUCCESS) {
+    PetscPrintf(comm, RED"Unable to open octree %s"NRM"\n", fname);
+    return 1;
+  }
+
+  octreeHeader hdr;
+  MPI_File_read_at_all(fh, 0, &hdr, sizeof(octreeHeader), MPI_BYTE, MPI_STATUS_IGNORE);
+  if ( strncmp(hdr.magic, OCTREE_MAGIC, 8) || (hdr.version > OCTREE_VERSION) ) {
+    PetscPrintf(comm, RED"%s is not a valid octree file"NRM"\n", fname);
+    MPI_File_close(&fh);
+    return 1;
+  }
+
+  // evenly distribute, the DA will repartition anyway
+  unsigned int N = hdr.numOctants;
+  unsigned int begin = (unsigned int)(((double)N*rank)/npes);
+  unsigned int end   = (unsigned int)(((double)N*(rank+1))/npes);
+  unsigned int localSz = end - begin;
+
+  unsigned int *buf = new unsigned int[4*localSz+1];
+  MPI_Offset offset = sizeof(octreeHeader) + (MPI_Offset)begin*4*sizeof(unsigned int);
+  MPI_File_read_at_all(fh, offset, buf, 4*localSz, MPI_UNSIGNED, MPI_STATUS_IGNORE);
+  MPI_File_close(&fh);
+
+  octs.clear();
+  octs.reserve(localSz);
+  for (unsigned int i=0; i<localSz; i++) {
+    octs.push_back(ot::TreeNode(buf[4*i], buf[4*i+1], buf[4*i+2], buf[4*i+3], hdr.dim, hdr.maxDepth));
+  }
+
+  delete [] buf;
+  return(0);
+}
@@ -0,0 +1,116 @@
+/**
+ *  @file   checkpoint.h
+ *  @brief  Binary checkpoint/restart of the outer-loop state of the inverse solver.
+ *  @author Hari Sundar
+ *  @date   2/11/08
+ *
+ *  A checkpoint file consists of a fixed size, versioned header followed by
+ *  the raw PetscScalar payload of a list of Vecs, one after the other.
+ *  Distributed Vecs are stored in the global ordering, every processor writing
+ *  its own ownership range, so that a checkpoint can be read back on a
+ *  different number of processors. Sequential (replicated) Vecs, like the
+ *  parametric control, are written once by rank 0.
+ *
+ *  The Vecs are copied into private buffers and the writes are posted as
+ *  non-blocking MPI-IO requests, so that the solver can carry on while the
+ *  data is flushed. Data is written to <name>.tmp and renamed once the write
+ *  has completed, so the previous checkpoint stays valid if the run is killed
+ *  while writing.
+ *
+ *  The octree needed to rebuild the ot::DA is written separately (once per run)
+ *  using writeOctree, and its filename is stored in the header.
+ **/
+
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <vector>
+#include "mpi.h"
+#include "petscvec.h"
+#include "TreeNode.h"
+
+#define CHECKPOINT_MAGIC      "INVCKPT"
+#define CHECKPOINT_VERSION    1
+#define CHECKPOINT_MAX_VECS   8
+#define CHECKPOINT_MAX_PATH   256
+
+#define OCTREE_MAGIC          "INVOCT"
+#define OCTREE_VERSION        1
+
+/**
+ *  @brief The fixed size header of a checkpoint file.
+ **/
+struct checkpointHeader {
+  char    magic[8];
+  int     version;
+  int     npes;                           // number of processors that wrote the checkpoint
+  int     iteration;                      // outer (Gauss-Newton) iteration
+  int     numVecs;
+  int     vecSize[CHECKPOINT_MAX_VECS];   // global sizes of the stored Vecs
+  double  cost;                           // cost function value
+  double  beta;                           // regularization parameter
+  double  gradNorm;                       // norm of the reduced gradient
+  char    layout[CHECKPOINT_MAX_PATH];    // octree file needed to rebuild the DA, empty for RG
+  double  initGradNorm;                   // norm of the first reduced gradient
+};
+
+class checkpoint {
+  public:
+    checkpoint();
+    ~checkpoint();
+
+    /**
+     *  @brief Posts a non-blocking write of the header and the Vecs to fname.
+     *  The Vecs can be modified as soon as the function returns. Any previous
+     *  write is completed first.
+     *  @return 0 if successful
+     **/
+    int write(const char *fname, checkpointHeader &hdr, std::vector<Vec> &vecs);
+
+    /**
+     *  @brief Completes the pending write, if any, and renames the file.
+     *  Must be called before MPI_Finalize, the destructor calls it otherwise.
+     **/
+    int wait();
+
+    /**
+     *  @brief Reads a checkpoint into the header and the (already created) Vecs.
+     *  The Vecs must have the global sizes that were written.
+     *  @return 0 if successful, 1 if the file is missing or incompatible.
+     **/
+    static int read(const char *fname, checkpointHeader &hdr, std::vector<Vec> &vecs);
+
+    /**
+     *  @brief Reads only the header, useful to get the layout before the DA is built.
+     **/
+    static int readHeader(const char *fname, checkpointHeader &hdr);
+
+    /**
+     *  @brief Writes the (balanced, linear) octree in parallel, in global order.
+     **/
+    static int writeOctree(const char *fname, std::vector<ot::TreeNode> &octs, MPI_Comm comm);
+
+    /**
+     *  @brief Reads an octree written by writeOctree, evenly distributed across comm.
+     **/
+    static int readOctree(const char *fname, std::vector<ot::TreeNode> &octs, MPI_Comm comm);
+
+  protected:
+    static bool isSequential(Vec v);
+    static bool checkHeader(checkpointHeader &hdr);
+
+    /**
+     *  @brief Completes the posted requests, closes and deletes the .tmp file, on
+     *  a failed write.
+     **/
+    void discard();
+
+    MPI_File                    m_file;
+    bool                        m_bPending;
+    checkpointHeader            m_header;
+    std::vector<MPI_Request>    m_requests;
+    std::vector<PetscScalar *>  m_buffers;
+    char                        m_szFileName[CHECKPOINT_MAX_PATH];
+};
+
+#endif
@@ -87,6 +87,10 @@ int main(int argc, char **argv)
   elasMass *Mass = new elasMass(feMat::PETSC); // Mass Matrix
   elasStiffness *Stiffness = new elasStiffness(feMat::PETSC); // Stiffness matrix
   raleighDamping *Damping = new raleighDamping(feMat::PETSC); // Damping Matrix
+  // the names of the operators in the perfLog summary
+  Mass->setName("elasMass");
+  Stiffness->setName("elasStiffness");
+  Damping->setName("raleighDamping");
 
   cardiacDynamic *Force = new cardiacDynamic(feVec::PETSC); // Force Vector
 
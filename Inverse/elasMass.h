@@ -46,6 +46,14 @@ public:
   inline bool ElementalMatVec(int i, int j, int k, PetscScalar ***in, PetscScalar ***out, double scale);
   inline bool ElementalMatVec(unsigned int idx, PetscScalar *in, PetscScalar *out, double scale);
 
+  /**
+   *  @brief  unrolled 3-dof kernels, other dofs use ElementalMatVec().
+   **/
+  template <unsigned int DOF>
+  inline bool ElementalMatVecT(int i, int j, int k, PetscScalar ***in, PetscScalar ***out, double scale);
+  template <unsigned int DOF, bool HANGING>
+  inline bool ElementalMatVecT(unsigned int idx, PetscScalar *in, PetscScalar *out, double scale);
+
   inline bool GetElementalMatrix(int i, int j, int k, PetscScalar *mat);
   inline bool GetElementalMatrix(unsigned int idx, std::vector<ot::MatRecord> &record);
 
@@ -70,6 +78,11 @@ private:
 
   double xFac, yFac, zFac;
   unsigned int maxD;
+
+  // the stencils as doubles, 8x8 for every element type
+  double          m_dStencil[8*8*8];
+  // local corners, for the elemental index of rho
+  PetscInt        m_iXs, m_iYs, m_iZs, m_iXm, m_iYm;
 };
 
 
@@ -113,6 +126,9 @@ bool elasMass::initStencils() {
       }//end k
     }//end j
     m_stencil = Ajk;
+    for (int j=0;j<64;j++) {
+      m_dStencil[j] = Bjk[j/8][j%8];
+    }
   } else {
     int Bijk[8][8][8] = {
       //Type-0:No Hanging
@@ -207,6 +223,9 @@ bool elasMass::initStencils() {
       }//end j
     }//end i
     m_stencil = Aijk;
+    for (int i=0;i<8*64;i++) {
+      m_dStencil[i] = Bijk[i/64][(i/8)%8][i%8];
+    }
   }
   return true;
 }
@@ -226,15 +245,16 @@ bool elasMass::preMatVec() {
     m_dHx = m_dHx*m_dHx*m_dHx;
     m_dHx /= 1728.0;
 
+    PetscInt zm;
+    CHKERRQ( DAGetCorners(m_DA, &m_iXs, &m_iYs, &m_iZs, &m_iXm, &m_iYm, &zm) );
+
     // std::cout << "Hx is " << m_dHx << std::endl;
   } else {
-    unsigned int maxD = m_octDA->getMaxDepth();
-
-    double xFac,yFac,zFac;
+    maxD = m_octDA->getMaxDepth();
 
     PetscScalar *rho; 
     // Get nuarray
-    m_octDA->vecGetBuffer(rhoVec, rho, false, false, true, m_uiDof);
+    m_octDA->vecGetBuffer(rhoVec, rho, false, false, true, 1);
     m_rho = rho;
 
     // Get the  x,y,z factors 
@@ -306,6 +326,69 @@ bool elasMass::ElementalMatVec(int i, int j, int k, PetscScalar ***in, PetscScal
       out[idx[q][0]][idx[q][1]][idx[q][2]+2] += stencilScale*Ajk[q][r]*in[idx[r][0]][idx[r][1]][idx[r][2]+2];
     }
   }
+  return true;
+}
+
+template <unsigned int DOF>
+bool elasMass::ElementalMatVecT(int i, int j, int k, PetscScalar ***in, PetscScalar ***out, double scale) {
+  if (DOF != 3)
+    return ElementalMatVec(i, j, k, in, out, scale);
+
+  PetscScalar *u[8] = { in[k][j] + 3*i, in[k][j] + 3*i+3, in[k][j+1] + 3*i, in[k][j+1] + 3*i+3,
+                        in[k+1][j] + 3*i, in[k+1][j] + 3*i+3, in[k+1][j+1] + 3*i, in[k+1][j+1] + 3*i+3 };
+  PetscScalar *v[8] = { out[k][j] + 3*i, out[k][j] + 3*i+3, out[k][j+1] + 3*i, out[k][j+1] + 3*i+3,
+                        out[k+1][j] + 3*i, out[k+1][j] + 3*i+3, out[k+1][j+1] + 3*i, out[k+1][j+1] + 3*i+3 };
+
+  PetscScalar *rho  = (PetscScalar *) m_rho;
+  double fac = m_dHx*scale*rho[((k-m_iZs)*m_iYm + j - m_iYs)*m_iXm + i - m_iXs];
+
+  for (int q = 0; q < 8; q++) {
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0;
+    for (int r = 0; r < 8; r++) {
+      s0 += m_dStencil[8*q+r]*u[r][0];
+      s1 += m_dStencil[8*q+r]*u[r][1];
+      s2 += m_dStencil[8*q+r]*u[r][2];
+    }
+    v[q][0] += fac*s0;
+    v[q][1] += fac*s1;
+    v[q][2] += fac*s2;
+  }
+  return true;
+}
+
+template <unsigned int DOF, bool HANGING>
+bool elasMass::ElementalMatVecT(unsigned int i, PetscScalar *in, PetscScalar *out, double scale) {
+  if (DOF != 3)
+    return ElementalMatVec(i, in, out, scale);
+
+  unsigned int lev = m_octDA->getLevel(i);
+  double hx = xFac*(1<<(maxD - lev));
+  double hy = yFac*(1<<(maxD - lev));
+  double hz = zFac*(1<<(maxD - lev));
+
+  PetscScalar *rho  = (PetscScalar *) m_rho;
+  double fac = rho[i]*scale*hx*hy*hz/1728.0;
+
+  stdElemType elemType = ST_0;
+  ot::DA::index idx[8];
+  if (HANGING)
+    alignElementAndVertices(m_octDA, elemType, idx);
+  else
+    m_octDA->getNodeIndices(idx);
+
+  const double *A = m_dStencil + 64*elemType;
+  for (int k = 0;k < 8;k++) {
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0;
+    for (int j=0;j<8;j++) {
+      s0 += A[8*k+j]*in[3*idx[j]];
+      s1 += A[8*k+j]*in[3*idx[j]+1];
+      s2 += A[8*k+j]*in[3*idx[j]+2];
+    }//end for j
+    out[3*idx[k]]   += fac*s0;
+    out[3*idx[k]+1] += fac*s1;
+    out[3*idx[k]+2] += fac*s2;
+  }//end for k
+  return true;
 }
 
   bool elasMass::GetElementalMatrix(unsigned int i, std::vector<ot::MatRecord> &records) {
@@ -372,7 +455,7 @@ bool elasMass::postMatVec() {
     CHKERRQ(ierr);
   } else {
     PetscScalar *rho = (PetscScalar *)m_rho;
-    m_octDA->vecRestoreBuffer(rhoVec, rho, false, false, true,m_uiDof);
+    m_octDA->vecRestoreBuffer(rhoVec, rho, false, false, true, 1);
   }
   // std::cout << "Leaving " << __func__ << std::endl;
   return true;
@@ -0,0 +1,140 @@
+/**
+ *  @file	elasMultigrid.h
+ *  @brief	The elastodynamic operators on the coarser levels of an octDMMG.
+ *  @author	Hari Sundar
+ *  @date	3/18/08
+ *
+ *  Creates the mass, stiffness and Raleigh damping operators on the DA of
+ *  every coarser level of an octree multigrid, with the material properties
+ *  of the finest level averaged over the coarser elements. The operators
+ *  are passed to the time stepper with timeStepper::setMultigrid().
+ */
+
+#ifndef __ELAS_MULTIGRID_H_
+#define __ELAS_MULTIGRID_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "octdamgHeader.h"
+#include "elasMass.h"
+#include "elasStiffness.h"
+#include "raleighDamping.h"
+
+class elasMultigrid {
+  public:
+    elasMultigrid();
+    ~elasMultigrid();
+
+    /**
+     *  @brief  creates the operators of the levels 0 .. nlevels-2 of dmmg.
+     *  @param  rho, lambda, mu the material properties on the finest level
+     *  @param  alpha, beta the coefficients of the Raleigh damping
+     **/
+    int init(octDMMG *dmmg, Vec rho, Vec lambda, Vec mu, unsigned int dof, double alpha, double beta);
+
+    int destroy();
+
+    std::vector<feMat*>& getMass() {
+      return m_Mass;
+    }
+
+    std::vector<feMat*>& getDamping() {
+      return m_Damping;
+    }
+
+    std::vector<feMat*>& getStiffness() {
+      return m_Stiffness;
+    }
+
+  private:
+    // coarsest first, as the levels of the octDMMG
+    std::vector<feMat*>   m_Mass;
+    std::vector<feMat*>   m_Damping;
+    std::vector<feMat*>   m_Stiffness;
+
+    // rho, lambda and mu of every coarse level
+    std::vector< std::vector<Vec> >  m_material;
+};
+
+elasMultigrid::elasMultigrid() {
+}
+
+elasMultigrid::~elasMultigrid() {
+  destroy();
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "elasMultigrid_init"
+int elasMultigrid::init(octDMMG *dmmg, Vec rho, Vec lambda, Vec mu, unsigned int dof, double alpha, double beta) {
+  int ierr;
+  int nlevels = octDMMGGetLevels(dmmg);
+
+  destroy();
+  if (nlevels < 2)
+    return(0);
+
+  m_material.resize(nlevels-1);
+  m_Mass.resize(nlevels-1);
+  m_Damping.resize(nlevels-1);
+  m_Stiffness.resize(nlevels-1);
+
+  std::vector<Vec> fine(3);
+  fine[0] = rho; fine[1] = lambda; fine[2] = mu;
+
+  for (int i=nlevels-2; i>=0; i--) {
+    ierr = octDMMGRestrictElemental(dmmg, i+1, (i == nlevels-2) ? fine : m_material[i+1], m_material[i]); CHKERRQ(ierr);
+
+    elasMass *Mass = new elasMass(feMat::OCT);
+    Mass->setProblemDimensions(1.0, 1.0, 1.0);
+    Mass->setDA(dmmg[i]->da);
+    Mass->setDof(dof);
+    Mass->setDensity(m_material[i][0]);
+
+    elasStiffness *Stiffness = new elasStiffness(feMat::OCT);
+    Stiffness->setProblemDimensions(1.0, 1.0, 1.0);
+    Stiffness->setDA(dmmg[i]->da);
+    Stiffness->setDof(dof);
+    Stiffness->setLame(m_material[i][1], m_material[i][2]);
+
+    raleighDamping *Damping = new raleighDamping(feMat::OCT);
+    Damping->setAlpha(alpha);
+    Damping->setBeta(beta);
+    Damping->setMassMatrix(Mass);
+    Damping->setStiffnessMatrix(Stiffness);
+    Damping->setDA(dmmg[i]->da);
+    Damping->setDof(dof);
+
+    // the coarse operators are timed separately from the fine ones
+    char suffix[16];
+    sprintf(suffix, ".level%d", i);
+    Mass->setName(std::string("elasMass") + suffix);
+    Stiffness->setName(std::string("elasStiffness") + suffix);
+    Damping->setName(std::string("raleighDamping") + suffix);
+
+    m_Mass[i] = Mass;
+    m_Stiffness[i] = Stiffness;
+    m_Damping[i] = Damping;
+  }
+
+  return(0);
+}
+
+int elasMultigrid::destroy() {
+  for (unsigned int i=0; i<m_Mass.size(); i++) {
+    delete m_Damping[i];
+    delete m_Stiffness[i];
+    delete m_Mass[i];
+  }
+  m_Mass.clear(); m_Damping.clear(); m_Stiffness.clear();
+
+  for (unsigned int i=0; i<m_material.size(); i++)
+    for (unsigned int j=0; j<m_material[i].size(); j++)
+      VecDestroy(m_material[i][j]);
+  m_material.clear();
+
+  return(0);
+}
+
+#endif
@@ -72,6 +72,15 @@ public:
   inline bool ElementalMatVec(int i, int j, int k, PetscScalar ***in, PetscScalar ***out, double scale);
   inline bool ElementalMatVec(unsigned int idx, PetscScalar *in, PetscScalar *out, double scale);
 
+  /**
+   *  @brief  unrolled 3-dof kernels, the element matrix lambda*A + mu*B is 
+   *  applied to the 24 gathered values. Other dofs use ElementalMatVec().
+   **/
+  template <unsigned int DOF>
+  inline bool ElementalMatVecT(int i, int j, int k, PetscScalar ***in, PetscScalar ***out, double scale);
+  template <unsigned int DOF, bool HANGING>
+  inline bool ElementalMatVecT(unsigned int idx, PetscScalar *in, PetscScalar *out, double scale);
+
   inline bool GetElementalMatrix(int i, int j, int k, PetscScalar *mat);
   inline bool GetElementalMatrix(unsigned int idx, std::vector<ot::MatRecord>& records);
 
@@ -108,6 +117,10 @@ private:
   double xFac, yFac, zFac;
   unsigned int maxD;
 
+  // the regular grid stencils (lambda, mu) as doubles
+  double    m_dK[2*24*24];
+  // local corners, for the elemental index of the Lame parameters
+  PetscInt  m_iXs, m_iYs, m_iZs, m_iXm, m_iYm;
 };
 
 elasStiffness::elasStiffness(daType da) {
@@ -197,6 +210,10 @@ bool elasStiffness::initStencils() {
       }//end k
     }//end j
     m_stencil = Aijk;
+    for (int j=0;j<24*24;j++) {
+      m_dK[j] = Bijk[0][j/24][j%24];
+      m_dK[24*24 + j] = Bijk[1][j/24][j%24];
+    }
 
   } else {
     m_stencil = NULL;
@@ -229,21 +246,22 @@ bool elasStiffness::preMatVec() {
 
     m_dHx = m_dHx; 
     m_dHx /= 72.0;
+
+    PetscInt zm;
+    CHKERRQ ( DAGetCorners(m_DA, &m_iXs, &m_iYs, &m_iZs, &m_iXm, &m_iYm, &zm) );
   } else {
     PetscScalar *mu; 
     PetscScalar *lambda; 
     // Get nuarray
-    m_octDA->vecGetBuffer(muVec, mu, false, false, true,m_uiDof);
-    m_octDA->vecGetBuffer(lambdaVec, lambda, false, false, true,m_uiDof);
+    m_octDA->vecGetBuffer(muVec, mu, false, false, true, 1);
+    m_octDA->vecGetBuffer(lambdaVec, lambda, false, false, true, 1);
     m_mu = mu;
     m_lambda = lambda;
 
     // compute Hx
     // For octree Hx values will change per element, so has to be 
     // computed inside the loop.
-    unsigned int maxD = m_octDA->getMaxDepth();
-
-    double xFac,yFac,zFac;
+    maxD = m_octDA->getMaxDepth();
 
     // Get the  x,y,z factors 
     xFac = 1.0/((double)(1<<(maxD-1)));
@@ -302,6 +320,44 @@ bool elasStiffness::ElementalMatVec(unsigned int i, PetscScalar *in, PetscScalar
   return true;
 }
 
+template <unsigned int DOF, bool HANGING>
+bool elasStiffness::ElementalMatVecT(unsigned int i, PetscScalar *in, PetscScalar *out, double scale) {
+  if (DOF != 3)
+    return ElementalMatVec(i, in, out, scale);
+
+  unsigned int lev = m_octDA->getLevel(i);
+  double fac = xFac*(1<<(maxD - lev));
+
+  stdElemType elemType = ST_0;
+  ot::DA::index idx[8];
+  if (HANGING)
+    alignElementAndVertices(m_octDA, elemType, idx);
+  else
+    m_octDA->getNodeIndices(idx);
+
+  unsigned int chNum = m_octDA->getChildNumber();
+  double *K = (double *)m_stencil;
+  const double *A = K + (chNum*18 + elemType)*24*24;
+  const double *B = K + ((8+chNum)*18 + elemType)*24*24;
+
+  double lam = fac*((PetscScalar *) m_lambda)[i];
+  double mu  = fac*((PetscScalar *) m_mu)[i];
+
+  double u[24];
+  for (int j=0;j<8;j++) {
+    u[3*j]   = in[3*idx[j]];
+    u[3*j+1] = in[3*idx[j]+1];
+    u[3*j+2] = in[3*idx[j]+2];
+  }
+  for (int k=0;k<24;k++) {
+    double s = 0.0;
+    for (int j=0;j<24;j++)
+      s += (lam*A[24*k+j] + mu*B[24*k+j])*u[j];
+    out[3*idx[k/3] + k%3] += s;
+  }
+  return true;
+}
+
 bool elasStiffness::GetElementalMatrix(unsigned int i, std::vector<ot::MatRecord>& records) {
 	unsigned int lev = m_octDA->getLevel(i);
 	double hx = xFac*(1<<(maxD - lev));
@@ -432,6 +488,38 @@ bool elasStiffness::ElementalMatVec(int i, int j, int k, PetscScalar ***in, Pets
       */
     }
   }
+  return true;
+}
+
+template <unsigned int DOF>
+bool elasStiffness::ElementalMatVecT(int i, int j, int k, PetscScalar ***in, PetscScalar ***out, double scale) {
+  if (DOF != 3)
+    return ElementalMatVec(i, j, k, in, out, scale);
+
+  PetscScalar *u[8] = { in[k][j] + 3*i, in[k][j] + 3*i+3, in[k][j+1] + 3*i, in[k][j+1] + 3*i+3,
+                        in[k+1][j] + 3*i, in[k+1][j] + 3*i+3, in[k+1][j+1] + 3*i, in[k+1][j+1] + 3*i+3 };
+  PetscScalar *v[8] = { out[k][j] + 3*i, out[k][j] + 3*i+3, out[k][j+1] + 3*i, out[k][j+1] + 3*i+3,
+                        out[k+1][j] + 3*i, out[k+1][j] + 3*i+3, out[k+1][j+1] + 3*i, out[k+1][j+1] + 3*i+3 };
+
+  double fac = -m_dHx*scale;
+  unsigned int e = ((k-m_iZs)*m_iYm + j - m_iYs)*m_iXm + i - m_iXs;
+  double lam = fac*((PetscScalar *) m_lambda)[e];
+  double mu  = fac*((PetscScalar *) m_mu)[e];
+
+  const double *A = m_dK;
+  const double *B = m_dK + 24*24;
+
+  double x[24];
+  for (int r = 0; r < 8; r++) {
+    x[3*r] = u[r][0]; x[3*r+1] = u[r][1]; x[3*r+2] = u[r][2];
+  }
+  for (int q = 0; q < 24; q++) {
+    double s = 0.0;
+    for (int r = 0; r < 24; r++)
+      s += (lam*A[24*q+r] + mu*B[24*q+r])*x[r];
+    v[q/3][q%3] += s;
+  }
+  return true;
 }
 
 bool elasStiffness::postMatVec() {
@@ -442,9 +530,9 @@ bool elasStiffness::postMatVec() {
     CHKERRQ( VecRestoreArray(lambdaVec, &lam) );
   } else {
     PetscScalar *mu = (PetscScalar *)m_mu;
-    m_octDA->vecRestoreBuffer(muVec, mu, false, false, true, m_uiDof);
+    m_octDA->vecRestoreBuffer(muVec, mu, false, false, true, 1);
     PetscScalar *lam = (PetscScalar *)m_lambda;
-    m_octDA->vecRestoreBuffer(lambdaVec, lam, false, false, true, m_uiDof);
+    m_octDA->vecRestoreBuffer(lambdaVec, lam, false, false, true, 1);
   }
   return true;
 }
@@ -17,16 +17,23 @@ static char help[] = "Driver for a estimate cardiac activations";
 #include "elasStiffness.h"
 #include "elasMass.h"
 #include "raleighDamping.h"
-#include "cardiacForce.h"
+#include "cardiacFiberForce.h"
 #include "parametricActivationInverse.h"
+#include "lbfgsActivationInverse.h"
 #include "radialBasis.h"
 #include "bSplineBasis.h"
+#include "perfLog.h"
+#include "spaceTimeComm.h"
 
 #define min(X, Y)  ((X) < (Y) ? (X) : (Y))
 
 int main(int argc, char **argv)
 {       
+  // -time_groups 2 bounds the memory of the gradient to a time slab, it is not
+  // faster than one group (see setReducedGradientPipelined), so it is off by default
+  spaceTimeComm::init(&argc, &argv);
   PetscInitialize(&argc, &argv, "elas.opt", help);
+  perfLog::init();
 
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -43,6 +50,31 @@ int main(int argc, char **argv)
   double t1 = 1.0;
   double beta = 0.000001;
 
+  // inexact Newton
+  PetscTruth inexact = PETSC_FALSE;
+  PetscTruth lsearch = PETSC_FALSE;
+  double etaMax = 0.5;
+  double gtol = 1e-6;
+
+  // L-BFGS
+  PetscTruth lbfgs = PETSC_FALSE;
+  PetscTruth hybrid = PETSC_FALSE;
+  int lbfgsHistory = 5;
+  int maxIter = 1;
+
+  // POD surrogate for the early Gauss-Newton iterations
+  PetscTruth pod = PETSC_FALSE;
+  int podModes = 40;
+  double podTol = 1e-3;
+  double podSwitch = 1e-2;
+
+  // landmarks tracked with markTags, instead of the full displacements
+  char lmFile[PETSC_MAX_PATH_LEN];
+  PetscTruth useLandmarks = PETSC_FALSE;
+  PetscTruth lmSynthetic = PETSC_FALSE;
+  double lmSpacing = -1.0;
+  double lmSlice = 0.5;
+
   // double dtratio = 1.0;
   DA  da;         // Underlying scalar DA - for scalar properties
   DA  da3d;       // Underlying vector DA - for vector properties
@@ -92,6 +124,22 @@ int main(int argc, char **argv)
   CHKERRQ ( PetscOptionsGetScalar(0,"-t1",&t1,0) );
   CHKERRQ ( PetscOptionsGetScalar(0,"-dt",&dt,0) );
   CHKERRQ ( PetscOptionsGetScalar(0,"-beta",&beta,0) );
+  CHKERRQ ( PetscOptionsGetInt(0,"-maxit",&maxIter,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_inexact",&inexact,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_linesearch",&lsearch,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-inv_eta_max",&etaMax,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-inv_gtol",&gtol,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_lbfgs",&lbfgs,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_lbfgs_hybrid",&hybrid,0) );
+  CHKERRQ ( PetscOptionsGetInt(0,"-inv_lbfgs_m",&lbfgsHistory,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_pod",&pod,0) );
+  CHKERRQ ( PetscOptionsGetInt(0,"-inv_pod_modes",&podModes,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-inv_pod_tol",&podTol,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-inv_pod_switch",&podSwitch,0) );
+  CHKERRQ ( PetscOptionsGetString(0,"-lm_file",lmFile,PETSC_MAX_PATH_LEN-1,&useLandmarks) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-lm_spacing",&lmSpacing,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-lm_slice",&lmSlice,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-lm_synthetic",&lmSynthetic,0) );
   CHKERRQ ( PetscOptionsGetString(PETSC_NULL,"-pn",problemName,PETSC_MAX_PATH_LEN-1,PETSC_NULL));
 
   if (!rank) {
@@ -114,8 +162,12 @@ int main(int argc, char **argv)
   elasMass *Mass = new elasMass(feMat::PETSC); // Mass Matrix
   elasStiffness *Stiffness = new elasStiffness(feMat::PETSC); // Stiffness matrix
   raleighDamping *Damping = new raleighDamping(feMat::PETSC); // Damping Matrix
+  // the names of the operators in the perfLog summary
+  Mass->setName("elasMass");
+  Stiffness->setName("elasStiffness");
+  Damping->setName("raleighDamping");
 
-  cardiacForce *Force = new cardiacForce(feVec::PETSC); // Force Vector
+  cardiacFiberForce *Force = new cardiacFiberForce(feVec::PETSC); // Force Vector
 
   // create vectors 
   CHKERRQ( DACreateGlobalVector(da, &rho) );
@@ -300,11 +352,13 @@ int main(int argc, char **argv)
 	
 	// DONE FIBERS
 
-	CHKERRQ( DACreateGlobalVector(da, &tmpTau) );
+  // elemental activations of all timesteps, converted to nodal in one batch
+  std::vector<Vec> tmpTaus;
 	
   // double tauNorm;
   for (unsigned int t=0; t<numSteps+1; t++) {
     CHKERRQ( DACreateGlobalVector(da, &tauVec) );
+    CHKERRQ( DACreateGlobalVector(da, &tmpTau) );
     CHKERRQ( VecSet( tmpTau, 0.0));
 
     CHKERRQ(DAVecGetArray(da, tmpTau, &tauArray));
@@ -327,21 +381,18 @@ int main(int argc, char **argv)
     // VecNorm(tauVec, NORM_2, &tauNorm);
     // tauNorm = tauNorm/pow(Ns,1.5);
     //std::cout << "Activation Norm is " << tauNorm << std::endl;
-    // std::cout << rank << " Converting to Nodal" << std::endl;
-    elementToNode(da, tmpTau, tauVec);
-    /*
-    VecNorm(tauVec, NORM_2, &tauNorm);
-    tauNorm = tauNorm/pow(Ns,1.5);
-    std::cout << "Nodal Norm is " << tauNorm << std::endl;
-    */
-    // std::cout << rank << " Done converting to Nodal Vector" << std::endl;
+    tmpTaus.push_back(tmpTau);
     tau.push_back(tauVec);
   }
+  // std::cout << rank << " Converting to Nodal" << std::endl;
+  elementToNode(da, tmpTaus, tau);
  // if (!rank) {
  // std::cout << "Finished setting activation" << std::endl;
  // }
 
-  CHKERRQ( VecDestroy( tmpTau ) );
+  for (unsigned int t=0; t<tmpTaus.size(); t++) {
+    CHKERRQ( VecDestroy( tmpTaus[t] ) );
+  }
   delete [] tmp_tau;
 
   std::cout << "Finished reading all files" << std::endl;
@@ -369,11 +420,19 @@ int main(int argc, char **argv)
   // Force Vector
   Force->setProblemDimensions(1.0,1.0,1.0);
   Force->setDA(da3d);
+  Force->setDAScalar(da);
   Force->setActivationVec(tau);
   Force->setFiberOrientations(fibers);
   // Force->setFDynamic(newF);
   Force->setTimeInfo(&ti);
 
+  PetscTruth adjTest = PETSC_FALSE;
+  PetscOptionsHasName(0, "-force_adjoint_test", &adjTest);
+  if (adjTest) {
+    double adjErr;
+    CHKERRQ( Force->adjointTest(adjErr) );
+  }
+
   // Newmark time stepper ...
   newmark *ts = new newmark; 
 
@@ -423,7 +482,15 @@ int main(int argc, char **argv)
   VecZeroEntries(guess);
 
   // Inverse solver set up
-  parametricActivationInverse *hyperInv = new parametricActivationInverse;
+  parametricActivationInverse *hyperInv;
+  if (lbfgs || hybrid) {
+    lbfgsActivationInverse *qnInv = new lbfgsActivationInverse;
+    qnInv->setHistorySize(lbfgsHistory);
+    qnInv->setHybrid(hybrid == PETSC_TRUE);
+    hyperInv = qnInv;
+  } else {
+    hyperInv = new parametricActivationInverse;
+  }
   PetscPrintf(0, "Constructed\n");
 
 	hyperInv->setScalarDA(da);
@@ -436,6 +503,34 @@ int main(int argc, char **argv)
   hyperInv->setInitialGuess(guess);// set the initial guess 
   hyperInv->setRegularizationParameter(beta); // set the regularization paramter
   hyperInv->setObservations(solvec); // set the data for the problem 
+
+  landmarkObservation *landmarks = NULL;
+  if (useLandmarks) {
+    landmarks = new landmarkObservation(feVec::PETSC);
+    landmarks->setProblemDimensions(1.0,1.0,1.0);
+    landmarks->setDA(da3d);
+    landmarks->setTimeInfo(&ti);
+    // pixels of the Ns^3 image by default
+    if (lmSpacing <= 0.0)
+      lmSpacing = 1.0/Ns;
+    landmarks->setImageGeometry(lmSpacing, lmSpacing, lmSlice);
+    CHKERRQ ( landmarks->readLandmarks(lmFile) );
+    CHKERRQ ( landmarks->build() );
+    // sample the synthetic forward solution at the landmarks instead of using the tracked motion
+    if (lmSynthetic)
+      landmarks->setObservations(solvec);
+    hyperInv->setLandmarkObservations(landmarks);
+  }
+  hyperInv->setMaximumNumberOfIterations(maxIter);
+  hyperInv->setInexactNewton(inexact == PETSC_TRUE);
+  hyperInv->setLineSearch(lsearch == PETSC_TRUE);
+  hyperInv->setMaxForcingTerm(etaMax);
+  hyperInv->setParamsTolerance(gtol);
+  if (pod && !(lbfgs || hybrid))
+    hyperInv->useSurrogate(podModes, podTol, podSwitch);
+  int numSlabs = 8;
+  CHKERRQ ( PetscOptionsGetInt(0,"-time_slabs",&numSlabs,0) );
+  hyperInv->setTimeSlabs(numSlabs);
   if (!rank)
     std::cout << "Initializing hyperInv" << std::endl;
   hyperInv->init(); // initialize the inverse solver
@@ -444,6 +539,9 @@ int main(int argc, char **argv)
   PetscPrintf(0, "Done Inverse solve\n");
   hyperInv->getCurrentControl(guess); // get the solution 
 
+  if (landmarks != NULL)
+    delete landmarks;
+
 
 
   // see the error in the solution relative to the actual solution
@@ -454,7 +552,10 @@ int main(int argc, char **argv)
   iC(VecNorm(Err, NORM_2, &errnorm));
   PetscPrintf(0,"errr in inverse = %g\n", errnorm/exsolnorm);
 	*/
+  perfLog::summary(problemName);
+  vecPool::clear();
   PetscFinalize();
+  spaceTimeComm::finalize();
 }
 
 
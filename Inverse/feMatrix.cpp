@@ -59,6 +59,11 @@ template <typename T>
 feMatrix<T>::~feMatrix() {
 }
 
+template <typename T>
+void feMatrix<T>::setName(std::string name) {
+	m_strMatrixType = name;
+}
+
 
 #undef __FUNCT__
 #define __FUNCT__ "feMatrix_MatGetDiagonal"
@@ -182,6 +187,13 @@ template <typename T>
 bool feMatrix<T>::MatVec(Vec _in, Vec _out, double scale){
 	PetscFunctionBegin;
 
+	// the operators are keyed by name in the perfLog summary
+	if ( m_strMatrixType.empty() ) {
+		SETERRQ(PETSC_ERR_ARG_WRONGSTATE, "feMatrix has no name, call setName() before MatVec()");
+	}
+
+	double pStart = perfLog::now();
+
 #ifdef __DEBUG__
 	assert ( ( m_daType == PETSC ) || ( m_daType == OCT ) );
 #endif
@@ -241,15 +253,21 @@ bool feMatrix<T>::MatVec(Vec _in, Vec _out, double scale){
 		// Any derived class initializations ...
 		preMatVec();
 
-		// loop through all elements ...
-		for (int k=z; k<z+zne; k++) {
-			for (int j=y; j<y+yne; j++) {
-				for (int i=x; i<x+xne; i++) {
-					// std::cout << i <<"," << j << "," << k << std::endl;
-					ElementalMatVec(i, j, k, in, out, scale);
-				} // end i
-			} // end j
-		} // end k
+		// loop through all elements, with the kernel for this dof
+#ifdef __FE_RUNTIME_KERNELS__
+		regularMatVec<0>(x, y, z, xne, yne, zne, in, out, scale);
+#else
+		switch (m_uiDof) {
+			case 1:
+				regularMatVec<1>(x, y, z, xne, yne, zne, in, out, scale);
+				break;
+			case 3:
+				regularMatVec<3>(x, y, z, xne, yne, zne, in, out, scale);
+				break;
+			default:
+				regularMatVec<0>(x, y, z, xne, yne, zne, in, out, scale);
+		}
+#endif
 
 		postMatVec();
 
@@ -281,19 +299,21 @@ bool feMatrix<T>::MatVec(Vec _in, Vec _out, double scale){
 		m_octDA->ReadFromGhostsBegin<PetscScalar>(in, m_uiDof);
 		preMatVec();
 
-		// Independent loop, loop through the nodes this processor owns..
-		for ( m_octDA->init<ot::DA::INDEPENDENT>(), m_octDA->init<ot::DA::WRITABLE>(); m_octDA->curr() < m_octDA->end<ot::DA::INDEPENDENT>(); m_octDA->next<ot::DA::INDEPENDENT>() ) {
-			ElementalMatVec( m_octDA->curr(), in, out, scale); 
-		}//end INDEPENDENT
-
-		// Wait for communication to end.
-		//m_octDA->updateGhostsEnd<PetscScalar>(in);
-		m_octDA->ReadFromGhostsEnd<PetscScalar>(in);
-
-		// Dependent loop ...
-		for ( m_octDA->init<ot::DA::DEPENDENT>(), m_octDA->init<ot::DA::WRITABLE>(); m_octDA->curr() < m_octDA->end<ot::DA::DEPENDENT>(); m_octDA->next<ot::DA::DEPENDENT>() ) {
-			ElementalMatVec( m_octDA->curr(), in, out, scale); 
-		}//end DEPENDENT
+		// the independent and dependent loops, with the kernels for this dof
+#ifdef __FE_RUNTIME_KERNELS__
+		octMatVec<0>(in, out, scale);
+#else
+		switch (m_uiDof) {
+			case 1:
+				octMatVec<1>(in, out, scale);
+				break;
+			case 3:
+				octMatVec<3>(in, out, scale);
+				break;
+			default:
+				octMatVec<0>(in, out, scale);
+		}
+#endif
 
 		postMatVec();
 
@@ -303,10 +323,55 @@ bool feMatrix<T>::MatVec(Vec _in, Vec _out, double scale){
 
 	}
 
+	// vector traffic: read in, read and write out
+	PetscInt localSz;
+	VecGetLocalSize(_in, &localSz);
+	perfLog::matVec(getName(), 3.0*localSz*sizeof(PetscScalar), perfLog::now() - pStart);
+
 	PetscFunctionReturn(0);
 }
 
 
+template <typename T>
+template <unsigned int DOF>
+void feMatrix<T>::regularMatVec(int x, int y, int z, int xne, int yne, int zne, PetscScalar ***in, PetscScalar ***out, double scale) {
+	for (int k=z; k<z+zne; k++) {
+		for (int j=y; j<y+yne; j++) {
+			for (int i=x; i<x+xne; i++) {
+				asLeaf().template ElementalMatVecT<DOF>(i, j, k, in, out, scale);
+			} // end i
+		} // end j
+	} // end k
+}
+
+/**
+*  @brief  The octree element loops of MatVec(), the ghosts of in are read 
+*  during the independent loop. Elements without hanging nodes, the common 
+*  case, use the HANGING = false kernels.
+**/
+template <typename T>
+template <unsigned int DOF>
+void feMatrix<T>::octMatVec(PetscScalar *in, PetscScalar *out, double scale) {
+	// Independent loop, loop through the nodes this processor owns..
+	for ( m_octDA->init<ot::DA::INDEPENDENT>(), m_octDA->init<ot::DA::WRITABLE>(); m_octDA->curr() < m_octDA->end<ot::DA::INDEPENDENT>(); m_octDA->next<ot::DA::INDEPENDENT>() ) {
+		if ( m_octDA->isHanging(m_octDA->curr()) )
+			asLeaf().template ElementalMatVecT<DOF, true>( m_octDA->curr(), in, out, scale);
+		else
+			asLeaf().template ElementalMatVecT<DOF, false>( m_octDA->curr(), in, out, scale);
+	}//end INDEPENDENT
+
+	// Wait for communication to end.
+	m_octDA->ReadFromGhostsEnd<PetscScalar>(in);
+
+	// Dependent loop ...
+	for ( m_octDA->init<ot::DA::DEPENDENT>(), m_octDA->init<ot::DA::WRITABLE>(); m_octDA->curr() < m_octDA->end<ot::DA::DEPENDENT>(); m_octDA->next<ot::DA::DEPENDENT>() ) {
+		if ( m_octDA->isHanging(m_octDA->curr()) )
+			asLeaf().template ElementalMatVecT<DOF, true>( m_octDA->curr(), in, out, scale);
+		else
+			asLeaf().template ElementalMatVecT<DOF, false>( m_octDA->curr(), in, out, scale);
+	}//end DEPENDENT
+}
+
 #undef __FUNCT__
 #define __FUNCT__ "feMatrix_MatAssemble"
 template <typename T>
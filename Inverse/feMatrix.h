@@ -4,6 +4,7 @@
 #include <string>
 #include "feMat.h"
 #include "timeInfo.h"
+#include "perfLog.h"
 
 template <typename T>
 class feMatrix : public feMat {
@@ -45,6 +46,13 @@ class feMatrix : public feMat {
 
   void setName(std::string name);
 
+  /**
+   *  @brief  name used for instrumentation, set with setName(), MatVec() fails without one.
+   **/
+  const char* getName() {
+    return m_strMatrixType.c_str();
+  }
+
   /**
    * 	@brief		The matrix-vector multiplication routine that is used by
    * 				matrix-free methods. 
@@ -115,6 +123,25 @@ class feMatrix : public feMat {
     return asLeaf().ElementalMatGetDiagonal(index, diag, scale);  
   }
 
+  /**
+   *  @brief  Elemental matvecs with the dof, and for the octree whether the 
+   *  element has hanging nodes, as template parameters.
+   *
+   *  MatVec() selects the instantiation from m_uiDof once for the whole element
+   *  loop, so that derived classes can provide kernels with fully unrolled loops
+   *  and without the runtime branches. The defaults call the runtime versions.
+   *  DOF = 0 stands for the runtime dof.
+   **/
+  template <unsigned int DOF>
+  inline bool ElementalMatVecT(int i, int j, int k, PetscScalar ***in, PetscScalar ***out, double scale) {
+    return asLeaf().ElementalMatVec(i,j,k,in,out,scale);  
+  }
+
+  template <unsigned int DOF, bool HANGING>
+  inline bool ElementalMatVecT(unsigned int index, PetscScalar *in, PetscScalar *out, double scale) {
+    return asLeaf().ElementalMatVec(index, in, out, scale);  
+  }
+
   // PetscErrorCode matVec(Vec in, Vec out, timeInfo info);
 
   /**
@@ -184,6 +211,12 @@ class feMatrix : public feMat {
   inline PetscErrorCode reOrderIndices(unsigned char eType, ot::DA::index* indices);
 
 protected:
+  template <unsigned int DOF>
+  void regularMatVec(int x, int y, int z, int xne, int yne, int zne, PetscScalar ***in, PetscScalar ***out, double scale);
+
+  template <unsigned int DOF>
+  void octMatVec(PetscScalar *in, PetscScalar *out, double scale);
+
   void *          	m_stencil;
 
   std::string     	m_strMatrixType;
@@ -220,6 +220,8 @@ template <typename T>
 bool feVector<T>::addVec(Vec _in, double scale, int indx){
   PetscFunctionBegin;
 
+  perfLog::scope timer(perfLog::FORCE_ASSEMBLY);
+
 #ifdef __DEBUG__
   assert ( ( m_daType == PETSC ) || ( m_daType == OCT ) );
 #endif
@@ -344,6 +346,7 @@ bool feVector<T>::addVec(Vec _in, double scale, int indx){
 
   }
 
+
   PetscFunctionReturn(0);
 }
 
@@ -4,6 +4,7 @@
 #include <string>
 #include "feVec.h"
 #include "timeInfo.h"
+#include "perfLog.h"
 
 template <typename T>
 class feVector : public feVec {
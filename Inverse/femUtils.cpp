@@ -1,61 +1,79 @@
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+
 #include "femUtils.h"
 
 int elementToNode( DA da, Vec elementVec, Vec nodeVec) {
+  std::vector<Vec> elementVecs(1, elementVec);
+  std::vector<Vec> nodeVecs(1, nodeVec);
+
+  return elementToNode(da, elementVecs, nodeVecs);
+}
+
+int elementToNode(DA da, std::vector<Vec> &elementVecs, std::vector<Vec> &nodeVecs) {
 #ifdef __DEBUG__  
   std::cout << RED"Entering "NRM << __func__ << std::endl;
 #endif  
   int ierr;
   int x,y,z,m,n,p;
-  int mx,my,mz, xne, yne, zne;
-  int rank;
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int mx,my,mz;
   int dof=1;
+  unsigned int nf = elementVecs.size();
   PetscScalar ***elem;
   PetscScalar ***node;
   CHKERRQ( DAGetCorners(da, &x, &y, &z, &m, &n, &p) ); 
   CHKERRQ( DAGetInfo(da,0, &mx, &my, &mz, 0,0,0,&dof,0,0,0) ); 
-  if (x+m == mx) {
-    xne=m-1;
-  } else {
-    xne=m;
-  }
-  if (y+n == my) {
-    yne=n-1;
-  } else {
-    yne=n;
-  }
-  if (z+p == mz) {
-    zne=p-1;
-  } else {
-    zne=p;
-  }
-  Vec localVec;
-
-  CHKERRQ( DACreateLocalVector(da, &localVec) );
-  CHKERRQ( VecSet( localVec, 0.0));
-  ierr = DAVecGetArray(da, elementVec,&elem); CHKERRQ(ierr);
-  ierr = DAVecGetArray(da, localVec,&node); CHKERRQ(ierr);
-  for (int k=z; k<z+zne; k++) {
-    for (int j=y; j<y+yne; j++) {
-      for (int i=x; i<x+xne; i++) {
-        for (int d=0; d<dof; d++) {
-          node[k][j][dof*i+d]         += elem[k][j][dof*i+d]/8.0; 
-          node[k][j][dof*(i+1)+d]     += elem[k][j][dof*i+d]/8.0;
-          node[k][j+1][dof*i+d]       += elem[k][j][dof*i+d]/8.0; 
-          node[k][j+1][dof*(i+1)+d]   += elem[k][j][dof*i+d]/8.0;
-          node[k+1][j][dof*i+d]       += elem[k][j][dof*i+d]/8.0; 
-          node[k+1][j][dof*(i+1)+d]   += elem[k][j][dof*i+d]/8.0;
-          node[k+1][j+1][dof*i+d]     += elem[k][j][dof*i+d]/8.0; 
-          node[k+1][j+1][dof*(i+1)+d] += elem[k][j][dof*i+d]/8.0;
-        } // d
-      }  // i
-    } // j
-  } // k
-  
-  ierr = DAVecRestoreArray(da, elementVec, &elem); CHKERRQ(ierr);
-  ierr = DAVecRestoreArray(da, localVec, &node); CHKERRQ(ierr);
-  ierr = DALocalToGlobalBegin(da, localVec, nodeVec); CHKERRQ(ierr);
-  ierr = DALocalToGlobalEnd(da, localVec, nodeVec); CHKERRQ(ierr);
+
+  // the elements are indexed by their first node, the last node in each
+  // direction is not an element.
+  int nex = mx-1, ney = my-1, nez = mz-1;
+
+  // ghosted elements of all fields, exchanged together
+  std::vector<Vec> localVecs(nf);
+  for (unsigned int f=0; f<nf; f++) {
+    CHKERRQ( DAGetLocalVector(da, &localVecs[f]) );
+    ierr = DAGlobalToLocalBegin(da, elementVecs[f], INSERT_VALUES, localVecs[f]); CHKERRQ(ierr);
+  }
+  for (unsigned int f=0; f<nf; f++) {
+    ierr = DAGlobalToLocalEnd(da, elementVecs[f], INSERT_VALUES, localVecs[f]); CHKERRQ(ierr);
+  }
+
+  for (unsigned int f=0; f<nf; f++) {
+    ierr = DAVecGetArray(da, localVecs[f], &elem); CHKERRQ(ierr);
+    ierr = DAVecGetArray(da, nodeVecs[f], &node); CHKERRQ(ierr);
+    for (int k=z; k<z+p; k++) {
+      // incident elements in z and y
+      int ks[2], nk=0;
+      if (k > 0)   ks[nk++] = k-1;
+      if (k < nez) ks[nk++] = k;
+      for (int j=y; j<y+n; j++) {
+        int js[2], nj=0;
+        if (j > 0)   js[nj++] = j-1;
+        if (j < ney) js[nj++] = j;
+
+        PetscScalar *nrow = node[k][j];
+        for (int i=dof*x; i<dof*(x+m); i++)
+          nrow[i] = 0.0;
+
+        for (int a=0; a<nk; a++) {
+          for (int b=0; b<nj; b++) {
+            PetscScalar *erow = elem[ks[a]][js[b]];
+            // element i-1
+            for (int i=dof*((x > 0) ? x : 1); i<dof*(x+m); i++)
+              nrow[i] += erow[i-dof]/8.0;
+            // element i
+            for (int i=dof*x; i<dof*((x+m < nex) ? x+m : nex); i++)
+              nrow[i] += erow[i]/8.0;
+          }
+        }
+      } // j
+    } // k
+    ierr = DAVecRestoreArray(da, localVecs[f], &elem); CHKERRQ(ierr);
+    ierr = DAVecRestoreArray(da, nodeVecs[f], &node); CHKERRQ(ierr);
+    CHKERRQ( DARestoreLocalVector(da, &localVecs[f]) );
+  }
 #ifdef __DEBUG__  
   std::cout << GRN"Leaving "NRM << __func__ << std::endl;
 #endif  
@@ -63,13 +81,33 @@ int elementToNode( DA da, Vec elementVec, Vec nodeVec) {
 }
 
 int elementToNode(ot::DA da, Vec elementVec, Vec nodeVec, unsigned int dof) {
+  std::vector<Vec> elementVecs(1, elementVec);
+  std::vector<Vec> nodeVecs(1, nodeVec);
+
+  return elementToNode(da, elementVecs, nodeVecs, dof);
+}
+
+int elementToNode(ot::DA &da, std::vector<Vec> &elementVecs, std::vector<Vec> &nodeVecs, unsigned int dof) {
 #ifdef __DEBUG__  
   std::cout << RED"Entering "NRM << __func__ << std::endl;
 #endif  
-  PetscScalar *elem, *node;
+  unsigned int nf = elementVecs.size();
+  unsigned int stride = nf*dof;
+  unsigned int bufSz = da.getLocalBufferSize();
+  std::vector<PetscScalar *> elem(nf), node(nf);
 
-  da.vecGetBuffer(elementVec, elem, true, false, true, dof);
-  da.vecGetBuffer(nodeVec, node, false, true, false, dof);
+  for (unsigned int f=0; f<nf; f++) {
+    da.vecGetBuffer(elementVecs[f], elem[f], true, false, true, dof);
+    da.vecGetBuffer(nodeVecs[f], node[f], false, true, false, dof);
+  }
+
+  // all fields packed per node, so that a single traversal and a single
+  // ghost exchange suffice.
+  std::vector<PetscScalar> packed(bufSz*stride);
+  for (unsigned int n=0; n<bufSz; n++)
+    for (unsigned int f=0; f<nf; f++)
+      for (unsigned int d=0; d<dof; d++)
+        packed[stride*n + dof*f + d] = node[f][dof*n + d];
 
   // loop ...
   for ( da.init<ot::DA::ALL>(), da.init<ot::DA::WRITABLE>(); da.curr() < da.end<ot::DA::ALL>(); da.next<ot::DA::ALL>()) {
@@ -79,21 +117,31 @@ int elementToNode(ot::DA da, Vec elementVec, Vec nodeVec, unsigned int dof) {
     
     unsigned char hn = da.getHangingNodeIndex(da.curr());
 
-    for (int d=0; d<dof; d++) {
-      for(int i = 0; i < 8; i++) {
-        if (!(hn & (1 << i))) {          
-            node[dof*indices[i]+d] += elem[dof*currIndex + d]/8;
-        }
+    for(int i = 0; i < 8; i++) {
+      if (!(hn & (1 << i))) {          
+        PetscScalar *nd = &(packed[stride*indices[i]]);
+        for (unsigned int f=0; f<nf; f++)
+          for (unsigned int d=0; d<dof; d++)
+            nd[dof*f + d] += elem[f][dof*currIndex + d]/8;
       }
     }
   }
 
   // write to ghost nodes
-  da.WriteToGhostsBegin(node, dof);
-  da.WriteToGhostsEnd(node, dof);
+  if (bufSz) {
+    da.WriteToGhostsBegin(&(*(packed.begin())), stride);
+    da.WriteToGhostsEnd(&(*(packed.begin())), stride);
+  }
 
-  da.vecRestoreBuffer(elementVec, elem, true, true, true, dof);
-  da.vecRestoreBuffer(nodeVec, node, false, true, false, dof);
+  for (unsigned int n=0; n<bufSz; n++)
+    for (unsigned int f=0; f<nf; f++)
+      for (unsigned int d=0; d<dof; d++)
+        node[f][dof*n + d] = packed[stride*n + dof*f + d];
+
+  for (unsigned int f=0; f<nf; f++) {
+    da.vecRestoreBuffer(elementVecs[f], elem[f], true, true, true, dof);
+    da.vecRestoreBuffer(nodeVecs[f], node[f], false, true, false, dof);
+  }
 
 #ifdef __DEBUG__  
   std::cout << GRN"Leaving "NRM << __func__ << std::endl;
@@ -102,7 +150,56 @@ int elementToNode(ot::DA da, Vec elementVec, Vec nodeVec, unsigned int dof) {
 }
 
 int nodeToElement(DA da, Vec nodeVec, Vec elementVec) {
-  return 0;
+  std::vector<Vec> nodeVecs(1, nodeVec);
+  std::vector<Vec> elementVecs(1, elementVec);
+
+  return nodeToElement(da, nodeVecs, elementVecs);
+}
+
+int nodeToElement(DA da, std::vector<Vec> &nodeVecs, std::vector<Vec> &elementVecs) {
+  int ierr;
+  int x,y,z,m,n,p;
+  int mx,my,mz, xne, yne, zne;
+  int dof=1;
+  unsigned int nf = nodeVecs.size();
+  PetscScalar ***elem;
+  PetscScalar ***node;
+  CHKERRQ( DAGetCorners(da, &x, &y, &z, &m, &n, &p) ); 
+  CHKERRQ( DAGetInfo(da,0, &mx, &my, &mz, 0,0,0,&dof,0,0,0) ); 
+  xne = (x+m == mx) ? m-1 : m;
+  yne = (y+n == my) ? n-1 : n;
+  zne = (z+p == mz) ? p-1 : p;
+
+  // ghosted nodes of all fields, exchanged together
+  std::vector<Vec> localVecs(nf);
+  for (unsigned int f=0; f<nf; f++) {
+    CHKERRQ( DAGetLocalVector(da, &localVecs[f]) );
+    ierr = DAGlobalToLocalBegin(da, nodeVecs[f], INSERT_VALUES, localVecs[f]); CHKERRQ(ierr);
+  }
+  for (unsigned int f=0; f<nf; f++) {
+    ierr = DAGlobalToLocalEnd(da, nodeVecs[f], INSERT_VALUES, localVecs[f]); CHKERRQ(ierr);
+  }
+
+  for (unsigned int f=0; f<nf; f++) {
+    ierr = DAVecGetArray(da, localVecs[f], &node); CHKERRQ(ierr);
+    ierr = DAVecGetArray(da, elementVecs[f], &elem); CHKERRQ(ierr);
+    for (int k=z; k<z+zne; k++) {
+      for (int j=y; j<y+yne; j++) {
+        PetscScalar *erow = elem[k][j];
+        PetscScalar *n00 = node[k][j],   *n01 = node[k][j+1];
+        PetscScalar *n10 = node[k+1][j], *n11 = node[k+1][j+1];
+        for (int i=dof*x; i<dof*(x+xne); i++) {
+          erow[i] = ( n00[i] + n00[i+dof] + n01[i] + n01[i+dof] + 
+                      n10[i] + n10[i+dof] + n11[i] + n11[i+dof] )/8.0;
+        }
+      } // j
+    } // k
+    ierr = DAVecRestoreArray(da, localVecs[f], &node); CHKERRQ(ierr);
+    ierr = DAVecRestoreArray(da, elementVecs[f], &elem); CHKERRQ(ierr);
+    CHKERRQ( DARestoreLocalVector(da, &localVecs[f]) );
+  }
+
+  return(0);
 }
 
 /*
@@ -253,3 +350,343 @@ int splitVec(Vec ctrl, std::vector<Vec> &dyna, unsigned int nt) {
 }
 
 
+
+/*
+ * Octree <-> regular grid transfer.
+ */
+
+#define INTERP_PLAN_MAGIC "OCTPLN2"
+
+struct interpPlanHeader {
+  char          magic[8];
+  unsigned int  npes;
+  unsigned int  Ns;
+  unsigned int  maxDepth;
+  unsigned int  octHash;
+  unsigned int  numElems;
+  unsigned int  nnz;
+  unsigned int  numVox;
+  unsigned int  tnnz;
+};
+
+// length of the overlap of [a, a+len) with voxel [i*h, (i+1)*h)
+static inline double overlap1d(double a, double len, int i, double h) {
+  double lo = (a > i*h) ? a : i*h;
+  double hi = ((a+len) < (i+1)*h) ? (a+len) : (i+1)*h;
+  return (hi > lo) ? (hi - lo) : 0.0;
+}
+
+static bool interpPlanCompare(const std::pair<unsigned int, std::pair<unsigned int, double> > &a,
+    const std::pair<unsigned int, std::pair<unsigned int, double> > &b) {
+  return (a.first < b.first);
+}
+
+interpPlan::interpPlan() {
+  m_bBuilt = false;
+  m_uiNs = 0;
+  m_uiNumElems = 0;
+  m_uiMaxDepth = 0;
+  m_uiOctHash = 0;
+}
+
+// FNV-1a of the anchor, level and buffer index of the local elements
+static inline void fnvHash(unsigned int &hash, unsigned int val) {
+  for (int b=0; b<4; b++) {
+    hash ^= (val >> (8*b)) & 0xff;
+    hash *= 16777619u;
+  }
+}
+
+unsigned int interpPlan::octreeHash(ot::DA &da) {
+  unsigned int hash = 2166136261u;
+  for ( da.init<ot::DA::ALL>(), da.init<ot::DA::WRITABLE>(); da.curr() < da.end<ot::DA::ALL>(); da.next<ot::DA::ALL>()) {
+    Point pt = da.getCurrentOffset();
+    fnvHash(hash, pt.xint());
+    fnvHash(hash, pt.yint());
+    fnvHash(hash, pt.zint());
+    fnvHash(hash, da.getLevel(da.curr()));
+    fnvHash(hash, da.curr());
+  }
+  return hash;
+}
+
+int interpPlan::build(ot::DA &da, unsigned int Ns) {
+  unsigned int maxD = da.getMaxDepth();
+  unsigned int balOctmaxD = maxD - 1;
+
+  // voxel size in octree units
+  double h = ((double)(1u << balOctmaxD))/Ns;
+  double voxVol = h*h*h;
+
+  m_uiNs = Ns;
+  m_elemIdx.clear(); m_rowPtr.clear(); m_colIdx.clear(); m_weights.clear();
+  m_rowPtr.push_back(0);
+
+  // (voxel, row, weight) for the transpose
+  std::vector< std::pair<unsigned int, std::pair<unsigned int, double> > > trip;
+
+  unsigned int row = 0;
+  for ( da.init<ot::DA::ALL>(), da.init<ot::DA::WRITABLE>(); da.curr() < da.end<ot::DA::ALL>(); da.next<ot::DA::ALL>(), row++) {
+    Point pt = da.getCurrentOffset();
+    unsigned int levelhere = da.getLevel(da.curr()) - 1;
+    double len = (double)(1u << (balOctmaxD - levelhere));
+    double elemVol = len*len*len;
+
+    double a[3] = { (double)pt.xint(), (double)pt.yint(), (double)pt.zint() };
+    int lo[3], hi[3];
+    for (int d=0; d<3; d++) {
+      lo[d] = (int)floor(a[d]/h);
+      hi[d] = (int)ceil((a[d]+len)/h);
+      if (lo[d] < 0) lo[d] = 0;
+      if (hi[d] > (int)Ns) hi[d] = Ns;
+    }
+
+    for (int k=lo[2]; k<hi[2]; k++) {
+      double oz = overlap1d(a[2], len, k, h);
+      for (int j=lo[1]; j<hi[1]; j++) {
+        double oy = overlap1d(a[1], len, j, h);
+        for (int i=lo[0]; i<hi[0]; i++) {
+          double w = overlap1d(a[0], len, i, h)*oy*oz;
+          if (w <= 0.0)
+            continue;
+          unsigned int vox = (k*Ns + j)*Ns + i;
+          m_colIdx.push_back(vox);
+          m_weights.push_back(w/elemVol);
+          trip.push_back(std::make_pair(vox, std::make_pair(row, w/voxVol)));
+        }
+      }
+    }
+    m_elemIdx.push_back(da.curr());
+    m_rowPtr.push_back(m_colIdx.size());
+  }
+  m_uiNumElems = row;
+  m_uiMaxDepth = maxD;
+  m_uiOctHash = octreeHash(da);
+
+  // transpose, rows were added in order so a stable sort keeps them sorted within a voxel
+  std::stable_sort(trip.begin(), trip.end(), interpPlanCompare);
+
+  m_voxIdx.clear(); m_tRowPtr.clear(); m_tColIdx.clear(); m_tWeights.clear();
+  for (unsigned int p=0; p<trip.size(); p++) {
+    if ( m_voxIdx.empty() || (m_voxIdx.back() != trip[p].first) ) {
+      m_voxIdx.push_back(trip[p].first);
+      m_tRowPtr.push_back(p);
+    }
+    m_tColIdx.push_back(trip[p].second.first);
+    m_tWeights.push_back(trip[p].second.second);
+  }
+  m_tRowPtr.push_back(trip.size());
+
+  m_bBuilt = true;
+  return(0);
+}
+
+int interpPlan::rg2octree(const std::vector<PetscScalar *> &rg, std::vector<PetscScalar *> &oct, unsigned int dof) const {
+  int nrows = m_uiNumElems;
+  unsigned int nvec = rg.size();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (int r=0; r<nrows; r++) {
+    unsigned int e = m_elemIdx[r];
+    for (unsigned int v=0; v<nvec; v++) {
+      for (unsigned int d=0; d<dof; d++)
+        oct[v][dof*e+d] = 0.0;
+    }
+    for (unsigned int p=m_rowPtr[r]; p<m_rowPtr[r+1]; p++) {
+      unsigned int c = dof*m_colIdx[p];
+      double w = m_weights[p];
+      for (unsigned int v=0; v<nvec; v++) {
+        for (unsigned int d=0; d<dof; d++)
+          oct[v][dof*e+d] += w*rg[v][c+d];
+      }
+    }
+  }
+  return(0);
+}
+
+int interpPlan::octree2rg(const std::vector<PetscScalar *> &oct, std::vector<PetscScalar *> &rg, unsigned int dof) const {
+  int nrows = m_voxIdx.size();
+  unsigned int nvec = oct.size();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (int r=0; r<nrows; r++) {
+    unsigned int c = dof*m_voxIdx[r];
+    for (unsigned int v=0; v<nvec; v++) {
+      for (unsigned int d=0; d<dof; d++)
+        rg[v][c+d] = 0.0;
+    }
+    for (unsigned int p=m_tRowPtr[r]; p<m_tRowPtr[r+1]; p++) {
+      unsigned int e = dof*m_elemIdx[m_tColIdx[p]];
+      double w = m_tWeights[p];
+      for (unsigned int v=0; v<nvec; v++) {
+        for (unsigned int d=0; d<dof; d++)
+          rg[v][c+d] += w*oct[v][e+d];
+      }
+    }
+  }
+  return(0);
+}
+
+int interpPlan::gatherRG(PetscScalar *rg, unsigned int dof, MPI_Comm comm) const {
+  int npes;
+  MPI_Comm_size(comm, &npes);
+  if (npes == 1)
+    return(0);
+
+  // voxels are shared only across the partition boundaries, but the sum is
+  // correct as long as octree2rg was called on a zeroed array.
+  int sz = m_uiNs*m_uiNs*m_uiNs*dof;
+  MPI_Allreduce(MPI_IN_PLACE, rg, sz, MPI_DOUBLE, MPI_SUM, comm);
+  return(0);
+}
+
+int interpPlan::save(const char *prefix, MPI_Comm comm) const {
+  int rank, npes;
+  char fname[PETSC_MAX_PATH_LEN];
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &npes);
+
+  sprintf(fname, "%s.%d_%d.plan", prefix, rank, npes);
+  std::ofstream out(fname, std::ios::binary);
+  if ( !out.good() )
+    return 1;
+
+  interpPlanHeader hdr;
+  memset(&hdr, 0, sizeof(interpPlanHeader));
+  strncpy(hdr.magic, INTERP_PLAN_MAGIC, 8);
+  hdr.npes     = npes;
+  hdr.Ns       = m_uiNs;
+  hdr.maxDepth = m_uiMaxDepth;
+  hdr.octHash  = m_uiOctHash;
+  hdr.numElems = m_uiNumElems;
+  hdr.nnz      = m_colIdx.size();
+  hdr.numVox   = m_voxIdx.size();
+  hdr.tnnz     = m_tColIdx.size();
+
+  out.write((char *)&hdr, sizeof(interpPlanHeader));
+  out.write((char *)&(*(m_elemIdx.begin())), hdr.numElems*sizeof(unsigned int));
+  out.write((char *)&(*(m_rowPtr.begin())), (hdr.numElems+1)*sizeof(unsigned int));
+  out.write((char *)&(*(m_colIdx.begin())), hdr.nnz*sizeof(unsigned int));
+  out.write((char *)&(*(m_weights.begin())), hdr.nnz*sizeof(double));
+  out.write((char *)&(*(m_voxIdx.begin())), hdr.numVox*sizeof(unsigned int));
+  out.write((char *)&(*(m_tRowPtr.begin())), (hdr.numVox+1)*sizeof(unsigned int));
+  out.write((char *)&(*(m_tColIdx.begin())), hdr.tnnz*sizeof(unsigned int));
+  out.write((char *)&(*(m_tWeights.begin())), hdr.tnnz*sizeof(double));
+  out.close();
+
+  return(0);
+}
+
+int interpPlan::load(const char *prefix, ot::DA &da, unsigned int Ns, MPI_Comm comm) {
+  int rank, npes;
+  char fname[PETSC_MAX_PATH_LEN];
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &npes);
+
+  m_bBuilt = false;
+
+  sprintf(fname, "%s.%d_%d.plan", prefix, rank, npes);
+  std::ifstream in(fname, std::ios::binary);
+
+  interpPlanHeader hdr;
+  int ok = 0;
+  if ( in.good() ) {
+    in.read((char *)&hdr, sizeof(interpPlanHeader));
+    ok = ( in.good() && !strncmp(hdr.magic, INTERP_PLAN_MAGIC, 8) && (hdr.npes == (unsigned int)npes) );
+  }
+  // a plan of another mesh or grid, e.g. after the octree was regenerated
+  if ( ok ) {
+    ok = ( (hdr.Ns == Ns) && (hdr.maxDepth == da.getMaxDepth()) && (hdr.octHash == octreeHash(da)) );
+  }
+
+  // all processors need a plan, else all of them rebuild it
+  int allOk;
+  MPI_Allreduce(&ok, &allOk, 1, MPI_INT, MPI_MIN, comm);
+  if ( !allOk ) {
+    in.close();
+    return 1;
+  }
+
+  m_uiNs = hdr.Ns;
+  m_uiNumElems = hdr.numElems;
+  m_uiMaxDepth = hdr.maxDepth;
+  m_uiOctHash = hdr.octHash;
+  m_elemIdx.resize(hdr.numElems);
+  m_rowPtr.resize(hdr.numElems+1);
+  m_colIdx.resize(hdr.nnz);
+  m_weights.resize(hdr.nnz);
+  m_voxIdx.resize(hdr.numVox);
+  m_tRowPtr.resize(hdr.numVox+1);
+  m_tColIdx.resize(hdr.tnnz);
+  m_tWeights.resize(hdr.tnnz);
+
+  in.read((char *)&(*(m_elemIdx.begin())), hdr.numElems*sizeof(unsigned int));
+  in.read((char *)&(*(m_rowPtr.begin())), (hdr.numElems+1)*sizeof(unsigned int));
+  in.read((char *)&(*(m_colIdx.begin())), hdr.nnz*sizeof(unsigned int));
+  in.read((char *)&(*(m_weights.begin())), hdr.nnz*sizeof(double));
+  in.read((char *)&(*(m_voxIdx.begin())), hdr.numVox*sizeof(unsigned int));
+  in.read((char *)&(*(m_tRowPtr.begin())), (hdr.numVox+1)*sizeof(unsigned int));
+  in.read((char *)&(*(m_tColIdx.begin())), hdr.tnnz*sizeof(unsigned int));
+  in.read((char *)&(*(m_tWeights.begin())), hdr.tnnz*sizeof(double));
+  in.close();
+
+  m_bBuilt = true;
+  return(0);
+}
+
+// the regular grid size from the size of a sequential Vec
+static unsigned int rgGridSize(Vec rgVec, unsigned int dof) {
+  PetscInt sz;
+  VecGetSize(rgVec, &sz);
+  return (unsigned int)(floor(pow((double)(sz/dof), 1.0/3.0) + 0.5));
+}
+
+int octree2rg(ot::DA &da, Vec octVec, Vec rgVec, unsigned int dof, interpPlan &plan) {
+  if ( !plan.isBuilt() ) {
+    plan.build(da, rgGridSize(rgVec, dof));
+  }
+
+  PetscScalar *oct, *rg;
+  CHKERRQ( VecZeroEntries(rgVec) );
+  CHKERRQ( VecGetArray(rgVec, &rg) );
+  da.vecGetBuffer(octVec, oct, true, true, true, dof);
+
+  std::vector<PetscScalar *> in(1, oct), out(1, rg);
+  plan.octree2rg(in, out, dof);
+  plan.gatherRG(rg, dof, PETSC_COMM_WORLD);
+
+  da.vecRestoreBuffer(octVec, oct, true, true, true, dof);
+  CHKERRQ( VecRestoreArray(rgVec, &rg) );
+  return(0);
+}
+
+int rg2octree(ot::DA &da, Vec rgVec, Vec octVec, unsigned int dof, interpPlan &plan) {
+  if ( !plan.isBuilt() ) {
+    plan.build(da, rgGridSize(rgVec, dof));
+  }
+
+  PetscScalar *oct, *rg;
+  CHKERRQ( VecGetArray(rgVec, &rg) );
+  da.vecGetBuffer(octVec, oct, true, true, false, dof);
+
+  std::vector<PetscScalar *> in(1, rg), out(1, oct);
+  plan.rg2octree(in, out, dof);
+
+  da.vecRestoreBuffer(octVec, oct, true, true, false, dof);
+  CHKERRQ( VecRestoreArray(rgVec, &rg) );
+  return(0);
+}
+
+int octree2rg(ot::DA da, Vec octVec, Vec rgVec, unsigned int dof) {
+  interpPlan plan;
+  return octree2rg(da, octVec, rgVec, dof, plan);
+}
+
+int rg2octree(ot::DA da, Vec rgVec, Vec octVec, unsigned int dof) {
+  interpPlan plan;
+  return rg2octree(da, rgVec, octVec, dof, plan);
+}
@@ -1,6 +1,8 @@
 #ifndef __FEM_UTILS_H_
 #define __FEM_UTILS_H_
 
+#include <vector>
+
 #include "petscda.h"
 #include "oct.h"
 #include "oda.h"
@@ -26,6 +28,27 @@ int elementToNode(ot::DA da, std::vector<T> &elementVec, std::vector<T> &nodeVec
 template <typename T>
 int nodeToElement(DA da, std::vector<T> &nodeVec, std::vector<T> &elementVec, unsigned int dof);
 
+/*
+ * Batched conversions for k fields (e.g., all timesteps) sharing the same DA.
+ * The ghost exchanges of all fields are started before any is completed, so
+ * the communication of the k fields is a single phase.
+ *
+ * The regular grid versions are gathers, every owned node averages its (up
+ * to 8) incident elements and is written exactly once, so that no
+ * accumulation across processors is needed and the inner loop vectorises.
+ * The result is the same as the element-wise scatter, i.e., each incident
+ * element contributes 1/8 of its value. nodeToElement assigns every element
+ * the average of its 8 nodes.
+ *
+ * The octree version scatters all fields in a single traversal of the mesh
+ * (using the hanging node masks) into a packed buffer, and writes the ghost
+ * contributions of all fields with a single exchange.
+ */
+int elementToNode(DA da, std::vector<Vec> &elementVecs, std::vector<Vec> &nodeVecs);
+int nodeToElement(DA da, std::vector<Vec> &nodeVecs, std::vector<Vec> &elementVecs);
+
+int elementToNode(ot::DA &da, std::vector<Vec> &elementVecs, std::vector<Vec> &nodeVecs, unsigned int dof);
+
 /* 
  * Functions to convert between a field defined on a regular grid and one on a given octree. All
  * functions require that a octree-based DA be specified. 
@@ -39,6 +62,105 @@ int octree2rg(ot::DA da, std::vector<T> &octVec, std::vector<T> &rgVec, unsigned
 template <typename T>
 int rg2octree(ot::DA da, std::vector<T> &rgVec, std::vector<T> &octVec, unsigned int dof);
 
+/*
+ * Precomputed transfer between the elements of an octree-based DA and a 
+ * regular grid of Ns^3 voxels covering the same domain. 
+ *
+ * The plan stores, for every local (writable) element, the voxels it 
+ * overlaps and the volume of the overlap, as a CSR matrix whose rows follow 
+ * the Morton order of the elements. The transpose, with rows sorted by voxel 
+ * index, is stored as well, so that both directions are a gather SpMV and 
+ * can be threaded over the rows.
+ *
+ *   rg2octree:  element value = volume weighted average of the voxels 
+ *   octree2rg:  voxel value   = volume weighted average of the elements 
+ *
+ * i.e., a coarse element gets the average of the voxels it covers and a 
+ * fine element gets the value of the voxel containing it. 
+ *
+ * The regular grid arrays are complete (Ns^3 x dof) arrays on every 
+ * processor, in the (k,j,i) order of the raw files, with the dofs 
+ * interleaved. Multiple vectors (e.g., timesteps) are transferred in a single 
+ * pass over the plan. octree2rg only fills the voxels covered by the local 
+ * elements, gatherRG() combines the contributions of all processors. 
+ *
+ * The plan depends only on the octree and its partition, and can be saved 
+ * and loaded to avoid the construction on repeated runs on the same mesh. 
+ * The saved plan records the grid size, the maximum depth and a hash of the 
+ * local octants, and load() refuses a plan that does not match the DA.
+ */
+class interpPlan {
+  public:
+    interpPlan();
+
+    /**
+     *  @brief Builds the plan for the local elements of da and a Ns^3 grid.
+     **/
+    int build(ot::DA &da, unsigned int Ns);
+
+    /**
+     *  @brief element values from voxel values, in and out are arrays of nvec vectors.
+     *  @param rg   nvec arrays of Ns^3 x dof values
+     *  @param oct  nvec ghosted elemental buffers (from vecGetBuffer)
+     **/
+    int rg2octree(const std::vector<PetscScalar *> &rg, std::vector<PetscScalar *> &oct, unsigned int dof) const;
+
+    /**
+     *  @brief voxel values from element values, only the voxels of local elements are written.
+     **/
+    int octree2rg(const std::vector<PetscScalar *> &oct, std::vector<PetscScalar *> &rg, unsigned int dof) const;
+
+    /**
+     *  @brief completes a regular grid array filled by octree2rg on all processors.
+     **/
+    int gatherRG(PetscScalar *rg, unsigned int dof, MPI_Comm comm) const;
+
+    int save(const char *prefix, MPI_Comm comm) const;
+
+    /**
+     *  @brief loads a plan saved by save(), returns 1 (on all processors) if a
+     *  processor has no plan for this octree, partition and Ns.
+     **/
+    int load(const char *prefix, ot::DA &da, unsigned int Ns, MPI_Comm comm);
+
+    bool isBuilt() const {
+      return m_bBuilt;
+    }
+
+    unsigned int getGridSize() const {
+      return m_uiNs;
+    }
+
+  protected:
+    bool                      m_bBuilt;
+    unsigned int              m_uiNs;
+    unsigned int              m_uiNumElems;
+    unsigned int              m_uiMaxDepth;
+    unsigned int              m_uiOctHash;    // of the local octants and their buffer indices
+
+    static unsigned int octreeHash(ot::DA &da);
+
+    // element -> voxels
+    std::vector<unsigned int> m_elemIdx;      // index of the element in the ghosted buffer
+    std::vector<unsigned int> m_rowPtr;
+    std::vector<unsigned int> m_colIdx;       // voxel index
+    std::vector<double>       m_weights;      // overlap / element volume
+
+    // voxel -> elements
+    std::vector<unsigned int> m_voxIdx;       // sorted
+    std::vector<unsigned int> m_tRowPtr;
+    std::vector<unsigned int> m_tColIdx;      // element (row) number
+    std::vector<double>       m_tWeights;     // overlap / voxel volume
+};
+
+/*
+ * Vec versions of the transfer, the RG Vec is a sequential Vec with Ns^3 x dof 
+ * entries on every processor. The plan is built on the first call if needed. 
+ * The versions without a plan build a new plan on every call.
+ */
+int octree2rg(ot::DA &da, Vec octVec, Vec rgVec, unsigned int dof, interpPlan &plan);
+int rg2octree(ot::DA &da, Vec rgVec, Vec octVec, unsigned int dof, interpPlan &plan);
+
 /*
  * Functions to read and write C-array like structures in parallel. These functions 
  * are useful when all processors want to read from the same file. 
@@ -20,7 +20,9 @@ static char help[] = "Driver for a linear elastodynamic problem (Hyperbolic)";
 #include "elasStiffness.h"
 #include "elasMass.h"
 #include "raleighDamping.h"
+#include "elasMultigrid.h"
 #include "cardiacForce.h"
+#include "perfLog.h"
 
 float uniform() {
   return float(rand()) / RAND_MAX; // [0,1)
@@ -67,6 +69,7 @@ double randgauss( double min, double max, double sigma, double centre) {
 
 int main(int argc, char **argv) {
   PetscInitialize(&argc, &argv, "cmame.opt", help);
+  perfLog::init();
 
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -198,6 +201,15 @@ int main(int argc, char **argv) {
   // MESH : Construct the octree-based Distruted Array.
   /*********************************************************************** */
   ot::DA da(balOct,MPI_COMM_WORLD);
+
+  // The coarser octrees for the multigrid preconditioner of the timestep solves.
+  PetscInt mgLevels = 1;
+  octDMMG *dmmg = NULL;
+  CHKERRQ ( PetscOptionsGetInt(0,"-octmg_nlevels",&mgLevels,0) );
+  if (mgLevels > 1) {
+    CHKERRQ ( octDMMGCreate(MPI_COMM_WORLD, mgLevels, NULL, &dmmg) );
+    CHKERRQ ( octDMMGSetOctree(&dmmg, balOct, &da, dof) );
+  }
   balOct.clear();
 
   MPI_Barrier(MPI_COMM_WORLD);
@@ -205,13 +217,25 @@ int main(int argc, char **argv) {
   if (!rank)
     std::cout <<"Finshed Meshing" << std::endl;
 
-  PetscFinalize();
-  return 0;
+  // -mesh_only stops after meshing, to time the octree construction alone
+  PetscTruth meshOnly = PETSC_FALSE;
+  PetscOptionsHasName(0, "-mesh_only", &meshOnly);
+  if (meshOnly) {
+    if (dmmg) {
+      CHKERRQ ( octDMMGDestroy(dmmg) );
+    }
+    PetscFinalize();
+    return 0;
+  }
 
   // create Matrices and Vectors
   elasMass *Mass = new elasMass(feMat::OCT); // Mass Matrix
   elasStiffness *Stiffness = new elasStiffness(feMat::OCT); // Stiffness matrix
   raleighDamping *Damping = new raleighDamping(feMat::OCT); // Damping Matrix
+  // the names of the operators in the perfLog summary
+  Mass->setName("elasMass");
+  Stiffness->setName("elasStiffness");
+  Damping->setName("raleighDamping");
 
   cardiacForce *Force = new cardiacForce(feVec::OCT); // Force Vector
 
@@ -406,6 +430,13 @@ int main(int argc, char **argv) {
 
   //if (!rank)
   //  std::cout << RED"Initializing Newmark"NRM << std::endl;
+  // coarse operators with the averaged material properties ...
+  elasMultigrid mg;
+  if (dmmg) {
+    mg.init(dmmg, rho, lambda, mu, dof, 0.0, 0.00075);
+    ts->setMultigrid(dmmg, mg.getMass(), mg.getDamping(), mg.getStiffness());
+  }
+
   double itime = MPI_Wtime();
   ts->init(); // initialize IMPORTANT 
   //if (!rank)
@@ -420,6 +451,13 @@ int main(int argc, char **argv) {
     std::cout << "Total time for solve is " << etime - stime << std::endl;
   }
 
+  perfLog::summary(problemName);
+  mg.destroy();
+  if (dmmg) {
+    CHKERRQ ( octDMMGDestroy(dmmg) );
+  }
+
+  vecPool::clear();
   PetscFinalize();
 }
 
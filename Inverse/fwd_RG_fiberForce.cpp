@@ -18,10 +18,12 @@ static char help[] = "Driver for a linear elastodynamic problem (Hyperbolic)";
 #include "elasMass.h"
 #include "raleighDamping.h"
 #include "cardiacForce.h"
+#include "perfLog.h"
 
 int main(int argc, char **argv)
 {       
   PetscInitialize(&argc, &argv, "elas.opt", help);
+  perfLog::init();
 
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -101,6 +103,10 @@ int main(int argc, char **argv)
   elasMass *Mass = new elasMass(feMat::PETSC); // Mass Matrix
   elasStiffness *Stiffness = new elasStiffness(feMat::PETSC); // Stiffness matrix
   raleighDamping *Damping = new raleighDamping(feMat::PETSC); // Damping Matrix
+  // the names of the operators in the perfLog summary
+  Mass->setName("elasMass");
+  Stiffness->setName("elasStiffness");
+  Damping->setName("raleighDamping");
 
   cardiacForce *Force = new cardiacForce(feVec::PETSC); // Force Vector
 
@@ -379,6 +385,8 @@ int main(int argc, char **argv)
     std::cout << "Total time for solve is " << etime - stime << std::endl;
   }
 
+  perfLog::summary(problemName);
+  vecPool::clear();
   PetscFinalize();
 }
 
@@ -0,0 +1,250 @@
+static char help[] = "Parallel generator for the synthetic cardiac phantoms";
+
+/**
+ *  @file   genPhantom.cpp
+ *  @brief  Parallel, streaming replacement for genLV, genLVfibers and genCmameFibers.
+ *  @author Hari Sundar
+ *  @date   2/22/08
+ *
+ *  Every processor generates the elements it owns in the same DA partition
+ *  used by the RG drivers, and writes its block directly into the shared
+ *  files using MPI-IO. No processor holds the complete volume, and the
+ *  output does not depend on the number of processors.
+ *
+ *  Writes
+ *    <pn>.<Ns>.img        geometry (uchar)
+ *    <pn>.<Ns>.fibers     fiber orientations (not for the lv phantom)
+ *    <pn>.<Ns>.act        activations of all timesteps, see phantom.h
+ *  and with -legacy also the per timestep <pn>.<Ns>.<t>.fld files read by
+ *  the current drivers. The frames are streamed, i.e., only one timestep is
+ *  kept in memory.
+ *
+ *  Options
+ *    -pn       output prefix
+ *    -Ns       number of elements in each dimension
+ *    -Nt       number of timesteps
+ *    -phantom  lv | lvcyl | cmame
+ *    -ffac     force factor for the lv phantom
+ *    -legacy   also write the .fld files
+ **/
+
+#include "mpi.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <vector>
+
+#include "petscda.h"
+
+#include "phantom.h"
+#include "colors.h"
+
+/**
+ *  @brief Collective write of a local (k,j,i) block of a Ns^3 x dof array starting at disp.
+ **/
+int writeBlock(MPI_File fh, MPI_Offset disp, int Ns, int dof, MPI_Datatype type,
+    int *start, int *sub, void *buf) {
+  MPI_Datatype elemType, fileType;
+  MPI_Status status;
+  int sizes[3] = {Ns, Ns, Ns};
+  int cnt = sub[0]*sub[1]*sub[2];
+
+  MPI_Type_contiguous(dof, type, &elemType);
+  MPI_Type_commit(&elemType);
+
+  if (cnt) {
+    MPI_Type_create_subarray(3, sizes, sub, start, MPI_ORDER_C, elemType, &fileType);
+    MPI_Type_commit(&fileType);
+    MPI_File_set_view(fh, disp, elemType, fileType, "native", MPI_INFO_NULL);
+    MPI_Type_free(&fileType);
+  } else {
+    // nothing to write, but the call is collective
+    MPI_File_set_view(fh, disp, elemType, elemType, "native", MPI_INFO_NULL);
+  }
+  MPI_File_write_all(fh, buf, cnt, elemType, &status);
+
+  MPI_Type_free(&elemType);
+  return(0);
+}
+
+/**
+ *  @brief Opens (and truncates) an output file, collective.
+ **/
+int openFile(const char *fname, MPI_File *fh) {
+  MPI_File_open(PETSC_COMM_WORLD, (char *)fname, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, fh);
+  MPI_File_set_size(*fh, 0);
+  return(0);
+}
+
+/**
+ *  @brief MetaIO header for a raw file.
+ **/
+void writeMhd(const char *hdrname, const char *fname, int Ns, int channels, const char *type) {
+  std::ofstream out(hdrname);
+  out << "ObjectType = Image" << std::endl << "NDims = 3" << std::endl << "BinaryData = True" << std::endl << "BinaryDataByteOrderMSB = False" << std::endl << "Offset = 0 0 0" << std::endl;
+  out << "ElementSpacing = 2.816 2.816 2.816" <<  std::endl;
+  out << "DimSize = " << Ns << " " << Ns << " " << Ns << std::endl;
+  if (channels > 1)
+    out << "ElementNumberOfChannels = " << channels << std::endl;
+  out << "ElementType = " << type << std::endl;
+  out << "ElementDataFile = " << fname << std::endl;
+  out.close();
+}
+
+int main(int argc, char **argv)
+{
+  PetscInitialize(&argc, &argv, 0, help);
+
+  int rank;
+  MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+
+  int Ns = 32;
+  int Nt = 100;
+  double ffac = 2.0;
+  PetscTruth legacy = PETSC_FALSE;
+
+  char problemName[PETSC_MAX_PATH_LEN];
+  char shapeName[PETSC_MAX_PATH_LEN];
+  char fname[PETSC_MAX_PATH_LEN];
+  char hdrname[PETSC_MAX_PATH_LEN];
+
+  sprintf(problemName, "phantom");
+  sprintf(shapeName, "lvcyl");
+
+  CHKERRQ ( PetscOptionsGetInt(0,"-Ns",&Ns,0) );
+  CHKERRQ ( PetscOptionsGetInt(0,"-Nt",&Nt,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-ffac",&ffac,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-legacy",&legacy,0) );
+  CHKERRQ ( PetscOptionsGetString(PETSC_NULL,"-pn",problemName,PETSC_MAX_PATH_LEN-1,PETSC_NULL));
+  CHKERRQ ( PetscOptionsGetString(PETSC_NULL,"-phantom",shapeName,PETSC_MAX_PATH_LEN-1,PETSC_NULL));
+
+  phantom::shape s = phantom::LV_CYLINDER;
+  if ( !strcmp(shapeName, "lv") )
+    s = phantom::LV;
+  else if ( !strcmp(shapeName, "cmame") )
+    s = phantom::CMAME;
+
+  phantom ph(s, Ns, Nt, ffac);
+  int dof = ph.getDof();
+
+  if (!rank) {
+    std::cout << "Generating " GRN << phantom::shapeName(s) << NRM " phantom of size " << Ns << " with " << Nt << " timesteps" << std::endl;
+  }
+
+  // same partition as the RG drivers, the last node in each direction is not an element
+  DA da;
+  int x, y, z, m, n, p;
+  CHKERRQ ( DACreate3d ( PETSC_COMM_WORLD, DA_NONPERIODIC, DA_STENCIL_BOX,
+                         Ns+1, Ns+1, Ns+1, PETSC_DECIDE, PETSC_DECIDE, PETSC_DECIDE,
+                         1, 1, 0, 0, 0, &da) );
+  CHKERRQ( DAGetCorners(da, &x, &y, &z, &m, &n, &p) );
+
+  if (x+m == Ns+1) m--;
+  if (y+n == Ns+1) n--;
+  if (z+p == Ns+1) p--;
+
+  int start[3] = {z, y, x};
+  int sub[3] = {p, n, m};
+  unsigned int localSz = m*n*p;
+
+  MPI_File fh;
+
+  // GEOMETRY
+  {
+    std::vector<unsigned char> img(localSz);
+    unsigned int cnt = 0;
+    for (int k=z; k<z+p; k++)
+      for (int j=y; j<y+n; j++)
+        for (int i=x; i<x+m; i++)
+          img[cnt++] = ph.inside(i,j,k) ? 200 : 0;
+
+    sprintf(fname, "%s.%d.img", problemName, Ns);
+    openFile(fname, &fh);
+    writeBlock(fh, 0, Ns, 1, MPI_UNSIGNED_CHAR, start, sub, localSz ? &(*(img.begin())) : NULL);
+    MPI_File_close(&fh);
+
+    if (!rank) {
+      sprintf(hdrname, "%s.%d.mhd", problemName, Ns);
+      writeMhd(hdrname, fname, Ns, 1, "MET_UCHAR");
+    }
+  }
+
+  // FIBERS
+  if ( ph.hasFibers() ) {
+    std::vector<double> fib(3*localSz);
+    std::vector<float>  ffib;
+    unsigned int cnt = 0;
+    for (int k=z; k<z+p; k++)
+      for (int j=y; j<y+n; j++)
+        for (int i=x; i<x+m; i++, cnt++)
+          ph.fiber(i, j, k, &(fib[3*cnt]));
+
+    sprintf(fname, "%s.%d.fibers", problemName, Ns);
+    openFile(fname, &fh);
+    if ( ph.singlePrecisionFibers() ) {
+      ffib.assign(fib.begin(), fib.end());
+      writeBlock(fh, 0, Ns, 3, MPI_FLOAT, start, sub, localSz ? &(*(ffib.begin())) : NULL);
+    } else {
+      writeBlock(fh, 0, Ns, 3, MPI_DOUBLE, start, sub, localSz ? &(*(fib.begin())) : NULL);
+    }
+    MPI_File_close(&fh);
+
+    if (!rank) {
+      sprintf(hdrname, "%s.%d.fibers.mhd", problemName, Ns);
+      writeMhd(hdrname, fname, Ns, 3, ph.singlePrecisionFibers() ? "MET_FLOAT" : "MET_DOUBLE");
+    }
+  }
+
+  // ACTIVATIONS, streamed one timestep at a time
+  std::vector<double> act(dof*localSz);
+  MPI_File lfh;
+
+  sprintf(fname, "%s.%d.act", problemName, Ns);
+  openFile(fname, &fh);
+
+  if (!rank) {
+    activationHeader hdr;
+    memset(&hdr, 0, sizeof(activationHeader));
+    strncpy(hdr.magic, PHANTOM_MAGIC, 8);
+    hdr.version = 1;
+    hdr.Ns = Ns;
+    hdr.Nt = Nt;
+    hdr.dof = dof;
+
+    std::vector<MPI_Offset> offsets(Nt);
+    for (int t=0; t<Nt; t++)
+      offsets[t] = phantom::frameOffset(Ns, Nt, dof, t);
+
+    MPI_Status status;
+    MPI_File_write_at(fh, 0, &hdr, sizeof(activationHeader), MPI_BYTE, &status);
+    if (Nt)
+      MPI_File_write_at(fh, sizeof(activationHeader), &(*(offsets.begin())), Nt*sizeof(MPI_Offset), MPI_BYTE, &status);
+  }
+
+  for (int t=0; t<Nt; t++) {
+    unsigned int cnt = 0;
+    for (int k=z; k<z+p; k++)
+      for (int j=y; j<y+n; j++)
+        for (int i=x; i<x+m; i++, cnt++)
+          ph.activation(i, j, k, t, &(act[dof*cnt]));
+
+    double *buf = localSz ? &(*(act.begin())) : NULL;
+    writeBlock(fh, phantom::frameOffset(Ns, Nt, dof, t), Ns, dof, MPI_DOUBLE, start, sub, buf);
+
+    if (legacy) {
+      sprintf(hdrname, "%s.%d.%.3d.fld", problemName, Ns, t);
+      openFile(hdrname, &lfh);
+      writeBlock(lfh, 0, Ns, dof, MPI_DOUBLE, start, sub, buf);
+      MPI_File_close(&lfh);
+    }
+  }
+  MPI_File_close(&fh);
+
+  if (!rank) {
+    std::cout << "Wrote " << fname << std::endl;
+  }
+
+  CHKERRQ( DADestroy(da) );
+  PetscFinalize();
+  return 0;
+}
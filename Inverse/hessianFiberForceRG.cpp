@@ -18,7 +18,7 @@ static char help[] = "Driver for a estimate cardiac activations";
 #include "elasStiffness.h"
 #include "elasMass.h"
 #include "raleighDamping.h"
-#include "cardiacForce.h"
+#include "cardiacFiberForce.h"
 #include "parametricActivationInverse.h"
 #include "radialBasis.h"
 #include "bSplineBasis.h"
@@ -118,8 +118,12 @@ int main(int argc, char **argv)
   elasMass *Mass = new elasMass(feMat::PETSC); // Mass Matrix
   elasStiffness *Stiffness = new elasStiffness(feMat::PETSC); // Stiffness matrix
   raleighDamping *Damping = new raleighDamping(feMat::PETSC); // Damping Matrix
+  // the names of the operators in the perfLog summary
+  Mass->setName("elasMass");
+  Stiffness->setName("elasStiffness");
+  Damping->setName("raleighDamping");
 
-  cardiacForce *Force = new cardiacForce(feVec::PETSC); // Force Vector
+  cardiacFiberForce *Force = new cardiacFiberForce(feVec::PETSC); // Force Vector
 
   // create vectors 
   CHKERRQ( DACreateGlobalVector(da, &rho) );
@@ -346,10 +350,18 @@ int main(int argc, char **argv)
   // Force Vector
   Force->setProblemDimensions(1.0,1.0,1.0);
   Force->setDA(da3d);
+  Force->setDAScalar(da);
   Force->setActivationVec(tau);
   Force->setFiberOrientations(fibers);
   Force->setTimeInfo(&ti);
 
+  PetscTruth adjTest = PETSC_FALSE;
+  PetscOptionsHasName(0, "-force_adjoint_test", &adjTest);
+  if (adjTest) {
+    double adjErr;
+    CHKERRQ( Force->adjointTest(adjErr) );
+  }
+
   // Newmark time stepper ...
   newmark *ts = new newmark; 
 
@@ -18,7 +18,10 @@ class hyperbolicInverse : public inverseSolver { // hyperbolic inverse
 
 public:
 
-  hyperbolicInverse() {}
+  hyperbolicInverse() {
+    m_vecForwardInitialDisplacement = NULL;
+    m_vecForwardInitialVelocity = NULL;
+  }
 
   virtual ~hyperbolicInverse() {}
 
@@ -41,8 +44,10 @@ public:
   virtual bool setReducedGradient();
 
   void setForwardInitialConditions(Vec initDisp, Vec initVel) {
-    VecDuplicate(initDisp, &m_vecForwardInitialDisplacement);
-    VecDuplicate(initVel, &m_vecForwardInitialVelocity);
+    if (m_vecForwardInitialDisplacement == NULL)
+      VecDuplicate(initDisp, &m_vecForwardInitialDisplacement);
+    if (m_vecForwardInitialVelocity == NULL)
+      VecDuplicate(initVel, &m_vecForwardInitialVelocity);
     VecCopy(initDisp, m_vecForwardInitialDisplacement);
     VecCopy(initVel, m_vecForwardInitialVelocity);
 
@@ -175,10 +180,9 @@ bool hyperbolicInverse::setReducedGradient() {
   cardiacDynamic *Fdynamic = new cardiacDynamic(feVec::PETSC);
 
   // Solver 
-  newmark *ts = new newmark;
+  newmark *ts = (newmark *)m_ts;
 
   // Forward solve
-  ts = (newmark *)m_ts;
   ts->setAdjoint(false);
 
   ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
@@ -262,8 +266,8 @@ bool hyperbolicInverse::setReducedGradient() {
 
   // set initial conditions for adjoint ...
   Vec initD, initV;
-  VecDuplicate(m_vecForwardInitialDisplacement, &initD);
-  VecDuplicate(m_vecForwardInitialDisplacement, &initV);
+  vecPool::get(m_vecForwardInitialDisplacement, &initD);
+  vecPool::get(m_vecForwardInitialDisplacement, &initV);
   VecZeroEntries(initD);
   VecZeroEntries(initV);
   ts->setInitialDisplacement(initD); 
@@ -278,7 +282,7 @@ bool hyperbolicInverse::setReducedGradient() {
   // clear memory ...
   for (int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
 
@@ -292,7 +296,7 @@ bool hyperbolicInverse::setReducedGradient() {
   // clear memory ...
   for (int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
 
@@ -308,8 +312,10 @@ bool hyperbolicInverse::setReducedGradient() {
   // VecNorm(m_vecReducedGradient,NORM_2,&norm);
   // PetscPrintf(0,"norm of reduced Gradient = %f\n", norm);
 
-  VecDestroy(initD);
-  VecDestroy(initV);
+  ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+  ts->setInitialVelocity(m_vecForwardInitialVelocity);
+  vecPool::restore(initD);
+  vecPool::restore(initV);
 
 // #endif
   // std::cout << GRN"Leaving "NRM << __func__ << std::endl;
@@ -327,14 +333,12 @@ void hyperbolicInverse::hessianMatMult(Vec In, Vec Out)
   // std::cout << RED"Entering "NRM << __func__ << std::endl;
   VecZeroEntries(Out);
 
-  newmark *ts = new newmark;
+  newmark *ts = (newmark *)m_ts;
 
   // Fdynamic which is the control 
   cardiacDynamic *Fdynamic = new cardiacDynamic(feVec::PETSC);
 
   // Forward solve
-  ts = (newmark *)m_ts;
-
   ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
   ts->setInitialVelocity(m_vecForwardInitialVelocity);
 
@@ -363,10 +367,11 @@ void hyperbolicInverse::hessianMatMult(Vec In, Vec Out)
   solvec = ts->getSolution();
 
   Vec tmp;
-  VecDuplicate(m_vecReducedGradient, &tmp);
+  vecPool::get(m_vecReducedGradient, &tmp);
   concatenateVecs(solvec, tmp, false);
   // VecNorm(tmp, NORM_2, &norm);
   // PetscPrintf(0, "Sol Norm after HessFwd is %g\n", norm);
+  vecPool::restore(tmp);
 
   // Scale to the set the right hand side of adjoint
   for (unsigned int i=0; i<solvec.size(); i++) {
@@ -393,8 +398,8 @@ void hyperbolicInverse::hessianMatMult(Vec In, Vec Out)
 
   // set initial conditions for adjoint ...
   Vec initD, initV;
-  VecDuplicate(m_vecForwardInitialDisplacement, &initD);
-  VecDuplicate(m_vecForwardInitialDisplacement, &initV);
+  vecPool::get(m_vecForwardInitialDisplacement, &initD);
+  vecPool::get(m_vecForwardInitialDisplacement, &initV);
   VecZeroEntries(initD);
   VecZeroEntries(initV);
   ts->setInitialDisplacement(initD); 
@@ -407,7 +412,7 @@ void hyperbolicInverse::hessianMatMult(Vec In, Vec Out)
   // clear memory ...
   for (int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
 
@@ -420,7 +425,7 @@ void hyperbolicInverse::hessianMatMult(Vec In, Vec Out)
   // clear memory ...
   for (int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
 
@@ -433,8 +438,10 @@ void hyperbolicInverse::hessianMatMult(Vec In, Vec Out)
   // add the contribution of the regularization parameter
   VecAXPY(Out, m_beta, In);
   // std::cout << GRN"Leaving "NRM << __func__ << std::endl;
-  VecDestroy(initD);
-  VecDestroy(initV);
+  ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+  ts->setInitialVelocity(m_vecForwardInitialVelocity);
+  vecPool::restore(initD);
+  vecPool::restore(initV);
 }
 
 #endif
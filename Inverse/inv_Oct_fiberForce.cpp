@@ -5,6 +5,7 @@ static char help[] = "Driver for a linear elastodynamic problem (Hyperbolic)";
 #include <fstream>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 
 #include "petscksp.h"
 #include "petscda.h"
@@ -20,10 +21,14 @@ static char help[] = "Driver for a linear elastodynamic problem (Hyperbolic)";
 #include "elasStiffness.h"
 #include "elasMass.h"
 #include "raleighDamping.h"
-#include "cardiacForce.h"
+#include "elasMultigrid.h"
+#include "cardiacFiberForce.h"
 #include "parametricActivationInverse.h"
+#include "lbfgsActivationInverse.h"
 #include "radialBasis.h"
 #include "bSplineBasis.h"
+#include "checkpoint.h"
+#include "perfLog.h"
 
 #define min(X, Y)  ((X) < (Y) ? (X) : (Y))
 
@@ -72,6 +77,7 @@ double randgauss( double min, double max, double sigma, double centre) {
 
 int main(int argc, char **argv) {
   PetscInitialize(&argc, &argv, "cmame.opt", help);
+  perfLog::init();
 
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -94,6 +100,29 @@ int main(int argc, char **argv) {
 
   char problemName[PETSC_MAX_PATH_LEN];
   char filename[PETSC_MAX_PATH_LEN];
+  char restartName[PETSC_MAX_PATH_LEN];
+  char ckptName[PETSC_MAX_PATH_LEN];
+  char layoutName[PETSC_MAX_PATH_LEN];
+
+  PetscTruth restart = PETSC_FALSE;
+  PetscTruth ckptSet = PETSC_FALSE;
+
+  // interpolation plan
+  char planName[PETSC_MAX_PATH_LEN];
+  PetscTruth planSet = PETSC_FALSE;
+  int ckptFreq = 1;
+  int maxIter = 1;
+
+  // inexact Newton
+  PetscTruth inexact = PETSC_FALSE;
+  PetscTruth lsearch = PETSC_FALSE;
+  double etaMax = 0.5;
+  double gtol = 1e-6;
+
+  // L-BFGS
+  PetscTruth lbfgs = PETSC_FALSE;
+  PetscTruth hybrid = PETSC_FALSE;
+  int lbfgsHistory = 5;
 
   double t0 = 0.0;
   double dt = 0.1;
@@ -144,6 +173,24 @@ int main(int argc, char **argv) {
   CHKERRQ ( PetscOptionsGetScalar(0,"-beta",&beta,0) );
   CHKERRQ ( PetscOptionsGetString(PETSC_NULL,"-pn",problemName,PETSC_MAX_PATH_LEN-1,PETSC_NULL));
 
+  // checkpoint / restart
+  CHKERRQ ( PetscOptionsGetInt(0,"-maxit",&maxIter,0) );
+  CHKERRQ ( PetscOptionsGetInt(0,"-ckptFreq",&ckptFreq,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_inexact",&inexact,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_linesearch",&lsearch,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-inv_eta_max",&etaMax,0) );
+  CHKERRQ ( PetscOptionsGetScalar(0,"-inv_gtol",&gtol,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_lbfgs",&lbfgs,0) );
+  CHKERRQ ( PetscOptionsGetTruth(0,"-inv_lbfgs_hybrid",&hybrid,0) );
+  CHKERRQ ( PetscOptionsGetInt(0,"-inv_lbfgs_m",&lbfgsHistory,0) );
+  CHKERRQ ( PetscOptionsGetString(PETSC_NULL,"-ckpt",ckptName,PETSC_MAX_PATH_LEN-1,&ckptSet));
+  CHKERRQ ( PetscOptionsGetString(PETSC_NULL,"-restart",restartName,PETSC_MAX_PATH_LEN-1,&restart));
+  CHKERRQ ( PetscOptionsGetString(PETSC_NULL,"-plan",planName,PETSC_MAX_PATH_LEN-1,&planSet));
+  if ( !ckptSet ) {
+    sprintf(ckptName, "%s", problemName);
+  }
+  sprintf(layoutName, "%s.layout.oct", ckptName);
+
   // Time info for timestepping
   ti.start = t0;
   ti.stop  = t1;
@@ -171,40 +218,62 @@ int main(int argc, char **argv) {
   // The points are not needed anymore, and can be cleared to free memory.
   // pts.clear();
 
-  if (!rank) {
-    ot::readNodesFromFile("test.256.oct", newLinOct);
-    std::cout << "Finished reading" << std::endl;
+  // On restart, the balanced octree is read back from the layout stored in the checkpoint.
+  checkpointHeader ckptHdr;
+  ckptHdr.layout[0] = '\0';
+  if (restart) {
+    CHKERRQ ( checkpoint::readHeader(restartName, ckptHdr) );
   }
 
-  // std::sort(linOct.begin(), linOct.end());
-  std::cout << rank << " Original octree size is " << newLinOct.size() << std::endl;
+  if ( restart && strlen(ckptHdr.layout) ) {
+    CHKERRQ ( checkpoint::readOctree(ckptHdr.layout, balOct, MPI_COMM_WORLD) );
+    sprintf(layoutName, "%s", ckptHdr.layout);
+    std::cout << rank << ": restart octree size is " << balOct.size() << std::endl;
+  } else {
+    if (!rank) {
+      ot::readNodesFromFile("test.256.oct", newLinOct);
+      std::cout << "Finished reading" << std::endl;
+    }
 
-  /*
-  par::Partition<ot::TreeNode>(linoct, newLinOct, MPI_COMM_WORLD);
-  linOct.clear();
-  */
-  par::sampleSort<ot::TreeNode>(newLinOct, linOct, MPI_COMM_WORLD);
-  newLinOct.clear();
+    // std::sort(linOct.begin(), linOct.end());
+    std::cout << rank << " Original octree size is " << newLinOct.size() << std::endl;
 
-  std::cout << rank << ": after Part octree size is " << linOct.size() << std::endl;
+    /*
+    par::Partition<ot::TreeNode>(linoct, newLinOct, MPI_COMM_WORLD);
+    linOct.clear();
+    */
+    par::sampleSort<ot::TreeNode>(newLinOct, linOct, MPI_COMM_WORLD);
+    newLinOct.clear();
 
-  /*********************************************************************** */
-  // BALANCE: Balance the linear octree to enforce the 2:1 balance conditions.
-  /*********************************************************************** */
-  ot::balanceOctree (linOct, balOct, dim, maxDepth, incCorner, MPI_COMM_WORLD);
+    std::cout << rank << ": after Part octree size is " << linOct.size() << std::endl;
 
-  std::cout << "Balanced octree size is " << balOct.size() << std::endl;
+    /*********************************************************************** */
+    // BALANCE: Balance the linear octree to enforce the 2:1 balance conditions.
+    /*********************************************************************** */
+    ot::balanceOctree (linOct, balOct, dim, maxDepth, incCorner, MPI_COMM_WORLD);
 
-  // The linear octree (unbalanced) can be cleared to free memory.
-  linOct.clear();
+    std::cout << "Balanced octree size is " << balOct.size() << std::endl;
 
-  // If desired the octree can be written to a file using the supplied routine ...
-  ot::writeNodesToFile("filename.oct", balOct);
+    // The linear octree (unbalanced) can be cleared to free memory.
+    linOct.clear();
+
+    // Write the balanced octree, this is the layout needed to restart.
+    CHKERRQ ( checkpoint::writeOctree(layoutName, balOct, MPI_COMM_WORLD) );
+  }
 
   /*********************************************************************** */
   // MESH : Construct the octree-based Distruted Array.
   /*********************************************************************** */
   ot::DA da(balOct,MPI_COMM_WORLD);
+
+  // The coarser octrees for the multigrid preconditioner of the timestep solves.
+  PetscInt mgLevels = 1;
+  octDMMG *dmmg = NULL;
+  CHKERRQ ( PetscOptionsGetInt(0,"-octmg_nlevels",&mgLevels,0) );
+  if (mgLevels > 1) {
+    CHKERRQ ( octDMMGCreate(MPI_COMM_WORLD, mgLevels, NULL, &dmmg) );
+    CHKERRQ ( octDMMGSetOctree(&dmmg, balOct, &da, dof) );
+  }
   balOct.clear();
 
   MPI_Barrier(MPI_COMM_WORLD);
@@ -212,15 +281,27 @@ int main(int argc, char **argv) {
   if (!rank)
     std::cout <<"Finshed Meshing" << std::endl;
 
-  PetscFinalize();
-  return 0;
+  // -mesh_only stops after meshing, to time the octree construction alone
+  PetscTruth meshOnly = PETSC_FALSE;
+  PetscOptionsHasName(0, "-mesh_only", &meshOnly);
+  if (meshOnly) {
+    if (dmmg) {
+      CHKERRQ ( octDMMGDestroy(dmmg) );
+    }
+    PetscFinalize();
+    return 0;
+  }
 
   // create Matrices and Vectors
   elasMass *Mass = new elasMass(feMat::OCT); // Mass Matrix
   elasStiffness *Stiffness = new elasStiffness(feMat::OCT); // Stiffness matrix
   raleighDamping *Damping = new raleighDamping(feMat::OCT); // Damping Matrix
+  // the names of the operators in the perfLog summary
+  Mass->setName("elasMass");
+  Stiffness->setName("elasStiffness");
+  Damping->setName("raleighDamping");
 
-  cardiacForce *Force = new cardiacForce(feVec::OCT); // Force Vector
+  cardiacFiberForce *Force = new cardiacFiberForce(feVec::OCT); // Force Vector
 
   // create vectors 
 
@@ -336,25 +417,26 @@ int main(int argc, char **argv) {
   
   PetscScalar *tauArray;
 
+  // regular grid -> octree transfer, reuse the plan from a previous run if possible
+  interpPlan plan;
+  if ( !planSet || plan.load(planName, da, Ns, PETSC_COMM_WORLD) ) {
+    plan.build(da, Ns);
+    if (planSet) {
+      plan.save(planName, PETSC_COMM_WORLD);
+    }
+  }
+  std::vector<PetscScalar *> rgIn(1), octOut(1);
+
   // load the fibers ...
-  da.vecGetBuffer(fibers, tauArray, true, true, 3);
+  da.vecGetBuffer(fibers, tauArray, true, true, false, dof);
     
   sprintf(filename, "%s.%d.fibers", problemName, Ns);
   std::ifstream fin3(filename, std::ios::binary); fin3.read((char *)tmp_fib, dof*elemSize*sizeof(double)); fin3.close();
 
-  for ( da.init<ot::DA::ALL>(), da.init<ot::DA::WRITABLE>(); da.curr() < da.end<ot::DA::ALL>(); da.next<ot::DA::ALL>()) {
-    unsigned int i = da.curr();
-    Point pt;
-    pt = da.getCurrentOffset();
-
-    int indx = pt.z()*Ns*Ns + pt.y()*Ns + pt.x();
-
-    for (int d=0; d<dof; d++) {
-      tauArray[dof*i+d] = tmp_tau[dof*indx+d];
-    }
-  }
+  rgIn[0] = tmp_fib; octOut[0] = tauArray;
+  plan.rg2octree(rgIn, octOut, dof);
 
-  da.vecRestoreBuffer(fibers, tauArray, true, true, 3);
+  da.vecRestoreBuffer(fibers, tauArray, true, true, false, dof);
 
   delete [] tmp_fib;
 
@@ -374,15 +456,8 @@ int main(int argc, char **argv) {
     fin.open(filename); fin.read((char *)tmp_tau, elemSize*sizeof(double)); fin.close();
 
     // c. set the values ...
-    for ( da.init<ot::DA::ALL>(), da.init<ot::DA::WRITABLE>(); da.curr() < da.end<ot::DA::ALL>(); da.next<ot::DA::ALL>()) {
-      unsigned int i = da.curr();
-      Point pt;
-      pt = da.getCurrentOffset();
-
-      int indx = pt.z()*Ns*Ns + pt.y()*Ns + pt.x();
-      
-      tauArray[i] = tmp_tau[indx];
-    }
+    rgIn[0] = tmp_tau; octOut[0] = tauArray;
+    plan.rg2octree(rgIn, octOut, 1);
 
     // restore
     da.vecRestoreBuffer(tmpTau, tauArray, true, true, 1);
@@ -420,6 +495,13 @@ int main(int argc, char **argv) {
   Force->setFiberOrientations(fibers);
   Force->setTimeInfo(&ti);
 
+  PetscTruth adjTest = PETSC_FALSE;
+  PetscOptionsHasName(0, "-force_adjoint_test", &adjTest);
+  if (adjTest) {
+    double adjErr;
+    CHKERRQ( Force->adjointTest(adjErr) );
+  }
+
   // Newmark time stepper ...
   newmark *ts = new newmark; 
 
@@ -441,6 +523,13 @@ int main(int argc, char **argv) {
 
   //if (!rank)
   //  std::cout << RED"Initializing Newmark"NRM << std::endl;
+  // coarse operators with the averaged material properties ...
+  elasMultigrid mg;
+  if (dmmg) {
+    mg.init(dmmg, rho, lambda, mu, dof, 0.0, 0.00075);
+    ts->setMultigrid(dmmg, mg.getMass(), mg.getDamping(), mg.getStiffness());
+  }
+
   double itime = MPI_Wtime();
   ts->init(); // initialize IMPORTANT 
   //if (!rank)
@@ -467,7 +556,15 @@ Vec alpha, outvec;
   VecDuplicate(alpha, &outvec);
 
   // Inverse solver set up
-  parametricActivationInverse *hyperInv = new parametricActivationInverse;
+  parametricActivationInverse *hyperInv;
+  if (lbfgs || hybrid) {
+    lbfgsActivationInverse *qnInv = new lbfgsActivationInverse;
+    qnInv->setHistorySize(lbfgsHistory);
+    qnInv->setHybrid(hybrid == PETSC_TRUE);
+    hyperInv = qnInv;
+  } else {
+    hyperInv = new parametricActivationInverse;
+  }
 
   hyperInv->setBasis(spatialBasis, temporalBasis);
 
@@ -479,10 +576,23 @@ Vec alpha, outvec;
 
   hyperInv->setRegularizationParameter(beta);	// set the regularization paramter
 
-  // hyperInv->setObservations(solvec); // set the data for the problem 
+  std::vector<Vec> solvec = ts->getSolution();
+  hyperInv->setObservations(solvec); // set the data for the problem 
+
+  hyperInv->setMaximumNumberOfIterations(maxIter);
+  hyperInv->setCheckpoint(ckptName, ckptFreq, layoutName);
+
+  hyperInv->setInexactNewton(inexact == PETSC_TRUE);
+  hyperInv->setLineSearch(lsearch == PETSC_TRUE);
+  hyperInv->setMaxForcingTerm(etaMax);
+  hyperInv->setParamsTolerance(gtol);
 
   hyperInv->init();	// initialize the inverse solver
 
+  if (restart) {
+    CHKERRQ ( hyperInv->restart(restartName) );
+  }
+
   hyperInv->solve();
 
   Vec FinalSolution;
@@ -503,6 +613,13 @@ Vec alpha, outvec;
     sol.close();
   }
 
+  perfLog::summary(problemName);
+  mg.destroy();
+  if (dmmg) {
+    CHKERRQ ( octDMMGDestroy(dmmg) );
+  }
+
+  vecPool::clear();
   PetscFinalize();
 }
 
@@ -20,11 +20,13 @@ static char help[] = "Driver for a linear elastodynamic problem (Hyperbolic)";
 #include "elasStiffness.h"
 #include "elasMass.h"
 #include "raleighDamping.h"
+#include "elasMultigrid.h"
 #include "cardiacDynamic.h"
 
 #include "parametricElasInverse.h"
 #include "radialBasis.h"
 #include "bSplineBasis.h"
+#include "perfLog.h"
 
 #define min(X, Y)  ((X) < (Y) ? (X) : (Y))
 
@@ -73,6 +75,7 @@ double randgauss( double min, double max, double sigma, double centre) {
 
 int main(int argc, char **argv) {
   PetscInitialize(&argc, &argv, "cmame.opt", help);
+  perfLog::init();
 
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -207,6 +210,15 @@ int main(int argc, char **argv) {
   // MESH : Construct the octree-based Distruted Array.
   /*********************************************************************** */
   ot::DA da(balOct,MPI_COMM_WORLD);
+
+  // The coarser octrees for the multigrid preconditioner of the timestep solves.
+  PetscInt mgLevels = 1;
+  octDMMG *dmmg = NULL;
+  CHKERRQ ( PetscOptionsGetInt(0,"-octmg_nlevels",&mgLevels,0) );
+  if (mgLevels > 1) {
+    CHKERRQ ( octDMMGCreate(MPI_COMM_WORLD, mgLevels, NULL, &dmmg) );
+    CHKERRQ ( octDMMGSetOctree(&dmmg, balOct, &da, dof) );
+  }
   balOct.clear();
 
   MPI_Barrier(MPI_COMM_WORLD);
@@ -214,13 +226,25 @@ int main(int argc, char **argv) {
   if (!rank)
     std::cout <<"Finshed Meshing" << std::endl;
 
-  PetscFinalize();
-  return 0;
+  // -mesh_only stops after meshing, to time the octree construction alone
+  PetscTruth meshOnly = PETSC_FALSE;
+  PetscOptionsHasName(0, "-mesh_only", &meshOnly);
+  if (meshOnly) {
+    if (dmmg) {
+      CHKERRQ ( octDMMGDestroy(dmmg) );
+    }
+    PetscFinalize();
+    return 0;
+  }
 
   // create Matrices and Vectors
   elasMass *Mass = new elasMass(feMat::OCT); // Mass Matrix
   elasStiffness *Stiffness = new elasStiffness(feMat::OCT); // Stiffness matrix
   raleighDamping *Damping = new raleighDamping(feMat::OCT); // Damping Matrix
+  // the names of the operators in the perfLog summary
+  Mass->setName("elasMass");
+  Stiffness->setName("elasStiffness");
+  Damping->setName("raleighDamping");
 
   cardiacDynamic *Force = new cardiacDynamic(feVec::OCT); // Force Vector
 
@@ -419,6 +443,13 @@ int main(int argc, char **argv) {
 
   //if (!rank)
   //  std::cout << RED"Initializing Newmark"NRM << std::endl;
+  // coarse operators with the averaged material properties ...
+  elasMultigrid mg;
+  if (dmmg) {
+    mg.init(dmmg, rho, lambda, mu, dof, 0.0, 0.00075);
+    ts->setMultigrid(dmmg, mg.getMass(), mg.getDamping(), mg.getStiffness());
+  }
+
   double itime = MPI_Wtime();
   ts->init(); // initialize IMPORTANT 
   //if (!rank)
@@ -481,6 +512,13 @@ Vec alpha, outvec;
     sol.close();
   }
 
+  perfLog::summary(problemName);
+  mg.destroy();
+  if (dmmg) {
+    CHKERRQ ( octDMMGDestroy(dmmg) );
+  }
+
+  vecPool::clear();
   PetscFinalize();
 }
 
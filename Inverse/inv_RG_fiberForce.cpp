@@ -18,16 +18,22 @@ static char help[] = "Driver for a estimate cardiac activations";
 #include "elasStiffness.h"
 #include "elasMass.h"
 #include "raleighDamping.h"
-#include "cardiacForce.h"
+#include "cardiacFiberForce.h"
 #include "parametricActivationInverse.h"
 #include "radialBasis.h"
 #include "bSplineBasis.h"
+#include "perfLog.h"
+#include "spaceTimeComm.h"
 
 #define min(X, Y)  ((X) < (Y) ? (X) : (Y))
 
 int main(int argc, char **argv)
 {       
+  // -time_groups 2 bounds the memory of the gradient to a time slab, it is not
+  // faster than one group (see setReducedGradientPipelined), so it is off by default
+  spaceTimeComm::init(&argc, &argv);
   PetscInitialize(&argc, &argv, "elas.opt", help);
+  perfLog::init();
 
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -118,8 +124,12 @@ int main(int argc, char **argv)
   elasMass *Mass = new elasMass(feMat::PETSC); // Mass Matrix
   elasStiffness *Stiffness = new elasStiffness(feMat::PETSC); // Stiffness matrix
   raleighDamping *Damping = new raleighDamping(feMat::PETSC); // Damping Matrix
+  // the names of the operators in the perfLog summary
+  Mass->setName("elasMass");
+  Stiffness->setName("elasStiffness");
+  Damping->setName("raleighDamping");
 
-  cardiacForce *Force = new cardiacForce(feVec::PETSC); // Force Vector
+  cardiacFiberForce *Force = new cardiacFiberForce(feVec::PETSC); // Force Vector
 
   // create vectors 
   CHKERRQ( DACreateGlobalVector(da, &rho) );
@@ -346,10 +356,18 @@ int main(int argc, char **argv)
   // Force Vector
   Force->setProblemDimensions(1.0,1.0,1.0);
   Force->setDA(da3d);
+  Force->setDAScalar(da);
   Force->setActivationVec(tau);
   Force->setFiberOrientations(fibers);
   Force->setTimeInfo(&ti);
 
+  PetscTruth adjTest = PETSC_FALSE;
+  PetscOptionsHasName(0, "-force_adjoint_test", &adjTest);
+  if (adjTest) {
+    double adjErr;
+    CHKERRQ( Force->adjointTest(adjErr) );
+  }
+
   // Newmark time stepper ...
   newmark *ts = new newmark; 
 
@@ -400,6 +418,9 @@ int main(int argc, char **argv)
   hyperInv->setTimeStepper(ts);    // set the timestepper
   hyperInv->setInitialGuess(alpha);// set the initial guess 
   hyperInv->setRegularizationParameter(beta); // set the regularization paramter
+  int numSlabs = 8;
+  CHKERRQ ( PetscOptionsGetInt(0,"-time_slabs",&numSlabs,0) );
+  hyperInv->setTimeSlabs(numSlabs);
 
   // hyperInv->setObservations(solvec); // set the data for the problem 
   hyperInv->init(); // initialize the inverse solver
@@ -458,7 +479,10 @@ int main(int argc, char **argv)
   }
   */
   
+    perfLog::summary(problemName);
+    vecPool::clear();
     PetscFinalize();
+    spaceTimeComm::finalize();
 }
 
 
@@ -22,6 +22,7 @@ static char help[] = "Generate the parametrized linear elastodynamic problem (Hy
 #include "parametricElasInverse.h"
 #include "radialBasis.h"
 #include "bSplineBasis.h"
+#include "perfLog.h"
 
 #define min(X, Y)  ((X) < (Y) ? (X) : (Y))
 
@@ -29,6 +30,7 @@ void getForces(Vec params, std::vector<Vec> &forces, DA da, timeInfo *ti, std::v
 
 int main(int argc, char **argv) {
   PetscInitialize(&argc, &argv, "elas.opt", help);
+  perfLog::init();
 
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -111,6 +113,10 @@ int main(int argc, char **argv) {
   elasMass *Mass = new elasMass(feMat::PETSC); // Mass Matrix
   elasStiffness *Stiffness = new elasStiffness(feMat::PETSC);	// Stiffness matrix
   raleighDamping *Damping = new raleighDamping(feMat::PETSC);	// Damping Matrix
+  // the names of the operators in the perfLog summary
+  Mass->setName("elasMass");
+  Stiffness->setName("elasStiffness");
+  Damping->setName("raleighDamping");
 
   cardiacDynamic *Force = new cardiacDynamic(feVec::PETSC);	// Force Vector
 
@@ -457,6 +463,8 @@ int main(int argc, char **argv) {
     hess.close();
   */
 
+  perfLog::summary(problemName);
+  vecPool::clear();
   PetscFinalize();
 }
 
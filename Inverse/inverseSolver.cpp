@@ -1,9 +1,36 @@
+#include <cstring>
+#include <cmath>
 #include "inverseSolver.h"
 
 // constructor
 inverseSolver::inverseSolver()
 {
   m_bUsePartialObservations = false;
+  m_landmarks = NULL;
+
+  m_maxIterations = 1;
+  m_numIterations = 0;
+  m_costFunctionValue = 0.0;
+  m_paramsTolerance = 1e-6;
+
+  m_bInexactNewton = false;
+  m_bLineSearch = false;
+  m_dForcing = 0.5;
+  m_dForcingMax = 0.5;
+  m_dForcingGamma = 0.9;
+  m_dForcingAlpha = 0.5*(1.0 + sqrt(5.0));
+  m_dPrevGradNorm = 0.0;
+  m_dInitialGradNorm = 0.0;
+  m_dInnerTolMin = 1e-8;
+  m_dInnerTolMax = 1e-3;
+  m_dInnerTolFactor = 0.1;
+  m_dArmijo = 1e-4;
+  m_iMaxLineSearch = 10;
+
+  m_iCheckpointFreq = 0;
+  m_bRestarted = false;
+  m_szCheckpointPrefix[0] = '\0';
+  m_szLayoutFile[0] = '\0';
 }
 // destructor
 inverseSolver::~inverseSolver()
@@ -78,4 +105,162 @@ PetscErrorCode inverseSolver::getCurrentControl(Vec currentControl)
   return(0);
 }
 
-// 
+//
+
+// set checkpointing parameters
+PetscErrorCode inverseSolver::setCheckpoint(const char *prefix, int freq, const char *layout)
+{
+  strncpy(m_szCheckpointPrefix, prefix, CHECKPOINT_MAX_PATH-8);
+  m_szCheckpointPrefix[CHECKPOINT_MAX_PATH-8] = '\0';
+  m_iCheckpointFreq = freq;
+  if (layout != NULL) {
+    strncpy(m_szLayoutFile, layout, CHECKPOINT_MAX_PATH-1);
+    m_szLayoutFile[CHECKPOINT_MAX_PATH-1] = '\0';
+  }
+  return(0);
+}
+
+// write the outer loop state 
+PetscErrorCode inverseSolver::writeCheckpoint()
+{
+  int ierr;
+  checkpointHeader hdr;
+  char fname[CHECKPOINT_MAX_PATH];
+
+  memset(&hdr, 0, sizeof(checkpointHeader));
+  hdr.iteration = m_numIterations;
+  hdr.cost = m_costFunctionValue;
+  hdr.beta = m_beta;
+  ierr = VecNorm(m_vecReducedGradient, NORM_2, &(hdr.gradNorm)); CHKERRQ(ierr);
+  hdr.initGradNorm = m_dInitialGradNorm;
+  strcpy(hdr.layout, m_szLayoutFile);
+
+  std::vector<Vec> vecs;
+  vecs.push_back(m_vecCurrentControl);
+  vecs.push_back(m_vecControlStep);
+  vecs.push_back(m_vecReducedGradient);
+
+  sprintf(fname, "%s.ckpt", m_szCheckpointPrefix);
+  ierr = m_checkpoint.write(fname, hdr, vecs); CHKERRQ(ierr);
+
+  PetscPrintf(0, "Checkpoint at iteration %d written to %s\n", m_numIterations, fname);
+  return(0);
+}
+
+// restore the outer loop state
+PetscErrorCode inverseSolver::restart(const char *fname)
+{
+  int ierr;
+  checkpointHeader hdr;
+
+  std::vector<Vec> vecs;
+  vecs.push_back(m_vecCurrentControl);
+  vecs.push_back(m_vecControlStep);
+  vecs.push_back(m_vecReducedGradient);
+
+  ierr = checkpoint::read(fname, hdr, vecs); CHKERRQ(ierr);
+
+  m_numIterations = hdr.iteration;
+  m_costFunctionValue = hdr.cost;
+  // the relative tolerance stays that of the first run
+  m_dInitialGradNorm = hdr.initGradNorm;
+  m_bRestarted = true;
+
+  if (hdr.beta != m_beta) {
+    PetscPrintf(0, "Warning: checkpoint was written with beta = %g, using %g\n", hdr.beta, m_beta);
+  }
+  PetscPrintf(0, "Restarting from %s at iteration %d, J = %g, |g| = %g\n", fname, hdr.iteration, hdr.cost, hdr.gradNorm);
+  return(0);
+}
+
+// cost function, needs to be implemented by the derived class for line search
+double inverseSolver::computeCost(Vec control)
+{
+  PetscPrintf(0, "computeCost is not implemented for this solver\n");
+  return m_costFunctionValue;
+}
+
+// Eisenstat-Walker forcing term (choice 2) for the Hessian solve
+double inverseSolver::getForcingTerm(double gnorm)
+{
+  double eta = m_dForcingMax;
+
+  if (m_dPrevGradNorm > 0.0) {
+    eta = m_dForcingGamma*pow(gnorm/m_dPrevGradNorm, m_dForcingAlpha);
+    // safeguard against the forcing term dropping too quickly
+    double safe = m_dForcingGamma*pow(m_dForcing, m_dForcingAlpha);
+    if (safe > 0.1)
+      eta = (eta > safe) ? eta : safe;
+  }
+  if (eta > m_dForcingMax)
+    eta = m_dForcingMax;
+
+  // do not oversolve close to convergence
+  double eps = 0.5*m_paramsTolerance*m_dInitialGradNorm/gnorm;
+  if (eta < eps)
+    eta = eps;
+
+  m_dForcing = eta;
+  m_dPrevGradNorm = gnorm;
+
+  return eta;
+}
+
+// tolerance of the forward and adjoint solves tied to the gradient norm
+PetscErrorCode inverseSolver::setInnerTolerance(double gnorm, double eta)
+{
+  int ierr;
+  double rtol = m_dInnerTolMax;
+
+  if (m_dInitialGradNorm > 0.0)
+    rtol = m_dInnerTolFactor*eta*gnorm/m_dInitialGradNorm;
+
+  if (rtol > m_dInnerTolMax) rtol = m_dInnerTolMax;
+  if (rtol < m_dInnerTolMin) rtol = m_dInnerTolMin;
+
+  ierr = m_ts->setSolverTolerance(rtol); CHKERRQ(ierr);
+  PetscPrintf(0, "Inexact Newton: eta = %g, fwd/adj rtol = %g\n", eta, rtol);
+  return(0);
+}
+
+// backtracking line search along -step, updates the current control
+PetscErrorCode inverseSolver::lineSearch(bool &accepted)
+{
+  int ierr;
+  double slope, cost;
+  Vec trial;
+
+  // directional derivative along -step is -g^T step
+  ierr = VecDot(m_vecReducedGradient, m_vecControlStep, &slope); CHKERRQ(ierr);
+  if (slope <= 0.0) {
+    PetscPrintf(0, "Newton step is not a descent direction, using the gradient\n");
+    ierr = VecCopy(m_vecReducedGradient, m_vecControlStep); CHKERRQ(ierr);
+    ierr = VecDot(m_vecReducedGradient, m_vecControlStep, &slope); CHKERRQ(ierr);
+  }
+
+  ierr = vecPool::get(m_vecCurrentControl, &trial); CHKERRQ(ierr);
+
+  double alpha = 1.0;
+  accepted = false;
+  for (int i=0; i<m_iMaxLineSearch; i++) {
+    ierr = VecWAXPY(trial, -alpha, m_vecControlStep, m_vecCurrentControl); CHKERRQ(ierr);
+    cost = computeCost(trial);
+    if ( cost <= m_costFunctionValue - m_dArmijo*alpha*slope ) {
+      accepted = true;
+      break;
+    }
+    PetscPrintf(0, "Line search: J(%g) = %g, backtracking\n", alpha, cost);
+    alpha *= 0.5;
+  }
+
+  if (accepted) {
+    PetscPrintf(0, "Line search: step length %g, J = %g\n", alpha, cost);
+    ierr = VecCopy(trial, m_vecCurrentControl); CHKERRQ(ierr);
+    m_costFunctionValue = cost;
+  } else {
+    PetscPrintf(0, "Line search failed, keeping the current control (J = %g)\n", m_costFunctionValue);
+  }
+  ierr = vecPool::restore(trial); CHKERRQ(ierr);
+
+  return(0);
+}
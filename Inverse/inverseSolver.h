@@ -6,8 +6,11 @@
 #include "petscdmmg.h"
 #include "timeStepper.h"
 #include "stsdamgHeader.h"
+#include "checkpoint.h"
+#include "perfLog.h"
 // #include "rpHeader.h"
 
+class landmarkObservation;
 
 class inverseSolver {
 
@@ -39,6 +42,10 @@ class inverseSolver {
     {
       return m_functionTolerance;
     }
+    void setMaximumNumberOfIterations (int n)
+    {
+      m_maxIterations = n;
+    }
     int getMaximumNumberOfIterations () const
     {
       return m_maxIterations;
@@ -59,6 +66,12 @@ class inverseSolver {
       return(0);
     }
 
+    // Sparse observations of tracked landmarks, instead of the nodal field.
+    PetscErrorCode setLandmarkObservations(landmarkObservation *lm) {
+      m_landmarks = lm;
+      return(0);
+    }
+
     // 
     PetscErrorCode setInitialGuess(Vec initialGuess);
 
@@ -84,6 +97,64 @@ class inverseSolver {
       return m_isOptimizing;
     };
 
+    /** @name Checkpoint / Restart **/
+    //@{
+    /**
+     *  @brief Enables checkpointing of the outer loop state every freq iterations
+     *  @param prefix the checkpoint is written to prefix.ckpt
+     *  @param freq   write every freq iterations, 0 disables checkpointing
+     *  @param layout file with the octree needed to rebuild the DA (optional)
+     **/
+    PetscErrorCode setCheckpoint(const char *prefix, int freq, const char *layout = NULL);
+
+    /**
+     *  @brief Writes (asynchronously) the current state of the outer loop.
+     **/
+    virtual PetscErrorCode writeCheckpoint();
+
+    /**
+     *  @brief Completes any pending checkpoint write.
+     **/
+    PetscErrorCode finishCheckpoint() {
+      return m_checkpoint.wait();
+    }
+
+    /**
+     *  @brief Restores the outer loop state from a checkpoint, must be called after init().
+     **/
+    virtual PetscErrorCode restart(const char *fname);
+    //@}
+
+    /** @name Inexact Newton **/
+    //@{
+    /**
+     *  @brief Enables the inexact Newton mode. The tolerance of the Hessian CG 
+     *  is set by the Eisenstat-Walker forcing term, and the tolerance of the 
+     *  forward and adjoint solves is tied to the gradient norm.
+     **/
+    void setInexactNewton(bool flag) {
+      m_bInexactNewton = flag;
+    }
+    /**
+     *  @brief Enables a backtracking (Armijo) line search along the Newton step.
+     *  Needs computeCost() to be implemented by the derived class.
+     **/
+    void setLineSearch(bool flag) {
+      m_bLineSearch = flag;
+    }
+    void setMaxForcingTerm(double eta) {
+      m_dForcingMax = eta;
+    }
+    void setMaxInnerTolerance(double rtol) {
+      m_dInnerTolMax = rtol;
+    }
+
+    /**
+     *  @brief Evaluates the cost function at the given control, this requires a forward solve.
+     **/
+    virtual double computeCost(Vec control);
+    //@}
+
     virtual void  hessianMatMult(Vec _in, Vec _out)= 0;
 
     virtual void mghessianMatMult(DA _da, Vec _in, Vec _out) = 0;
@@ -95,7 +166,9 @@ class inverseSolver {
       inverseSolver *contxt;
       MatShellGetContext(M,(void**)&contxt);
 
+      perfLog::begin(perfLog::HESSIAN_MATVEC);
       contxt->hessianMatMult(In,Out);
+      perfLog::end(perfLog::HESSIAN_MATVEC);
       return(0);
     }
 
@@ -167,6 +240,9 @@ class inverseSolver {
     Vec m_vecPartialObservations;
     bool m_bUsePartialObservations;
 
+    // landmark observation operator, NULL if the nodal field is observed
+    landmarkObservation *m_landmarks;
+
     // Working Vectors
     Vec m_vecCurrentControl;
     Vec m_vecCurrentState;
@@ -190,6 +266,33 @@ class inverseSolver {
     // Multigrid solver for the step
     stsDMMG *m_dmmg;
 
+    // Inexact Newton
+    double getForcingTerm(double gnorm);
+    PetscErrorCode setInnerTolerance(double gnorm, double eta);
+    // accepted is false if no step length decreases the cost enough, the control is then unchanged
+    PetscErrorCode lineSearch(bool &accepted);
+
+    bool   m_bInexactNewton;
+    bool   m_bLineSearch;
+    double m_dForcing;            // current forcing term
+    double m_dForcingMax;         // eta_max
+    double m_dForcingGamma;       // Eisenstat-Walker gamma
+    double m_dForcingAlpha;       // Eisenstat-Walker alpha
+    double m_dPrevGradNorm;
+    double m_dInitialGradNorm;
+    double m_dInnerTolMin;        // tolerance of the fwd/adj solves at convergence
+    double m_dInnerTolMax;        // tolerance of the fwd/adj solves far from the optimum
+    double m_dInnerTolFactor;
+    double m_dArmijo;
+    int    m_iMaxLineSearch;
+
+    // Checkpointing
+    checkpoint m_checkpoint;
+    int  m_iCheckpointFreq;
+    bool m_bRestarted;
+    char m_szCheckpointPrefix[CHECKPOINT_MAX_PATH];
+    char m_szLayoutFile[CHECKPOINT_MAX_PATH];
+
 };
 
 #endif 
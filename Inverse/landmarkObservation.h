@@ -0,0 +1,459 @@
+/**
+ *  @file   landmarkObservation.h
+ *  @brief  Sparse observation operator for tracked (tagged MRI) landmarks.
+ *  @author Hari Sundar
+ *  @date   3/14/08
+ *
+ *  The observations are the displacements of a few landmarks, tracked on
+ *  a slice with the markTags tool, instead of the full displacement field.
+ *  The operator B interpolates the nodal displacements at the reference
+ *  (first frame) positions of the landmarks, trilinearly on the regular
+ *  grid, and with the hanging nodes replaced by the nodes of the parent on
+ *  the octree. Only the in-plane (x,y) components are observed.
+ *
+ *  The interpolation weights are computed once (build()). Every processor
+ *  keeps the weights of the nodes it owns on the regular grid, and of the
+ *  landmarks that fall in its elements on the octree, so that B u and
+ *  B^T r are O(#landmarks) per timestep; the landmark values are summed
+ *  with a single MPI_Allreduce, and are replicated on all processors.
+ *
+ *  The class is also the force vector of the adjoint problem: it stores
+ *  the residuals of all timesteps and addVec() adds B^T r_t, so that the
+ *  adjoint solve does not need a nodal vector per timestep.
+ **/
+
+#ifndef _LANDMARK_OBSERVATION_H_
+#define _LANDMARK_OBSERVATION_H_
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "mpi.h"
+#include "petscda.h"
+#include "oda.h"
+#include "feVec.h"
+#include "timeInfo.h"
+
+class landmarkObservation : public feVec {
+  public:
+    landmarkObservation(daType da);
+
+    /**
+     *  @brief reads the landmarks written by markTags.
+     *
+     *  Two formats are supported, the .pts file (also read by readLandmarks.m),
+     *  i.e., the number of frames followed, for every frame, by the number of
+     *  points and their x y pixel coordinates, and the .txt file, i.e., the
+     *  total number of points and the number of frames followed by x y frame
+     *  for every point. All frames must have the same landmarks, in the same
+     *  order.
+     **/
+    int readLandmarks(const char *fname);
+
+    /**
+     *  @brief maps the pixel (x,y) to (x*sx, y*sy, z) in the domain.
+     **/
+    void setImageGeometry(double sx, double sy, double z) {
+      m_dSpacing[0] = sx;
+      m_dSpacing[1] = sy;
+      m_dSlice = z;
+    }
+
+    /**
+     *  @brief the frames are spread uniformly over the timesteps of ti.
+     **/
+    void setTimeInfo(timeInfo *ti) {
+      m_time = ti;
+    }
+
+    unsigned int getNumLandmarks() {
+      return m_uiNumLandmarks;
+    }
+
+    /**
+     *  @brief locates the landmarks and computes the weights and the data at every timestep.
+     **/
+    int build();
+
+    /**
+     *  @brief replaces the tracked data by B u_t, e.g., for synthetic experiments.
+     **/
+    int setObservations(std::vector<Vec> &states);
+
+    /**
+     *  @brief y = B u, replicated on all processors, 2 x #landmarks.
+     **/
+    int apply(Vec u, double *y);
+
+    /**
+     *  @brief out += scale * B^T y.
+     **/
+    int applyTranspose(double *y, Vec out, double scale);
+
+    /**
+     *  @brief stores the residual r_t = d_t - B u at timestep t, and returns |r_t|^2.
+     *  @param withData  if false r_t = -B u, the right hand side of a Hessian product
+     **/
+    double setResidual(Vec u, unsigned int t, bool withData = true);
+
+    /**
+     *  @brief adds scale * B^T r_indx, the adjoint force at timestep indx.
+     **/
+    virtual bool addVec(Vec _in, double scale=1.0, int indx = -1);
+
+    virtual bool computeVec(Vec _in, Vec _out, double scale=1.0) {
+      return false;
+    }
+
+  protected:
+    int  addEntry(unsigned int lm, unsigned int idx, double w);
+
+    timeInfo              *m_time;
+
+    unsigned int           m_uiNumLandmarks;
+    unsigned int           m_uiNumFrames;
+    unsigned int           m_uiNumSteps;
+
+    double                 m_dSpacing[2];
+    double                 m_dSlice;
+
+    // tracked pixel positions, numFrames x 2 x numLandmarks
+    std::vector<double>    m_frames;
+
+    // displacements and residuals, (NT+1) x 2 x numLandmarks
+    std::vector<double>    m_data;
+    std::vector<double>    m_res;
+
+    // the local part of B, landmark, (local or buffer) node index and weight
+    std::vector<unsigned int> m_entLandmark;
+    std::vector<unsigned int> m_entNode;
+    std::vector<double>       m_entWeight;
+};
+
+landmarkObservation::landmarkObservation(daType da) {
+  m_daType = da;
+  m_DA = NULL;
+  m_octDA = NULL;
+  m_time = NULL;
+
+  m_dLx = m_dLy = m_dLz = 1.0;
+  m_dSpacing[0] = m_dSpacing[1] = 1.0;
+  m_dSlice = 0.5;
+
+  m_uiNumLandmarks = 0;
+  m_uiNumFrames = 0;
+  m_uiNumSteps = 0;
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "landmarkObservation_readLandmarks"
+int landmarkObservation::readLandmarks(const char *fname) {
+  std::ifstream in(fname);
+  if ( !in.is_open() ) {
+    PetscPrintf(0, "landmarkObservation: can not open %s\n", fname);
+    return(1);
+  }
+
+  std::vector<double> px;
+  unsigned int nf, nn = 0;
+  int len = strlen(fname);
+
+  if ( (len > 4) && !strcmp(fname + len - 4, ".txt") ) {
+    unsigned int np;
+    in >> np >> nf;
+    if ( !nf || (np % nf) ) {
+      PetscPrintf(0, "landmarkObservation: %d points can not be split into %d frames\n", np, nf);
+      return(1);
+    }
+    nn = np/nf;
+    px.resize(2*np);
+    std::vector<unsigned int> cnt(nf, 0);
+    for (unsigned int i=0; i<np; i++) {
+      double x, y;
+      unsigned int f;
+      in >> x >> y >> f;
+      if ( (f >= nf) || (cnt[f] >= nn) ) {
+        PetscPrintf(0, "landmarkObservation: all frames must have the same number of points\n");
+        return(1);
+      }
+      px[2*(f*nn + cnt[f])] = x;
+      px[2*(f*nn + cnt[f]) + 1] = y;
+      cnt[f]++;
+    }
+  } else {
+    in >> nf;
+    for (unsigned int f=0; f<nf; f++) {
+      unsigned int n;
+      in >> n;
+      if (!f) {
+        nn = n;
+        px.resize(2*nf*nn);
+      } else if (n != nn) {
+        PetscPrintf(0, "landmarkObservation: frame %d has %d points instead of %d\n", f, n, nn);
+        return(1);
+      }
+      for (unsigned int j=0; j<nn; j++) {
+        in >> px[2*(f*nn + j)] >> px[2*(f*nn + j) + 1];
+      }
+    }
+  }
+  in.close();
+
+  m_uiNumFrames = nf;
+  m_uiNumLandmarks = nn;
+
+  m_frames = px;
+
+  PetscPrintf(0, "landmarkObservation: %d landmarks, %d frames from %s\n", nn, nf, fname);
+  return(0);
+}
+
+int landmarkObservation::addEntry(unsigned int lm, unsigned int idx, double w) {
+  if (w == 0.0)
+    return(0);
+  m_entLandmark.push_back(lm);
+  m_entNode.push_back(idx);
+  m_entWeight.push_back(w);
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "landmarkObservation_build"
+int landmarkObservation::build() {
+  int ierr;
+  unsigned int L = m_uiNumLandmarks;
+
+  m_entLandmark.clear();
+  m_entNode.clear();
+  m_entWeight.clear();
+
+  // reference positions, clamped to the domain
+  std::vector<double> pts(3*L);
+  unsigned int outside = 0;
+  for (unsigned int j=0; j<L; j++) {
+    double p[3] = { m_dSpacing[0]*m_frames[2*j], m_dSpacing[1]*m_frames[2*j+1], m_dSlice };
+    double lx[3] = { m_dLx, m_dLy, m_dLz };
+    bool out = false;
+    for (int d=0; d<3; d++) {
+      if (p[d] < 0.0) { p[d] = 0.0; out = true; }
+      if (p[d] > lx[d]) { p[d] = lx[d]; out = true; }
+      pts[3*j+d] = p[d];
+    }
+    if (out)
+      outside++;
+  }
+  if (outside)
+    PetscPrintf(0, "landmarkObservation: %d landmarks outside the domain, moved to the boundary\n", outside);
+
+  if (m_daType == PETSC) {
+    PetscInt mx, my, mz, xs, ys, zs, xm, ym, zm;
+    ierr = DAGetInfo(m_DA, 0, &mx, &my, &mz, 0,0,0,0,0,0,0); CHKERRQ(ierr);
+    ierr = DAGetCorners(m_DA, &xs, &ys, &zs, &xm, &ym, &zm); CHKERRQ(ierr);
+
+    int n[3] = { mx, my, mz };
+    double h[3] = { m_dLx/(mx-1), m_dLy/(my-1), m_dLz/(mz-1) };
+
+    for (unsigned int j=0; j<L; j++) {
+      int e[3];
+      double xi[3];
+      for (int d=0; d<3; d++) {
+        e[d] = (int)floor(pts[3*j+d]/h[d]);
+        if (e[d] > n[d]-2)
+          e[d] = n[d]-2;
+        xi[d] = pts[3*j+d]/h[d] - e[d];
+      }
+      // only the nodes owned by this processor
+      for (int q=0; q<8; q++) {
+        int i = e[0] + (q & 1), jj = e[1] + ((q >> 1) & 1), k = e[2] + ((q >> 2) & 1);
+        if ( (i < xs) || (i >= xs+xm) || (jj < ys) || (jj >= ys+ym) || (k < zs) || (k >= zs+zm) )
+          continue;
+        double w = ((q & 1) ? xi[0] : 1.0-xi[0]) * (((q >> 1) & 1) ? xi[1] : 1.0-xi[1]) * (((q >> 2) & 1) ? xi[2] : 1.0-xi[2]);
+        addEntry(j, ((k-zs)*ym + (jj-ys))*xm + (i-xs), w);
+      }
+    }
+  } else {
+    unsigned int maxD = m_octDA->getMaxDepth();
+    double fac = (double)(1u << (maxD-1));
+    double top = fac*(1.0 - 1e-12);
+
+    // landmark positions in octree units
+    std::vector<double> X(3*L);
+    for (unsigned int j=0; j<L; j++) {
+      X[3*j]   = pts[3*j]*fac/m_dLx;
+      X[3*j+1] = pts[3*j+1]*fac/m_dLy;
+      X[3*j+2] = pts[3*j+2]*fac/m_dLz;
+      for (int d=0; d<3; d++)
+        if (X[3*j+d] > top)
+          X[3*j+d] = top;
+    }
+
+    // every landmark is in exactly one writable element
+    std::vector<bool> found(L, false);
+    for ( m_octDA->init<ot::DA::ALL>(), m_octDA->init<ot::DA::WRITABLE>(); m_octDA->curr() < m_octDA->end<ot::DA::ALL>(); m_octDA->next<ot::DA::ALL>() ) {
+      Point pt = m_octDA->getCurrentOffset();
+      unsigned int lev = m_octDA->getLevel(m_octDA->curr());
+      double h = (double)(1u << (maxD - lev));
+      double a[3] = { (double)pt.x(), (double)pt.y(), (double)pt.z() };
+
+      for (unsigned int j=0; j<L; j++) {
+        if ( found[j] )
+          continue;
+        double *x = &(X[3*j]);
+        if ( (x[0] < a[0]) || (x[0] >= a[0]+h) || (x[1] < a[1]) || (x[1] >= a[1]+h) || (x[2] < a[2]) || (x[2] >= a[2]+h) )
+          continue;
+        found[j] = true;
+
+        ot::DA::index idx[8];
+        m_octDA->getNodeIndices(idx);
+        unsigned char hn = m_octDA->getHangingNodeIndex(m_octDA->curr());
+        unsigned int ch = m_octDA->getChildNumber();
+
+        double xi[3] = { (x[0]-a[0])/h, (x[1]-a[1])/h, (x[2]-a[2])/h };
+        for (unsigned int q=0; q<8; q++) {
+          double w = ((q & 1) ? xi[0] : 1.0-xi[0]) * (((q >> 1) & 1) ? xi[1] : 1.0-xi[1]) * (((q >> 2) & 1) ? xi[2] : 1.0-xi[2]);
+          if ( !(hn & (1 << q)) ) {
+            addEntry(j, idx[q], w);
+            continue;
+          }
+          // A hanging node is the midpoint of the parent corners ch^s, s in q^ch,
+          // and getNodeIndices returns the parent corners for the hanging nodes.
+          unsigned int diff = q ^ ch;
+          unsigned int cnt = 0;
+          for (unsigned int s=0; s<8; s++)
+            if ( !(s & ~diff) )
+              cnt++;
+          for (unsigned int s=0; s<8; s++)
+            if ( !(s & ~diff) )
+              addEntry(j, idx[ch ^ s], w/cnt);
+        }
+      }
+    }
+  }
+
+  // data at every timestep, the frames are linearly interpolated in time
+  m_uiNumSteps = (unsigned int)(ceil(( m_time->stop - m_time->start)/m_time->step));
+  unsigned int NT = m_uiNumSteps;
+  m_data.resize(2*L*(NT+1));
+  m_res.resize(2*L*(NT+1));
+  for (unsigned int t=0; t<=NT; t++) {
+    double s = (NT && (m_uiNumFrames > 1)) ? ((double)t*(m_uiNumFrames-1))/NT : 0.0;
+    unsigned int f = (unsigned int)floor(s);
+    if (f >= m_uiNumFrames-1)
+      f = (m_uiNumFrames > 1) ? m_uiNumFrames-2 : 0;
+    double a = (m_uiNumFrames > 1) ? s - f : 0.0;
+    unsigned int f1 = (m_uiNumFrames > 1) ? f+1 : f;
+    for (unsigned int j=0; j<2*L; j++) {
+      m_data[2*L*t + j] = m_dSpacing[j%2]*((1.0-a)*m_frames[2*L*f + j] + a*m_frames[2*L*f1 + j] - m_frames[j]);
+      m_res[2*L*t + j] = 0.0;
+    }
+  }
+
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "landmarkObservation_setObservations"
+int landmarkObservation::setObservations(std::vector<Vec> &states) {
+  int ierr;
+  unsigned int L = m_uiNumLandmarks;
+  for (unsigned int t=0; (t<states.size()) && (t<=m_uiNumSteps); t++) {
+    ierr = apply(states[t], &(m_data[2*L*t])); CHKERRQ(ierr);
+  }
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "landmarkObservation_apply"
+int landmarkObservation::apply(Vec u, double *y) {
+  int ierr;
+  unsigned int L = m_uiNumLandmarks;
+  unsigned int ne = m_entWeight.size();
+  std::vector<double> loc(2*L, 0.0);
+
+  PetscScalar *arr;
+  if (m_daType == PETSC) {
+    ierr = VecGetArray(u, &arr); CHKERRQ(ierr);
+  } else {
+    m_octDA->vecGetBuffer(u, arr, false, false, true, 3);
+    m_octDA->ReadFromGhostsBegin<PetscScalar>(arr, 3);
+    m_octDA->ReadFromGhostsEnd<PetscScalar>(arr);
+  }
+
+  for (unsigned int e=0; e<ne; e++) {
+    PetscScalar *v = arr + 3*m_entNode[e];
+    loc[2*m_entLandmark[e]]     += m_entWeight[e]*v[0];
+    loc[2*m_entLandmark[e] + 1] += m_entWeight[e]*v[1];
+  }
+
+  if (m_daType == PETSC) {
+    ierr = VecRestoreArray(u, &arr); CHKERRQ(ierr);
+  } else {
+    m_octDA->vecRestoreBuffer(u, arr, false, false, true, 3);
+  }
+
+  if (L)
+    MPI_Allreduce(&(*(loc.begin())), y, 2*L, MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "landmarkObservation_applyTranspose"
+int landmarkObservation::applyTranspose(double *y, Vec out, double scale) {
+  int ierr;
+  unsigned int ne = m_entWeight.size();
+
+  if (m_daType == PETSC) {
+    PetscScalar *arr;
+    ierr = VecGetArray(out, &arr); CHKERRQ(ierr);
+    for (unsigned int e=0; e<ne; e++) {
+      PetscScalar *v = arr + 3*m_entNode[e];
+      v[0] += scale*m_entWeight[e]*y[2*m_entLandmark[e]];
+      v[1] += scale*m_entWeight[e]*y[2*m_entLandmark[e] + 1];
+    }
+    ierr = VecRestoreArray(out, &arr); CHKERRQ(ierr);
+  } else {
+    // the nodes of a landmark's element can be ghosts, they are added to their owners
+    unsigned int bufSz = m_octDA->getLocalBufferSize();
+    std::vector<PetscScalar> packed(3*bufSz, 0.0);
+    for (unsigned int e=0; e<ne; e++) {
+      packed[3*m_entNode[e]]     += scale*m_entWeight[e]*y[2*m_entLandmark[e]];
+      packed[3*m_entNode[e] + 1] += scale*m_entWeight[e]*y[2*m_entLandmark[e] + 1];
+    }
+    if (bufSz) {
+      m_octDA->WriteToGhostsBegin(&(*(packed.begin())), 3);
+      m_octDA->WriteToGhostsEnd(&(*(packed.begin())), 3);
+    }
+
+    PetscScalar *buf;
+    m_octDA->vecGetBuffer(out, buf, false, false, false, 3);
+    for (unsigned int i=0; i<3*bufSz; i++)
+      buf[i] += packed[i];
+    m_octDA->vecRestoreBuffer(out, buf, false, false, false, 3);
+  }
+  return(0);
+}
+
+double landmarkObservation::setResidual(Vec u, unsigned int t, bool withData) {
+  unsigned int L = m_uiNumLandmarks;
+  double *r = &(m_res[2*L*t]);
+
+  apply(u, r);
+
+  double rnorm = 0.0;
+  for (unsigned int j=0; j<2*L; j++) {
+    r[j] = (withData ? m_data[2*L*t + j] : 0.0) - r[j];
+    rnorm += r[j]*r[j];
+  }
+  return rnorm;
+}
+
+bool landmarkObservation::addVec(Vec _in, double scale, int indx) {
+  if ( (indx < 0) || (indx > (int)m_uiNumSteps) )
+    return true;
+  applyTranspose(&(m_res[2*m_uiNumLandmarks*indx]), _in, scale);
+  return true;
+}
+
+#endif
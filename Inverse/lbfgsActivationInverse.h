@@ -0,0 +1,296 @@
+/**
+ * @file lbfgsActivationInverse.h
+ * @brief Limited memory quasi-Newton (L-BFGS) solver for the parametric activation inverse problem
+ * @author Hari Sundar
+ * @date   2/20/08
+ *
+ * Uses the same reduced gradient (one forward and one adjoint solve) and cost
+ * function (one forward solve) as the Gauss-Newton solver in
+ * parametricActivationInverse, but does not need any Hessian matvecs. The
+ * inverse Hessian is approximated from the last m pairs of control and
+ * gradient differences, and the step length is chosen with the Armijo
+ * backtracking line search of inverseSolver.
+ *
+ * In the hybrid mode the step is a truncated Newton step, i.e., the Gauss-Newton
+ * system is solved with the inv_ KSP as before, but preconditioned with the
+ * L-BFGS approximation of the inverse Hessian built from the outer iterations.
+ *
+ * The number of forward and adjoint solves needed by either method is reported
+ * in the forward_solve/adjoint_solve calls of the perfLog summary.
+ *
+ * The L-BFGS history is not checkpointed, it is rebuilt after a restart.
+ **/
+
+#ifndef _LBFGS_ACTIVATION_INVERSE_H_
+#define _LBFGS_ACTIVATION_INVERSE_H_
+
+#include <vector>
+#include "parametricActivationInverse.h"
+
+class lbfgsActivationInverse : public parametricActivationInverse {
+
+public:
+
+  lbfgsActivationInverse() {
+    m_iHistory = 5;
+    m_bHybrid = false;
+    m_dCurvatureTol = 1e-10;
+  }
+
+  ~lbfgsActivationInverse() {
+  }
+
+  virtual int destroy() {
+    clearHistory();
+    return parametricActivationInverse::destroy();
+  }
+
+  virtual int init();
+
+  virtual int solve();
+
+  /**
+   *	@brief Number of (s,y) pairs used to approximate the inverse Hessian, default 5
+   **/
+  void setHistorySize(int m) {
+    m_iHistory = m;
+  }
+
+  /**
+   *	@brief Use truncated Newton steps preconditioned by the L-BFGS approximation
+   **/
+  void setHybrid(bool flag) {
+    m_bHybrid = flag;
+  }
+
+  /**
+   *	@brief Applies the L-BFGS approximation of the inverse Hessian (two-loop recursion)
+   *  @param In  PETSC Vector, the input vector
+   *  @param Out PETSC Vector, H^{-1} In
+   **/
+  PetscErrorCode applyInverseHessian(Vec In, Vec Out);
+
+  static PetscErrorCode PCApply(void *ctx, Vec In, Vec Out) {
+    return ((lbfgsActivationInverse *)ctx)->applyInverseHessian(In, Out);
+  }
+
+protected:
+  PetscErrorCode updateHistory(Vec s, Vec y);
+  void clearHistory();
+
+  int    m_iHistory;
+  bool   m_bHybrid;
+  double m_dCurvatureTol;
+
+  // history, oldest first
+  std::vector<Vec>    m_vecS;
+  std::vector<Vec>    m_vecY;
+  std::vector<double> m_rho;
+};
+
+/**
+ *	@brief Same as parametricActivationInverse::init, in the hybrid mode the
+ *  L-BFGS approximation is set as the preconditioner of the inv_ KSP.
+ **/
+#undef __FUNCT__
+#define __FUNCT__ "lbfgsInv_init"
+int lbfgsActivationInverse::init() {
+  int ierr;
+
+  ierr = parametricActivationInverse::init(); CHKERRQ(ierr);
+
+  if (m_bHybrid) {
+    PC pc;
+    ierr = KSPGetPC(m_ksp, &pc); CHKERRQ(ierr);
+    ierr = PCSetType(pc, PCSHELL); CHKERRQ(ierr);
+    ierr = PCShellSetApply(pc, PCApply); CHKERRQ(ierr);
+    ierr = PCShellSetContext(pc, this); CHKERRQ(ierr);
+    ierr = PCShellSetName(pc, "L-BFGS"); CHKERRQ(ierr);
+  }
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "lbfgsInv_solve"
+int lbfgsActivationInverse::solve() {
+  int ierr;
+  double gnorm;
+  Vec prevControl, prevGradient;
+
+  if ( !m_bRestarted ) {
+    ierr = VecCopy(m_vecInitialControl, m_vecCurrentControl); CHKERRQ(ierr);
+    m_numIterations = 0;
+  }
+
+  clearHistory();
+  ierr = VecDuplicate(m_vecCurrentControl, &prevControl); CHKERRQ(ierr);
+  ierr = VecDuplicate(m_vecCurrentControl, &prevGradient); CHKERRQ(ierr);
+
+  m_dPrevGradNorm = 0.0;
+  if ( !m_bRestarted ) {
+    m_dInitialGradNorm = 0.0;
+  }
+  if (m_bInexactNewton) {
+    m_dInnerTolMin = m_ts->getSolverTolerance();
+    ierr = m_ts->setSolverTolerance(m_dInnerTolMax); CHKERRQ(ierr);
+  }
+
+  // gradient and cost @ the initial control
+  setReducedGradient();
+
+  while (m_numIterations < m_maxIterations) {
+    long numCreated = vecPool::getNumCreated();
+
+    ierr = VecNorm(m_vecReducedGradient, NORM_2, &gnorm); CHKERRQ(ierr);
+    if (m_dInitialGradNorm == 0.0)
+      m_dInitialGradNorm = gnorm;
+    PetscPrintf(0, "L-BFGS iteration %d: J = %g, |g| = %g\n", m_numIterations, m_costFunctionValue, gnorm);
+
+    if ( gnorm <= m_paramsTolerance*m_dInitialGradNorm ) {
+      PetscPrintf(0, "Converged, relative gradient norm below %g\n", m_paramsTolerance);
+      break;
+    }
+
+    if (m_bInexactNewton) {
+      double eta = getForcingTerm(gnorm);
+      ierr = KSPSetTolerances(m_ksp, eta, PETSC_DEFAULT, PETSC_DEFAULT, PETSC_DEFAULT); CHKERRQ(ierr);
+      ierr = setInnerTolerance(gnorm, eta); CHKERRQ(ierr);
+    }
+
+    // search direction, the update is control - alpha*step
+    if (m_bHybrid) {
+      ierr = VecZeroEntries(m_vecControlStep); CHKERRQ(ierr);
+      ierr = KSPSolve(m_ksp, m_vecReducedGradient, m_vecControlStep); CHKERRQ(ierr);
+    } else if ( m_vecS.empty() ) {
+      // no curvature information, use a unit length gradient step
+      ierr = VecCopy(m_vecReducedGradient, m_vecControlStep); CHKERRQ(ierr);
+      ierr = VecScale(m_vecControlStep, 1.0/gnorm); CHKERRQ(ierr);
+    } else {
+      ierr = applyInverseHessian(m_vecReducedGradient, m_vecControlStep); CHKERRQ(ierr);
+    }
+
+    ierr = VecCopy(m_vecCurrentControl, prevControl); CHKERRQ(ierr);
+    ierr = VecCopy(m_vecReducedGradient, prevGradient); CHKERRQ(ierr);
+
+    bool accepted;
+    ierr = lineSearch(accepted); CHKERRQ(ierr);
+    if (!accepted) {
+      // the curvature pairs are stale, start again from the gradient
+      if ( !m_bHybrid && !m_vecS.empty() ) {
+        PetscPrintf(0, "Clearing the L-BFGS history\n");
+        clearHistory();
+        continue;
+      }
+      PetscPrintf(0, "No decrease along the gradient, stopping\n");
+      break;
+    }
+
+    // gradient @ the new control, this also recomputes the cost
+    setReducedGradient();
+
+    // s = x_{k+1} - x_k, y = g_{k+1} - g_k
+    ierr = VecAYPX(prevControl, -1.0, m_vecCurrentControl); CHKERRQ(ierr);
+    ierr = VecAYPX(prevGradient, -1.0, m_vecReducedGradient); CHKERRQ(ierr);
+    ierr = updateHistory(prevControl, prevGradient); CHKERRQ(ierr);
+
+    m_numIterations++;
+    // the history allocates until it is full, nothing after that
+    PetscPrintf(0, "L-BFGS iteration %d: %ld new Vecs\n", m_numIterations, vecPool::getNumCreated() - numCreated);
+
+    if ( m_iCheckpointFreq && !(m_numIterations % m_iCheckpointFreq) ) {
+      ierr = writeCheckpoint(); CHKERRQ(ierr);
+    }
+  }
+
+  ierr = finishCheckpoint(); CHKERRQ(ierr);
+
+  if (m_bInexactNewton) {
+    ierr = m_ts->setSolverTolerance(m_dInnerTolMin); CHKERRQ(ierr);
+  }
+
+  ierr = VecDestroy(prevControl); CHKERRQ(ierr);
+  ierr = VecDestroy(prevGradient); CHKERRQ(ierr);
+
+  return(0);
+}
+
+/**
+ *	@brief Standard two-loop recursion, the initial inverse Hessian is scaled by s^T y / y^T y of the last pair.
+ **/
+#undef __FUNCT__
+#define __FUNCT__ "lbfgsInv_applyInverseHessian"
+PetscErrorCode lbfgsActivationInverse::applyInverseHessian(Vec In, Vec Out) {
+  int ierr;
+  int k = m_vecS.size();
+  std::vector<double> alpha(k);
+
+  ierr = VecCopy(In, Out); CHKERRQ(ierr);
+  if (!k)
+    return(0);
+
+  for (int i=k-1; i>=0; i--) {
+    double sq;
+    ierr = VecDot(m_vecS[i], Out, &sq); CHKERRQ(ierr);
+    alpha[i] = m_rho[i]*sq;
+    ierr = VecAXPY(Out, -alpha[i], m_vecY[i]); CHKERRQ(ierr);
+  }
+
+  double yy;
+  ierr = VecDot(m_vecY[k-1], m_vecY[k-1], &yy); CHKERRQ(ierr);
+  ierr = VecScale(Out, 1.0/(m_rho[k-1]*yy)); CHKERRQ(ierr);
+
+  for (int i=0; i<k; i++) {
+    double yr;
+    ierr = VecDot(m_vecY[i], Out, &yr); CHKERRQ(ierr);
+    ierr = VecAXPY(Out, alpha[i] - m_rho[i]*yr, m_vecS[i]); CHKERRQ(ierr);
+  }
+  return(0);
+}
+
+/**
+ *	@brief Adds the pair (s,y), the pair is skipped if the curvature condition s^T y > 0 does not hold.
+ **/
+#undef __FUNCT__
+#define __FUNCT__ "lbfgsInv_updateHistory"
+PetscErrorCode lbfgsActivationInverse::updateHistory(Vec s, Vec y) {
+  int ierr;
+  double sy, snorm, ynorm;
+
+  ierr = VecDot(s, y, &sy); CHKERRQ(ierr);
+  ierr = VecNorm(s, NORM_2, &snorm); CHKERRQ(ierr);
+  ierr = VecNorm(y, NORM_2, &ynorm); CHKERRQ(ierr);
+
+  if ( sy <= m_dCurvatureTol*snorm*ynorm ) {
+    PetscPrintf(0, "L-BFGS: skipping update, s^T y = %g\n", sy);
+    return(0);
+  }
+
+  Vec sNew, yNew;
+  if ( (int)m_vecS.size() >= m_iHistory ) {
+    // reuse the oldest vectors
+    sNew = m_vecS.front();
+    yNew = m_vecY.front();
+    m_vecS.erase(m_vecS.begin());
+    m_vecY.erase(m_vecY.begin());
+    m_rho.erase(m_rho.begin());
+  } else {
+    ierr = vecPool::get(s, &sNew); CHKERRQ(ierr);
+    ierr = vecPool::get(y, &yNew); CHKERRQ(ierr);
+  }
+  ierr = VecCopy(s, sNew); CHKERRQ(ierr);
+  ierr = VecCopy(y, yNew); CHKERRQ(ierr);
+
+  m_vecS.push_back(sNew);
+  m_vecY.push_back(yNew);
+  m_rho.push_back(1.0/sy);
+
+  return(0);
+}
+
+void lbfgsActivationInverse::clearHistory() {
+  vecPool::restore(m_vecS);
+  vecPool::restore(m_vecY);
+  m_rho.clear();
+}
+
+#endif
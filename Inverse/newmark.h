@@ -28,6 +28,7 @@
 
 #include "timeStepper.h"
 #include "colors.h"
+#include "perfLog.h"
 
 
 /**
@@ -58,6 +59,26 @@ public:
 	virtual int init();
 	virtual int solve();
 
+	/**
+	 *	@brief sets the initial conditions and solves for the initial acceleration, i.e., the state at step 0
+	 **/
+	int startSolve();
+
+	/**
+	 *	@brief advances the current state by numSteps timesteps, calling the monitor after every step
+	 **/
+	int advance(unsigned int numSteps);
+
+	/**
+	 *	@brief copies the current state (displacement, velocity and acceleration), to restart from it later
+	 **/
+	int getState(Vec u, Vec v, Vec a);
+
+	/**
+	 *	@brief sets the current state, the next call to advance() continues from timestep step
+	 **/
+	int setState(Vec u, Vec v, Vec a, unsigned int step);
+
 	virtual int destroy() {
 		// Allocate memory for working vectors
 		CHKERRQ(VecDestroy(m_vecSolution));
@@ -137,14 +158,11 @@ public:
 	* @brief observer operator which saves the solution after every t timesteps
 	**/
 	virtual int monitor();
+	/**
+	* @brief zeroes the state, the stored solutions that were not taken with getSolution() are restored to the vecPool
+	**/
 	int clearMonitor() {
-		/*
-		for (int i=0; i<m_solVector.size(); i++) {
-			if (m_solVector[i] != NULL) {
-				VecDestroy(m_solVector[i]);
-			}
-		} */
-		m_solVector.clear();
+		CHKERRQ( vecPool::restore( m_solVector ) );
 		CHKERRQ( VecZeroEntries( m_vecSolution ) );
 		CHKERRQ( VecZeroEntries( m_vecVelocity ) );
 		CHKERRQ( VecZeroEntries( m_vecAccn ) );
@@ -152,10 +170,21 @@ public:
 	}
 
 	/**
-	* @brief get the solution vector
+	* @brief takes the solution vector, the Vecs are from the vecPool and are now owned by
+	* the caller, who returns them with vecPool::restore(). The time stepper keeps none of them.
 	**/
 	virtual std::vector<Vec> getSolution() {
-		return m_solVector;
+		std::vector<Vec> sol;
+		sol.swap(m_solVector);
+		return sol;
+	}
+
+	/**
+	* @brief restores the stored solution to the vecPool without changing the current state
+	**/
+	int clearSolution() {
+		CHKERRQ( vecPool::restore( m_solVector ) );
+		return(0);
 	}
 
 	void storeVec(bool flag) {
@@ -170,6 +199,10 @@ public:
 		m_bDamp = f;
 	}
 
+	bool isDamped() {
+		return m_bDamp;
+	}
+
 protected:
 	double    m_dBeta;
 	double    m_dGamma;
@@ -242,7 +275,7 @@ int newmark::init() {
 		MatAXPY(m_matJacobian, -1.0, K, SAME_NONZERO_PATTERN);
 
 		int npes;
-		MPI_Comm_size(MPI_COMM_WORLD, &npes);
+		MPI_Comm_size(PETSC_COMM_WORLD, &npes);
 
 		if (npes == 1) {
 			PetscTruth isSym;
@@ -287,6 +320,22 @@ int newmark::init() {
 	CHKERRQ(KSPSetOperators(m_ksp, m_matJacobian, m_matJacobian, SAME_NONZERO_PATTERN));
 	CHKERRQ(KSPSetType(m_ksp,KSPCG));
 
+	// The coarse Jacobians are the same combination of the coarse operators.
+	if (m_octDMMG != NULL) {
+		double dt = m_ti->step;
+		for (int i=0; i<octDMMGGetLevels(m_octDMMG)-1; i++) {
+			std::vector<feMat*> ops;
+			std::vector<double> scales;
+			ops.push_back(m_mgStiffness[i]); scales.push_back(-1.0);
+			ops.push_back(m_mgMass[i]); scales.push_back(1.0/(m_dBeta*dt*dt));
+			if (m_bDamp) {
+				ops.push_back(m_mgDamping[i]); scales.push_back(m_dGamma/(m_dBeta*dt));
+			}
+			CHKERRQ(octDMMGSetOperators(m_octDMMG[i], ops, scales));
+		}
+		CHKERRQ(octDMMGSetUpLevel(m_octDMMG, m_ksp));
+	}
+
 	CHKERRQ(KSPSetFromOptions(m_ksp));
 
 	// KSP for initial accn solve ...
@@ -318,18 +367,27 @@ int newmark::solve() {
 #ifdef __DEBUG__  
 	std::cout << "Entering " << __func__ << std::endl;
 #endif  
-	// Time info
-	int rank;
-	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	unsigned NT = (int)(ceil((m_ti->stop - m_ti->start)/m_ti->step));
 
-	m_dBeta = 0.25; m_dGamma = 0.5;
-	// std::cout << "Newmark beta = " << m_dBeta << " and Gamma is " << m_dGamma << std::endl;
+	CHKERRQ( startSolve() );
+	CHKERRQ( advance(NT) );
 
-	unsigned NT = (int)(ceil((m_ti->stop - m_ti->start)/m_ti->step));
+	// std::cout << RED"Finished Solve"NRM << std::endl;
+#ifdef __DEBUG__
+	std::cout << "Leaving " << __func__ << std::endl;
+#endif
+	return(0);
+}
 
-	// std::cout << RED"Number of Timesteps is "NRM << NT << std::endl;
-	double temprtol;
-	CHKERRQ(KSPGetTolerances(m_ksp, &temprtol,0,0,0));
+#undef __FUNCT__
+#define __FUNCT__ "Newmark_StartSolve"
+int newmark::startSolve() {
+	perfLog::phase solvePhase = (m_bIsAdjoint) ? perfLog::ADJOINT_SOLVE : perfLog::FORWARD_SOLVE;
+	perfLog::scope timer(solvePhase);
+	int its;
+
+	m_dBeta = 0.25; m_dGamma = 0.5;
+	// std::cout << "Newmark beta = " << m_dBeta << " and Gamma is " << m_dGamma << std::endl;
 
 	// Set initial conditions
 	CHKERRQ( VecCopy( m_vecInitialSolution, m_vecSolution ) );
@@ -341,152 +399,110 @@ int newmark::solve() {
 	setAccnRHS();
 	//std::cout << "Solving for initial accn" << std::endl;
 	CHKERRQ( KSPSolve (m_AccnKSP, m_vecRHS, m_vecAccn) );
+	CHKERRQ( KSPGetIterationNumber(m_AccnKSP, &its) );
+	perfLog::kspIterations(solvePhase, 0, its);
 	// std::cout << "Done solving for initial accn" << std::endl;
 
+	m_ti->current = m_ti->start;
+	m_ti->currentstep = 0;
+	monitor();
 
-	// Time stepping
-	if ( !m_bIsAdjoint) {	// FORWARD PROBLEM
-		// std::cout << RED"STARTING FORWARD SOLVE"NRM << std::endl;
-		m_ti->current = m_ti->start;
-		m_ti->currentstep = 0;
-		monitor();
-		while (m_ti->currentstep < NT) {
-			// std::cout << "Step is " << m_ti->currentstep << std::endl;
-			// std::cout << GRN"At time "RED << m_ti->current << NRM" ";
-			double stime = MPI_Wtime();
+	return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "Newmark_Advance"
+int newmark::advance(unsigned int numSteps) {
+	int rank;
+	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+
+	perfLog::phase solvePhase = (m_bIsAdjoint) ? perfLog::ADJOINT_SOLVE : perfLog::FORWARD_SOLVE;
+	perfLog::scope timer(solvePhase);
+	int its;
 
-			m_ti->currentstep++;
-			m_ti->current += m_ti->step;
+	// The forward and the adjoint problems are stepped in the same way, the
+	// adjoint force is indexed backwards in time (see setRHS).
+	unsigned int last = m_ti->currentstep + numSteps;
+	while (m_ti->currentstep < last) {
+		m_ti->currentstep++;
+		m_ti->current += m_ti->step;
 
 #ifdef __DEBUG__
-			if (!rank) {
+		if (!rank) {
+			if ( !m_bIsAdjoint )
 				std::cout << GRN"Forward Time is "YLW << std::setw(6) << std::setprecision(3) << m_ti->current << NRM"\r" << std::flush;
-			}
+			else
+				std::cout << GRN"Adjoint Time is "YLW << std::setw(6) << std::setprecision(3) << m_ti->stop - m_ti->current << NRM"\r" << std::flush;
+		}
 #endif
 
-			// Get the Right hand side of the ksp solve using the current solution
-			// std::cout << "Setting RHS" << std::endl;
-			setRHS();
-			// std::cout << "Finished setting RHS" << std::endl;
+		// Get the Right hand side of the ksp solve using the current solution
+		setRHS();
 
 #ifdef __DEBUG__
-			double norm;
-			CHKERRQ(VecNorm(m_vecRHS, NORM_INFINITY,&norm));
-			std::cout << GRN"norm of the RHS @ "NRM << m_ti->current  << " = " << norm << std::endl;
+		double norm;
+		CHKERRQ(VecNorm(m_vecRHS, NORM_INFINITY,&norm));
+		std::cout << GRN"norm of the RHS @ "NRM << m_ti->current  << " = " << norm << std::endl;
 #endif
 
-			// clear du, dv, and da
-			CHKERRQ ( VecZeroEntries(m_vec_du) );
-			CHKERRQ ( VecZeroEntries(m_vec_dv) );
-			CHKERRQ ( VecZeroEntries(m_vec_da) );
-
-			// Solve the ksp using the current rhs and non-zero initial guess
-			// CHKERRQ( KSPSetInitialGuessNonzero( m_ksp, PETSC_TRUE) );
-			// std::cout << "Starting KSP Solve" << std::endl;
-			CHKERRQ( KSPSolve (m_ksp, m_vecRHS, m_vec_du) );
+		// clear du, dv, and da
+		CHKERRQ ( VecZeroEntries(m_vec_du) );
+		CHKERRQ ( VecZeroEntries(m_vec_dv) );
+		CHKERRQ ( VecZeroEntries(m_vec_da) );
 
-			// std::cout << "Finished KSP Solve" << std::endl;
+		// Solve the ksp using the current rhs and non-zero initial guess
+		// CHKERRQ( KSPSetInitialGuessNonzero( m_ksp, PETSC_TRUE) );
+		CHKERRQ( KSPSolve (m_ksp, m_vecRHS, m_vec_du) );
+		CHKERRQ( KSPGetIterationNumber(m_ksp, &its) );
+		perfLog::kspIterations(solvePhase, m_ti->currentstep, its);
 
-#ifdef __DEBUG__      
-			double norm3;
-			CHKERRQ ( VecNorm(m_vec_du, NORM_INFINITY, &norm3) );
-			std::cout << "norm of the DU @ " << m_ti->current  << " = " << norm3 << std::endl;
-#endif      
-
-			double dt = m_ti->step;
-
-			// compute dv and da
-			CHKERRQ ( VecAXPY(m_vec_dv, m_dGamma/(m_dBeta*dt), m_vec_du));
-			CHKERRQ ( VecAXPY(m_vec_dv, -m_dGamma/m_dBeta, m_vecVelocity));
-			CHKERRQ ( VecAXPY(m_vec_dv, dt*(1.0 - m_dGamma/(2.0*m_dBeta)), m_vecAccn));
-
-#ifdef __DEBUG__      
-			double norm4;
-			CHKERRQ ( VecNorm(m_vec_dv, NORM_INFINITY, &norm4) );
-			std::cout << "norm of the DV @ " << m_ti->current  << " = " << norm4 << std::endl;
-#endif      
+		double dt = m_ti->step;
 
+		// compute dv and da
+		CHKERRQ ( VecAXPY(m_vec_dv, m_dGamma/(m_dBeta*dt), m_vec_du));
+		CHKERRQ ( VecAXPY(m_vec_dv, -m_dGamma/m_dBeta, m_vecVelocity));
+		CHKERRQ ( VecAXPY(m_vec_dv, dt*(1.0 - m_dGamma/(2.0*m_dBeta)), m_vecAccn));
 
-			CHKERRQ ( VecAXPY(m_vec_da, 1.0/(m_dBeta*dt*dt), m_vec_du));
-			CHKERRQ ( VecAXPY(m_vec_da, -1.0/(m_dBeta*dt), m_vecVelocity));
-			CHKERRQ ( VecAXPY(m_vec_da, -1.0/(2.0*m_dBeta), m_vecAccn));
+		CHKERRQ ( VecAXPY(m_vec_da, 1.0/(m_dBeta*dt*dt), m_vec_du));
+		CHKERRQ ( VecAXPY(m_vec_da, -1.0/(m_dBeta*dt), m_vecVelocity));
+		CHKERRQ ( VecAXPY(m_vec_da, -1.0/(2.0*m_dBeta), m_vecAccn));
 
-			// Now update solution, velocity and acceleration.
-			CHKERRQ ( VecAXPY(m_vecSolution, 1.0, m_vec_du) );
-			CHKERRQ ( VecAXPY(m_vecVelocity, 1.0, m_vec_dv) );
-			CHKERRQ ( VecAXPY(m_vecAccn,     1.0, m_vec_da) );
+		// Now update solution, velocity and acceleration.
+		CHKERRQ ( VecAXPY(m_vecSolution, 1.0, m_vec_du) );
+		CHKERRQ ( VecAXPY(m_vecVelocity, 1.0, m_vec_dv) );
+		CHKERRQ ( VecAXPY(m_vecAccn,     1.0, m_vec_da) );
 
 #ifdef __DEBUG__
-			double norm1;
-			CHKERRQ ( VecNorm(m_vecSolution, NORM_INFINITY, &norm1) );
-			std::cout << GRN"norm of the solution @ "NRM << m_ti->current  << " = "RED << norm1 << NRM << std::endl;
-
-			double norm2;
-			CHKERRQ ( VecNorm(m_vecAccn, NORM_INFINITY, &norm2) );
-			std::cout << "norm of the accn @ " << m_ti->current  << " = " << norm2 << std::endl;
+		double norm1;
+		CHKERRQ ( VecNorm(m_vecSolution, NORM_INFINITY, &norm1) );
+		std::cout << GRN"norm of the solution @ "NRM << m_ti->current  << " = "RED << norm1 << NRM << std::endl;
 #endif
-			monitor();
-
-			// std::cout << "Finished time step in time " << MPI_Wtime() - stime << std::endl;
-		}
-#ifdef __DEBUG__
-		if (!rank)
-			std::cout << GRN"Finished Forward Solve"NRM << std::endl;
-#endif
-	} else {	// ADJOINT PROBLEM
-		m_ti->current = m_ti->start;
-		m_ti->currentstep = 0;
 		monitor();
-		while (m_ti->currentstep < NT) {
-			m_ti->currentstep++;
-			m_ti->current += m_ti->step;
-
-#ifdef __DEBUG__
-			if (!rank) {
-				std::cout << GRN"Adjoint Time is "YLW << std::setw(6) << std::setprecision(3) << m_ti->stop - m_ti->current << NRM"\r" << std::flush;
-				// std::cout << GRN"Time is "YLW << m_ti->current << NRM"\t:\r";
-			}
-#endif
-
-			// Get the right hand side of the ksp solve for the adjoint problem
-			setRHS();
-
-			// clear du, dv, and da
-			CHKERRQ(VecZeroEntries(m_vec_du));
-			CHKERRQ(VecZeroEntries(m_vec_dv));
-			CHKERRQ(VecZeroEntries(m_vec_da));
-
-			// Solve ksp using the current rhs and non-zero initial guess
-			// CHKERRQ( KSPSetInitialGuessNonzero(m_ksp,PETSC_TRUE) );
-			CHKERRQ( KSPSolve(m_ksp, m_vecRHS, m_vec_du) );
+	}
 
-			double dt = m_ti->step;
-			// compute dv and da
-			CHKERRQ ( VecAXPY(m_vec_dv, m_dGamma/(m_dBeta*dt), m_vec_du));
-			CHKERRQ ( VecAXPY(m_vec_dv, -m_dGamma/m_dBeta, m_vecVelocity));
-			CHKERRQ ( VecAXPY(m_vec_dv, dt*(1.0 - m_dGamma/(2.0*m_dBeta)), m_vecAccn));
+	return(0);
+}
 
-			CHKERRQ ( VecAXPY(m_vec_da, 1.0/(m_dBeta*dt*dt), m_vec_du));
-			CHKERRQ ( VecAXPY(m_vec_da, -1.0/(m_dBeta*dt), m_vecVelocity));
-			CHKERRQ ( VecAXPY(m_vec_da, -1.0/(2.0*m_dBeta), m_vecAccn));
+#undef __FUNCT__
+#define __FUNCT__ "Newmark_GetState"
+int newmark::getState(Vec u, Vec v, Vec a) {
+	CHKERRQ( VecCopy(m_vecSolution, u) );
+	CHKERRQ( VecCopy(m_vecVelocity, v) );
+	CHKERRQ( VecCopy(m_vecAccn, a) );
+	return(0);
+}
 
-			// Now update solution, velocity and acceleration.
-			CHKERRQ ( VecAXPY(m_vecSolution, 1.0, m_vec_du) );
-			CHKERRQ ( VecAXPY(m_vecVelocity, 1.0, m_vec_dv) );
-			CHKERRQ ( VecAXPY(m_vecAccn,     1.0, m_vec_da) );
+#undef __FUNCT__
+#define __FUNCT__ "Newmark_SetState"
+int newmark::setState(Vec u, Vec v, Vec a, unsigned int step) {
+	m_dBeta = 0.25; m_dGamma = 0.5;
 
-			monitor();
-		}
-#ifdef __DEBUG__
-		if (!rank)
-			std::cout << GRN"Finished Adjoint Solve"NRM << std::endl;
-#endif
-	}
+	CHKERRQ( VecCopy(u, m_vecSolution) );
+	CHKERRQ( VecCopy(v, m_vecVelocity) );
+	CHKERRQ( VecCopy(a, m_vecAccn) );
 
-	// std::cout << RED"Finished Solve"NRM << std::endl;
-#ifdef __DEBUG__
-	std::cout << "Leaving " << __func__ << std::endl;
-#endif
+	m_ti->currentstep = step;
+	m_ti->current = m_ti->start + step*m_ti->step;
 	return(0);
 }
 
@@ -655,10 +671,10 @@ int newmark::monitor() {
 #endif
 
 	if (fmod(m_ti->currentstep,(double)(m_iMon)) < 0.0001) {
+		perfLog::scope timer(perfLog::MONITOR_IO);
 		// double norm;
 		int ierr;
 		Vec tempSol;
-		ierr = VecDuplicate(m_vecSolution,&tempSol);  CHKERRQ(ierr);
 #ifdef __DEBUG__
 		//		VecNorm(m_vecSolution,NORM_INFINITY,&norm);
 		//		PetscPrintf(0,"solution norm b4 push back %f\n",norm);
@@ -668,6 +684,8 @@ int newmark::monitor() {
 
 
 		if (m_bStoreVec) {
+			// returned to the pool by the consumer of getSolution()
+			ierr = vecPool::get(m_vecSolution,&tempSol);  CHKERRQ(ierr);
 			ierr = VecCopy(m_vecSolution,tempSol); CHKERRQ(ierr);
 			// std::cout << YLW"Pushing to solution Vector"NRM << std::endl;
 			if ( !m_bIsAdjoint) {	// FORWARD PROBLEM
@@ -0,0 +1,877 @@
+
+#include <climits>
+#include <cstring>
+#include <algorithm>
+
+#include "petscksp.h"           /*I "petscksp.h"  I*/
+#include "petscmg.h"            /*I "petscmg.h"   I*/
+#include "oct.h"
+#include "oda.h"
+#include "octdamgHeader.h"
+
+/*
+   Code for managing multigrid solvers on octree meshes, see octdamgHeader.h
+*/
+
+/*
+   Morton order of two points, z is the most significant as in the child
+   numbers. The dimension with the highest differing bit decides.
+*/
+static inline bool lessMsb(unsigned int a, unsigned int b)
+{
+  return (a < b) && (a < (a ^ b));
+}
+
+static inline bool mortonLess(const unsigned int *a, const unsigned int *b)
+{
+  unsigned int d = 2, m = a[2] ^ b[2];
+  if (lessMsb(m, a[1] ^ b[1])) {
+    d = 1; m = a[1] ^ b[1];
+  }
+  if (lessMsb(m, a[0] ^ b[0])) {
+    d = 0;
+  }
+  return a[d] < b[d];
+}
+
+struct mortonCmp {
+  const unsigned int *pts;
+  mortonCmp(const unsigned int *p) : pts(p) { }
+  bool operator() (unsigned int i, unsigned int j) const {
+    return mortonLess(pts + 3*i, pts + 3*j);
+  }
+};
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGRoutePoints"
+/*
+   Sends every point (3 coordinates in octree units) to the processor whose
+   writable elements contain it. The processors are ordered by the anchor of
+   their first element. On return order[k] is the index of the k-th sent
+   point, and recv has the points received by this processor.
+*/
+static PetscErrorCode octDMMGRoutePoints(ot::DA *da, MPI_Comm comm, std::vector<unsigned int> &pts,
+    std::vector<unsigned int> &order, std::vector<int> &sendCnt, std::vector<int> &sendOff,
+    std::vector<int> &recvCnt, std::vector<int> &recvOff, std::vector<unsigned int> &recv)
+{
+  int npes;
+
+  PetscFunctionBegin;
+  MPI_Comm_size(comm, &npes);
+
+  // the first element of every processor, inactive processors have none
+  unsigned int first[4] = { 0, 0, 0, 0 };
+  for ( da->init<ot::DA::ALL>(), da->init<ot::DA::WRITABLE>(); da->curr() < da->end<ot::DA::ALL>(); da->next<ot::DA::ALL>() ) {
+    Point pt = da->getCurrentOffset();
+    first[0] = pt.x(); first[1] = pt.y(); first[2] = pt.z(); first[3] = 1;
+    break;
+  }
+  std::vector<unsigned int> split(4*npes);
+  MPI_Allgather(first, 4, MPI_UNSIGNED, &(*(split.begin())), 4, MPI_UNSIGNED, comm);
+
+  std::vector<int> active;
+  for (int p=0; p<npes; p++)
+    if (split[4*p+3])
+      active.push_back(p);
+
+  // the owner is the last active processor whose first element is not after the point
+  unsigned int n = pts.size()/3;
+  std::vector<int> owner(n);
+  sendCnt.assign(npes, 0);
+  for (unsigned int i=0; i<n; i++) {
+    int lo = 0, hi = active.size();
+    while (hi - lo > 1) {
+      int mid = (lo + hi)/2;
+      if ( mortonLess(&(pts[3*i]), &(split[4*active[mid]])) )
+        hi = mid;
+      else
+        lo = mid;
+    }
+    owner[i] = active[lo];
+    sendCnt[owner[i]]++;
+  }
+
+  sendOff.assign(npes, 0);
+  for (int p=1; p<npes; p++)
+    sendOff[p] = sendOff[p-1] + sendCnt[p-1];
+
+  order.resize(n);
+  std::vector<int> pos(sendOff);
+  for (unsigned int i=0; i<n; i++)
+    order[pos[owner[i]]++] = i;
+
+  recvCnt.resize(npes);
+  MPI_Alltoall(&(*(sendCnt.begin())), 1, MPI_INT, &(*(recvCnt.begin())), 1, MPI_INT, comm);
+  recvOff.assign(npes, 0);
+  for (int p=1; p<npes; p++)
+    recvOff[p] = recvOff[p-1] + recvCnt[p-1];
+  unsigned int nr = recvOff[npes-1] + recvCnt[npes-1];
+
+  // the coordinates, in units of unsigned ints
+  std::vector<unsigned int> sbuf(3*n + 1);
+  for (unsigned int k=0; k<n; k++)
+    memcpy(&(sbuf[3*k]), &(pts[3*order[k]]), 3*sizeof(unsigned int));
+  std::vector<int> sc(npes), so(npes), rc(npes), ro(npes);
+  for (int p=0; p<npes; p++) {
+    sc[p] = 3*sendCnt[p]; so[p] = 3*sendOff[p];
+    rc[p] = 3*recvCnt[p]; ro[p] = 3*recvOff[p];
+  }
+  recv.resize(3*nr + 1);
+  MPI_Alltoallv(&(*(sbuf.begin())), &(*(sc.begin())), &(*(so.begin())), MPI_UNSIGNED,
+                &(*(recv.begin())), &(*(rc.begin())), &(*(ro.begin())), MPI_UNSIGNED, comm);
+  recv.resize(3*nr);
+
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGLocatePoints"
+/*
+   Locates the points in the writable elements of da, both are visited in
+   Morton order. For nodal = true the rows are the trilinear weights of the
+   nodes of the element, with the hanging nodes replaced by the corners of the
+   parent (which are returned by getNodeIndices). Otherwise the row is the
+   element. The rows are in the order of the points.
+*/
+static PetscErrorCode octDMMGLocatePoints(ot::DA *da, std::vector<unsigned int> &pts, bool nodal,
+    std::vector<unsigned int> &ptr, std::vector<unsigned int> &node, std::vector<double> &wt)
+{
+  PetscFunctionBegin;
+  unsigned int n = pts.size()/3;
+  unsigned int maxD = da->getMaxDepth();
+  unsigned int top = (1u << (maxD-1)) - 1;
+
+  // the points on the positive boundaries are located in the last element
+  std::vector<unsigned int> cl(pts);
+  for (unsigned int i=0; i<3*n; i++)
+    if (cl[i] > top)
+      cl[i] = top;
+
+  std::vector<unsigned int> perm(n);
+  for (unsigned int i=0; i<n; i++)
+    perm[i] = i;
+  std::sort(perm.begin(), perm.end(), mortonCmp(&(*(cl.begin()))));
+
+  // at most 8 vertices, each on at most 4 parent corners
+  const unsigned int S = 32;
+  std::vector<unsigned int> cnt(n, 0), tmpNode(S*n);
+  std::vector<double> tmpWt(S*n);
+
+  unsigned int cur = 0, lost = 0;
+  for ( da->init<ot::DA::ALL>(), da->init<ot::DA::WRITABLE>(); (cur < n) && (da->curr() < da->end<ot::DA::ALL>()); da->next<ot::DA::ALL>() ) {
+    Point pt = da->getCurrentOffset();
+    unsigned int h = 1u << (maxD - da->getLevel(da->curr()));
+    unsigned int a[3] = { pt.x(), pt.y(), pt.z() };
+
+    while ( (cur < n) && mortonLess(&(cl[3*perm[cur]]), a) ) {
+      lost++; cur++;
+    }
+
+    ot::DA::index idx[8];
+    unsigned char hn = 0;
+    unsigned int ch = 0;
+    bool first = true;
+
+    for (; cur < n; cur++) {
+      unsigned int i = perm[cur];
+      unsigned int *c = &(cl[3*i]);
+      if ( (c[0] >= a[0]+h) || (c[1] >= a[1]+h) || (c[2] >= a[2]+h) || (c[0] < a[0]) || (c[1] < a[1]) || (c[2] < a[2]) )
+        break;
+
+      if ( !nodal ) {
+        tmpNode[S*i] = da->curr();
+        tmpWt[S*i] = 1.0;
+        cnt[i] = 1;
+        continue;
+      }
+
+      if (first) {
+        da->getNodeIndices(idx);
+        hn = da->getHangingNodeIndex(da->curr());
+        ch = da->getChildNumber();
+        first = false;
+      }
+
+      double xi[3];
+      for (int d=0; d<3; d++)
+        xi[d] = ((double)pts[3*i+d] - (double)a[d])/h;
+
+      for (unsigned int q=0; q<8; q++) {
+        double w = ((q & 1) ? xi[0] : 1.0-xi[0]) * (((q >> 1) & 1) ? xi[1] : 1.0-xi[1]) * (((q >> 2) & 1) ? xi[2] : 1.0-xi[2]);
+        if (w == 0.0)
+          continue;
+        if ( !(hn & (1 << q)) ) {
+          tmpNode[S*i + cnt[i]] = idx[q];
+          tmpWt[S*i + cnt[i]++] = w;
+          continue;
+        }
+        unsigned int diff = q ^ ch, num = 0;
+        for (unsigned int s=0; s<8; s++)
+          if ( !(s & ~diff) )
+            num++;
+        for (unsigned int s=0; s<8; s++) {
+          if ( !(s & ~diff) ) {
+            tmpNode[S*i + cnt[i]] = idx[ch ^ s];
+            tmpWt[S*i + cnt[i]++] = w/num;
+          }
+        }
+      }
+    }
+  }
+  lost += n - cur;
+
+  if (lost) {
+    PetscPrintf(PETSC_COMM_SELF, "octDMMG: %d points are not in the local elements\n", lost);
+  }
+
+  ptr.resize(n+1);
+  ptr[0] = 0;
+  for (unsigned int i=0; i<n; i++)
+    ptr[i+1] = ptr[i] + cnt[i];
+  node.resize(ptr[n]);
+  wt.resize(ptr[n]);
+  for (unsigned int i=0; i<n; i++) {
+    for (unsigned int e=0; e<cnt[i]; e++) {
+      node[ptr[i]+e] = tmpNode[S*i+e];
+      wt[ptr[i]+e] = tmpWt[S*i+e];
+    }
+  }
+
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGBuildTransfer"
+/*
+   The interpolation from fine->coarser to fine. The fine points are the
+   nodes owned by this processor, from the non-hanging vertices of the
+   writable elements.
+*/
+static PetscErrorCode octDMMGBuildTransfer(octDMMG fine)
+{
+  PetscErrorCode ierr;
+  ot::DA *da = fine->da;
+  octTransfer &T = fine->transfer;
+  unsigned int maxD = da->getMaxDepth();
+  unsigned int beg = da->getIdxElementBegin();
+  unsigned int end = da->getIdxPostGhostBegin();
+
+  PetscFunctionBegin;
+  std::vector<bool> seen(da->getLocalBufferSize(), false);
+  std::vector<unsigned int> idx, pts;
+  for ( da->init<ot::DA::ALL>(), da->init<ot::DA::WRITABLE>(); da->curr() < da->end<ot::DA::ALL>(); da->next<ot::DA::ALL>() ) {
+    Point pt = da->getCurrentOffset();
+    unsigned int h = 1u << (maxD - da->getLevel(da->curr()));
+    unsigned char hn = da->getHangingNodeIndex(da->curr());
+    ot::DA::index nd[8];
+    da->getNodeIndices(nd);
+    for (unsigned int q=0; q<8; q++) {
+      if ( (hn & (1 << q)) || (nd[q] < beg) || (nd[q] >= end) || seen[nd[q]] )
+        continue;
+      seen[nd[q]] = true;
+      idx.push_back(nd[q]);
+      pts.push_back(pt.x() + ((q & 1) ? h : 0));
+      pts.push_back(pt.y() + ((q & 2) ? h : 0));
+      pts.push_back(pt.z() + ((q & 4) ? h : 0));
+    }
+  }
+
+  PetscInt nloc;
+  ierr = VecGetLocalSize(fine->x, &nloc); CHKERRQ(ierr);
+  if (idx.size() != (unsigned int)nloc/fine->dof) {
+    PetscPrintf(PETSC_COMM_SELF, "octDMMG: located %d of %d fine nodes\n", (int)idx.size(), nloc/fine->dof);
+  }
+
+  std::vector<unsigned int> order, recv;
+  ierr = octDMMGRoutePoints(fine->coarser->da, fine->comm, pts, order, T.sendCnt, T.sendOff, T.recvCnt, T.recvOff, recv); CHKERRQ(ierr);
+
+  T.fineIdx.resize(order.size());
+  for (unsigned int k=0; k<order.size(); k++)
+    T.fineIdx[k] = idx[order[k]];
+
+  ierr = octDMMGLocatePoints(fine->coarser->da, recv, true, T.ptr, T.node, T.wt); CHKERRQ(ierr);
+
+  // the exchanges are in units of values
+  for (unsigned int p=0; p<T.sendCnt.size(); p++) {
+    T.sendCnt[p] *= fine->dof; T.sendOff[p] *= fine->dof;
+    T.recvCnt[p] *= fine->dof; T.recvOff[p] *= fine->dof;
+  }
+  T.sendBuf.resize(fine->dof*T.fineIdx.size() + 1);
+  T.recvBuf.resize(fine->dof*(T.ptr.size()-1) + 1);
+  T.packed.resize(fine->dof*fine->coarser->da->getLocalBufferSize());
+
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGInterpolate"
+static PetscErrorCode octDMMGInterpolate(Mat R, Vec xc, Vec xf)
+{
+  PetscErrorCode ierr;
+  octDMMG fine;
+  PetscScalar *in, *out;
+
+  PetscFunctionBegin;
+  ierr = MatShellGetContext(R, (void**)&fine); CHKERRQ(ierr);
+  octDMMG coarse = fine->coarser;
+  octTransfer &T = fine->transfer;
+  unsigned int dof = fine->dof;
+  unsigned int nr = T.ptr.size() - 1;
+
+  coarse->da->vecGetBuffer(xc, in, false, false, true, dof);
+  coarse->da->ReadFromGhostsBegin<PetscScalar>(in, dof);
+  coarse->da->ReadFromGhostsEnd<PetscScalar>(in);
+  for (unsigned int i=0; i<nr; i++) {
+    for (unsigned int c=0; c<dof; c++) {
+      double s = 0.0;
+      for (unsigned int e=T.ptr[i]; e<T.ptr[i+1]; e++)
+        s += T.wt[e]*in[dof*T.node[e]+c];
+      T.recvBuf[dof*i+c] = s;
+    }
+  }
+  coarse->da->vecRestoreBuffer(xc, in, false, false, true, dof);
+
+  MPI_Alltoallv(&(*(T.recvBuf.begin())), &(*(T.recvCnt.begin())), &(*(T.recvOff.begin())), MPI_DOUBLE,
+                &(*(T.sendBuf.begin())), &(*(T.sendCnt.begin())), &(*(T.sendOff.begin())), MPI_DOUBLE, fine->comm);
+
+  ierr = VecZeroEntries(xf); CHKERRQ(ierr);
+  fine->da->vecGetBuffer(xf, out, false, false, false, dof);
+  for (unsigned int k=0; k<T.fineIdx.size(); k++)
+    for (unsigned int c=0; c<dof; c++)
+      out[dof*T.fineIdx[k]+c] = T.sendBuf[dof*k+c];
+  fine->da->vecRestoreBuffer(xf, out, false, false, false, dof);
+
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGRestrict"
+static PetscErrorCode octDMMGRestrict(Mat R, Vec xf, Vec xc)
+{
+  PetscErrorCode ierr;
+  octDMMG fine;
+  PetscScalar *in, *out;
+
+  PetscFunctionBegin;
+  ierr = MatShellGetContext(R, (void**)&fine); CHKERRQ(ierr);
+  octDMMG coarse = fine->coarser;
+  octTransfer &T = fine->transfer;
+  unsigned int dof = fine->dof;
+  unsigned int nr = T.ptr.size() - 1;
+
+  fine->da->vecGetBuffer(xf, in, false, false, true, dof);
+  for (unsigned int k=0; k<T.fineIdx.size(); k++)
+    for (unsigned int c=0; c<dof; c++)
+      T.sendBuf[dof*k+c] = in[dof*T.fineIdx[k]+c];
+  fine->da->vecRestoreBuffer(xf, in, false, false, true, dof);
+
+  MPI_Alltoallv(&(*(T.sendBuf.begin())), &(*(T.sendCnt.begin())), &(*(T.sendOff.begin())), MPI_DOUBLE,
+                &(*(T.recvBuf.begin())), &(*(T.recvCnt.begin())), &(*(T.recvOff.begin())), MPI_DOUBLE, fine->comm);
+
+  // the coarse nodes can be ghosts, they are added to their owners
+  std::fill(T.packed.begin(), T.packed.end(), 0.0);
+  for (unsigned int i=0; i<nr; i++)
+    for (unsigned int e=T.ptr[i]; e<T.ptr[i+1]; e++)
+      for (unsigned int c=0; c<dof; c++)
+        T.packed[dof*T.node[e]+c] += T.wt[e]*T.recvBuf[dof*i+c];
+  if (T.packed.size()) {
+    coarse->da->WriteToGhostsBegin(&(*(T.packed.begin())), dof);
+    coarse->da->WriteToGhostsEnd(&(*(T.packed.begin())), dof);
+  }
+
+  ierr = VecZeroEntries(xc); CHKERRQ(ierr);
+  coarse->da->vecGetBuffer(xc, out, false, false, false, dof);
+  for (unsigned int i=0; i<T.packed.size(); i++)
+    out[i] = T.packed[i];
+  coarse->da->vecRestoreBuffer(xc, out, false, false, false, dof);
+
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGMatMult"
+static PetscErrorCode octDMMGMatMult(Mat J, Vec in, Vec out)
+{
+  PetscErrorCode ierr;
+  octDMMG dmmg;
+
+  PetscFunctionBegin;
+  ierr = MatShellGetContext(J, (void**)&dmmg); CHKERRQ(ierr);
+  ierr = VecZeroEntries(out); CHKERRQ(ierr);
+  for (unsigned int k=0; k<dmmg->ops.size(); k++)
+    dmmg->ops[k]->MatVec(in, out, dmmg->scales[k]);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGGetDiagonal"
+static PetscErrorCode octDMMGGetDiagonal(Mat J, Vec diag)
+{
+  PetscErrorCode ierr;
+  octDMMG dmmg;
+
+  PetscFunctionBegin;
+  ierr = MatShellGetContext(J, (void**)&dmmg); CHKERRQ(ierr);
+  ierr = VecZeroEntries(diag); CHKERRQ(ierr);
+  for (unsigned int k=0; k<dmmg->ops.size(); k++)
+    dmmg->ops[k]->MatGetDiagonal(diag, dmmg->scales[k]);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGCreate"
+/*@C
+    octDMMGCreate - Creates an octree based multigrid solver object.
+
+    Collective on MPI_Comm
+
+    Input Parameter:
++   comm - the processors that will share the grids and solution process
+.   nlevels - number of multigrid levels (the maximum, see octDMMGSetOctree())
+-   user - an optional user context
+
+    Output Parameters:
+.   dmmg - the context
+
+.seealso octDMMGDestroy(), octDMMGSetOctree()
+
+@*/
+PetscErrorCode octDMMGCreate(MPI_Comm comm,PetscInt nlevels,void *user,octDMMG **dmmg)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  octDMMG        *p;
+
+  PetscFunctionBegin;
+  if (nlevels < 1) nlevels = 1;
+
+  ierr = PetscMalloc(nlevels*sizeof(octDMMG),&p);CHKERRQ(ierr);
+  for (i=0; i<nlevels; i++) {
+    p[i]           = new _p_octDMMG;
+    p[i]->da       = NULL;
+    p[i]->dof      = 1;
+    p[i]->x = p[i]->b = p[i]->r = p[i]->diag = PETSC_NULL;
+    p[i]->J = p[i]->R = PETSC_NULL;
+    p[i]->nlevels  = nlevels - i;
+    p[i]->comm     = comm;
+    p[i]->user     = user;
+    p[i]->coarser  = (i) ? p[i-1] : NULL;
+    p[i]->ksp      = PETSC_NULL;
+    p[i]->rhs      = 0;
+  }
+  *dmmg = p;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGDestroy"
+PetscErrorCode octDMMGDestroy(octDMMG *dmmg)
+{
+  PetscErrorCode ierr;
+  PetscInt       i,nlevels;
+
+  PetscFunctionBegin;
+  if (!dmmg) SETERRQ(PETSC_ERR_ARG_NULL,"Passing null as octDMMG");
+  nlevels = dmmg[0]->nlevels;
+
+  for (i=0; i<nlevels; i++) {
+    if (dmmg[i]->R)       {ierr = MatDestroy(dmmg[i]->R);CHKERRQ(ierr);}
+    if (dmmg[i]->J)       {ierr = MatDestroy(dmmg[i]->J);CHKERRQ(ierr);}
+    if (dmmg[i]->x)       {ierr = VecDestroy(dmmg[i]->x);CHKERRQ(ierr);}
+    if (dmmg[i]->b)       {ierr = VecDestroy(dmmg[i]->b);CHKERRQ(ierr);}
+    if (dmmg[i]->r)       {ierr = VecDestroy(dmmg[i]->r);CHKERRQ(ierr);}
+    if (dmmg[i]->diag)    {ierr = VecDestroy(dmmg[i]->diag);CHKERRQ(ierr);}
+    if (dmmg[i]->ksp)     {ierr = KSPDestroy(dmmg[i]->ksp);CHKERRQ(ierr);}
+    // the finest DA belongs to the caller
+    if ( (i < nlevels-1) && dmmg[i]->da ) delete dmmg[i]->da;
+    delete dmmg[i];
+  }
+  ierr = PetscFree(dmmg);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGCoarsenOctree"
+/*
+   Replaces every complete family of leaves, which are consecutive in a
+   sorted linear octree, by its parent. Families split across processors
+   are kept.
+*/
+static PetscErrorCode octDMMGCoarsenOctree(std::vector<ot::TreeNode> &in, std::vector<ot::TreeNode> &out)
+{
+  PetscFunctionBegin;
+  out.clear();
+  unsigned int i = 0, n = in.size();
+  while (i < n) {
+    bool family = (i+7 < n) && (in[i].getLevel() > 1) && (in[i].getChildNumber() == 0);
+    if (family) {
+      ot::TreeNode parent = in[i].getParent();
+      for (unsigned int k=1; family && (k<8); k++)
+        family = (in[i+k].getLevel() == in[i].getLevel()) && (in[i+k].getParent() == parent);
+      if (family) {
+        out.push_back(parent);
+        i += 8;
+        continue;
+      }
+    }
+    out.push_back(in[i++]);
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGSetOctree"
+/*@C
+    octDMMGSetOctree - Creates the coarser meshes and sets up all levels
+
+    Collective on octDMMG
+
+    Input Parameter:
++   dmmg - the context
+.   balOct - the balanced octree of the finest level, as used to create da
+.   da - the DA of the finest level
+-   dof - degrees of freedom per node
+
+    Notes: Coarsening stops when a level has more than 80% of the elements
+    of the finer one, and the number of levels is reduced accordingly.
+
+.seealso octDMMGCreate(), octDMMGDestroy()
+
+@*/
+PetscErrorCode octDMMGSetOctree(octDMMG **dmmg, std::vector<ot::TreeNode> &balOct, ot::DA *da, unsigned int dof)
+{
+  PetscErrorCode ierr;
+  octDMMG        *p = *dmmg;
+  PetscInt       i,nlevels = p[0]->nlevels;
+  MPI_Comm       comm = p[0]->comm;
+
+  PetscFunctionBegin;
+  unsigned int maxDepth = 0, locDepth = (balOct.size()) ? balOct[0].getMaxDepth() : 0;
+  MPI_Allreduce(&locDepth, &maxDepth, 1, MPI_UNSIGNED, MPI_MAX, comm);
+
+  // the coarser DAs, from the finest
+  std::vector<ot::DA*> das(1, da);
+  std::vector<ot::TreeNode> cur(balOct), tmp, bal;
+  unsigned long locSz = cur.size(), sz;
+  MPI_Allreduce(&locSz, &sz, 1, MPI_UNSIGNED_LONG, MPI_SUM, comm);
+  while ((PetscInt)das.size() < nlevels) {
+    ierr = octDMMGCoarsenOctree(cur, tmp); CHKERRQ(ierr);
+    bal.clear();
+    ot::balanceOctree (tmp, bal, 3, maxDepth, true, comm);
+    tmp.clear();
+
+    unsigned long locCsz = bal.size(), csz;
+    MPI_Allreduce(&locCsz, &csz, 1, MPI_UNSIGNED_LONG, MPI_SUM, comm);
+    if (csz > 0.8*sz)
+      break;
+
+    cur = bal;
+    das.push_back(new ot::DA(bal, comm));
+    sz = csz;
+  }
+  cur.clear();
+
+  // fewer levels, drop the coarsest contexts
+  PetscInt nl = das.size();
+  if (nl < nlevels) {
+    PetscInfo2(0, "octDMMGSetOctree: using %D of %D levels\n", nl, nlevels);
+    for (i=0; i<nlevels-nl; i++)
+      delete p[i];
+    for (i=0; i<nl; i++) {
+      p[i] = p[i + nlevels - nl];
+      p[i]->nlevels = nl - i;
+      p[i]->coarser = (i) ? p[i-1] : NULL;
+    }
+    nlevels = nl;
+  }
+
+  for (i=0; i<nlevels; i++) {
+    p[i]->da  = das[nlevels-1-i];
+    p[i]->dof = dof;
+    p[i]->da->createVector(p[i]->x, false, false, dof);
+    ierr = VecDuplicate(p[i]->x,&p[i]->b); CHKERRQ(ierr);
+    ierr = VecDuplicate(p[i]->x,&p[i]->r); CHKERRQ(ierr);
+    ierr = VecDuplicate(p[i]->x,&p[i]->diag); CHKERRQ(ierr);
+
+    PetscInt m;
+    ierr = VecGetLocalSize(p[i]->x, &m); CHKERRQ(ierr);
+    ierr = MatCreateShell(comm, m, m, PETSC_DETERMINE, PETSC_DETERMINE, p[i], &p[i]->J); CHKERRQ(ierr);
+    ierr = MatShellSetOperation(p[i]->J, MATOP_MULT, (void(*)(void))octDMMGMatMult); CHKERRQ(ierr);
+    ierr = MatShellSetOperation(p[i]->J, MATOP_GET_DIAGONAL, (void(*)(void))octDMMGGetDiagonal); CHKERRQ(ierr);
+  }
+
+  for (i=1; i<nlevels; i++) {
+    PetscInt m, n;
+    ierr = octDMMGBuildTransfer(p[i]); CHKERRQ(ierr);
+    ierr = VecGetLocalSize(p[i]->x, &m); CHKERRQ(ierr);
+    ierr = VecGetLocalSize(p[i-1]->x, &n); CHKERRQ(ierr);
+    ierr = MatCreateShell(comm, m, n, PETSC_DETERMINE, PETSC_DETERMINE, p[i], &p[i]->R); CHKERRQ(ierr);
+    ierr = MatShellSetOperation(p[i]->R, MATOP_MULT, (void(*)(void))octDMMGInterpolate); CHKERRQ(ierr);
+    ierr = MatShellSetOperation(p[i]->R, MATOP_MULT_TRANSPOSE, (void(*)(void))octDMMGRestrict); CHKERRQ(ierr);
+  }
+
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGSetOperators"
+PetscErrorCode octDMMGSetOperators(octDMMG dmmg, std::vector<feMat*> &ops, std::vector<double> &scales)
+{
+  PetscFunctionBegin;
+  dmmg->ops = ops;
+  dmmg->scales = scales;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGEstimateEigenvalue"
+/*
+   Largest eigenvalue of inv(D) A by power iterations.
+*/
+static PetscErrorCode octDMMGEstimateEigenvalue(Mat A, Vec diag, Vec v, Vec w, PetscInt its, PetscReal *emax)
+{
+  PetscErrorCode ierr;
+  PetscReal      nrm;
+  PetscRandom    rctx;
+
+  PetscFunctionBegin;
+  ierr = MatGetDiagonal(A, diag); CHKERRQ(ierr);
+  ierr = PetscRandomCreate(PETSC_COMM_WORLD,&rctx); CHKERRQ(ierr);
+  ierr = PetscRandomSetFromOptions(rctx); CHKERRQ(ierr);
+  ierr = VecSetRandom(v,rctx); CHKERRQ(ierr);
+  ierr = PetscRandomDestroy(rctx); CHKERRQ(ierr);
+
+  *emax = 0.0;
+  ierr = VecNormalize(v, &nrm); CHKERRQ(ierr);
+  for (PetscInt k=0; k<its; k++) {
+    ierr = MatMult(A, v, w); CHKERRQ(ierr);
+    ierr = VecPointwiseDivide(w, w, diag); CHKERRQ(ierr);
+    ierr = VecNorm(w, NORM_2, emax); CHKERRQ(ierr);
+    ierr = VecCopy(w, v); CHKERRQ(ierr);
+    ierr = VecNormalize(v, &nrm); CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGSetUpLevel"
+/*@C
+    octDMMGSetUpLevel - Sets the preconditioner of ksp to multigrid on the hierarchy
+
+    Collective on octDMMG
+
+    Input Parameter:
++   dmmg - the context, with the operators of the coarser levels set
+-   ksp - the solver, its operator is used on the finest level
+
+    Notes: The V-cycle is symmetric, the outer KSP type is not changed.
+
+.seealso octDMMGSetOctree(), octDMMGSetOperators()
+
+@*/
+PetscErrorCode octDMMGSetUpLevel(octDMMG *dmmg, KSP ksp)
+{
+  PetscErrorCode ierr;
+  PetscInt       i,nlevels = dmmg[0]->nlevels;
+  PetscInt       smoothIts = 2, coarseIts = 20, eigIts = 10;
+  char           smoother[256] = "chebychev";
+  PC             pc;
+  KSP            lksp;
+  Mat            A, B;
+  MatStructure   str;
+  MPI_Comm       *comms;
+
+  PetscFunctionBegin;
+  if (!dmmg) SETERRQ(PETSC_ERR_ARG_NULL,"Passing null as octDMMG");
+  ierr = PetscOptionsGetInt(0,"-octmg_smooth_its",&smoothIts,0); CHKERRQ(ierr);
+  ierr = PetscOptionsGetInt(0,"-octmg_coarse_its",&coarseIts,0); CHKERRQ(ierr);
+  ierr = PetscOptionsGetInt(0,"-octmg_eig_its",&eigIts,0); CHKERRQ(ierr);
+  ierr = PetscOptionsGetString(0,"-octmg_smoother",smoother,255,0); CHKERRQ(ierr);
+  PetscTruth jacobi = (strcmp(smoother, "jacobi")) ? PETSC_FALSE : PETSC_TRUE;
+
+  ierr = KSPGetOperators(ksp, &A, &B, &str); CHKERRQ(ierr);
+
+  ierr = KSPGetPC(ksp,&pc);CHKERRQ(ierr);
+  ierr = PCSetType(pc,PCMG);CHKERRQ(ierr);
+  ierr = PetscMalloc(nlevels*sizeof(MPI_Comm),&comms);CHKERRQ(ierr);
+  for (i=0; i<nlevels; i++) {
+    comms[i] = dmmg[i]->comm;
+  }
+  ierr = PCMGSetLevels(pc,nlevels,comms);CHKERRQ(ierr);
+  ierr = PetscFree(comms);CHKERRQ(ierr);
+  ierr = PCMGSetType(pc,PC_MG_MULTIPLICATIVE);CHKERRQ(ierr);
+
+  for (i=0; i<nlevels; i++) {
+    Mat J = (i == nlevels-1) ? A : dmmg[i]->J;
+    PC  lpc;
+    PetscReal emax;
+
+    ierr = PCMGGetSmoother(pc,i,&lksp);CHKERRQ(ierr);
+    ierr = KSPSetOperators(lksp,J,J,DIFFERENT_NONZERO_PATTERN);CHKERRQ(ierr);
+    ierr = KSPGetPC(lksp,&lpc);CHKERRQ(ierr);
+    ierr = PCSetType(lpc,PCJACOBI);CHKERRQ(ierr);
+
+    ierr = octDMMGEstimateEigenvalue(J, dmmg[i]->diag, dmmg[i]->r, dmmg[i]->b, eigIts, &emax); CHKERRQ(ierr);
+    PetscInfo2(0, "octDMMGSetUpLevel: level %D, largest eigenvalue of inv(D)A %G\n", i, emax);
+
+    // Chebyshev targets the upper part of the spectrum on the smoothing
+    // levels, and most of it on the coarsest level.
+    if (jacobi && i) {
+      ierr = KSPSetType(lksp,KSPRICHARDSON);CHKERRQ(ierr);
+      ierr = KSPRichardsonSetScale(lksp,4.0/(3.0*emax));CHKERRQ(ierr);
+    } else {
+      ierr = KSPSetType(lksp,KSPCHEBYCHEV);CHKERRQ(ierr);
+      ierr = KSPChebychevSetEigenvalues(lksp,1.1*emax,(i) ? 0.1*emax : 0.01*emax);CHKERRQ(ierr);
+    }
+    ierr = KSPSetTolerances(lksp,PETSC_DEFAULT,PETSC_DEFAULT,PETSC_DEFAULT,(i) ? smoothIts : coarseIts);CHKERRQ(ierr);
+    ierr = KSPSetNormType(lksp,KSP_NO_NORM);CHKERRQ(ierr);
+
+    if (i < nlevels-1) { /* don't set for finest level, they are set in PCApply_MG()*/
+      ierr = PCMGSetX(pc,i,dmmg[i]->x);CHKERRQ(ierr);
+      ierr = PCMGSetRhs(pc,i,dmmg[i]->b);CHKERRQ(ierr);
+    }
+    if (i > 0) {
+      ierr = PCMGSetR(pc,i,dmmg[i]->r);CHKERRQ(ierr);
+      ierr = PCMGSetResidual(pc,i,PCMGDefaultResidual,J);CHKERRQ(ierr);
+      ierr = PCMGSetInterpolation(pc,i,dmmg[i]->R);CHKERRQ(ierr);
+      ierr = PCMGSetRestriction(pc,i,dmmg[i]->R);CHKERRQ(ierr);
+    }
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGSetKSP"
+/*@C
+    octDMMGSetKSP - Creates a CG solver for the finest level, preconditioned with the hierarchy
+
+    Collective on octDMMG
+
+    Input Parameter:
++   dmmg - the context, with the operators of all levels set
+-   rhs - function to compute right hand side on the finest level
+
+.seealso octDMMGSolve()
+
+@*/
+PetscErrorCode octDMMGSetKSP(octDMMG *dmmg, PetscErrorCode (*rhs)(octDMMG,Vec))
+{
+  PetscErrorCode ierr;
+  octDMMG        fine = octDMMGGetFine(dmmg);
+
+  PetscFunctionBegin;
+  if (!fine->ksp) {
+    ierr = KSPCreate(fine->comm,&fine->ksp);CHKERRQ(ierr);
+  }
+  ierr = KSPSetOperators(fine->ksp,fine->J,fine->J,SAME_NONZERO_PATTERN);CHKERRQ(ierr);
+  ierr = KSPSetType(fine->ksp,KSPCG);CHKERRQ(ierr);
+  ierr = octDMMGSetUpLevel(dmmg,fine->ksp);CHKERRQ(ierr);
+  ierr = KSPSetOptionsPrefix(fine->ksp,"octmg_");CHKERRQ(ierr);
+  ierr = KSPSetFromOptions(fine->ksp);CHKERRQ(ierr);
+  fine->rhs = rhs;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGSolve"
+PetscErrorCode octDMMGSolve(octDMMG *dmmg)
+{
+  PetscErrorCode ierr;
+  octDMMG        fine = octDMMGGetFine(dmmg);
+
+  PetscFunctionBegin;
+  if (fine->rhs) {
+    ierr = (*fine->rhs)(fine,fine->b);CHKERRQ(ierr);
+  }
+  ierr = KSPSolve(fine->ksp,fine->b,fine->x);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "octDMMGRestrictElemental"
+/*@C
+    octDMMGRestrictElemental - Averages elemental scalars (e.g., material properties) on the next coarser level
+
+    Collective on octDMMG
+
+    Input Parameter:
++   dmmg - the context
+.   level - the level of the input vectors
+-   in - the elemental vectors on level
+
+    Output Parameter:
+.   out - new elemental vectors on level-1, to be destroyed by the caller
+
+    Notes: Every fine element is contained in a single coarse element, which
+    gets the volume weighted average of the fine elements it contains.
+
+@*/
+PetscErrorCode octDMMGRestrictElemental(octDMMG *dmmg, PetscInt level, std::vector<Vec> &in, std::vector<Vec> &out)
+{
+  PetscErrorCode ierr;
+  ot::DA         *fda = dmmg[level]->da, *cda = dmmg[level-1]->da;
+  unsigned int   maxD = fda->getMaxDepth(), nv = in.size();
+  PetscScalar    *arr;
+
+  PetscFunctionBegin;
+  // the centres, volumes and values of the fine elements
+  std::vector<unsigned int> pts;
+  std::vector<double> vals;
+  std::vector<PetscScalar*> fbuf(nv);
+  for (unsigned int v=0; v<nv; v++)
+    fda->vecGetBuffer(in[v], fbuf[v], false, false, true, 1);
+  for ( fda->init<ot::DA::ALL>(), fda->init<ot::DA::WRITABLE>(); fda->curr() < fda->end<ot::DA::ALL>(); fda->next<ot::DA::ALL>() ) {
+    Point pt = fda->getCurrentOffset();
+    unsigned int h = 1u << (maxD - fda->getLevel(fda->curr()));
+    pts.push_back(pt.x() + h/2);
+    pts.push_back(pt.y() + h/2);
+    pts.push_back(pt.z() + h/2);
+    double vol = (double)h*h*h;
+    vals.push_back(vol);
+    for (unsigned int v=0; v<nv; v++)
+      vals.push_back(vol*fbuf[v][fda->curr()]);
+  }
+  for (unsigned int v=0; v<nv; v++)
+    fda->vecRestoreBuffer(in[v], fbuf[v], false, false, true, 1);
+
+  std::vector<unsigned int> order, recv;
+  std::vector<int> sendCnt, sendOff, recvCnt, recvOff;
+  ierr = octDMMGRoutePoints(cda, dmmg[level]->comm, pts, order, sendCnt, sendOff, recvCnt, recvOff, recv); CHKERRQ(ierr);
+
+  unsigned int w = nv+1, n = order.size(), nr = recv.size()/3;
+  std::vector<double> sbuf(w*n + 1), rbuf(w*nr + 1);
+  for (unsigned int k=0; k<n; k++)
+    for (unsigned int v=0; v<w; v++)
+      sbuf[w*k+v] = vals[w*order[k]+v];
+  for (unsigned int p=0; p<sendCnt.size(); p++) {
+    sendCnt[p] *= w; sendOff[p] *= w;
+    recvCnt[p] *= w; recvOff[p] *= w;
+  }
+  MPI_Alltoallv(&(*(sbuf.begin())), &(*(sendCnt.begin())), &(*(sendOff.begin())), MPI_DOUBLE,
+                &(*(rbuf.begin())), &(*(recvCnt.begin())), &(*(recvOff.begin())), MPI_DOUBLE, dmmg[level]->comm);
+
+  std::vector<unsigned int> ptr, elem;
+  std::vector<double> wt;
+  ierr = octDMMGLocatePoints(cda, recv, false, ptr, elem, wt); CHKERRQ(ierr);
+
+  std::vector<double> sums(w*cda->getLocalBufferSize(), 0.0);
+  for (unsigned int i=0; i<nr; i++)
+    if (ptr[i+1] > ptr[i])
+      for (unsigned int v=0; v<w; v++)
+        sums[w*elem[ptr[i]]+v] += rbuf[w*i+v];
+
+  out.resize(nv);
+  for (unsigned int v=0; v<nv; v++) {
+    cda->createVector(out[v], false, false, 1);
+    ierr = VecZeroEntries(out[v]); CHKERRQ(ierr);
+    cda->vecGetBuffer(out[v], arr, false, false, false, 1);
+    for ( cda->init<ot::DA::ALL>(), cda->init<ot::DA::WRITABLE>(); cda->curr() < cda->end<ot::DA::ALL>(); cda->next<ot::DA::ALL>() ) {
+      unsigned int e = cda->curr();
+      if (sums[w*e] > 0.0)
+        arr[e] = sums[w*e+v+1]/sums[w*e];
+    }
+    cda->vecRestoreBuffer(out[v], arr, false, false, false, 1);
+  }
+
+  PetscFunctionReturn(0);
+}
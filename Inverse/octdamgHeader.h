@@ -0,0 +1,143 @@
+/**
+ *  @file   octdamgHeader.h
+ *  @brief  Multigrid hierarchy of octree meshes, with the interface of stsDMMG.
+ *  @author Hari Sundar
+ *  @date   3/18/08
+ *
+ *  The stsDMMG object only refines structured DAs. The octDMMG object
+ *  builds the coarser levels of a balanced octree by replacing every
+ *  complete family of 8 leaves by its parent and rebalancing, and creates
+ *  an ot::DA for every level. The finest level is the DA of the caller.
+ *
+ *  Everything is matrix-free:
+ *    - the operator of a level is a linear combination of feMat operators
+ *      created on the DA of that level (octDMMGSetOperators()), i.e., the
+ *      same elemental loops as on the finest level,
+ *    - the interpolation is the evaluation of the coarse finite element
+ *      function at the (non-hanging) nodes of the finer mesh, with the
+ *      hanging nodes of the coarse mesh replaced by the corners of their
+ *      parents, and the restriction is its transpose,
+ *    - the smoothers are Chebyshev (or damped Jacobi) iterations,
+ *      preconditioned with the diagonal (MatGetDiagonal) of the operator,
+ *      with the largest eigenvalue estimated by a few power iterations,
+ *      and the coarsest level is solved with more iterations of the same.
+ *
+ *  The work per level is proportional to the number of elements, so a
+ *  V-cycle is O(N). The V-cycle is linear and symmetric, and can be used
+ *  as the preconditioner of CG.
+ *
+ *  Typical use, as a preconditioner of an existing KSP:
+ *
+ *    octDMMGCreate(comm, nlevels, user, &dmmg);
+ *    octDMMGSetOctree(&dmmg, balOct, &da, dof);
+ *    for every level l < nlevels-1:  octDMMGSetOperators(dmmg[l], ops, scales);
+ *    octDMMGSetUpLevel(dmmg, ksp);
+ *
+ *  or with octDMMGSetKSP() and octDMMGSolve() as for stsDMMG.
+ *
+ *  Options:
+ *    -octmg_nlevels <n>                 number of levels, read by the drivers and passed to octDMMGCreate
+ *    -octmg_smoother <chebychev|jacobi> smoother (chebychev)
+ *    -octmg_smooth_its <n>              smoothing iterations per level (2)
+ *    -octmg_coarse_its <n>              iterations on the coarsest level (20)
+ *    -octmg_eig_its <n>                 power iterations for the eigenvalue estimates (10)
+ **/
+
+#ifndef __OCTDMMGHEADER_H
+#define __OCTDMMGHEADER_H
+
+#include <vector>
+
+#include "petscksp.h"
+#include "TreeNode.h"
+#include "oda.h"
+#include "feMat.h"
+
+typedef struct _p_octDMMG* octDMMG;
+
+/**
+ *  @brief the interpolation from the next coarser level, in the fine level.
+ *
+ *  The fine processors send the coordinates of the nodes they own to the
+ *  processors whose coarse elements contain them (once), and the values
+ *  are exchanged in the same order for every interpolation/restriction.
+ **/
+struct octTransfer {
+  // fine side: the owned nodes, in the order they are sent
+  std::vector<unsigned int>   fineIdx;
+  std::vector<int>            sendCnt, sendOff;
+
+  // coarse side: the received nodes, as rows of weights of the coarse nodes
+  std::vector<int>            recvCnt, recvOff;
+  std::vector<unsigned int>   ptr;
+  std::vector<unsigned int>   node;
+  std::vector<double>         wt;
+
+  std::vector<PetscScalar>    sendBuf, recvBuf, packed;
+};
+
+struct _p_octDMMG {
+  ot::DA         *da;                  /* octree mesh of this level */
+  unsigned int   dof;
+  Vec            x,b,r;                /* global vectors used in multigrid preconditioner for this level*/
+  Vec            diag;                 /* work vector for the eigenvalue estimates */
+  Mat            J;                    /* matrix-free operator on this level */
+  Mat            R;                    /* matrix-free interpolation from the next coarser level */
+  PetscInt       nlevels;              /* number of levels above this one (total number of levels on level 0)*/
+  MPI_Comm       comm;
+  void           *user;
+
+  /* the operator is sum_k scales[k]*ops[k] */
+  std::vector<feMat*>   ops;
+  std::vector<double>   scales;
+
+  octDMMG        coarser;
+  octTransfer    transfer;
+
+  /* KSP only */
+  KSP            ksp;
+  PetscErrorCode (*rhs)(octDMMG,Vec);
+};
+
+PetscErrorCode octDMMGCreate(MPI_Comm,PetscInt,void*,octDMMG**);
+PetscErrorCode octDMMGDestroy(octDMMG*);
+
+/**
+ *  @brief builds the coarser octrees and their DAs, the vectors, operators and transfers of all levels.
+ *
+ *  The number of levels is reduced if the octree can not be coarsened
+ *  further, hence the pointer to the array. The finest DA is not copied
+ *  and must not be destroyed before the octDMMG.
+ **/
+PetscErrorCode octDMMGSetOctree(octDMMG**,std::vector<ot::TreeNode>&,ot::DA*,unsigned int);
+
+/**
+ *  @brief sets the operators of a level, the feMats must use the DA of the level.
+ **/
+PetscErrorCode octDMMGSetOperators(octDMMG,std::vector<feMat*>&,std::vector<double>&);
+
+/**
+ *  @brief makes the multigrid the preconditioner of ksp, whose operator is the finest level.
+ **/
+PetscErrorCode octDMMGSetUpLevel(octDMMG*,KSP);
+
+PetscErrorCode octDMMGSetKSP(octDMMG*,PetscErrorCode (*)(octDMMG,Vec));
+PetscErrorCode octDMMGSolve(octDMMG*);
+
+/**
+ *  @brief volume weighted averages on level-1 of the elemental scalars in on level, out is created.
+ **/
+PetscErrorCode octDMMGRestrictElemental(octDMMG*,PetscInt,std::vector<Vec>&,std::vector<Vec>&);
+
+#define octDMMGGetRHS(ctx)              (ctx)[(ctx)[0]->nlevels-1]->b
+#define octDMMGGetx(ctx)                (ctx)[(ctx)[0]->nlevels-1]->x
+#define octDMMGGetJ(ctx)                (ctx)[(ctx)[0]->nlevels-1]->J
+#define octDMMGGetComm(ctx)             (ctx)[(ctx)[0]->nlevels-1]->comm
+#define octDMMGGetFine(ctx)             (ctx)[(ctx)[0]->nlevels-1]
+#define octDMMGGetKSP(ctx)              (ctx)[(ctx)[0]->nlevels-1]->ksp
+#define octDMMGGetDA(ctx)               (ctx)[(ctx)[0]->nlevels-1]->da
+#define octDMMGGetUser(ctx,level)       ((ctx)[level]->user)
+#define octDMMGSetUser(ctx,level,usr)   ((ctx)[level]->user = usr,0)
+#define octDMMGGetLevels(ctx)           (ctx)[0]->nlevels
+
+#endif
@@ -87,6 +87,10 @@ int main(int argc, char **argv)
   massMatrix *Mass = new massMatrix(feMat::PETSC); // Mass Matrix
   stiffnessMatrix *Stiffness = new stiffnessMatrix(feMat::PETSC); // Stiffness matrix
   waveDamping *Damping = new waveDamping(feMat::PETSC); // Damping Matrix
+  // the names of the operators in the perfLog summary
+  Mass->setName("massMatrix");
+  Stiffness->setName("stiffnessMatrix");
+  Damping->setName("waveDamping");
 
   fdynamicVector *Force = new fdynamicVector(feVec::PETSC); // Force Vector
 
@@ -15,6 +15,7 @@
 #define _PARABOLIC_H_
 
 #include "timeStepper.h"
+#include "perfLog.h"
 
 /**
  *	@brief Main class for a linear parabolic problem
@@ -118,7 +119,11 @@ int parabolic::solve()
   //  m_ti.stop = m_dStopTime;
   //  m_ti.step = m_dTimeStep;
   int ierr;	
+  int its;
   unsigned int NT = (int)(ceil( m_ti->stop - m_ti->start)/m_ti->step);
+
+  perfLog::phase solvePhase = (m_bIsAdjoint) ? perfLog::ADJOINT_SOLVE : perfLog::FORWARD_SOLVE;
+  perfLog::scope timer(solvePhase);
   double temprtol;
   ierr = KSPGetTolerances(m_ksp,&temprtol,0,0,0); CHKERRQ(ierr);
 
@@ -148,6 +153,8 @@ int parabolic::solve()
       // Solve the ksp using the current rhs and non-zero initial guess
       ierr = KSPSetInitialGuessNonzero(m_ksp,PETSC_TRUE); CHKERRQ(ierr);
       ierr = KSPSolve(m_ksp,m_vecRHS,m_vecSolution); CHKERRQ(ierr);
+      ierr = KSPGetIterationNumber(m_ksp,&its); CHKERRQ(ierr);
+      perfLog::kspIterations(solvePhase, m_ti->currentstep, its);
 
 		if(m_iMon > 0){
 		  monitor();
@@ -173,6 +180,8 @@ int parabolic::solve()
       // Solve ksp using the current rhs and non-zero initial guess
 		ierr = KSPSetInitialGuessNonzero(m_ksp,PETSC_TRUE); CHKERRQ(ierr);
       ierr = KSPSolve(m_ksp,m_vecRHS,m_vecSolution); CHKERRQ(ierr);
+      ierr = KSPGetIterationNumber(m_ksp,&its); CHKERRQ(ierr);
+      perfLog::kspIterations(solvePhase, m_ti->currentstep, its);
     }
   }
 
@@ -221,7 +230,7 @@ int parabolic::monitor()
 		double norm;
 		int ierr;
 		Vec tempSol;
-		ierr = VecDuplicate(m_vecSolution,&tempSol);  CHKERRQ(ierr);
+		ierr = vecPool::get(m_vecSolution,&tempSol);  CHKERRQ(ierr);
 #ifdef __DEBUG__
 		//		VecNorm(m_vecSolution,NORM_INFINITY,&norm);
 		//		PetscPrintf(0,"solution norm b4 push back %f\n",norm);
@@ -19,15 +19,29 @@
 #include "radialBasis.h"
 #include "bSplineBasis.h"
 
-#include "cardiacForce.h"
-#include "cardiacForceTranspose.h"
+#include "cardiacFiberForce.h"
 #include "cardiacDynamic.h"
+#include "spaceTimeComm.h"
+#include "podSurrogate.h"
+#include "landmarkObservation.h"
 
 class parametricActivationInverse : public inverseSolver {
 
 public:
 
   parametricActivationInverse() {
+    m_vecForwardInitialDisplacement = NULL;
+    m_vecForwardInitialVelocity = NULL;
+    m_vecScalarTemplate = NULL;
+    m_iNumSlabs = 8;
+
+    m_pod = NULL;
+    m_bSurrogateActive = false;
+    m_bUseSurrogate = false;
+    m_bCostCurrent = false;
+    m_dTrustRadius = 0.0;
+    m_dSurrogateSwitch = 1e-2;
+    m_iRejected = 0;
   }
 
   ~parametricActivationInverse() {
@@ -42,6 +56,16 @@ public:
     CHKERRQ(MatDestroy(m_matReducedHessian));
     CHKERRQ(KSPDestroy(m_ksp));
 
+    if (m_vecScalarTemplate != NULL) {
+      CHKERRQ(VecDestroy(m_vecScalarTemplate));
+      m_vecScalarTemplate = NULL;
+    }
+
+    if (m_pod != NULL) {
+      delete m_pod;
+      m_pod = NULL;
+    }
+
     return true;
   }
 
@@ -53,9 +77,41 @@ public:
 
   virtual bool setReducedGradient();
 
+  /**
+   *  @brief the reduced gradient with the forward and adjoint sweeps pipelined over two groups of processors.
+   **/
+  bool setReducedGradientPipelined();
+
+  virtual double computeCost(Vec control);
+
+  /**
+   *  @brief use a POD surrogate (see podSurrogate.h) for the early Gauss-Newton iterations.
+   *  @param maxModes   maximum size of the reduced basis
+   *  @param tol        POD truncation tolerance
+   *  @param switchTol  the full model is used once the surrogate gradient is below switchTol of the initial gradient
+   **/
+  void useSurrogate(int maxModes, double tol, double switchTol) {
+    if (m_pod == NULL)
+      m_pod = new podSurrogate;
+    m_pod->setMaxModes(maxModes);
+    m_pod->setTolerance(tol);
+    m_dSurrogateSwitch = switchTol;
+    m_bSurrogateActive = true;
+  }
+
+  /**
+   *  @brief number of time slabs (forward checkpoints) of the pipelined gradient.
+   **/
+  void setTimeSlabs(int n) {
+    m_iNumSlabs = (n > 0) ? n : 1;
+  }
+
   void setForwardInitialConditions(Vec initDisp, Vec initVel) {
-    VecDuplicate(initDisp, &m_vecForwardInitialDisplacement);
-    VecDuplicate(initVel, &m_vecForwardInitialVelocity);
+    // reuse the vectors if called again, e.g., for a new case
+    if (m_vecForwardInitialDisplacement == NULL)
+      VecDuplicate(initDisp, &m_vecForwardInitialDisplacement);
+    if (m_vecForwardInitialVelocity == NULL)
+      VecDuplicate(initVel, &m_vecForwardInitialVelocity);
     VecCopy(initDisp, m_vecForwardInitialDisplacement);
     VecCopy(initVel, m_vecForwardInitialVelocity);
   }
@@ -78,6 +134,14 @@ public:
   void getActivations(Vec params, std::vector<Vec> &tau);
   void getParams(std::vector<Vec> forces, Vec params);
 
+  void addAdjoint(Vec lambda, unsigned int t, std::vector<Vec> &lambdaInt);
+  void reduceAdjoint(std::vector<Vec> &lambdaInt, Vec params);
+
+  /**
+   *  @brief the spatial basis functions first, ..., first+g.size()-1 as scalar Vecs, from the vecPool.
+   **/
+  void getSpatialBasis(unsigned int first, std::vector<Vec> &g);
+
   // Set the scalar DA ..
   void setScalarDA(DA da) {
     m_daScalar = da;
@@ -98,6 +162,60 @@ protected:
 
   // Easier if we have access to the 3D scalar DA ... not needed for the octree case.
   DA m_daScalar;
+
+  // time slabs of the pipelined gradient
+  int m_iNumSlabs;
+
+  // POD surrogate
+  podSurrogate *m_pod;
+  bool   m_bSurrogateActive;    // early iterations, until the switch to the full model
+  bool   m_bUseSurrogate;       // Hessian matvecs on the surrogate
+  bool   m_bCostCurrent;        // m_costFunctionValue is the cost at the current control
+  double m_dTrustRadius;
+  double m_dSurrogateSwitch;
+  int    m_iRejected;
+
+  int    setupSurrogate();
+  bool   surrogateStep();
+  double surrogateGradient(Vec control, Vec grad);
+  void   surrogateHessianMatMult(Vec In, Vec Out);
+  void   paramsToCoef(Vec params, std::vector<double> &coef);
+  void   coefToParams(std::vector<double> &coef, Vec params);
+
+  /**
+   *  @brief replaces the state at timestep t by the (masked) residual, returns its squared norm.
+   *
+   *  With landmark observations the state is not modified, the residual is
+   *  kept by m_landmarks, which is then the adjoint force.
+   **/
+  double setMisfit(Vec state, unsigned int t) {
+    if (m_landmarks != NULL) {
+      return m_landmarks->setResidual(state, t);
+    }
+    double rnorm;
+    VecAYPX(state, -1.0, m_vecObservations[t]);
+    if (m_bUsePartialObservations) {
+      VecPointwiseMult(state, state, m_vecPartialObservations);
+    }
+    VecNorm(state, NORM_2, &rnorm);
+    return rnorm*rnorm;
+  }
+
+  /**
+   *  @brief layout of the scalar (activation) vectors, used to get them from the vecPool.
+   **/
+  Vec getScalarTemplate() {
+    if (m_vecScalarTemplate == NULL) {
+      if ( !(m_ts->getMass()->getDAtype()) ) {
+        DACreateGlobalVector(m_daScalar, &m_vecScalarTemplate);
+      } else {
+        m_ts->getMass()->getOctDA()->createVector(m_vecScalarTemplate, false, true, 1);
+      }
+    }
+    return m_vecScalarTemplate;
+  }
+
+  Vec m_vecScalarTemplate;
 };
 
 /**
@@ -138,39 +256,126 @@ int parametricActivationInverse::init() {
 int parametricActivationInverse::solve() {
   int ierr;
 
-  // Set the initial guess to the current control
-  ierr = VecCopy(m_vecInitialControl, m_vecCurrentControl); CHKERRQ(ierr);
+  // Set the initial guess to the current control, unless we are resuming
+  // from a checkpoint, in which case the current control has been restored.
+  if ( !m_bRestarted ) {
+    ierr = VecCopy(m_vecInitialControl, m_vecCurrentControl); CHKERRQ(ierr);
+    m_numIterations = 0;
+  }
 
 #ifdef __DEBUG__
   VecNorm(m_vecCurrentControl,NORM_2,&norm);
   PetscPrintf(0,"norm of initial guess = %g\n",norm);
 #endif
 
-  // initiate the step to zero
-  ierr = VecZeroEntries(m_vecControlStep); CHKERRQ(ierr);
+  // In the inexact mode, start with loose forward/adjoint solves. The 
+  // user specified tolerance (-fwd_ksp_rtol) is used close to convergence.
+  double gnorm;
+  m_dPrevGradNorm = 0.0;
+  if ( !m_bRestarted ) {
+    m_dInitialGradNorm = 0.0;
+  }
+  if (m_bInexactNewton) {
+    m_dInnerTolMin = m_ts->getSolverTolerance();
+    ierr = m_ts->setSolverTolerance(m_dInnerTolMax); CHKERRQ(ierr);
+  }
 
-  setReducedGradient();
+  // The surrogate projects the misfit of the nodal field.
+  if ( (m_pod != NULL) && (m_landmarks != NULL) ) {
+    PetscPrintf(0, "POD surrogate not used with landmark observations\n");
+    delete m_pod;
+    m_pod = NULL;
+    m_bSurrogateActive = false;
+  }
 
-  // Solve for the step using the reduced Hessian
-  ierr = KSPSolve(m_ksp, m_vecReducedGradient, m_vecControlStep); CHKERRQ(ierr);
+  // Gauss-Newton iterations
+  while (m_numIterations < m_maxIterations) {
+    long numCreated = vecPool::getNumCreated();
 
-  PetscReal rnorm;
-  PetscInt its;
-  KSPGetResidualNorm(m_ksp, &rnorm);
-  KSPGetIterationNumber(m_ksp,&its);
-  // Print the final residual ...
-  PetscPrintf(0, "Final residual norm is %g\n", rnorm);
-  PetscPrintf(0, "Total number of iterations: %d\n", its);
+    // initiate the step to zero
+    ierr = VecZeroEntries(m_vecControlStep); CHKERRQ(ierr);
+
+    // early iterations on the reduced model, until it is no longer accurate enough
+    if ( m_bSurrogateActive && surrogateStep() ) {
+      m_numIterations++;
+      PetscPrintf(0, "GN iteration %d: J = %g (surrogate, %d modes)\n", m_numIterations, m_costFunctionValue, m_pod->getNumModes());
+      if ( m_iCheckpointFreq && !(m_numIterations % m_iCheckpointFreq) ) {
+        ierr = writeCheckpoint(); CHKERRQ(ierr);
+      }
+      continue;
+    }
+
+    setReducedGradient();
+
+    ierr = VecNorm(m_vecReducedGradient, NORM_2, &gnorm); CHKERRQ(ierr);
+    if (m_dInitialGradNorm == 0.0)
+      m_dInitialGradNorm = gnorm;
+    PetscPrintf(0, "GN iteration %d: |g| = %g\n", m_numIterations, gnorm);
+
+    if ( gnorm <= m_paramsTolerance*m_dInitialGradNorm ) {
+      PetscPrintf(0, "Converged, relative gradient norm below %g\n", m_paramsTolerance);
+      break;
+    }
+
+    if (m_bInexactNewton) {
+      double eta = getForcingTerm(gnorm);
+      ierr = KSPSetTolerances(m_ksp, eta, PETSC_DEFAULT, PETSC_DEFAULT, PETSC_DEFAULT); CHKERRQ(ierr);
+      // used for the Hessian matvecs and the next gradient
+      ierr = setInnerTolerance(gnorm, eta); CHKERRQ(ierr);
+    }
+
+    // Solve for the step using the reduced Hessian
+    ierr = KSPSolve(m_ksp, m_vecReducedGradient, m_vecControlStep); CHKERRQ(ierr);
+
+    PetscReal rnorm;
+    PetscInt its;
+    KSPGetResidualNorm(m_ksp, &rnorm);
+    KSPGetIterationNumber(m_ksp,&its);
+    // Print the final residual ...
+    PetscPrintf(0, "Final residual norm is %g\n", rnorm);
+    PetscPrintf(0, "Total number of iterations: %d\n", its);
 
 #ifdef __DEBUG__
-  Mat Hessian; 
-  ierr = KSPComputeExplicitOperator(m_ksp,&Hessian); CHKERRQ(ierr);
-  std::cout << RED"HESSIAN"NRM << std::endl;
-  MatView(Hessian, 0);
+    Mat Hessian; 
+    ierr = KSPComputeExplicitOperator(m_ksp,&Hessian); CHKERRQ(ierr);
+    std::cout << RED"HESSIAN"NRM << std::endl;
+    MatView(Hessian, 0);
 #endif
 
-  // new control = old control - step
-  ierr = VecAXPY(m_vecCurrentControl, -1.0, m_vecControlStep); CHKERRQ(ierr);
+    // new control = old control - alpha*step
+    if (m_bLineSearch) {
+      bool accepted;
+      ierr = lineSearch(accepted); CHKERRQ(ierr);
+      if (!accepted) {
+        PetscPrintf(0, "No decrease along the Newton step, stopping\n");
+        break;
+      }
+    } else {
+      ierr = VecAXPY(m_vecCurrentControl, -1.0, m_vecControlStep); CHKERRQ(ierr);
+    }
+    m_bCostCurrent = m_bLineSearch;
+
+    // the first trust region is the first Newton step
+    if ( m_bSurrogateActive && (m_dTrustRadius <= 0.0) ) {
+      ierr = VecNorm(m_vecControlStep, NORM_2, &m_dTrustRadius); CHKERRQ(ierr);
+    }
+
+    m_numIterations++;
+    PetscPrintf(0, "GN iteration %d: J = %g\n", m_numIterations, m_costFunctionValue);
+    // should be zero once the pool is warm
+    PetscPrintf(0, "GN iteration %d: %ld new Vecs\n", m_numIterations, vecPool::getNumCreated() - numCreated);
+
+    if ( m_iCheckpointFreq && !(m_numIterations % m_iCheckpointFreq) ) {
+      ierr = writeCheckpoint(); CHKERRQ(ierr);
+    }
+  }
+
+  // make sure the last checkpoint is on disk
+  ierr = finishCheckpoint(); CHKERRQ(ierr);
+
+  if (m_bInexactNewton) {
+    ierr = m_ts->setSolverTolerance(m_dInnerTolMin); CHKERRQ(ierr);
+  }
 
 #ifdef __DEBUG__
   VecNorm(m_vecCurrentControl,NORM_INFINITY,&norm);
@@ -186,12 +391,16 @@ int parametricActivationInverse::solve() {
  **/
 bool parametricActivationInverse::setReducedGradient() {
 
+  // the landmark residuals are small, there is nothing to pipeline
+  if ( (spaceTimeComm::getNumGroups() > 1) && (m_landmarks == NULL) )
+    return setReducedGradientPipelined();
+
   std::cout << "entering set RG" << std::endl;
   // Initiate the reduced Gradient to zero
   VecZeroEntries(m_vecReducedGradient);
 
   // Fdynamic which is the control 
-  cardiacForce *cForce; // = new cardiacForce(feVec::PETSC);
+  cardiacFiberForce *cForce;
   cardiacDynamic *Fdynamic; 
 
   if ( !(m_ts->getMass()->getDAtype())) {
@@ -208,20 +417,18 @@ bool parametricActivationInverse::setReducedGradient() {
     Fdynamic->setDof(3);
   }
   // Solver 
-  newmark *ts = new newmark;
+  newmark *ts = (newmark *)m_ts;
 
+  // Forward solve
   ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
   ts->setInitialVelocity(m_vecForwardInitialVelocity);
-
-  // Forward solve
-  ts = (newmark *)m_ts;
   ts->setAdjoint(false);
 
   ts->setTimeFrames(1);
   ts->storeVec(true);
 
   // Get the force from the timestepper
-  cForce = (cardiacForce *)ts->getForce();
+  cForce = (cardiacFiberForce *)ts->getForce();
 
   // Set the force to the current control
   std::vector<Vec> currControl;
@@ -246,7 +453,7 @@ bool parametricActivationInverse::setReducedGradient() {
   // Now can clear memory ...
   for (unsigned int i=0; i<currControl.size(); i++) {
     if (currControl[i] != NULL) {
-      VecDestroy(currControl[i]);
+      vecPool::restore(currControl[i]);
     }
   }
   currControl.clear();
@@ -258,34 +465,31 @@ bool parametricActivationInverse::setReducedGradient() {
 #endif
 
   // Set the right hand side of the adjoint, (state - data)
-  for (unsigned int i=0; i<solvec.size(); i++) {
-    VecAYPX(solvec[i], -1.0, m_vecObservations[i]);  
-    if (m_bUsePartialObservations) {
-      VecPointwiseMult(solvec[i], solvec[i], m_vecPartialObservations);
-    }
+  if (m_pod != NULL) {
+    m_pod->addSnapshots(solvec);
   }
 
-  // Now can clear memory ...
-  for (unsigned int i=0; i<m_vecObservations.size(); i++) {
-    if (m_vecObservations[i] != NULL) {
-      VecDestroy(m_vecObservations[i]);
-    }
+  // The observations are kept, they are needed for every outer iteration.
+  double misfit = 0.0;
+  for (unsigned int i=0; i<solvec.size(); i++) {
+    misfit += setMisfit(solvec[i], i);
   }
-  m_vecObservations.clear();
 
   // set the Fstatic again for the adjoint right hand side
-  Fdynamic->setFDynamic(solvec);
-
-  // set the Fstatic
-  ts->setForceVector(Fdynamic);
+  if (m_landmarks != NULL) {
+    ts->setForceVector(m_landmarks);
+  } else {
+    Fdynamic->setFDynamic(solvec);
+    ts->setForceVector(Fdynamic);
+  }
 
   // set the adjoint flag.. here it does not matter 
   ts->setAdjoint(true);
 
   // set initial conditions for adjoint ...
   Vec initD, initV;
-  VecDuplicate(m_vecForwardInitialDisplacement, &initD);
-  VecDuplicate(m_vecForwardInitialDisplacement, &initV);
+  vecPool::get(m_vecForwardInitialDisplacement, &initD);
+  vecPool::get(m_vecForwardInitialDisplacement, &initV);
   VecZeroEntries(initD);
   VecZeroEntries(initV);
   ts->setInitialDisplacement(initD); 
@@ -300,7 +504,7 @@ bool parametricActivationInverse::setReducedGradient() {
   // clear memory ...
   for (unsigned int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
   solvec.clear();
@@ -308,6 +512,10 @@ bool parametricActivationInverse::setReducedGradient() {
   // get the solution
   solvec = ts->getSolution();
 
+  if (m_pod != NULL) {
+    m_pod->addSnapshots(solvec);
+  }
+
   ts->setForceVector(cForce);
 
   // PetscPrintf(0, "Getting params from forces\n");
@@ -317,7 +525,7 @@ bool parametricActivationInverse::setReducedGradient() {
   // clear memory ...
   for (unsigned int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
   solvec.clear();
@@ -328,16 +536,296 @@ bool parametricActivationInverse::setReducedGradient() {
   // add the contribution of the regularization parameter
   VecAXPY(m_vecReducedGradient, m_beta, m_vecCurrentControl);
 
+  // cost function at the current control
+  double cnorm;
+  VecNorm(m_vecCurrentControl, NORM_2, &cnorm);
+  m_costFunctionValue = 0.5*misfit*m_ts->getTimeInfo()->step + 0.5*m_beta*cnorm*cnorm;
+
 #ifdef __DEBUG__
   VecNorm(m_vecReducedGradient,NORM_2,&norm);
   PetscPrintf(0,"norm of reduced Gradient = %f\n", norm);
 #endif
-  VecDestroy(initD);
-  VecDestroy(initV);
+  // the solver must not keep the adjoint initial conditions once they are back in the pool
+  ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+  ts->setInitialVelocity(m_vecForwardInitialVelocity);
+  vecPool::restore(initD);
+  vecPool::restore(initV);
 
   PetscPrintf(0, "Finished setting reduced gradient\n");
   return true;
 }
+
+/**
+ *	@brief the reduced gradient with the forward and adjoint sweeps on two groups of processors (see spaceTimeComm).
+ *
+ * The adjoint at time t depends on the misfit at all later times, so it can
+ * not start before the forward solve has reached the final time. Instead of
+ * storing the states of all timesteps, the forward group (group 1) saves the
+ * state at the start of every time slab, and then recomputes the slabs in
+ * reverse order from these checkpoints, sending the misfits of every slab
+ * to the adjoint group (group 0). The adjoint sweep over a slab overlaps the
+ * recomputation of the previous slab, and the adjoints are added to the
+ * time integrals as they are computed, so that neither group stores more
+ * than a slab of timesteps. Other groups, if any, only receive the result.
+ *
+ * This bounds the memory, it does not save time: only the recomputation
+ * overlaps the adjoint, so the critical path is still a full forward sweep
+ * followed by a full adjoint sweep, each on half the processors, which is
+ * no faster than the forward and adjoint solves of setReducedGradient() on
+ * all of them. Use it when the states of all timesteps do not fit.
+ *
+ * All groups end up with the same gradient and cost.
+ **/
+#undef __FUNCT__
+#define __FUNCT__ "pActInv_setReducedGradientPipelined"
+bool parametricActivationInverse::setReducedGradientPipelined() {
+  int group = spaceTimeComm::getGroup();
+  newmark *ts = (newmark *)m_ts;
+  timeInfo *ti = m_ts->getTimeInfo();
+  cardiacFiberForce *cForce = (cardiacFiberForce *)ts->getForce();
+
+  unsigned int NT = (unsigned int)(ceil(( ti->stop - ti->start)/ti->step));
+  unsigned int slabSize = (NT + m_iNumSlabs - 1)/m_iNumSlabs;
+  if (slabSize < 1)
+    slabSize = 1;
+  unsigned int numSlabs = (NT + slabSize - 1)/slabSize;
+
+  double misfit = 0.0;
+  double waitTime = 0.0;
+  double sTime = perfLog::now();
+
+  VecZeroEntries(m_vecReducedGradient);
+
+  if (group == 1) {
+    // Forward group
+    std::vector<Vec> currControl;
+    getActivations(m_vecCurrentControl, currControl);
+    cForce->setActivationVec(currControl);
+
+    ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+    ts->setInitialVelocity(m_vecForwardInitialVelocity);
+    ts->setAdjoint(false);
+    ts->setTimeFrames(1);
+    ts->storeVec(true);
+    ts->clearMonitor();
+
+    // displacement, velocity and acceleration at the start of every slab
+    std::vector<Vec> ckpt(3*numSlabs);
+    for (unsigned int i=0; i<ckpt.size(); i++) {
+      vecPool::get(m_vecForwardInitialDisplacement, &(ckpt[i]));
+    }
+
+    // the misfits of the current slab, including its first timestep
+    std::vector<Vec> slab;
+    std::vector<Vec> solvec;
+
+    ts->startSolve();
+    for (unsigned int s=0; s<numSlabs; s++) {
+      unsigned int first = s*slabSize;
+      unsigned int last = (first + slabSize < NT) ? first + slabSize : NT;
+
+      ts->getState(ckpt[3*s], ckpt[3*s+1], ckpt[3*s+2]);
+      ts->advance(last - first);
+      solvec = ts->getSolution();
+
+      // timesteps first+1 to last, and 0 for the first slab
+      unsigned int t0 = last + 1 - solvec.size();
+      for (unsigned int i=0; i<solvec.size(); i++) {
+        misfit += setMisfit(solvec[i], t0 + i);
+        slab.push_back(solvec[i]);
+      }
+
+      if (s+1 < numSlabs) {
+        // keep the last one, it is the first of the next slab
+        Vec next = slab.back();
+        slab.pop_back();
+        vecPool::restore(slab);
+        slab.push_back(next);
+      }
+    }
+
+    // the last slab is ready, the others are recomputed from the checkpoints
+    spaceTimeComm::sendVecs(slab, 0, numSlabs-1);
+    vecPool::restore(slab);
+
+    for (int s=numSlabs-2; s>=0; s--) {
+      unsigned int first = s*slabSize;
+      unsigned int last = first + slabSize;
+
+      ts->setState(ckpt[3*s], ckpt[3*s+1], ckpt[3*s+2], first);
+      ts->advance(last - first);
+      solvec = ts->getSolution();
+
+      Vec r;
+      vecPool::get(m_vecForwardInitialDisplacement, &r);
+      VecCopy(ckpt[3*s], r);
+      setMisfit(r, first);
+      slab.push_back(r);
+      for (unsigned int i=0; i<solvec.size(); i++) {
+        setMisfit(solvec[i], first + 1 + i);
+        slab.push_back(solvec[i]);
+      }
+
+      double wStart = perfLog::now();
+      spaceTimeComm::sendVecs(slab, 0, s);
+      waitTime += perfLog::now() - wStart;
+      vecPool::restore(slab);
+    }
+    double wStart = perfLog::now();
+    spaceTimeComm::waitSend();
+    waitTime += perfLog::now() - wStart;
+
+    vecPool::restore(ckpt);
+    vecPool::restore(currControl);
+  } else if (group == 0) {
+    // Adjoint group
+    cardiacDynamic *Fdynamic;
+    if ( !(m_ts->getMass()->getDAtype())) {
+      Fdynamic = new cardiacDynamic(feVec::PETSC);
+      Fdynamic->setDA(m_ts->getMass()->getDA());
+    } else {
+      Fdynamic = new cardiacDynamic(feVec::OCT);
+      Fdynamic->setDA(m_ts->getMass()->getOctDA());
+    }
+    Fdynamic->setProblemDimensions(1.0,1.0,1.0);
+    Fdynamic->setTimeInfo(m_ts->getTimeInfo());
+    Fdynamic->setDof(3);
+
+    Vec initD, initV;
+    vecPool::get(m_vecForwardInitialDisplacement, &initD);
+    vecPool::get(m_vecForwardInitialDisplacement, &initV);
+    VecZeroEntries(initD);
+    VecZeroEntries(initV);
+
+    ts->setForceVector(Fdynamic);
+    ts->setAdjoint(true);
+    ts->setInitialDisplacement(initD);
+    ts->setInitialVelocity(initV);
+    ts->setTimeFrames(1);
+    ts->storeVec(true);
+    ts->clearMonitor();
+
+    // only the entries of the current slab are set
+    std::vector<Vec> fdynamic(NT+1, (Vec)NULL);
+    std::vector<Vec> lambdaInt;
+
+    for (int s=numSlabs-1; s>=0; s--) {
+      unsigned int first = s*slabSize;
+      unsigned int last = (first + slabSize < NT) ? first + slabSize : NT;
+
+      std::vector<Vec> slab(last - first + 1);
+      for (unsigned int i=0; i<slab.size(); i++) {
+        vecPool::get(m_vecForwardInitialDisplacement, &(slab[i]));
+      }
+      double wStart = perfLog::now();
+      spaceTimeComm::recvVecs(slab, 1, s);
+      waitTime += perfLog::now() - wStart;
+
+      for (unsigned int i=0; i<slab.size(); i++) {
+        fdynamic[first + i] = slab[i];
+      }
+      Fdynamic->setFDynamic(fdynamic);
+
+      // the adjoint steps of this slab, they need the misfits from first to last
+      if (s+1 == (int)numSlabs) {
+        ts->startSolve();
+      }
+      ts->advance(last - first);
+
+      // adjoints at timesteps first to last-1, and NT for the last slab
+      std::vector<Vec> lambda = ts->getSolution();
+      for (unsigned int i=0; i<lambda.size(); i++) {
+        addAdjoint(lambda[i], first + i, lambdaInt);
+      }
+      vecPool::restore(lambda);
+
+      for (unsigned int i=0; i<slab.size(); i++) {
+        fdynamic[first + i] = NULL;
+      }
+      vecPool::restore(slab);
+    }
+
+    ts->setForceVector(cForce);
+    reduceAdjoint(lambdaInt, m_vecReducedGradient);
+
+    ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+    ts->setInitialVelocity(m_vecForwardInitialVelocity);
+    vecPool::restore(initD);
+    vecPool::restore(initV);
+    delete Fdynamic;
+  }
+
+  // the gradient from the adjoint group and the misfit from the forward group
+  spaceTimeComm::bcast(m_vecReducedGradient, 0);
+  spaceTimeComm::bcast(misfit, 1);
+
+  PetscPrintf(0, "Pipelined gradient (group %d): %d slabs of %d steps in %g s, waited %g s\n", group, numSlabs, slabSize, perfLog::now() - sTime, waitTime);
+
+  // scale the reduced Gradient
+  VecScale(m_vecReducedGradient,-1.0);
+
+  // add the contribution of the regularization parameter
+  VecAXPY(m_vecReducedGradient, m_beta, m_vecCurrentControl);
+
+  // cost function at the current control
+  double cnorm;
+  VecNorm(m_vecCurrentControl, NORM_2, &cnorm);
+  m_costFunctionValue = 0.5*misfit*m_ts->getTimeInfo()->step + 0.5*m_beta*cnorm*cnorm;
+
+  return true;
+}
+
+/**
+ *	@brief evaluate the cost function at a given control, one forward solve.
+ *  @return 0.5*dt*sum |y - y*|^2 + 0.5*beta*|p|^2
+ **/
+#undef __FUNCT__
+#define __FUNCT__ "pActInv_computeCost"
+double parametricActivationInverse::computeCost(Vec control) {
+  newmark *ts = (newmark *)m_ts;
+
+  ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+  ts->setInitialVelocity(m_vecForwardInitialVelocity);
+  ts->setAdjoint(false);
+  ts->setTimeFrames(1);
+  ts->storeVec(true);
+
+  cardiacFiberForce *cForce = (cardiacFiberForce *)ts->getForce();
+
+  std::vector<Vec> currControl;
+  getActivations(control, currControl);
+  cForce->setActivationVec(currControl);
+
+  ts->clearMonitor();
+  ts->solve();
+
+  std::vector<Vec> solvec;
+  solvec = ts->getSolution();
+
+  if (m_pod != NULL) {
+    m_pod->addSnapshots(solvec);
+  }
+
+  double misfit = 0.0;
+  for (unsigned int i=0; i<solvec.size(); i++) {
+    misfit += setMisfit(solvec[i], i);
+    vecPool::restore(solvec[i]);
+  }
+  solvec.clear();
+
+  for (unsigned int i=0; i<currControl.size(); i++) {
+    if (currControl[i] != NULL) {
+      vecPool::restore(currControl[i]);
+    }
+  }
+  currControl.clear();
+
+  double cnorm;
+  VecNorm(control, NORM_2, &cnorm);
+
+  return 0.5*misfit*m_ts->getTimeInfo()->step + 0.5*m_beta*cnorm*cnorm;
+}
+
 /**
  *	@brief set the reduced Hessian matrix vector product, this function does one forward solve and one adjoint solve
  *
@@ -347,12 +835,16 @@ bool parametricActivationInverse::setReducedGradient() {
 #define __FUNCT__ "pActInv_hessianMatMult"
 void parametricActivationInverse::hessianMatMult(Vec In, Vec Out) {
   // std::cout << "Entering " << __FUNCT__ << std::endl;
+  if (m_bUseSurrogate) {
+    surrogateHessianMatMult(In, Out);
+    return;
+  }
   VecZeroEntries(Out);
 
   newmark *ts = (newmark *)m_ts;
 
   // Get the force from the timestepper
-  cardiacForce *cForce =  (cardiacForce *)ts->getForce();
+  cardiacFiberForce *cForce =  (cardiacFiberForce *)ts->getForce();
   cardiacDynamic *Fdynamic; 
 
   if ( !(m_ts->getMass()->getDAtype())) {
@@ -399,13 +891,17 @@ void parametricActivationInverse::hessianMatMult(Vec In, Vec Out) {
   // Now can clear memory ...
   for (unsigned int i=0; i<currControl.size(); i++) {
     if (currControl[i] != NULL) {
-      VecDestroy(currControl[i]);
+      vecPool::restore(currControl[i]);
     }
   }
   currControl.clear();
 
   // Scale to the set the right hand side of adjoint
   for (unsigned int i=0; i<solvec.size(); i++) {
+    if (m_landmarks != NULL) {
+      m_landmarks->setResidual(solvec[i], i, false);
+      continue;
+    }
     VecScale(solvec[i],-1.0);
     if (m_bUsePartialObservations) {
       VecPointwiseMult(solvec[i], solvec[i], m_vecPartialObservations);
@@ -418,11 +914,13 @@ void parametricActivationInverse::hessianMatMult(Vec In, Vec Out) {
   }
 
 
-  // Adjoint solve steps
-  Fdynamic->setFDynamic(solvec);
-
-  // set the adjoint right hand side
-  ts->setForceVector(Fdynamic);
+  // Adjoint solve steps, set the adjoint right hand side
+  if (m_landmarks != NULL) {
+    ts->setForceVector(m_landmarks);
+  } else {
+    Fdynamic->setFDynamic(solvec);
+    ts->setForceVector(Fdynamic);
+  }
   ts->clearMonitor();
 
   // set the adjoint flag
@@ -430,8 +928,8 @@ void parametricActivationInverse::hessianMatMult(Vec In, Vec Out) {
 
   // set initial conditions for adjoint ...
   Vec initD, initV;
-  VecDuplicate(m_vecForwardInitialDisplacement, &initD);
-  VecDuplicate(m_vecForwardInitialDisplacement, &initV);
+  vecPool::get(m_vecForwardInitialDisplacement, &initD);
+  vecPool::get(m_vecForwardInitialDisplacement, &initV);
   VecZeroEntries(initD);
   VecZeroEntries(initV);
   ts->setInitialDisplacement(initD); 
@@ -443,7 +941,7 @@ void parametricActivationInverse::hessianMatMult(Vec In, Vec Out) {
   // clear memory ...
   for (unsigned int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
   solvec.clear();
@@ -458,7 +956,7 @@ void parametricActivationInverse::hessianMatMult(Vec In, Vec Out) {
   // clear memory ...
   for (unsigned int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
   solvec.clear();
@@ -470,8 +968,10 @@ void parametricActivationInverse::hessianMatMult(Vec In, Vec Out) {
   // add the contribution of the regularization parameter
   VecAXPY(Out, m_beta, In);
   // std::cout << GRN"Leaving "NRM << __func__ << std::endl;
-  VecDestroy(initD);
-  VecDestroy(initV);
+  ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+  ts->setInitialVelocity(m_vecForwardInitialVelocity);
+  vecPool::restore(initD);
+  vecPool::restore(initV);
 }
 
 // Functions to handle the full / parametrized representations
@@ -481,6 +981,7 @@ void parametricActivationInverse::getActivations(Vec params, std::vector<Vec> &t
 #ifdef __DEBUG__
   std::cout << RED"Entering "NRM << __func__ << std::endl;
 #endif
+  perfLog::begin(perfLog::BASIS_EVAL);
 
   PetscScalar * pVec;
   VecGetArray(params, &pVec);
@@ -488,7 +989,7 @@ void parametricActivationInverse::getActivations(Vec params, std::vector<Vec> &t
   // Clear the Forces
   for (unsigned int i=0; i<tau.size(); i++) {
     if (tau[i] != NULL) {
-      VecDestroy(tau[i]);
+      vecPool::restore(tau[i]);
     }
   }
   tau.clear();
@@ -507,7 +1008,7 @@ void parametricActivationInverse::getActivations(Vec params, std::vector<Vec> &t
     // create and initialize to 0
     for (unsigned int i=0; i<numSteps+1; i++) {
       Vec tmp;
-      DACreateGlobalVector(m_daScalar, &tmp);
+      vecPool::get(getScalarTemplate(), &tmp);
       VecZeroEntries(tmp);
       tau.push_back(tmp);
     }
@@ -564,7 +1065,7 @@ void parametricActivationInverse::getActivations(Vec params, std::vector<Vec> &t
     // create and initialize to 0
     for (unsigned int i=0; i<numSteps+1; i++) {
       Vec tmp;
-      da->createVector(tmp, false, true, 1);
+      vecPool::get(getScalarTemplate(), &tmp);
       VecZeroEntries(tmp);
       tau.push_back(tmp);
     }
@@ -618,6 +1119,7 @@ void parametricActivationInverse::getActivations(Vec params, std::vector<Vec> &t
 
   VecRestoreArray(params, &pVec);
 
+  perfLog::end(perfLog::BASIS_EVAL);
 #ifdef __DEBUG__
   std::cout << GRN"Leaving "NRM << __func__ << std::endl;
 #endif
@@ -629,12 +1131,64 @@ void parametricActivationInverse::getParams(std::vector<Vec> forces, Vec params)
 #ifdef __DEBUG__
   std::cout << RED"Entering pActInv::"NRM << __func__ << std::endl;
 #endif
+  timeInfo *ti = m_ts->getTimeInfo();
+  unsigned int numSteps = (unsigned int)(ceil(( ti->stop - ti->start)/ti->step));
+
+  std::vector<Vec> lambdaInt;
+  for (unsigned int t=0; t<numSteps+1; t++) {
+    addAdjoint(forces[t], t, lambdaInt);
+  }
+  reduceAdjoint(lambdaInt, params);
+#ifdef __DEBUG__
+  std::cout << GRN"Leaving "NRM << __func__ << std::endl;
+#endif
+}
+
+/**
+ *  @brief adds the adjoint at timestep t to the time integrals against the bSpline basis.
+ *
+ *  The force does not depend on time, so the time integration of the
+ *  bSpline basis is done on the adjoints, and the transpose of the force
+ *  is applied once per basis function (in reduceAdjoint) instead of once
+ *  per timestep. lambdaInt is created on the first call.
+ **/
+#undef __FUNCT__
+#define __FUNCT__ "pActInv_addAdjoint"
+void parametricActivationInverse::addAdjoint(Vec lambda, unsigned int t, std::vector<Vec> &lambdaInt) {
+  perfLog::begin(perfLog::BASIS_EVAL);
 
-  int daType = m_ts->getMass()->getDAtype();
   timeInfo *ti = m_ts->getTimeInfo();
+  int knotsize = m_bsplineBasis.getNumKnots();
 
-  unsigned int numSteps = (unsigned int)(ceil(( ti->stop - ti->start)/ti->step));
+  if (lambdaInt.empty()) {
+    for (int b=0; b<knotsize; b++) {
+      Vec tmp;
+      vecPool::get(lambda, &tmp);
+      VecZeroEntries(tmp);
+      lambdaInt.push_back(tmp);
+    }
+  }
+
+  double *currBasis = new double[knotsize];
+  m_bsplineBasis.basis(ti->start + t*ti->step, currBasis);
+  for (int b=0; b<knotsize; b++) {
+    if (currBasis[b] != 0.0)
+      VecAXPY(lambdaInt[b], currBasis[b]*ti->step, lambda);
+  }
+  delete [] currBasis;
+
+  perfLog::end(perfLog::BASIS_EVAL);
+}
+
+/**
+ *  @brief the parameters from the time integrated adjoints, returns lambdaInt to the pool.
+ **/
+#undef __FUNCT__
+#define __FUNCT__ "pActInv_reduceAdjoint"
+void parametricActivationInverse::reduceAdjoint(std::vector<Vec> &lambdaInt, Vec params) {
+  perfLog::begin(perfLog::BASIS_EVAL);
 
+  int daType = m_ts->getMass()->getDAtype();
 
   int sz;
 
@@ -650,48 +1204,20 @@ void parametricActivationInverse::getParams(std::vector<Vec> forces, Vec params)
 
   double gx;
   int knotsize = m_bsplineBasis.getNumKnots();
-  double *currBasis = new double[knotsize];
 
   std::vector<Vec> ibldt;
+  for (int i=0; i<knotsize; i++) {
+    Vec tmp;
+    vecPool::get(getScalarTemplate(), &tmp);
+    VecZeroEntries(tmp);
+    ibldt.push_back(tmp);
+  }
 
-  if ( !daType ) { // PetSc
-    for (int i=0; i<knotsize; i++) {
-      Vec tmp;
-      DACreateGlobalVector(m_daScalar, &tmp);
-      VecZeroEntries(tmp);
-      ibldt.push_back(tmp);
-    }
-
-    cardiacForce* cforce = (cardiacForce *)m_ts->getForce();
-    Vec fibers = cforce->getFiberOrientations();
-
-    cardiacForceTranspose* cforceTranspose = new cardiacForceTranspose(feVec::PETSC);
-    cforceTranspose->setProblemDimensions(1.0,1.0,1.0);
-    cforceTranspose->setDA3d(m_ts->getMass()->getDA());
-    cforceTranspose->setDA(m_daScalar);
-    cforceTranspose->setTimeInfo(m_ts->getTimeInfo());
-    cforceTranspose->setDof(1);
-
-    cforceTranspose->setFiberOrientations(fibers);
-    cforceTranspose->setAdjoints(forces);
-
-    Vec tauVec;
-    DACreateGlobalVector(m_daScalar, &tauVec);
-
-    // first the time integration of bSpline Basis with lambda
-    double currTime = ti->start;
-    double dt = ti->step;
-    for (unsigned int t=0; t<numSteps+1; t++) {
-      m_bsplineBasis.basis(currTime, currBasis);
-      VecZeroEntries(tauVec);
-      cforceTranspose->addVec(tauVec, 1.0, t);
-      for (unsigned int b=0; b<knotsize; b++) {
-        double ifac = currBasis[b]*dt; 
-        VecAXPY(ibldt[b], ifac, tauVec);
-      }
-      currTime += ti->step;
-    }
+  cardiacFiberForce* cforce = (cardiacFiberForce *)m_ts->getForce();
+  cforce->applyTransposeBatched(lambdaInt, ibldt);
+  vecPool::restore(lambdaInt);
 
+  if ( !daType ) { // PetSc
     PetscScalar ***bl; 
 
     DA da = m_ts->getMass()->getDA();
@@ -725,45 +1251,6 @@ void parametricActivationInverse::getParams(std::vector<Vec> forces, Vec params)
   } else {  // OTK
     ot::DA* da = m_ts->getMass()->getOctDA();
 
-
-    for (int i=0; i<knotsize; i++) {
-      Vec tmp;
-      da->createVector(tmp, false, true, 1);
-      VecZeroEntries(tmp);
-      ibldt.push_back(tmp);
-    }
-
-    cardiacForce* cforce = (cardiacForce *)m_ts->getForce();
-    Vec fibers = cforce->getFiberOrientations();
-
-    cardiacForceTranspose* cforceTranspose = new cardiacForceTranspose(feVec::OCT);
-    cforceTranspose->setProblemDimensions(1.0,1.0,1.0);
-    cforceTranspose->setDA(m_ts->getMass()->getOctDA());
-    cforceTranspose->setTimeInfo(m_ts->getTimeInfo());
-    cforceTranspose->setDof(1);
-
-    cforceTranspose->setFiberOrientations(fibers);
-    cforceTranspose->setAdjoints(forces);
-
-    Vec tauVec;
-
-    da->createVector(tauVec, false, true, 1);
-
-    // first the time integration of bSpline Basis with lambda
-    double currTime = ti->start;
-    double dt = ti->step;
-    for (unsigned int t=0; t<numSteps+1; t++) {
-      m_bsplineBasis.basis(currTime, currBasis);
-      VecZeroEntries(tauVec);
-      cforceTranspose->addVec(tauVec, 1.0, t);
-      for (unsigned int b=0; b<knotsize; b++) {
-        double ifac = currBasis[b]*dt; 
-        VecAXPY(ibldt[b], ifac, tauVec);
-      }
-      currTime += ti->step;
-    }
-
-
     PetscScalar *bl; 
 
     unsigned int maxD = da->getMaxDepth();
@@ -794,17 +1281,299 @@ void parametricActivationInverse::getParams(std::vector<Vec> forces, Vec params)
     } // g
   }
 
-  delete [] currBasis;
-  MPI_Barrier(MPI_COMM_WORLD);
+  vecPool::restore(ibldt);
+  MPI_Barrier(PETSC_COMM_WORLD);
 
   // update copies on all ...
-  MPI_Allreduce ( sendVec, pVec, sz,  MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD );
+  MPI_Allreduce ( sendVec, pVec, sz,  MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD );
   VecRestoreArray(params, &pVec);
   delete [] sendVec;
-  // delete [] lambda;
-#ifdef __DEBUG__
-  std::cout << GRN"Leaving "NRM << __func__ << std::endl;
-#endif
+  perfLog::end(perfLog::BASIS_EVAL);
+}
+
+/**
+ *	@brief one Gauss-Newton iteration on the POD surrogate, safeguarded by a trust region on the full cost.
+ *
+ * The step is computed with the surrogate gradient and Hessian, restricted
+ * to the trust region, and accepted if the full cost at the new control
+ * (one full forward solve, whose states also refresh the basis) decreases
+ * by at least a tenth of the decrease predicted by the surrogate. The
+ * radius is adapted to the ratio of the actual and predicted decrease.
+ *
+ * @return false if the full model should be used, i.e., there is no basis
+ * yet, or the surrogate gradient is small, in which case the full model is
+ * used from now on. The full model is also used from now on after two
+ * consecutive rejected steps.
+ **/
+#undef __FUNCT__
+#define __FUNCT__ "pActInv_surrogateStep"
+bool parametricActivationInverse::surrogateStep() {
+  if ( (m_pod->getNumModes() == 0) || (m_dTrustRadius <= 0.0) )
+    return false;
+
+  // the full cost at the current control, for the actual decrease
+  if ( !m_bCostCurrent ) {
+    m_costFunctionValue = computeCost(m_vecCurrentControl);
+    m_bCostCurrent = true;
+  }
+  if ( !m_pod->isProjected() ) {
+    setupSurrogate();
+  }
+
+  double Jr = surrogateGradient(m_vecCurrentControl, m_vecReducedGradient);
+
+  double gnorm;
+  VecNorm(m_vecReducedGradient, NORM_2, &gnorm);
+  PetscPrintf(0, "GN iteration %d: |g| = %g (surrogate)\n", m_numIterations, gnorm);
+
+  if ( gnorm <= m_dSurrogateSwitch*m_dInitialGradNorm ) {
+    PetscPrintf(0, "Surrogate gradient below %g of the initial gradient, switching to the full model\n", m_dSurrogateSwitch);
+    m_bSurrogateActive = false;
+    return false;
+  }
+
+  // Newton step on the surrogate
+  m_bUseSurrogate = true;
+  KSPSolve(m_ksp, m_vecReducedGradient, m_vecControlStep);
+  m_bUseSurrogate = false;
+
+  double snorm;
+  VecNorm(m_vecControlStep, NORM_2, &snorm);
+  if (snorm > m_dTrustRadius) {
+    VecScale(m_vecControlStep, m_dTrustRadius/snorm);
+    snorm = m_dTrustRadius;
+  }
+
+  Vec trial;
+  vecPool::get(m_vecCurrentControl, &trial);
+  VecWAXPY(trial, -1.0, m_vecControlStep, m_vecCurrentControl);
+
+  double pred = Jr - surrogateGradient(trial, NULL);
+  double cost = computeCost(trial);
+  double actual = m_costFunctionValue - cost;
+  double rho = (pred > 0.0) ? actual/pred : -1.0;
+
+  PetscPrintf(0, "Trust region: radius %g, |s| = %g, predicted decrease %g, actual %g, rho = %g\n", m_dTrustRadius, snorm, pred, actual, rho);
+
+  if (rho < 0.25) {
+    m_dTrustRadius *= 0.25;
+  } else if ( (rho > 0.75) && (snorm >= 0.99*m_dTrustRadius) ) {
+    m_dTrustRadius *= 2.0;
+  }
+
+  if (rho > 0.1) {
+    VecCopy(trial, m_vecCurrentControl);
+    m_costFunctionValue = cost;
+    m_iRejected = 0;
+  } else {
+    // the current control and cost are unchanged
+    VecZeroEntries(m_vecControlStep);
+    if (++m_iRejected == 2) {
+      PetscPrintf(0, "Surrogate steps rejected, switching to the full model\n");
+      m_bSurrogateActive = false;
+    }
+  }
+  vecPool::restore(trial);
+
+  return true;
+}
+
+/**
+ *	@brief projects the full model onto the current POD basis.
+ **/
+#undef __FUNCT__
+#define __FUNCT__ "pActInv_setupSurrogate"
+int parametricActivationInverse::setupSurrogate() {
+  newmark *ts = (newmark *)m_ts;
+  m_pod->setTimeStepper(ts);
+
+  cardiacDynamic *Fdynamic;
+  if ( !(m_ts->getMass()->getDAtype())) {
+    Fdynamic = new cardiacDynamic(feVec::PETSC);
+    Fdynamic->setDA(m_ts->getMass()->getDA());
+  } else {
+    Fdynamic = new cardiacDynamic(feVec::OCT);
+    Fdynamic->setDA(m_ts->getMass()->getOctDA());
+  }
+  Fdynamic->setProblemDimensions(1.0,1.0,1.0);
+  Fdynamic->setTimeInfo(m_ts->getTimeInfo());
+  Fdynamic->setDof(3);
+
+  Vec mask = (m_bUsePartialObservations) ? m_vecPartialObservations : NULL;
+  m_pod->project(Fdynamic, m_vecObservations, mask, m_vecForwardInitialDisplacement, m_vecForwardInitialVelocity);
+  delete Fdynamic;
+
+  // The force is linear in the activation, so the force at every timestep
+  // is a combination of the forces of the spatial basis functions.
+  cardiacFiberForce *cForce = (cardiacFiberForce *)ts->getForce();
+  unsigned int numForces = m_radialBasis.size();
+  for (unsigned int b=0; b<numForces; b+=8) {
+    unsigned int n = (b + 8 < numForces) ? 8 : numForces - b;
+    std::vector<Vec> g(n), f(n);
+    getSpatialBasis(b, g);
+    for (unsigned int i=0; i<n; i++) {
+      vecPool::get(m_vecForwardInitialDisplacement, &(f[i]));
+      VecZeroEntries(f[i]);
+    }
+    cForce->applyBatched(g, f);
+    m_pod->projectForces(f, b, numForces);
+    vecPool::restore(g);
+    vecPool::restore(f);
+  }
+
+  return(0);
+}
+
+/**
+ *	@brief cost and (if grad is not NULL) reduced gradient of the surrogate, same scaling as setReducedGradient().
+ **/
+#undef __FUNCT__
+#define __FUNCT__ "pActInv_surrogateGradient"
+double parametricActivationInverse::surrogateGradient(Vec control, Vec grad) {
+  std::vector<double> coef, z, fAdj;
+
+  paramsToCoef(control, coef);
+  m_pod->forward(coef, false, z);
+  double misfit = m_pod->residual(z, true, fAdj);
+
+  if (grad != NULL) {
+    m_pod->adjoint(fAdj, coef);
+    coefToParams(coef, grad);
+    VecScale(grad, -1.0);
+    VecAXPY(grad, m_beta, control);
+  }
+
+  double cnorm;
+  VecNorm(control, NORM_2, &cnorm);
+  return 0.5*misfit*m_ts->getTimeInfo()->step + 0.5*m_beta*cnorm*cnorm;
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "pActInv_surrogateHessianMatMult"
+void parametricActivationInverse::surrogateHessianMatMult(Vec In, Vec Out) {
+  std::vector<double> coef, z, fAdj;
+
+  paramsToCoef(In, coef);
+  m_pod->forward(coef, true, z);
+  m_pod->residual(z, false, fAdj);
+  m_pod->adjoint(fAdj, coef);
+  coefToParams(coef, Out);
+
+  VecScale(Out, -1.0);
+  VecAXPY(Out, m_beta, In);
+}
+
+/**
+ *	@brief coefficients of the spatial basis functions at every timestep, (NT+1) x numBasis.
+ **/
+void parametricActivationInverse::paramsToCoef(Vec params, std::vector<double> &coef) {
+  timeInfo *ti = m_ts->getTimeInfo();
+  unsigned int numSteps = (unsigned int)(ceil(( ti->stop - ti->start)/ti->step));
+  unsigned int numBasis = m_radialBasis.size();
+  int knotsize = m_bsplineBasis.getNumKnots();
+
+  PetscScalar *pVec;
+  VecGetArray(params, &pVec);
+  double *currBasis = new double[knotsize];
+
+  coef.assign((numSteps+1)*numBasis, 0.0);
+  for (unsigned int t=0; t<numSteps+1; t++) {
+    m_bsplineBasis.basis(ti->start + t*ti->step, currBasis);
+    for (unsigned int b=0; b<numBasis; b++) {
+      for (int r=0; r<knotsize; r++) {
+        coef[t*numBasis + b] += currBasis[r]*pVec[b*knotsize + r];
+      }
+    }
+  }
+
+  delete [] currBasis;
+  VecRestoreArray(params, &pVec);
+}
+
+/**
+ *	@brief the transpose of paramsToCoef, with the time integration weights as in addAdjoint().
+ **/
+void parametricActivationInverse::coefToParams(std::vector<double> &coef, Vec params) {
+  timeInfo *ti = m_ts->getTimeInfo();
+  unsigned int numSteps = (unsigned int)(ceil(( ti->stop - ti->start)/ti->step));
+  unsigned int numBasis = m_radialBasis.size();
+  int knotsize = m_bsplineBasis.getNumKnots();
+
+  VecZeroEntries(params);
+  PetscScalar *pVec;
+  VecGetArray(params, &pVec);
+  double *currBasis = new double[knotsize];
+
+  for (unsigned int t=0; t<numSteps+1; t++) {
+    m_bsplineBasis.basis(ti->start + t*ti->step, currBasis);
+    for (unsigned int b=0; b<numBasis; b++) {
+      for (int r=0; r<knotsize; r++) {
+        pVec[b*knotsize + r] += ti->step*currBasis[r]*coef[t*numBasis + b];
+      }
+    }
+  }
+
+  delete [] currBasis;
+  VecRestoreArray(params, &pVec);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "pActInv_getSpatialBasis"
+void parametricActivationInverse::getSpatialBasis(unsigned int first, std::vector<Vec> &g) {
+  perfLog::begin(perfLog::BASIS_EVAL);
+
+  for (unsigned int b=0; b<g.size(); b++) {
+    vecPool::get(getScalarTemplate(), &(g[b]));
+  }
+
+  if ( !(m_ts->getMass()->getDAtype()) ) { // PetSc
+    PetscScalar ***arr;
+    int x, y, z, m, n, p;
+    int mx,my,mz;
+
+    DAGetCorners(m_daScalar, &x, &y, &z, &m, &n, &p);
+    DAGetInfo(m_daScalar, 0, &mx, &my, &mz, 0,0,0,0,0,0,0);
+
+    double hx = 1.0/(mx-1.0);
+
+    for (unsigned int b=0; b<g.size(); b++) {
+      DAVecGetArray(m_daScalar, g[b], &arr);
+      for (int k = z; k < z + p ; k++) {
+        for (int j = y; j < y + n; j++) {
+          for (int i = x; i < x + m; i++) {
+            Point px(i,j,k);
+            px *= hx;
+            arr[k][j][i] = m_radialBasis[first + b].getValue(px);
+          }
+        }
+      }
+      DAVecRestoreArray(m_daScalar, g[b], &arr);
+    }
+  } else { // OTK
+    ot::DA *da = m_ts->getMass()->getOctDA();
+    PetscScalar *arr;
+
+    unsigned int maxD = da->getMaxDepth();
+
+    for (unsigned int b=0; b<g.size(); b++) {
+      da->vecGetBuffer(g[b], arr, false, true, false, 1);
+      for ( da->init<ot::DA::ALL>(), da->init<ot::DA::WRITABLE>(); da->curr() < da->end<ot::DA::ALL>(); da->next<ot::DA::ALL>()) {
+        unsigned int i = da->curr();
+        Point pt;
+        pt = da->getCurrentOffset();
+
+        double x = (double)(pt.xint())/((double)(1<<(maxD-1)));
+        double y = (double)(pt.yint())/((double)(1<<(maxD-1)));
+        double z = (double)(pt.zint())/((double)(1<<(maxD-1)));
+
+        Point px(x,y,z);
+        arr[i] = m_radialBasis[first + b].getValue(px);
+      }
+      da->vecRestoreBuffer(g[b], arr, false, true, false, 1);
+    }
+  }
+
+  perfLog::end(perfLog::BASIS_EVAL);
 }
 
 #endif
@@ -23,6 +23,9 @@ class parametricElasInverse : public inverseSolver {
 public:
 
   parametricElasInverse() {
+    m_vecForwardInitialDisplacement = NULL;
+    m_vecForwardInitialVelocity = NULL;
+    m_vecForceTemplate = NULL;
   }
 
   ~parametricElasInverse() {
@@ -37,6 +40,11 @@ public:
     CHKERRQ(MatDestroy(m_matReducedHessian));
     CHKERRQ(KSPDestroy(m_ksp));
 
+    if (m_vecForceTemplate != NULL) {
+      CHKERRQ(VecDestroy(m_vecForceTemplate));
+      m_vecForceTemplate = NULL;
+    }
+
     return true;
   }
 
@@ -49,8 +57,10 @@ public:
   virtual bool setReducedGradient();
 
   void setForwardInitialConditions(Vec initDisp, Vec initVel) {
-    VecDuplicate(initDisp, &m_vecForwardInitialDisplacement);
-    VecDuplicate(initVel, &m_vecForwardInitialVelocity);
+    if (m_vecForwardInitialDisplacement == NULL)
+      VecDuplicate(initDisp, &m_vecForwardInitialDisplacement);
+    if (m_vecForwardInitialVelocity == NULL)
+      VecDuplicate(initVel, &m_vecForwardInitialVelocity);
     VecCopy(initDisp, m_vecForwardInitialDisplacement);
     VecCopy(initVel, m_vecForwardInitialVelocity);
   }
@@ -102,6 +112,9 @@ protected:
   Vec m_vecForwardInitialDisplacement;
   Vec m_vecForwardInitialVelocity;
 
+  // layout of the forces, used to get them from the vecPool
+  Vec m_vecForceTemplate;
+
 
 
 };
@@ -211,12 +224,11 @@ bool parametricElasInverse::setReducedGradient() {
   cardiacDynamic *Fdynamic = new cardiacDynamic(feVec::PETSC);
 
   // Solver 
-  newmark *ts = new newmark;
+  newmark *ts = (newmark *)m_ts;
 
 
 
   // Forward solve
-  ts = (newmark *)m_ts;
   ts->setAdjoint(false);
 
   ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
@@ -252,7 +264,7 @@ bool parametricElasInverse::setReducedGradient() {
   // Now can clear memory ...
   for (unsigned int i=0; i<currControl.size(); i++) {
     if (currControl[i] != NULL) {
-      VecDestroy(currControl[i]);
+      vecPool::restore(currControl[i]);
     }
   }
   currControl.clear();
@@ -290,8 +302,8 @@ bool parametricElasInverse::setReducedGradient() {
 
   // set initial conditions for adjoint ...
   Vec initD, initV;
-  VecDuplicate(m_vecForwardInitialDisplacement, &initD);
-  VecDuplicate(m_vecForwardInitialDisplacement, &initV);
+  vecPool::get(m_vecForwardInitialDisplacement, &initD);
+  vecPool::get(m_vecForwardInitialDisplacement, &initV);
   VecZeroEntries(initD);
   VecZeroEntries(initV);
   ts->setInitialDisplacement(initD); 
@@ -306,7 +318,7 @@ bool parametricElasInverse::setReducedGradient() {
   // clear memory ...
   for (unsigned int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
   solvec.clear();
@@ -321,7 +333,7 @@ bool parametricElasInverse::setReducedGradient() {
   // clear memory ...
   for (unsigned int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
   solvec.clear();
@@ -336,8 +348,10 @@ bool parametricElasInverse::setReducedGradient() {
   VecNorm(m_vecReducedGradient,NORM_2,&norm);
   PetscPrintf(0,"norm of reduced Gradient = %f\n", norm);
 #endif
-  VecDestroy(initD);
-  VecDestroy(initV);
+  ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+  ts->setInitialVelocity(m_vecForwardInitialVelocity);
+  vecPool::restore(initD);
+  vecPool::restore(initV);
 
   PetscPrintf(0, "Finished setting reduced gradient\n");
   return true;
@@ -354,14 +368,12 @@ void parametricElasInverse::hessianMatMult(Vec In, Vec Out) {
   // std::cout << "Entering HMM" << std::endl;
   VecZeroEntries(Out);
 
-  newmark *ts = new newmark;
+  newmark *ts = (newmark *)m_ts;
 
   // Fdynamic which is the control 
   cardiacDynamic *Fdynamic = new cardiacDynamic(feVec::PETSC);
 
   // Forward solve
-  ts = (newmark *)m_ts;
-
   ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
   ts->setInitialVelocity(m_vecForwardInitialVelocity);
 
@@ -391,7 +403,7 @@ void parametricElasInverse::hessianMatMult(Vec In, Vec Out) {
   // Now can clear memory ...
   for (unsigned int i=0; i<currControl.size(); i++) {
     if (currControl[i] != NULL) {
-      VecDestroy(currControl[i]);
+      vecPool::restore(currControl[i]);
     }
   }
   currControl.clear();
@@ -416,8 +428,8 @@ void parametricElasInverse::hessianMatMult(Vec In, Vec Out) {
 
   // set initial conditions for adjoint ...
   Vec initD, initV;
-  VecDuplicate(m_vecForwardInitialDisplacement, &initD);
-  VecDuplicate(m_vecForwardInitialDisplacement, &initV);
+  vecPool::get(m_vecForwardInitialDisplacement, &initD);
+  vecPool::get(m_vecForwardInitialDisplacement, &initV);
   VecZeroEntries(initD);
   VecZeroEntries(initV);
   ts->setInitialDisplacement(initD); 
@@ -430,7 +442,7 @@ void parametricElasInverse::hessianMatMult(Vec In, Vec Out) {
   // clear memory ...
   for (unsigned int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
   solvec.clear();
@@ -444,7 +456,7 @@ void parametricElasInverse::hessianMatMult(Vec In, Vec Out) {
   // clear memory ...
   for (unsigned int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
   solvec.clear();
@@ -455,8 +467,10 @@ void parametricElasInverse::hessianMatMult(Vec In, Vec Out) {
   // add the contribution of the regularization parameter
   VecAXPY(Out, m_beta, In);
   // std::cout << GRN"Leaving "NRM << __func__ << std::endl;
-  VecDestroy(initD);
-  VecDestroy(initV);
+  ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+  ts->setInitialVelocity(m_vecForwardInitialVelocity);
+  vecPool::restore(initD);
+  vecPool::restore(initV);
 }
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -478,7 +492,7 @@ void parametricElasInverse::getForces(Vec params, std::vector<Vec> &forces) {
   // Clear the Forces
   for (unsigned int i=0; i<forces.size(); i++) {
     if (forces[i] != NULL) {
-      VecDestroy(forces[i]);
+      vecPool::restore(forces[i]);
     }
   }
   forces.clear();
@@ -495,10 +509,13 @@ void parametricElasInverse::getForces(Vec params, std::vector<Vec> &forces) {
     unsigned int numSteps = (unsigned int)(ceil(( ti->stop - ti->start)/ti->step));
     PetscScalar ***tauArray; 
 
+    if (m_vecForceTemplate == NULL)
+      DACreateGlobalVector(da, &m_vecForceTemplate);
+
     // create and initialize to 0
     for (unsigned int i=0; i<numSteps+1; i++) {
       Vec tmp;
-      DACreateGlobalVector(da, &tmp);
+      vecPool::get(m_vecForceTemplate, &tmp);
       VecZeroEntries(tmp);
       forces.push_back(tmp);
     }
@@ -558,10 +575,13 @@ void parametricElasInverse::getForces(Vec params, std::vector<Vec> &forces) {
     unsigned int numSteps = (unsigned int)(ceil(( ti->stop - ti->start)/ti->step));
     PetscScalar *tauArray; 
 
+    if (m_vecForceTemplate == NULL)
+      da->createVector(m_vecForceTemplate, false, true, 3);
+
     // create and initialize to 0
     for (unsigned int i=0; i<numSteps+1; i++) {
       Vec tmp;
-      da->createVector(tmp, false, true, 3);
+      vecPool::get(m_vecForceTemplate, &tmp);
       VecZeroEntries(tmp);
       forces.push_back(tmp);
     }
@@ -661,7 +681,7 @@ void parametricElasInverse::getParams(std::vector<Vec> forces, Vec params) {
   std::vector<Vec> ibldt;
   for (int i=0; i<knotsize; i++) {
     Vec tmp;
-    VecDuplicate(forces[i], &tmp);
+    vecPool::get(forces[i], &tmp);
     VecZeroEntries(tmp);
     ibldt.push_back(tmp);
   }
@@ -751,6 +771,7 @@ void parametricElasInverse::getParams(std::vector<Vec> forces, Vec params) {
   }
 
   delete [] currBasis;
+  vecPool::restore(ibldt);
   MPI_Barrier(MPI_COMM_WORLD);
 
   // update copies on all ...
@@ -20,7 +20,11 @@ class parametricWaveInverse : public inverseSolver {
 
 public:
 
-  parametricWaveInverse() { m_bComputeBasisOnTheFly = true;}
+  parametricWaveInverse() {
+    m_bComputeBasisOnTheFly = true;
+    m_vecForwardInitialDisplacement = NULL;
+    m_vecForwardInitialVelocity = NULL;
+  }
 
   ~parametricWaveInverse() {}
 
@@ -44,8 +48,10 @@ public:
   virtual bool setReducedGradient();
 
   void setForwardInitialConditions(Vec initDisp, Vec initVel) {
-    VecDuplicate(initDisp, &m_vecForwardInitialDisplacement);
-    VecDuplicate(initVel, &m_vecForwardInitialVelocity);
+    if (m_vecForwardInitialDisplacement == NULL)
+      VecDuplicate(initDisp, &m_vecForwardInitialDisplacement);
+    if (m_vecForwardInitialVelocity == NULL)
+      VecDuplicate(initVel, &m_vecForwardInitialVelocity);
     VecCopy(initDisp, m_vecForwardInitialDisplacement);
     VecCopy(initVel, m_vecForwardInitialVelocity);
   }
@@ -208,13 +214,11 @@ bool parametricWaveInverse::setReducedGradient()
   fdynamicVector *Fdynamic = new fdynamicVector(feVec::PETSC);
 
   // Solver 
-  newmark *ts = new newmark;
+  newmark *ts = (newmark *)m_ts;
 
+  // Forward solve
   ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
   ts->setInitialVelocity(m_vecForwardInitialVelocity);
-
-  // Forward solve
-  ts = (newmark *)m_ts;
   ts->setAdjoint(false);
 
   ts->setTimeFrames(1);
@@ -248,7 +252,7 @@ bool parametricWaveInverse::setReducedGradient()
    // Now can clear memory ...
   for (int i=0; i<currControl.size(); i++) {
     if (currControl[i] != NULL) {
-      VecDestroy(currControl[i]);
+      vecPool::restore(currControl[i]);
     }
   }
 
@@ -305,8 +309,8 @@ bool parametricWaveInverse::setReducedGradient()
 
   // set initial conditions for adjoint ...
   Vec initD, initV;
-  VecDuplicate(m_vecForwardInitialDisplacement, &initD);
-  VecDuplicate(m_vecForwardInitialDisplacement, &initV);
+  vecPool::get(m_vecForwardInitialDisplacement, &initD);
+  vecPool::get(m_vecForwardInitialDisplacement, &initV);
   VecZeroEntries(initD);
   VecZeroEntries(initV);
   ts->setInitialDisplacement(initD); 
@@ -321,7 +325,7 @@ bool parametricWaveInverse::setReducedGradient()
   // clear memory ...
   for (int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
 
@@ -337,7 +341,7 @@ bool parametricWaveInverse::setReducedGradient()
   // clear memory ...
   for (int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
 
@@ -353,8 +357,10 @@ bool parametricWaveInverse::setReducedGradient()
   VecNorm(m_vecReducedGradient,NORM_2,&norm);
   PetscPrintf(0,"norm of reduced Gradient = %f\n", norm);
 #endif
-  VecDestroy(initD);
-  VecDestroy(initV);
+  ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+  ts->setInitialVelocity(m_vecForwardInitialVelocity);
+  vecPool::restore(initD);
+  vecPool::restore(initV);
 
   // std::cout << GRN"Leaving "NRM << __func__ << std::endl;
 
@@ -371,14 +377,12 @@ void parametricWaveInverse::hessianMatMult(Vec In, Vec Out)
   // std::cout << RED"Entering "NRM << __func__ << std::endl;
   VecZeroEntries(Out);
 
-  newmark *ts = new newmark;
+  newmark *ts = (newmark *)m_ts;
 
   // Fdynamic which is the control 
   fdynamicVector *Fdynamic = new fdynamicVector(feVec::PETSC);
 
   // Forward solve
-  ts = (newmark *)m_ts;
-
   ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
   ts->setInitialVelocity(m_vecForwardInitialVelocity);
 
@@ -410,7 +414,7 @@ void parametricWaveInverse::hessianMatMult(Vec In, Vec Out)
    // Now can clear memory ...
   for (int i=0; i<currControl.size(); i++) {
     if (currControl[i] != NULL) {
-      VecDestroy(currControl[i]);
+      vecPool::restore(currControl[i]);
     }
   }
 
@@ -445,8 +449,8 @@ void parametricWaveInverse::hessianMatMult(Vec In, Vec Out)
 
   // set initial conditions for adjoint ...
   Vec initD, initV;
-  VecDuplicate(m_vecForwardInitialDisplacement, &initD);
-  VecDuplicate(m_vecForwardInitialDisplacement, &initV);
+  vecPool::get(m_vecForwardInitialDisplacement, &initD);
+  vecPool::get(m_vecForwardInitialDisplacement, &initV);
   VecZeroEntries(initD);
   VecZeroEntries(initV);
   ts->setInitialDisplacement(initD); 
@@ -459,7 +463,7 @@ void parametricWaveInverse::hessianMatMult(Vec In, Vec Out)
   // clear memory ...
   for (int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
 
@@ -473,7 +477,7 @@ void parametricWaveInverse::hessianMatMult(Vec In, Vec Out)
   // clear memory ...
   for (int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
 
@@ -487,8 +491,10 @@ void parametricWaveInverse::hessianMatMult(Vec In, Vec Out)
   // add the contribution of the regularization parameter
   VecAXPY(Out, m_beta, In);
   // std::cout << GRN"Leaving "NRM << __func__ << std::endl;
-  VecDestroy(initD);
-  VecDestroy(initV);
+  ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+  ts->setInitialVelocity(m_vecForwardInitialVelocity);
+  vecPool::restore(initD);
+  vecPool::restore(initV);
 }
 
 // Functions to hanlde the full / parametrized representations
@@ -505,7 +511,7 @@ void parametricWaveInverse::getForces(Vec params, std::vector<Vec> &forces) {
   // Clear the Forces
   for (unsigned int i=0; i<forces.size(); i++) {
     if (forces[i] != NULL) {
-      VecDestroy(forces[i]);
+      vecPool::restore(forces[i]);
     }
   }
   forces.clear();
@@ -514,7 +520,7 @@ void parametricWaveInverse::getForces(Vec params, std::vector<Vec> &forces) {
     // create and initialize to alpha_0 * Basis_0
     for (unsigned int i=0; i<m_forceBasis[0].size(); i++) {
       Vec tmp;
-      VecDuplicate(m_forceBasis[0][i], &tmp);
+      vecPool::get(m_forceBasis[0][i], &tmp);
       VecZeroEntries(tmp);
       VecAXPY(tmp, pVec[0], m_forceBasis[0][i]);
       forces.push_back(tmp);
@@ -531,10 +537,10 @@ void parametricWaveInverse::getForces(Vec params, std::vector<Vec> &forces) {
 
 
     unsigned int numSteps = (unsigned int)(ceil(( ti->stop - ti->start)/ti->step));
-    // create and initialize to 0
+    // create and initialize to 0, same layout as the state
     for (unsigned int i=0; i<numSteps+1; i++) {
       Vec tmp;
-      DACreateGlobalVector(da, &tmp);
+      vecPool::get(m_vecForwardInitialDisplacement, &tmp);
       VecZeroEntries(tmp);
       forces.push_back(tmp);
     }
@@ -0,0 +1,240 @@
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "perfLog.h"
+#include "vecPool.h"
+
+bool                                    perfLog::m_bInit = false;
+double                                  perfLog::m_dStartTime = 0.0;
+perfLog::phaseInfo                      perfLog::m_phases[perfLog::NUM_PHASES];
+std::map<std::string, perfLog::opInfo>  perfLog::m_ops;
+std::vector<int>                        perfLog::m_kspIts[perfLog::NUM_PHASES];
+std::vector<int>                        perfLog::m_kspSolves[perfLog::NUM_PHASES];
+int                                     perfLog::m_stages[perfLog::NUM_PHASES];
+PetscEvent                              perfLog::m_events[perfLog::NUM_PHASES];
+
+const char* perfLog::phaseName(phase p)
+{
+  switch (p) {
+    case FORWARD_SOLVE:   return "forward_solve";
+    case ADJOINT_SOLVE:   return "adjoint_solve";
+    case HESSIAN_MATVEC:  return "hessian_matvec";
+    case FORCE_ASSEMBLY:  return "force_assembly";
+    case MONITOR_IO:      return "monitor_io";
+    case BASIS_EVAL:      return "basis_eval";
+    default:              return "unknown";
+  }
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "perfLog_init"
+int perfLog::init()
+{
+  int ierr;
+  PetscCookie cookie;
+
+  for (int i=0; i<NUM_PHASES; i++) {
+    m_phases[i].time  = 0.0;
+    m_phases[i].start = 0.0;
+    m_phases[i].depth = 0;
+    m_phases[i].calls = 0;
+    m_stages[i] = -1;
+  }
+
+  ierr = PetscLogClassRegister(&cookie, "Inverse"); CHKERRQ(ierr);
+  for (int i=0; i<NUM_PHASES; i++) {
+    ierr = PetscLogEventRegister(&(m_events[i]), phaseName((phase)i), cookie); CHKERRQ(ierr);
+  }
+
+  // stages only for the solves, the rest are events within these.
+  ierr = PetscLogStageRegister(&(m_stages[FORWARD_SOLVE]), "Forward Solve"); CHKERRQ(ierr);
+  ierr = PetscLogStageRegister(&(m_stages[ADJOINT_SOLVE]), "Adjoint Solve"); CHKERRQ(ierr);
+  ierr = PetscLogStageRegister(&(m_stages[HESSIAN_MATVEC]), "Hessian MatVec"); CHKERRQ(ierr);
+
+  m_dStartTime = MPI_Wtime();
+  m_bInit = true;
+  return(0);
+}
+
+void perfLog::begin(phase p)
+{
+  if ( m_phases[p].depth++ == 0 ) {
+    m_phases[p].start = MPI_Wtime();
+    m_phases[p].calls++;
+  }
+  if (m_bInit) {
+    if (m_stages[p] >= 0)
+      PetscLogStagePush(m_stages[p]);
+    PetscLogEventBegin(m_events[p],0,0,0,0);
+  }
+}
+
+void perfLog::end(phase p)
+{
+  if (m_bInit) {
+    PetscLogEventEnd(m_events[p],0,0,0,0);
+    if (m_stages[p] >= 0)
+      PetscLogStagePop();
+  }
+  if ( --m_phases[p].depth == 0 ) {
+    m_phases[p].time += MPI_Wtime() - m_phases[p].start;
+  }
+}
+
+void perfLog::matVec(const char *op, double bytes, double time)
+{
+  opInfo &info = m_ops[op];
+  info.calls++;
+  info.bytes += bytes;
+  info.time  += time;
+}
+
+void perfLog::kspIterations(phase p, unsigned int step, int its)
+{
+  if ( m_kspIts[p].size() <= step ) {
+    m_kspIts[p].resize(step+1, 0);
+    m_kspSolves[p].resize(step+1, 0);
+  }
+  m_kspIts[p][step] += its;
+  m_kspSolves[p][step]++;
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "perfLog_summary"
+int perfLog::summary(const char *prefix, MPI_Comm comm)
+{
+  int rank, npes;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &npes);
+
+  double wtime = MPI_Wtime() - m_dStartTime;
+  double wtimeMax;
+  MPI_Reduce(&wtime, &wtimeMax, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+
+  // phases ...
+  double ptime[NUM_PHASES], ptimeMax[NUM_PHASES], ptimeSum[NUM_PHASES];
+  for (int i=0; i<NUM_PHASES; i++) {
+    ptime[i] = m_phases[i].time;
+  }
+  MPI_Reduce(ptime, ptimeMax, NUM_PHASES, MPI_DOUBLE, MPI_MAX, 0, comm);
+  MPI_Reduce(ptime, ptimeSum, NUM_PHASES, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+  // operators, reduced across the processors only if they all have the
+  // operators of rank 0, in the same order
+  int numOps = m_ops.size();
+  std::string keys;
+  for (std::map<std::string, opInfo>::iterator it = m_ops.begin(); it != m_ops.end(); it++) {
+    keys += it->first;
+    keys += '\n';
+  }
+  int keyLen = keys.size();
+  MPI_Bcast(&keyLen, 1, MPI_INT, 0, comm);
+  std::vector<char> rootKeys(keyLen+1);
+  if (!rank) {
+    memcpy(&(*(rootKeys.begin())), keys.c_str(), keyLen);
+  }
+  MPI_Bcast(&(*(rootKeys.begin())), keyLen, MPI_CHAR, 0, comm);
+  int sameKeys = ( (keyLen == (int)keys.size()) && !memcmp(&(*(rootKeys.begin())), keys.c_str(), keyLen) ) ? 1 : 0;
+  int allSameKeys;
+  MPI_Allreduce(&sameKeys, &allSameKeys, 1, MPI_INT, MPI_MIN, comm);
+
+  std::vector<double> opData(3*numOps+1), opMax(3*numOps+1), opSum(3*numOps+1);
+  int cnt = 0;
+  for (std::map<std::string, opInfo>::iterator it = m_ops.begin(); it != m_ops.end(); it++, cnt++) {
+    opData[3*cnt]   = it->second.calls;
+    opData[3*cnt+1] = it->second.bytes;
+    opData[3*cnt+2] = it->second.time;
+  }
+  if (allSameKeys) {
+    MPI_Reduce(&(*(opData.begin())), &(*(opMax.begin())), 3*numOps, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(&(*(opData.begin())), &(*(opSum.begin())), 3*numOps, MPI_DOUBLE, MPI_SUM, 0, comm);
+  } else {
+    // different operators on different processors, report rank 0 only.
+    if (!rank) {
+      std::cerr << "perfLog: the operators differ across processors, reporting those of rank 0 only" << std::endl;
+    }
+    opMax = opData;
+    opSum = opData;
+  }
+
+  // Vec pool, max over processors
+  const vecPool::counters &pool = vecPool::getCounters();
+  long poolData[4] = {pool.created, pool.checkouts, pool.returns, pool.peak};
+  long poolMax[4];
+  MPI_Reduce(poolData, poolMax, 4, MPI_LONG, MPI_MAX, 0, comm);
+
+  if (rank)
+    return(0);
+
+  char fname[PETSC_MAX_PATH_LEN];
+
+  // JSON ...
+  sprintf(fname, "%s.perf.json", prefix);
+  std::ofstream out(fname);
+  out << std::setprecision(6);
+  out << "{" << std::endl;
+  out << "  \"npes\": " << npes << "," << std::endl;
+  out << "  \"wall_time\": " << wtimeMax << "," << std::endl;
+
+  out << "  \"phases\": {" << std::endl;
+  for (int i=0; i<NUM_PHASES; i++) {
+    out << "    \"" << phaseName((phase)i) << "\": { \"calls\": " << m_phases[i].calls
+      << ", \"time_max\": " << ptimeMax[i] << ", \"time_avg\": " << ptimeSum[i]/npes << " }"
+      << ((i < NUM_PHASES-1) ? "," : "") << std::endl;
+  }
+  out << "  }," << std::endl;
+
+  out << "  \"operators\": {" << std::endl;
+  cnt = 0;
+  for (std::map<std::string, opInfo>::iterator it = m_ops.begin(); it != m_ops.end(); it++, cnt++) {
+    out << "    \"" << it->first << "\": { \"matvecs\": " << (long)opMax[3*cnt]
+      << ", \"bytes_estimate\": " << opSum[3*cnt+1] << ", \"time_max\": " << opMax[3*cnt+2] << " }"
+      << ((cnt < numOps-1) ? "," : "") << std::endl;
+  }
+  out << "  }," << std::endl;
+
+  out << "  \"ksp_iterations\": {" << std::endl;
+  for (int i=FORWARD_SOLVE; i<=ADJOINT_SOLVE; i++) {
+    out << "    \"" << phaseName((phase)i) << "\": [";
+    for (unsigned int t=0; t<m_kspIts[i].size(); t++) {
+      out << ((t) ? ", " : "") << m_kspIts[i][t];
+    }
+    out << "]" << ((i < ADJOINT_SOLVE) ? "," : "") << std::endl;
+  }
+  out << "  }," << std::endl;
+
+  out << "  \"vec_pool\": { \"created\": " << poolMax[0] << ", \"checkouts\": " << poolMax[1]
+    << ", \"returns\": " << poolMax[2] << ", \"peak\": " << poolMax[3] << " }" << std::endl;
+  out << "}" << std::endl;
+  out.close();
+
+  // CSV ...
+  sprintf(fname, "%s.perf.csv", prefix);
+  out.open(fname);
+  out << std::setprecision(6);
+  out << "section,name,index,calls,time_max,time_avg,bytes_estimate,iterations" << std::endl;
+  out << "run,wall_time,," << npes << "," << wtimeMax << ",,," << std::endl;
+  for (int i=0; i<NUM_PHASES; i++) {
+    out << "phase," << phaseName((phase)i) << ",," << m_phases[i].calls << ","
+      << ptimeMax[i] << "," << ptimeSum[i]/npes << ",," << std::endl;
+  }
+  cnt = 0;
+  for (std::map<std::string, opInfo>::iterator it = m_ops.begin(); it != m_ops.end(); it++, cnt++) {
+    out << "operator," << it->first << ",," << (long)opMax[3*cnt] << ","
+      << opMax[3*cnt+2] << "," << opSum[3*cnt+2]/npes << "," << opSum[3*cnt+1] << "," << std::endl;
+  }
+  for (int i=FORWARD_SOLVE; i<=ADJOINT_SOLVE; i++) {
+    for (unsigned int t=0; t<m_kspIts[i].size(); t++) {
+      out << "ksp," << phaseName((phase)i) << "," << t << "," << m_kspSolves[i][t] << ",,,," << m_kspIts[i][t] << std::endl;
+    }
+  }
+  const char *poolNames[4] = {"created", "checkouts", "returns", "peak"};
+  for (int i=0; i<4; i++) {
+    out << "vec_pool," << poolNames[i] << ",," << poolMax[i] << ",,,," << std::endl;
+  }
+  out.close();
+
+  return(0);
+}
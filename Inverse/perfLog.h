@@ -0,0 +1,128 @@
+/**
+ *  @file   perfLog.h
+ *  @brief  Light-weight, always-on performance instrumentation for the Inverse drivers.
+ *  @author Hari Sundar
+ *  @date   2/14/08
+ *
+ *  Accumulates wall-clock time for the main phases of the inverse problem
+ *  (forward solve, adjoint solve, Hessian matvec, force assembly, monitor I/O
+ *  and basis evaluation), MatVec counts and an estimate of the bytes moved per
+ *  operator, and the KSP iterations per timestep. The bytes are a model, not a
+ *  measurement (e.g., three local Vecs per feMatrix MatVec), and are reported
+ *  as bytes_estimate. The counters only cost an
+ *  MPI_Wtime() call and a few additions per event, so they are always enabled.
+ *
+ *  If PETSc has been built with logging, the phases are also registered as
+ *  PETSc log stages/events so that they show up in -log_summary.
+ *
+ *  At the end of the run summary() writes <prefix>.perf.json and
+ *  <prefix>.perf.csv, with timings reduced (max/avg) across processors,
+ *  together with the counters of the vecPool.
+ *
+ *  Phases are inclusive, e.g., the Hessian matvec time includes the time of the
+ *  forward and adjoint solves it performs.
+ **/
+
+#ifndef _PERF_LOG_H_
+#define _PERF_LOG_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mpi.h"
+#include "petsc.h"
+
+class perfLog {
+  public:
+    enum phase {
+      FORWARD_SOLVE = 0,
+      ADJOINT_SOLVE,
+      HESSIAN_MATVEC,
+      FORCE_ASSEMBLY,
+      MONITOR_IO,
+      BASIS_EVAL,
+      NUM_PHASES
+    };
+
+    /**
+     *  @brief Registers the PETSc log stages and events, call after PetscInitialize.
+     **/
+    static int init();
+
+    /**
+     *  @brief Start and stop timing a phase. Calls can be nested.
+     **/
+    static void begin(phase p);
+    static void end(phase p);
+
+    /**
+     *  @brief Times a phase for the lifetime of the object, so that the early
+     *  returns of CHKERRQ end the phase as well.
+     **/
+    class scope {
+      public:
+        scope(phase p) : m_phase(p) {
+          begin(p);
+        }
+        ~scope() {
+          end(m_phase);
+        }
+
+      private:
+        phase m_phase;
+    };
+
+    /**
+     *  @brief Records one MatVec of the named operator.
+     *  @param op     name of the operator
+     *  @param bytes  estimate of the bytes read and written, from a model of the operator
+     *  @param time   time taken by the MatVec
+     **/
+    static void matVec(const char *op, double bytes, double time);
+
+    /**
+     *  @brief Records the KSP iterations needed at a given timestep.
+     **/
+    static void kspIterations(phase p, unsigned int step, int its);
+
+    /**
+     *  @brief Writes the JSON and CSV summaries, collective on comm.
+     **/
+    static int summary(const char *prefix, MPI_Comm comm = MPI_COMM_WORLD);
+
+    static double now() {
+      return MPI_Wtime();
+    }
+
+    static const char* phaseName(phase p);
+
+  protected:
+    struct phaseInfo {
+      double  time;
+      double  start;
+      int     depth;
+      int     calls;
+    };
+
+    struct opInfo {
+      int     calls;
+      double  bytes;
+      double  time;
+    };
+
+    static bool                           m_bInit;
+    static double                         m_dStartTime;
+    static phaseInfo                      m_phases[NUM_PHASES];
+    static std::map<std::string, opInfo>  m_ops;
+
+    // indexed by timestep
+    static std::vector<int>               m_kspIts[NUM_PHASES];
+    static std::vector<int>               m_kspSolves[NUM_PHASES];
+
+    // PETSc logging
+    static int                            m_stages[NUM_PHASES];
+    static PetscEvent                     m_events[NUM_PHASES];
+};
+
+#endif
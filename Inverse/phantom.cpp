@@ -0,0 +1,170 @@
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "phantom.h"
+
+phantom::phantom(shape s, unsigned int Ns, unsigned int Nt, double forceFactor)
+{
+  m_shape = s;
+  m_uiNs = Ns;
+  m_uiNt = Nt;
+  m_dForceFactor = forceFactor;
+  m_iCenter = Ns/2;
+
+  switch (m_shape) {
+    case CMAME:
+      m_uiHeight = 4*Ns/5;
+      m_uiRadiusOuter = (unsigned int)(Ns/2.5);
+      m_uiRadiusInner = (unsigned int)(Ns/4.5);
+      m_uiZmin = Ns/10;
+      break;
+    default:
+      m_uiHeight = 3*Ns/5;
+      m_uiRadiusOuter = Ns/3;
+      m_uiRadiusInner = Ns/4;
+      m_uiZmin = Ns/5;
+  }
+}
+
+const char* phantom::shapeName(shape s)
+{
+  switch (s) {
+    case LV:            return "lv";
+    case LV_CYLINDER:   return "lvcyl";
+    case CMAME:         return "cmame";
+    default:            return "unknown";
+  }
+}
+
+bool phantom::inside(int i, int j, int k) const
+{
+  int kk = k - (int)m_uiZmin;
+  if ( (kk < 0) || (kk >= (int)m_uiHeight) )
+    return false;
+
+  double rr = sqrt((double)((i-m_iCenter)*(i-m_iCenter) + (j-m_iCenter)*(j-m_iCenter)));
+
+  if (m_shape == LV_CYLINDER) {
+    return ( (rr > m_uiRadiusInner) && (rr < m_uiRadiusOuter) );
+  }
+
+  // ellipsoidal shell
+  unsigned int ht2 = m_uiHeight - m_uiRadiusOuter + m_uiRadiusInner;
+  float fac = sqrt((1.0/m_uiHeight)*kk);
+  unsigned int r1 = (unsigned int)(fac*m_uiRadiusOuter);
+
+  bool _in = ( rr <= r1 );
+
+  if ( (unsigned int)kk > (m_uiRadiusOuter - m_uiRadiusInner) ) {
+    fac = sqrt((1.0/ht2)*(kk - m_uiRadiusOuter + m_uiRadiusInner));
+    unsigned int r2 = (unsigned int)(fac*m_uiRadiusInner);
+    if ( rr <= r2 )
+      _in = false;
+  }
+  return _in;
+}
+
+void phantom::fiber(int i, int j, int k, double *f) const
+{
+  f[0] = f[1] = f[2] = 0.0;
+
+  if ( !hasFibers() || !inside(i, j, k) )
+    return;
+
+  double rr = sqrt((double)((i-m_iCenter)*(i-m_iCenter) + (j-m_iCenter)*(j-m_iCenter)));
+  if (rr < 0.00001)
+    return;
+
+  double rm1 = m_uiRadiusOuter, rm2 = m_uiRadiusInner;
+
+  f[0] = -(j-m_iCenter)/rr;
+  f[1] = (i-m_iCenter)/rr;
+
+  if (m_shape == LV_CYLINDER) {
+    f[2] = (rr-rm2)/(rm1-rm2) - 0.5;
+  } else {
+    // stored in single precision, normalize in single precision as well
+    float ff[3];
+    ff[0] = f[0]; ff[1] = f[1];
+    ff[2] = 2*(rr-rm2)/(rm1-rm2) - 1.0;
+    double mag = sqrt(ff[0]*ff[0] + ff[1]*ff[1] + ff[2]*ff[2]);
+    if (mag > 0.001) {
+      ff[0] /= mag; ff[1] /= mag; ff[2] /= mag;
+    }
+    f[0] = ff[0]; f[1] = ff[1]; f[2] = ff[2];
+  }
+}
+
+double phantom::decay(unsigned int t) const
+{
+  unsigned int endSys = m_uiNt/3;
+
+  if (m_shape == LV) {
+    if ( t <= endSys )
+      return ((double)t)/endSys;
+    return ((double)(m_uiNt - t))/(2.0*endSys);
+  }
+
+  if ( t < endSys )
+    return ((double)t)/endSys;
+  return 1.0 - ((double)t - endSys)/(2*endSys);
+}
+
+void phantom::activation(int i, int j, int k, unsigned int t, double *a) const
+{
+  int dof = getDof();
+  for (int d=0; d<dof; d++)
+    a[d] = 0.0;
+
+  if ( !inside(i, j, k) )
+    return;
+
+  if (m_shape != LV) {
+    a[0] = 1000.0*decay(t);
+    return;
+  }
+
+  // radial force
+  double rr = sqrt((double)((i-m_iCenter)*(i-m_iCenter) + (j-m_iCenter)*(j-m_iCenter)));
+  if (rr > 0.00001) {
+    double fac = decay(t)*m_dForceFactor;
+    a[0] = fac*(-(double)(m_iCenter-i))/rr;
+    a[1] = fac*(-(double)(m_iCenter-j))/rr;
+  }
+}
+
+MPI_Offset phantom::frameOffset(int Ns, int Nt, int dof, int t)
+{
+  MPI_Offset frameSize = (MPI_Offset)Ns*Ns*Ns*dof*sizeof(double);
+  return sizeof(activationHeader) + Nt*sizeof(MPI_Offset) + t*frameSize;
+}
+
+bool phantom::readHeader(const char *fname, activationHeader &hdr)
+{
+  std::ifstream in(fname, std::ios::binary);
+  if ( !in.good() )
+    return false;
+  in.read((char *)&hdr, sizeof(activationHeader));
+  in.close();
+
+  return ( !strncmp(hdr.magic, PHANTOM_MAGIC, 8) );
+}
+
+bool phantom::readFrame(const char *fname, int t, double *buf)
+{
+  activationHeader hdr;
+  if ( !readHeader(fname, hdr) || (t < 0) || (t >= hdr.Nt) )
+    return false;
+
+  MPI_Offset off;
+  std::ifstream in(fname, std::ios::binary);
+  in.seekg(sizeof(activationHeader) + t*sizeof(MPI_Offset));
+  in.read((char *)&off, sizeof(MPI_Offset));
+  in.seekg(off);
+  in.read((char *)buf, (size_t)hdr.Ns*hdr.Ns*hdr.Ns*hdr.dof*sizeof(double));
+  bool ok = in.good();
+  in.close();
+
+  return ok;
+}
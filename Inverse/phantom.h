@@ -0,0 +1,120 @@
+/**
+ *  @file   phantom.h
+ *  @brief  Synthetic cardiac phantoms, evaluated pointwise.
+ *  @author Hari Sundar
+ *  @date   2/22/08
+ *
+ *  The geometries, fibers and activations generated by genLV, genLVfibers and
+ *  genCmameFibers, written as functions of the global voxel index (i,j,k) and
+ *  the timestep t. Since every value depends only on the global index, any
+ *  block of the volume can be generated independently, and the result does not
+ *  depend on the number of processors used.
+ *
+ *  The activations of all timesteps are stored in a single file, with a small
+ *  header and an index of the offsets of the frames,
+ *
+ *    activationHeader | offset[Nt] | frame 0 | frame 1 | ... | frame Nt-1
+ *
+ *  where each frame is a raw Ns^3 x dof array of doubles in the same (k,j,i)
+ *  order as the .fld files.
+ **/
+
+#ifndef _PHANTOM_H_
+#define _PHANTOM_H_
+
+#include "mpi.h"
+
+#define PHANTOM_MAGIC "PHNTACT"
+
+struct activationHeader {
+  char          magic[8];
+  int           version;
+  int           Ns;
+  int           Nt;
+  int           dof;
+};
+
+class phantom {
+  public:
+    enum shape {
+      LV = 0,          // ellipsoidal LV, radial (full) force, as genLV
+      LV_CYLINDER,     // cylindrical LV with fibers, as genLVfibers
+      CMAME            // ellipsoidal LV with fibers, as genCmameFibers
+    };
+
+    phantom(shape s, unsigned int Ns, unsigned int Nt, double forceFactor = 2.0);
+
+    /**
+     *  @brief true if the voxel is part of the myocardium
+     **/
+    bool inside(int i, int j, int k) const;
+
+    /**
+     *  @brief fiber orientation at the voxel, zero outside
+     **/
+    void fiber(int i, int j, int k, double *f) const;
+
+    /**
+     *  @brief activation (dof = 1) or force (dof = 3) at the voxel at timestep t
+     **/
+    void activation(int i, int j, int k, unsigned int t, double *a) const;
+
+    /**
+     *  @brief temporal profile of the activation
+     **/
+    double decay(unsigned int t) const;
+
+    /**
+     *  @brief number of components of the activation, 3 for the full force phantom
+     **/
+    int getDof() const {
+      return (m_shape == LV) ? 3 : 1;
+    }
+
+    bool hasFibers() const {
+      return (m_shape != LV);
+    }
+
+    /**
+     *  @brief fibers are stored in single precision for the CMAME phantom
+     **/
+    bool singlePrecisionFibers() const {
+      return (m_shape == CMAME);
+    }
+
+    static const char* shapeName(shape s);
+
+    /** @name Activation container **/
+    //@{
+    /**
+     *  @brief byte offset of frame t in the activation container
+     **/
+    static MPI_Offset frameOffset(int Ns, int Nt, int dof, int t);
+
+    /**
+     *  @brief reads the header of an activation container, returns false if the file is not one.
+     **/
+    static bool readHeader(const char *fname, activationHeader &hdr);
+
+    /**
+     *  @brief reads a complete frame of an activation container
+     *  @param buf should have Ns^3 x dof doubles
+     **/
+    static bool readFrame(const char *fname, int t, double *buf);
+    //@}
+
+  protected:
+    shape         m_shape;
+    unsigned int  m_uiNs;
+    unsigned int  m_uiNt;
+    double        m_dForceFactor;
+
+    // geometry, in voxels
+    unsigned int  m_uiHeight;
+    unsigned int  m_uiRadiusOuter;
+    unsigned int  m_uiRadiusInner;
+    unsigned int  m_uiZmin;
+    int           m_iCenter;
+};
+
+#endif
@@ -0,0 +1,641 @@
+/**
+ *  @file   podSurrogate.h
+ *  @brief  Reduced order (POD/Galerkin) model of the Newmark forward and adjoint problems.
+ *  @author Hari Sundar
+ *  @date   3/10/08
+ *
+ *  The reduced basis V is built from the states the time stepper stores in
+ *  its solution vector (getSolution()), using the method of snapshots. The
+ *  basis is updated incrementally, every new set of snapshots is combined
+ *  with the current modes (weighted by their singular values), so the
+ *  snapshots do not need to be kept.
+ *
+ *  project() computes the Galerkin projections of the mass, damping and
+ *  stiffness operators, of a set of force vectors (the forces of the
+ *  spatial basis functions of the parametrization), and of the misfit and
+ *  the adjoint right hand side. The reduced forward and adjoint problems are
+ *  then stepped with exactly the same Newmark scheme as newmark.h, using
+ *  dense r x r matrices replicated on all processors, i.e., O(r^2) per
+ *  timestep and no communication.
+ *
+ *  The partial observation mask, if any, is assumed to be 0/1.
+ **/
+
+#ifndef _POD_SURROGATE_H_
+#define _POD_SURROGATE_H_
+
+#include <cmath>
+#include <vector>
+
+#include "petscvec.h"
+#include "feMat.h"
+#include "feVec.h"
+#include "newmark.h"
+#include "cardiacDynamic.h"
+#include "vecPool.h"
+
+class podSurrogate {
+  public:
+    podSurrogate();
+    ~podSurrogate();
+
+    /**
+     *  @brief the time stepper, its matrices and time info are projected.
+     **/
+    void setTimeStepper(newmark *ts) {
+      m_ts = ts;
+    }
+
+    /**
+     *  @brief modes are kept until the relative energy left out is below tol^2.
+     **/
+    void setTolerance(double tol) {
+      m_dTolerance = tol;
+    }
+
+    void setMaxModes(int r) {
+      m_iMaxModes = r;
+    }
+
+    int getNumModes() {
+      return m_basis.size();
+    }
+
+    /**
+     *  @brief false if the basis has changed since the last project().
+     **/
+    bool isProjected() {
+      return m_bProjected;
+    }
+
+    /**
+     *  @brief updates the basis with a set of snapshots, the snapshots are not modified.
+     *
+     *  Every set is normalized to unit Frobenius norm, so that the forward and
+     *  the adjoint states contribute equally to the basis.
+     **/
+    int addSnapshots(std::vector<Vec> &snaps);
+
+    /**
+     *  @brief projects the operators and observations onto the current basis.
+     *  @param adjForce    the adjoint force operator, applied to the (masked) residual
+     *  @param obs         observations at timesteps 0 to NT
+     *  @param mask        partial observation mask, NULL for full observations
+     *  @param initDisp    initial displacement of the forward problem
+     *  @param initVel     initial velocity of the forward problem
+     **/
+    int project(cardiacDynamic *adjForce, std::vector<Vec> &obs, Vec mask, Vec initDisp, Vec initVel);
+
+    /**
+     *  @brief projects the forces f_b, b = first, ..., first+forces.size()-1, of the force coefficients.
+     *
+     *  Called after project(), the forces can be projected a few at a time.
+     **/
+    int projectForces(std::vector<Vec> &forces, int first, int numForces);
+
+    /**
+     *  @brief reduced forward solve.
+     *  @param coef   force coefficients, (NT+1) x numForces, the force at step t is sum_b coef[t][b] f_b
+     *  @param homogeneous zero initial conditions (Hessian products), instead of the projected ones
+     *  @param z      reduced displacements, (NT+1) x r
+     **/
+    int forward(std::vector<double> &coef, bool homogeneous, std::vector<double> &z);
+
+    /**
+     *  @brief the misfit 0.5*sum_t |Q(d_t - u_t)|^2 without the 0.5 and dt, and the adjoint force.
+     *  @param withData  if false the data is left out, i.e., the right hand side of a Hessian product
+     *  @param fAdj      reduced adjoint forces, (NT+1) x r
+     **/
+    double residual(std::vector<double> &z, bool withData, std::vector<double> &fAdj);
+
+    /**
+     *  @brief reduced adjoint solve, returns the projections f_b^T lambda_t, (NT+1) x numForces.
+     **/
+    int adjoint(std::vector<double> &fAdj, std::vector<double> &coefAdj);
+
+  protected:
+    int  clear();
+    void step(std::vector<double> &f, std::vector<double> &u0, std::vector<double> &v0, std::vector<double> &z);
+
+    // dense helpers, row-major n x n
+    static void symmetricEigen(std::vector<double> &A, int n, std::vector<double> &evals, std::vector<double> &evecs);
+    static void luFactor(std::vector<double> &A, int n, std::vector<int> &piv);
+    static void luSolve(std::vector<double> &LU, std::vector<int> &piv, int n, double *b);
+    static void matMult(std::vector<double> &A, int n, double *x, double *y, double scale);
+
+    newmark                *m_ts;
+
+    std::vector<Vec>        m_basis;
+    std::vector<double>     m_sigma;      // singular values of the modes
+
+    double                  m_dTolerance;
+    int                     m_iMaxModes;
+    bool                    m_bProjected;
+
+    // reduced operators, r x r
+    std::vector<double>     m_Mr, m_Cr, m_Kr;
+    std::vector<double>     m_jacLU, m_massLU;
+    std::vector<int>        m_jacPiv, m_massPiv;
+
+    // reduced forces, r x numForces
+    std::vector<double>     m_G;
+    int                     m_iNumForces;
+
+    // misfit z^T A z - 2 b_t^T z + c_t, adjoint force h_t - H z
+    std::vector<double>     m_A, m_H;
+    std::vector<double>     m_b, m_h, m_c;
+
+    // projected initial conditions
+    std::vector<double>     m_u0, m_v0;
+};
+
+podSurrogate::podSurrogate() {
+  m_ts = NULL;
+  m_dTolerance = 1e-3;
+  m_iMaxModes = 40;
+  m_bProjected = false;
+  m_iNumForces = 0;
+}
+
+podSurrogate::~podSurrogate() {
+  clear();
+}
+
+int podSurrogate::clear() {
+  vecPool::restore(m_basis);
+  m_sigma.clear();
+  m_bProjected = false;
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "podSurrogate_addSnapshots"
+int podSurrogate::addSnapshots(std::vector<Vec> &snaps) {
+  int ierr;
+  int r = m_basis.size();
+  int m = snaps.size();
+  if (!m)
+    return(0);
+  int n = r + m;
+
+  // correlation matrix of [V*Sigma, w*S]
+  std::vector<double> C(n*n, 0.0);
+  std::vector<double> dots(n);
+
+  double fro = 0.0;
+  for (int j=0; j<m; j++) {
+    ierr = VecMDot(snaps[j], j+1, &(snaps[0]), &(dots[0])); CHKERRQ(ierr);
+    for (int i=0; i<=j; i++) {
+      C[(r+i)*n + r+j] = C[(r+j)*n + r+i] = dots[i];
+    }
+    fro += dots[j];
+  }
+  if (fro <= 0.0)
+    return(0);
+  double w = 1.0/sqrt(fro);
+
+  for (int i=r; i<n; i++)
+    for (int j=r; j<n; j++)
+      C[i*n+j] *= w*w;
+
+  for (int i=0; i<r; i++) {
+    C[i*n+i] = m_sigma[i]*m_sigma[i];
+  }
+  for (int j=0; j<m && r; j++) {
+    ierr = VecMDot(snaps[j], r, &(m_basis[0]), &(dots[0])); CHKERRQ(ierr);
+    for (int i=0; i<r; i++) {
+      C[i*n + r+j] = C[(r+j)*n + i] = m_sigma[i]*w*dots[i];
+    }
+  }
+
+  std::vector<double> evals, evecs;
+  symmetricEigen(C, n, evals, evecs);
+
+  // truncate, the modes left out have less than tol^2 of the energy
+  double total = 0.0;
+  for (int k=0; k<n; k++)
+    total += (evals[k] > 0.0) ? evals[k] : 0.0;
+
+  int numModes = 0;
+  double energy = 0.0;
+  while ( (numModes < n) && (numModes < m_iMaxModes) && (evals[numModes] > 1e-14*evals[0]) ) {
+    energy += evals[numModes];
+    numModes++;
+    if (energy >= (1.0 - m_dTolerance*m_dTolerance)*total)
+      break;
+  }
+
+  // the new modes, V_k = [V*Sigma, w*S] u_k / sqrt(lambda_k)
+  std::vector<Vec> basis(numModes);
+  std::vector<double> sigma(numModes);
+  std::vector<double> alpha(n);
+  for (int k=0; k<numModes; k++) {
+    sigma[k] = sqrt(evals[k]);
+    for (int i=0; i<r; i++)
+      alpha[i] = m_sigma[i]*evecs[i*n+k]/sigma[k];
+    for (int j=0; j<m; j++)
+      alpha[r+j] = w*evecs[(r+j)*n+k]/sigma[k];
+
+    ierr = vecPool::get(snaps[0], &(basis[k])); CHKERRQ(ierr);
+    ierr = VecZeroEntries(basis[k]); CHKERRQ(ierr);
+    if (r) {
+      ierr = VecMAXPY(basis[k], r, &(alpha[0]), &(m_basis[0])); CHKERRQ(ierr);
+    }
+    ierr = VecMAXPY(basis[k], m, &(alpha[r]), &(snaps[0])); CHKERRQ(ierr);
+  }
+
+  // reorthogonalize, the modes lose orthogonality for small eigenvalues
+  for (int k=0; k<numModes; k++) {
+    if (k) {
+      ierr = VecMDot(basis[k], k, &(basis[0]), &(dots[0])); CHKERRQ(ierr);
+      for (int i=0; i<k; i++)
+        dots[i] = -dots[i];
+      ierr = VecMAXPY(basis[k], k, &(dots[0]), &(basis[0])); CHKERRQ(ierr);
+    }
+    double nrm;
+    ierr = VecNormalize(basis[k], &nrm); CHKERRQ(ierr);
+  }
+
+  clear();
+  m_basis = basis;
+  m_sigma = sigma;
+
+  PetscPrintf(0, "POD: %d snapshots, %d modes, %g of the energy\n", m, numModes, energy/total);
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "podSurrogate_project"
+int podSurrogate::project(cardiacDynamic *adjForce, std::vector<Vec> &obs, Vec mask, Vec initDisp, Vec initVel) {
+  int ierr;
+  int r = m_basis.size();
+  if (!r)
+    return(1);
+
+  timeInfo *ti = m_ts->getTimeInfo();
+  unsigned int NT = (unsigned int)(ceil(( ti->stop - ti->start)/ti->step));
+  double dt = ti->step;
+  double beta = 0.25, gamma = 0.5;
+  bool damp = m_ts->isDamped();
+
+  Vec tmp;
+  ierr = vecPool::get(m_basis[0], &tmp); CHKERRQ(ierr);
+  std::vector<double> col(r);
+
+  // mass, damping and stiffness
+  m_Mr.assign(r*r, 0.0);
+  m_Cr.assign(r*r, 0.0);
+  m_Kr.assign(r*r, 0.0);
+  for (int j=0; j<r; j++) {
+    ierr = VecZeroEntries(tmp); CHKERRQ(ierr);
+    m_ts->getMass()->MatVec(m_basis[j], tmp, 1.0);
+    ierr = VecMDot(tmp, r, &(m_basis[0]), &(col[0])); CHKERRQ(ierr);
+    for (int i=0; i<r; i++)
+      m_Mr[i*r+j] = col[i];
+
+    ierr = VecZeroEntries(tmp); CHKERRQ(ierr);
+    m_ts->getStiffness()->MatVec(m_basis[j], tmp, 1.0);
+    ierr = VecMDot(tmp, r, &(m_basis[0]), &(col[0])); CHKERRQ(ierr);
+    for (int i=0; i<r; i++)
+      m_Kr[i*r+j] = col[i];
+
+    if (damp) {
+      ierr = VecZeroEntries(tmp); CHKERRQ(ierr);
+      m_ts->getDamping()->MatVec(m_basis[j], tmp, 1.0);
+      ierr = VecMDot(tmp, r, &(m_basis[0]), &(col[0])); CHKERRQ(ierr);
+      for (int i=0; i<r; i++)
+        m_Cr[i*r+j] = col[i];
+    }
+  }
+
+  // the Jacobian and the mass matrix of newmark, factored once
+  m_jacLU.resize(r*r);
+  for (int i=0; i<r*r; i++)
+    m_jacLU[i] = m_Mr[i]/(beta*dt*dt) - m_Kr[i] + ( damp ? gamma/(beta*dt)*m_Cr[i] : 0.0 );
+  luFactor(m_jacLU, r, m_jacPiv);
+  m_massLU = m_Mr;
+  luFactor(m_massLU, r, m_massPiv);
+
+  // the forces are set by projectForces()
+  m_iNumForces = 0;
+  m_G.clear();
+
+  // initial conditions
+  m_u0.resize(r);
+  m_v0.resize(r);
+  ierr = VecMDot(initDisp, r, &(m_basis[0]), &(m_u0[0])); CHKERRQ(ierr);
+  ierr = VecMDot(initVel, r, &(m_basis[0]), &(m_v0[0])); CHKERRQ(ierr);
+
+  // Q V and W = Q Mq V, the adjoint force operator Mq is symmetric
+  std::vector<Vec> QV(r), W(r);
+  std::vector<Vec> fdyn(1);
+  for (int j=0; j<r; j++) {
+    ierr = vecPool::get(m_basis[0], &(QV[j])); CHKERRQ(ierr);
+    ierr = vecPool::get(m_basis[0], &(W[j])); CHKERRQ(ierr);
+
+    ierr = VecCopy(m_basis[j], QV[j]); CHKERRQ(ierr);
+    fdyn[0] = m_basis[j];
+    adjForce->setFDynamic(fdyn);
+    ierr = VecZeroEntries(W[j]); CHKERRQ(ierr);
+    adjForce->addVec(W[j], 1.0, 0);
+    if (mask != NULL) {
+      ierr = VecPointwiseMult(QV[j], QV[j], mask); CHKERRQ(ierr);
+      ierr = VecPointwiseMult(W[j], W[j], mask); CHKERRQ(ierr);
+    }
+  }
+
+  m_A.assign(r*r, 0.0);
+  m_H.assign(r*r, 0.0);
+  for (int j=0; j<r; j++) {
+    ierr = VecMDot(QV[j], r, &(QV[0]), &(col[0])); CHKERRQ(ierr);
+    for (int i=0; i<r; i++)
+      m_A[i*r+j] = col[i];
+    ierr = VecMDot(m_basis[j], r, &(W[0]), &(col[0])); CHKERRQ(ierr);
+    for (int i=0; i<r; i++)
+      m_H[i*r+j] = col[i];
+  }
+
+  // observations
+  m_b.assign((NT+1)*r, 0.0);
+  m_h.assign((NT+1)*r, 0.0);
+  m_c.assign(NT+1, 0.0);
+  for (unsigned int t=0; t<=NT; t++) {
+    ierr = VecMDot(obs[t], r, &(QV[0]), &(m_b[t*r])); CHKERRQ(ierr);
+    ierr = VecMDot(obs[t], r, &(W[0]), &(m_h[t*r])); CHKERRQ(ierr);
+    ierr = VecCopy(obs[t], tmp); CHKERRQ(ierr);
+    if (mask != NULL) {
+      ierr = VecPointwiseMult(tmp, tmp, mask); CHKERRQ(ierr);
+    }
+    double nrm;
+    ierr = VecNorm(tmp, NORM_2, &nrm); CHKERRQ(ierr);
+    m_c[t] = nrm*nrm;
+  }
+
+  vecPool::restore(QV);
+  vecPool::restore(W);
+  vecPool::restore(tmp);
+
+  m_bProjected = true;
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "podSurrogate_projectForces"
+int podSurrogate::projectForces(std::vector<Vec> &forces, int first, int numForces) {
+  int ierr;
+  int r = m_basis.size();
+  std::vector<double> col(r);
+
+  if (m_iNumForces != numForces) {
+    m_iNumForces = numForces;
+    m_G.assign(r*numForces, 0.0);
+  }
+  for (unsigned int b=0; b<forces.size(); b++) {
+    ierr = VecMDot(forces[b], r, &(m_basis[0]), &(col[0])); CHKERRQ(ierr);
+    for (int i=0; i<r; i++)
+      m_G[i*numForces + first + b] = col[i];
+  }
+  return(0);
+}
+
+int podSurrogate::forward(std::vector<double> &coef, bool homogeneous, std::vector<double> &z) {
+  int r = m_basis.size();
+  int nf = m_iNumForces;
+  unsigned int NT = coef.size()/nf - 1;
+
+  std::vector<double> f((NT+1)*r, 0.0);
+  for (unsigned int t=0; t<=NT; t++) {
+    for (int i=0; i<r; i++) {
+      double sum = 0.0;
+      for (int b=0; b<nf; b++)
+        sum += m_G[i*nf+b]*coef[t*nf+b];
+      f[t*r+i] = sum;
+    }
+  }
+
+  if (homogeneous) {
+    std::vector<double> zero(r, 0.0);
+    step(f, zero, zero, z);
+  } else {
+    step(f, m_u0, m_v0, z);
+  }
+  return(0);
+}
+
+double podSurrogate::residual(std::vector<double> &z, bool withData, std::vector<double> &fAdj) {
+  int r = m_basis.size();
+  unsigned int NT = z.size()/r - 1;
+  std::vector<double> Az(r);
+
+  double misfit = 0.0;
+  fAdj.assign((NT+1)*r, 0.0);
+  for (unsigned int t=0; t<=NT; t++) {
+    double *zt = &(z[t*r]);
+    double *ft = &(fAdj[t*r]);
+
+    Az.assign(r, 0.0);
+    matMult(m_A, r, zt, &(Az[0]), 1.0);
+    matMult(m_H, r, zt, ft, -1.0);
+    for (int i=0; i<r; i++) {
+      misfit += zt[i]*Az[i];
+      if (withData) {
+        misfit -= 2.0*m_b[t*r+i]*zt[i];
+        ft[i] += m_h[t*r+i];
+      }
+    }
+    if (withData)
+      misfit += m_c[t];
+  }
+  return misfit;
+}
+
+int podSurrogate::adjoint(std::vector<double> &fAdj, std::vector<double> &coefAdj) {
+  int r = m_basis.size();
+  int nf = m_iNumForces;
+  unsigned int NT = fAdj.size()/r - 1;
+
+  // the adjoint is stepped like the forward problem, backwards in time (see newmark::setRHS)
+  std::vector<double> f((NT+1)*r), lambda, zero(r, 0.0);
+  for (unsigned int t=0; t<=NT; t++)
+    for (int i=0; i<r; i++)
+      f[t*r+i] = fAdj[(NT-t)*r+i];
+  step(f, zero, zero, lambda);
+
+  coefAdj.assign((NT+1)*nf, 0.0);
+  for (unsigned int t=0; t<=NT; t++) {
+    double *lt = &(lambda[(NT-t)*r]);
+    for (int b=0; b<nf; b++) {
+      double sum = 0.0;
+      for (int i=0; i<r; i++)
+        sum += m_G[i*nf+b]*lt[i];
+      coefAdj[t*nf+b] = sum;
+    }
+  }
+  return(0);
+}
+
+/**
+ *  @brief the Newmark scheme of newmark.h in the reduced space, f is (NT+1) x r.
+ **/
+void podSurrogate::step(std::vector<double> &f, std::vector<double> &u0, std::vector<double> &v0, std::vector<double> &z) {
+  int r = m_basis.size();
+  unsigned int NT = f.size()/r - 1;
+  double dt = m_ts->getTimeInfo()->step;
+  double beta = 0.25, gamma = 0.5;
+  bool damp = m_ts->isDamped();
+
+  std::vector<double> u(u0), v(v0), a(r), rhs(r), du(r);
+
+  // initial acceleration, M a = f_0 - C v - K u
+  for (int i=0; i<r; i++)
+    a[i] = f[i];
+  if (damp)
+    matMult(m_Cr, r, &(v[0]), &(a[0]), -1.0);
+  matMult(m_Kr, r, &(u[0]), &(a[0]), -1.0);
+  luSolve(m_massLU, m_massPiv, r, &(a[0]));
+
+  z.resize((NT+1)*r);
+  for (int i=0; i<r; i++)
+    z[i] = u[i];
+
+  for (unsigned int n=1; n<=NT; n++) {
+    rhs.assign(r, 0.0);
+    matMult(m_Mr, r, &(a[0]), &(rhs[0]), 1.0/(2.0*beta));
+    matMult(m_Mr, r, &(v[0]), &(rhs[0]), 1.0/(beta*dt));
+    if (damp) {
+      matMult(m_Cr, r, &(a[0]), &(rhs[0]), dt*(gamma/(2*beta) - 1));
+      matMult(m_Cr, r, &(v[0]), &(rhs[0]), gamma/beta);
+    }
+    for (int i=0; i<r; i++)
+      rhs[i] += f[n*r+i] - f[(n-1)*r+i];
+
+    du = rhs;
+    luSolve(m_jacLU, m_jacPiv, r, &(du[0]));
+
+    for (int i=0; i<r; i++) {
+      double dv = gamma/(beta*dt)*du[i] - gamma/beta*v[i] + dt*(1.0 - gamma/(2.0*beta))*a[i];
+      double da = du[i]/(beta*dt*dt) - v[i]/(beta*dt) - a[i]/(2.0*beta);
+      u[i] += du[i];
+      v[i] += dv;
+      a[i] += da;
+      z[n*r+i] = u[i];
+    }
+  }
+}
+
+/**
+ *  @brief cyclic Jacobi, the eigenvalues are sorted in decreasing order, evecs(:,k) is the k-th eigenvector.
+ **/
+void podSurrogate::symmetricEigen(std::vector<double> &A, int n, std::vector<double> &evals, std::vector<double> &evecs) {
+  std::vector<double> a(A);
+  std::vector<double> V(n*n, 0.0);
+  for (int i=0; i<n; i++)
+    V[i*n+i] = 1.0;
+
+  double nrm = 0.0;
+  for (int i=0; i<n*n; i++)
+    nrm += a[i]*a[i];
+
+  for (int sweep=0; sweep<100; sweep++) {
+    double off = 0.0;
+    for (int i=0; i<n; i++)
+      for (int j=i+1; j<n; j++)
+        off += a[i*n+j]*a[i*n+j];
+    if (off <= 1e-30*nrm)
+      break;
+
+    for (int p=0; p<n; p++) {
+      for (int q=p+1; q<n; q++) {
+        double apq = a[p*n+q];
+        if (fabs(apq) < 1e-300)
+          continue;
+        double theta = (a[q*n+q] - a[p*n+p])/(2.0*apq);
+        double t = ((theta >= 0.0) ? 1.0 : -1.0)/(fabs(theta) + sqrt(theta*theta + 1.0));
+        double c = 1.0/sqrt(t*t + 1.0);
+        double s = t*c;
+
+        for (int k=0; k<n; k++) {
+          double akp = a[k*n+p], akq = a[k*n+q];
+          a[k*n+p] = c*akp - s*akq;
+          a[k*n+q] = s*akp + c*akq;
+        }
+        for (int k=0; k<n; k++) {
+          double apk = a[p*n+k], aqk = a[q*n+k];
+          a[p*n+k] = c*apk - s*aqk;
+          a[q*n+k] = s*apk + c*aqk;
+        }
+        for (int k=0; k<n; k++) {
+          double vkp = V[k*n+p], vkq = V[k*n+q];
+          V[k*n+p] = c*vkp - s*vkq;
+          V[k*n+q] = s*vkp + c*vkq;
+        }
+      }
+    }
+  }
+
+  // sort
+  std::vector<int> idx(n);
+  for (int i=0; i<n; i++)
+    idx[i] = i;
+  for (int i=0; i<n; i++)
+    for (int j=i+1; j<n; j++)
+      if (a[idx[j]*n+idx[j]] > a[idx[i]*n+idx[i]]) {
+        int tmp = idx[i]; idx[i] = idx[j]; idx[j] = tmp;
+      }
+
+  evals.resize(n);
+  evecs.resize(n*n);
+  for (int k=0; k<n; k++) {
+    evals[k] = a[idx[k]*n+idx[k]];
+    for (int i=0; i<n; i++)
+      evecs[i*n+k] = V[i*n+idx[k]];
+  }
+}
+
+void podSurrogate::luFactor(std::vector<double> &A, int n, std::vector<int> &piv) {
+  piv.resize(n);
+  for (int k=0; k<n; k++) {
+    int p = k;
+    for (int i=k+1; i<n; i++)
+      if (fabs(A[i*n+k]) > fabs(A[p*n+k]))
+        p = i;
+    piv[k] = p;
+    if (p != k)
+      for (int j=0; j<n; j++) {
+        double tmp = A[k*n+j]; A[k*n+j] = A[p*n+j]; A[p*n+j] = tmp;
+      }
+    for (int i=k+1; i<n; i++) {
+      A[i*n+k] /= A[k*n+k];
+      for (int j=k+1; j<n; j++)
+        A[i*n+j] -= A[i*n+k]*A[k*n+j];
+    }
+  }
+}
+
+void podSurrogate::luSolve(std::vector<double> &LU, std::vector<int> &piv, int n, double *b) {
+  for (int k=0; k<n; k++) {
+    double tmp = b[k]; b[k] = b[piv[k]]; b[piv[k]] = tmp;
+  }
+  for (int i=1; i<n; i++)
+    for (int j=0; j<i; j++)
+      b[i] -= LU[i*n+j]*b[j];
+  for (int i=n-1; i>=0; i--) {
+    for (int j=i+1; j<n; j++)
+      b[i] -= LU[i*n+j]*b[j];
+    b[i] /= LU[i*n+i];
+  }
+}
+
+/**
+ *  @brief y += scale*A x
+ **/
+void podSurrogate::matMult(std::vector<double> &A, int n, double *x, double *y, double scale) {
+  for (int i=0; i<n; i++) {
+    double sum = 0.0;
+    for (int j=0; j<n; j++)
+      sum += A[i*n+j]*x[j];
+    y[i] += scale*sum;
+  }
+}
+
+#endif
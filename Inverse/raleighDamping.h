@@ -41,6 +41,11 @@ class raleighDamping : public feMatrix<raleighDamping>
     inline bool ElementalMatVec(int i, int j, int k, PetscScalar ***in, PetscScalar ***out, double scale);
     inline bool ElementalMatVec(unsigned int idx, PetscScalar *in, PetscScalar *out, double scale);
 
+    template <unsigned int DOF>
+    inline bool ElementalMatVecT(int i, int j, int k, PetscScalar ***in, PetscScalar ***out, double scale);
+    template <unsigned int DOF, bool HANGING>
+    inline bool ElementalMatVecT(unsigned int idx, PetscScalar *in, PetscScalar *out, double scale);
+
     inline bool ElementalMatGetDiagonal(int i, int j, int k, PetscScalar ***diag, double scale);
     inline bool ElementalMatGetDiagonal(unsigned int idx, PetscScalar *diag, double scale);
 
@@ -109,6 +114,18 @@ bool raleighDamping::ElementalMatVec(unsigned int idx, PetscScalar *in, PetscSca
            m_matStiffness->ElementalMatVec(idx,in,out,scale*m_dBeta) );
 }
 
+template <unsigned int DOF>
+bool raleighDamping::ElementalMatVecT(int i, int j, int k, PetscScalar ***in, PetscScalar ***out, double scale) {
+  return ( m_matMass->ElementalMatVecT<DOF>(i,j,k,in,out,scale*m_dAlpha) + 
+           m_matStiffness->ElementalMatVecT<DOF>(i,j,k,in,out,scale*m_dBeta) );
+}
+
+template <unsigned int DOF, bool HANGING>
+bool raleighDamping::ElementalMatVecT(unsigned int idx, PetscScalar *in, PetscScalar *out, double scale) {
+  return ( m_matMass->ElementalMatVecT<DOF,HANGING>(idx, in, out, scale*m_dAlpha) +
+           m_matStiffness->ElementalMatVecT<DOF,HANGING>(idx,in,out,scale*m_dBeta) );
+}
+
 bool raleighDamping::ElementalMatGetDiagonal(int i, int j, int k, PetscScalar ***diag, double scale) {
   return ( m_matMass->ElementalMatGetDiagonal(i,j,k,diag,scale*m_dAlpha) + 
            m_matStiffness->ElementalMatGetDiagonal(i,j,k,diag,scale*m_dBeta) );
@@ -19,7 +19,10 @@ class scalarHyperbolicInverse : public inverseSolver { // scalarHyperbolic inver
 
 public:
 
-  scalarHyperbolicInverse() {}
+  scalarHyperbolicInverse() {
+    m_vecForwardInitialDisplacement = NULL;
+    m_vecForwardInitialVelocity = NULL;
+  }
 
   virtual ~scalarHyperbolicInverse() {}
 
@@ -42,8 +45,10 @@ public:
   virtual bool setReducedGradient();
 
   void setForwardInitialConditions(Vec initDisp, Vec initVel) {
-    VecDuplicate(initDisp, &m_vecForwardInitialDisplacement);
-    VecDuplicate(initVel, &m_vecForwardInitialVelocity);
+    if (m_vecForwardInitialDisplacement == NULL)
+      VecDuplicate(initDisp, &m_vecForwardInitialDisplacement);
+    if (m_vecForwardInitialVelocity == NULL)
+      VecDuplicate(initVel, &m_vecForwardInitialVelocity);
     VecCopy(initDisp, m_vecForwardInitialDisplacement);
     VecCopy(initVel, m_vecForwardInitialVelocity);
 
@@ -184,13 +189,11 @@ bool scalarHyperbolicInverse::setReducedGradient()
   fdynamicVector *Fdynamic = new fdynamicVector(feVec::PETSC);
 
   // Solver 
-  newmark *ts = new newmark;
+  newmark *ts = (newmark *)m_ts;
 
+  // Forward solve
   ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
   ts->setInitialVelocity(m_vecForwardInitialVelocity);
-
-  // Forward solve
-  ts = (newmark *)m_ts;
   ts->setAdjoint(false);
 
   ts->setTimeFrames(1);
@@ -269,8 +272,8 @@ bool scalarHyperbolicInverse::setReducedGradient()
 
   // set initial conditions for adjoint ...
   Vec initD, initV;
-  VecDuplicate(m_vecForwardInitialDisplacement, &initD);
-  VecDuplicate(m_vecForwardInitialDisplacement, &initV);
+  vecPool::get(m_vecForwardInitialDisplacement, &initD);
+  vecPool::get(m_vecForwardInitialDisplacement, &initV);
   VecZeroEntries(initD);
   VecZeroEntries(initV);
   ts->setInitialDisplacement(initD); 
@@ -285,7 +288,7 @@ bool scalarHyperbolicInverse::setReducedGradient()
   // clear memory ...
   for (int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
 
@@ -299,7 +302,7 @@ bool scalarHyperbolicInverse::setReducedGradient()
   // clear memory ...
   for (int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
 
@@ -315,8 +318,10 @@ bool scalarHyperbolicInverse::setReducedGradient()
   VecNorm(m_vecReducedGradient,NORM_2,&norm);
   PetscPrintf(0,"norm of reduced Gradient = %f\n", norm);
 
-  VecDestroy(initD);
-  VecDestroy(initV);
+  ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+  ts->setInitialVelocity(m_vecForwardInitialVelocity);
+  vecPool::restore(initD);
+  vecPool::restore(initV);
 
 // #endif
   std::cout << GRN"Leaving "NRM << __func__ << std::endl;
@@ -334,14 +339,12 @@ void scalarHyperbolicInverse::hessianMatMult(Vec In, Vec Out)
   // std::cout << RED"Entering "NRM << __func__ << std::endl;
   VecZeroEntries(Out);
 
-  newmark *ts = new newmark;
+  newmark *ts = (newmark *)m_ts;
 
   // Fdynamic which is the control 
   fdynamicVector *Fdynamic = new fdynamicVector(feVec::PETSC);
 
   // Forward solve
-  ts = (newmark *)m_ts;
-
   ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
   ts->setInitialVelocity(m_vecForwardInitialVelocity);
 
@@ -370,10 +373,11 @@ void scalarHyperbolicInverse::hessianMatMult(Vec In, Vec Out)
   solvec = ts->getSolution();
 
   Vec tmp;
-  VecDuplicate(m_vecReducedGradient, &tmp);
+  vecPool::get(m_vecReducedGradient, &tmp);
   concatenateVecs(solvec, tmp, false);
   // VecNorm(tmp, NORM_2, &norm);
   // PetscPrintf(0, "Sol Norm after HessFwd is %g\n", norm);
+  vecPool::restore(tmp);
 
   // Scale to the set the right hand side of adjoint
   for (unsigned int i=0; i<solvec.size(); i++) {
@@ -400,8 +404,8 @@ void scalarHyperbolicInverse::hessianMatMult(Vec In, Vec Out)
 
   // set initial conditions for adjoint ...
   Vec initD, initV;
-  VecDuplicate(m_vecForwardInitialDisplacement, &initD);
-  VecDuplicate(m_vecForwardInitialDisplacement, &initV);
+  vecPool::get(m_vecForwardInitialDisplacement, &initD);
+  vecPool::get(m_vecForwardInitialDisplacement, &initV);
   VecZeroEntries(initD);
   VecZeroEntries(initV);
   ts->setInitialDisplacement(initD); 
@@ -414,7 +418,7 @@ void scalarHyperbolicInverse::hessianMatMult(Vec In, Vec Out)
   // clear memory ...
   for (int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
 
@@ -427,7 +431,7 @@ void scalarHyperbolicInverse::hessianMatMult(Vec In, Vec Out)
   // clear memory ...
   for (int i=0; i<solvec.size(); i++) {
     if (solvec[i] != NULL) {
-      VecDestroy(solvec[i]);
+      vecPool::restore(solvec[i]);
     }
   }
 
@@ -440,8 +444,10 @@ void scalarHyperbolicInverse::hessianMatMult(Vec In, Vec Out)
   // add the contribution of the regularization parameter
   VecAXPY(Out, m_beta, In);
   // std::cout << GRN"Leaving "NRM << __func__ << std::endl;
-  VecDestroy(initD);
-  VecDestroy(initV);
+  ts->setInitialDisplacement(m_vecForwardInitialDisplacement);
+  ts->setInitialVelocity(m_vecForwardInitialVelocity);
+  vecPool::restore(initD);
+  vecPool::restore(initV);
 }
 
 #endif
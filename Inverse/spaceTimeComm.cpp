@@ -0,0 +1,154 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "petsc.h"
+#include "spaceTimeComm.h"
+
+int                       spaceTimeComm::m_iNumGroups = 1;
+int                       spaceTimeComm::m_iGroup = 0;
+MPI_Comm                  spaceTimeComm::m_groupComm = MPI_COMM_NULL;
+MPI_Comm                  spaceTimeComm::m_acrossComm = MPI_COMM_NULL;
+std::vector<PetscScalar>  spaceTimeComm::m_sendBuf;
+MPI_Request               spaceTimeComm::m_sendRequest;
+bool                      spaceTimeComm::m_bSendPending = false;
+
+int spaceTimeComm::init(int *argc, char ***argv)
+{
+  int rank, npes;
+
+  MPI_Init(argc, argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &npes);
+
+  // PETSc options are not available yet.
+  m_iNumGroups = 1;
+  for (int i=1; i<(*argc)-1; i++) {
+    if ( !strcmp((*argv)[i], "-time_groups") )
+      m_iNumGroups = atoi((*argv)[i+1]);
+  }
+
+  if ( (m_iNumGroups < 1) || (npes % m_iNumGroups) ) {
+    if (!rank)
+      std::cerr << "spaceTimeComm: " << npes << " processors can not be split into " << m_iNumGroups << " groups, using one group." << std::endl;
+    m_iNumGroups = 1;
+  }
+
+  int groupSize = npes/m_iNumGroups;
+  m_iGroup = rank/groupSize;
+
+  MPI_Comm_split(MPI_COMM_WORLD, m_iGroup, rank, &m_groupComm);
+  MPI_Comm_split(MPI_COMM_WORLD, rank % groupSize, m_iGroup, &m_acrossComm);
+
+  PETSC_COMM_WORLD = m_groupComm;
+
+  return(0);
+}
+
+int spaceTimeComm::finalize()
+{
+  waitSend();
+  m_sendBuf.clear();
+
+  MPI_Comm_free(&m_acrossComm);
+  MPI_Comm_free(&m_groupComm);
+
+  MPI_Finalize();
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "spaceTimeComm_sendVecs"
+int spaceTimeComm::sendVecs(std::vector<Vec> &vecs, int toGroup, int tag)
+{
+  int ierr;
+  PetscInt sz, total = 0;
+  PetscScalar *arr;
+
+  ierr = waitSend(); CHKERRQ(ierr);
+
+  for (unsigned int i=0; i<vecs.size(); i++) {
+    ierr = VecGetLocalSize(vecs[i], &sz); CHKERRQ(ierr);
+    total += sz;
+  }
+  m_sendBuf.resize(total);
+
+  PetscInt off = 0;
+  for (unsigned int i=0; i<vecs.size(); i++) {
+    ierr = VecGetLocalSize(vecs[i], &sz); CHKERRQ(ierr);
+    ierr = VecGetArray(vecs[i], &arr); CHKERRQ(ierr);
+    memcpy(&(m_sendBuf[off]), arr, sz*sizeof(PetscScalar));
+    ierr = VecRestoreArray(vecs[i], &arr); CHKERRQ(ierr);
+    off += sz;
+  }
+
+  if (total) {
+    MPI_Isend(&(*(m_sendBuf.begin())), total*sizeof(PetscScalar), MPI_BYTE, toGroup, tag, m_acrossComm, &m_sendRequest);
+    m_bSendPending = true;
+  }
+
+  return(0);
+}
+
+int spaceTimeComm::waitSend()
+{
+  if (m_bSendPending) {
+    MPI_Status status;
+    MPI_Wait(&m_sendRequest, &status);
+    m_bSendPending = false;
+  }
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "spaceTimeComm_recvVecs"
+int spaceTimeComm::recvVecs(std::vector<Vec> &vecs, int fromGroup, int tag)
+{
+  int ierr;
+  PetscInt sz, total = 0;
+  PetscScalar *arr;
+  MPI_Status status;
+
+  for (unsigned int i=0; i<vecs.size(); i++) {
+    ierr = VecGetLocalSize(vecs[i], &sz); CHKERRQ(ierr);
+    total += sz;
+  }
+  if (!total)
+    return(0);
+
+  std::vector<PetscScalar> buf(total);
+  MPI_Recv(&(*(buf.begin())), total*sizeof(PetscScalar), MPI_BYTE, fromGroup, tag, m_acrossComm, &status);
+
+  PetscInt off = 0;
+  for (unsigned int i=0; i<vecs.size(); i++) {
+    ierr = VecGetLocalSize(vecs[i], &sz); CHKERRQ(ierr);
+    ierr = VecGetArray(vecs[i], &arr); CHKERRQ(ierr);
+    memcpy(arr, &(buf[off]), sz*sizeof(PetscScalar));
+    ierr = VecRestoreArray(vecs[i], &arr); CHKERRQ(ierr);
+    off += sz;
+  }
+
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "spaceTimeComm_bcast"
+int spaceTimeComm::bcast(Vec v, int root)
+{
+  int ierr;
+  PetscInt sz;
+  PetscScalar *arr;
+
+  ierr = VecGetLocalSize(v, &sz); CHKERRQ(ierr);
+  ierr = VecGetArray(v, &arr); CHKERRQ(ierr);
+  MPI_Bcast(arr, sz*sizeof(PetscScalar), MPI_BYTE, root, m_acrossComm);
+  ierr = VecRestoreArray(v, &arr); CHKERRQ(ierr);
+
+  return(0);
+}
+
+int spaceTimeComm::bcast(double &val, int root)
+{
+  MPI_Bcast(&val, 1, MPI_DOUBLE, root, m_acrossComm);
+  return(0);
+}
@@ -0,0 +1,97 @@
+/**
+ *  @file   spaceTimeComm.h
+ *  @brief  Splits the processors into groups that each solve the full spatial problem.
+ *  @author Hari Sundar
+ *  @date   3/3/08
+ *
+ *  The processors are split into numGroups groups of equal size, and
+ *  PETSC_COMM_WORLD is set to the group communicator before PetscInitialize,
+ *  so that every group creates its own DAs, matrices and time stepper,
+ *  with the same partition. The groups work on different time slabs, and
+ *  exchange Vecs over a second communicator that connects the processors
+ *  with the same rank in every group, so a Vec is transferred by sending
+ *  the local arrays, without any redistribution.
+ *
+ *  The drivers call init() instead of MPI_Init and finalize() after
+ *  PetscFinalize. With the default of a single group, PETSC_COMM_WORLD is
+ *  MPI_COMM_WORLD and nothing changes.
+ *
+ *  Splitting the processors does not shorten the gradient, whose adjoint can
+ *  only start at the end of the forward solve, it bounds its memory to a
+ *  time slab (see parametricActivationInverse::setReducedGradientPipelined).
+ *
+ *  Options (read before PetscInitialize):
+ *    -time_groups <n>   number of groups (1, i.e., off)
+ **/
+
+#ifndef _SPACE_TIME_COMM_H_
+#define _SPACE_TIME_COMM_H_
+
+#include <vector>
+
+#include "mpi.h"
+#include "petscvec.h"
+
+class spaceTimeComm {
+  public:
+    /**
+     *  @brief initializes MPI and splits the processors, must be called before PetscInitialize.
+     **/
+    static int init(int *argc, char ***argv);
+
+    /**
+     *  @brief frees the communicators and finalizes MPI, call after PetscFinalize.
+     **/
+    static int finalize();
+
+    static int getNumGroups() {
+      return m_iNumGroups;
+    }
+
+    static int getGroup() {
+      return m_iGroup;
+    }
+
+    /**
+     *  @brief the communicator connecting the processors with the same rank in every group, ranked by group.
+     **/
+    static MPI_Comm getAcrossComm() {
+      return m_acrossComm;
+    }
+
+    /**
+     *  @brief sends the local parts of the Vecs to the same processor of group toGroup.
+     *
+     *  The send is non-blocking, the data is copied so the Vecs can be reused
+     *  immediately. The previous send, if any, is completed first.
+     **/
+    static int sendVecs(std::vector<Vec> &vecs, int toGroup, int tag);
+
+    /**
+     *  @brief completes the last sendVecs().
+     **/
+    static int waitSend();
+
+    /**
+     *  @brief receives the local parts of the (already created) Vecs from group fromGroup.
+     **/
+    static int recvVecs(std::vector<Vec> &vecs, int fromGroup, int tag);
+
+    /**
+     *  @brief copies the local part of v on group root to all groups.
+     **/
+    static int bcast(Vec v, int root);
+    static int bcast(double &val, int root);
+
+  protected:
+    static int                      m_iNumGroups;
+    static int                      m_iGroup;
+    static MPI_Comm                 m_groupComm;
+    static MPI_Comm                 m_acrossComm;
+
+    static std::vector<PetscScalar> m_sendBuf;
+    static MPI_Request              m_sendRequest;
+    static bool                     m_bSendPending;
+};
+
+#endif
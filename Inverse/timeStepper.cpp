@@ -23,6 +23,9 @@ timeStepper::timeStepper()
   // Linear Solver
   m_ksp = NULL;
 
+  // no octree multigrid
+  m_octDMMG = NULL;
+
   // Adjoint flag false
   m_bIsAdjoint = false;
 
@@ -118,6 +121,21 @@ int timeStepper::setReaction(feVec* Reaction)
   return(0);
 }
 
+/**
+ *	@brief This function sets the octree multigrid preconditioner
+ * @param dmmg the octree hierarchy
+ * @param Mass, Damping, Stiffness operators of the coarser levels
+ * @return bool true if successful, false otherwise
+ **/
+int timeStepper::setMultigrid(octDMMG *dmmg, std::vector<feMat*> &Mass, std::vector<feMat*> &Damping, std::vector<feMat*> &Stiffness)
+{
+  m_octDMMG = dmmg;
+  m_mgMass = Mass;
+  m_mgDamping = Damping;
+  m_mgStiffness = Stiffness;
+  return(0);
+}
+
 /**
  *	@brief This function sets all the time parameters
  * @param StartTime double starting time of the timestepper
@@ -157,5 +175,31 @@ int timeStepper::setAdjoint(bool flag)
   return(0);
 }
 
+/**
+ *	@brief This function sets the relative tolerance of the timestep solves
+ * @param rtol, relative tolerance passed on to the KSP
+ * @return 0 if successful
+ **/
+int timeStepper::setSolverTolerance(double rtol)
+{
+  int ierr;
+  if (m_ksp == NULL)
+    return(0);
+  ierr = KSPSetTolerances(m_ksp, rtol, PETSC_DEFAULT, PETSC_DEFAULT, PETSC_DEFAULT); CHKERRQ(ierr);
+  return(0);
+}
+
+/**
+ *	@brief This function returns the relative tolerance of the timestep solves
+ * @return the relative tolerance, 0 if the KSP has not been created
+ **/
+double timeStepper::getSolverTolerance()
+{
+  double rtol = 0.0;
+  if (m_ksp != NULL)
+    KSPGetTolerances(m_ksp, &rtol, 0, 0, 0);
+  return rtol;
+}
+
 /// Jacobian matmult, setRhs will be in the derived class
 
@@ -10,7 +10,9 @@
 #include "feMat.h"
 #include "feVec.h"
 #include "timeInfo.h"
+#include "vecPool.h"
 #include "stsdamgHeader.h"
+#include "octdamgHeader.h"
 //#include "rpHeader.h"
 
 class timeStepper {
@@ -37,6 +39,15 @@ class timeStepper {
   int setForceVector(feVec* Force);
 
   int setReaction(feVec* Reaction);
+
+  /**
+	*	@brief use an octree multigrid as the preconditioner of the KSP, must be called before init()
+	*  @param dmmg the hierarchy, with the finest level on the DA of the operators
+	*  @param Mass, Damping, Stiffness the operators of the coarser levels, coarsest first
+	*
+	*  Damping is only used if the time stepper uses damping.
+	**/
+  int setMultigrid(octDMMG *dmmg, std::vector<feMat*> &Mass, std::vector<feMat*> &Damping, std::vector<feMat*> &Stiffness);
   
   /*
   template <typename T>
@@ -50,6 +61,17 @@ class timeStepper {
 
   int setTimeInfo(timeInfo *ti);
 
+  /**
+	*	@brief set the relative tolerance of the KSP used at every timestep, must be called after init()
+	*  @param rtol relative tolerance
+	**/
+  int setSolverTolerance(double rtol);
+
+  /**
+	*	@brief get the relative tolerance of the KSP used at every timestep
+	**/
+  double getSolverTolerance();
+
   timeInfo* getTimeInfo() {
     return m_ti;
   }
@@ -233,6 +255,12 @@ class timeStepper {
 
   // stsDMMG Multigrid
   stsDMMG      *m_dmmg;
+
+  // octree Multigrid, and the operators of its coarser levels
+  octDMMG               *m_octDMMG;
+  std::vector<feMat*>   m_mgMass;
+  std::vector<feMat*>   m_mgDamping;
+  std::vector<feMat*>   m_mgStiffness;
   
   // Time info
   timeInfo     *m_ti;
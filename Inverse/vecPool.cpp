@@ -0,0 +1,99 @@
+#include "vecPool.h"
+
+std::map<vecPool::layout, std::vector<Vec> >  vecPool::m_pool;
+vecPool::counters                             vecPool::m_counters = {0, 0, 0, 0, 0, 0};
+std::set<Vec>                                 vecPool::m_owned;
+std::set<Vec>                                 vecPool::m_checkedOut;
+
+int vecPool::getLayout(Vec v, layout &l)
+{
+  int ierr;
+  VecType type;
+  ierr = PetscObjectGetComm((PetscObject)v, &(l.comm)); CHKERRQ(ierr);
+  ierr = VecGetType(v, &type); CHKERRQ(ierr);
+  l.type = type ? type : "";
+  ierr = VecGetLocalSize(v, &(l.local)); CHKERRQ(ierr);
+  ierr = VecGetSize(v, &(l.global)); CHKERRQ(ierr);
+  ierr = VecGetBlockSize(v, &(l.bs)); CHKERRQ(ierr);
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "vecPool_get"
+int vecPool::get(Vec templ, Vec *v)
+{
+  int ierr;
+  layout l;
+  ierr = getLayout(templ, l); CHKERRQ(ierr);
+
+  std::vector<Vec> &avail = m_pool[l];
+  if ( avail.empty() ) {
+    ierr = VecDuplicate(templ, v); CHKERRQ(ierr);
+    m_owned.insert(*v);
+    m_counters.created++;
+  } else {
+    *v = avail.back();
+    avail.pop_back();
+    m_counters.pooled--;
+  }
+  m_checkedOut.insert(*v);
+
+  m_counters.checkouts++;
+  if ( ++m_counters.outstanding > m_counters.peak )
+    m_counters.peak = m_counters.outstanding;
+
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "vecPool_restore"
+int vecPool::restore(Vec v)
+{
+  if (v == NULL)
+    return(0);
+
+  if ( m_owned.find(v) == m_owned.end() ) {
+    SETERRQ(PETSC_ERR_ARG_WRONG,"Restoring a Vec that was not obtained from the vecPool");
+  }
+  if ( m_checkedOut.find(v) == m_checkedOut.end() ) {
+    SETERRQ(PETSC_ERR_ARG_WRONG,"Restoring a Vec that is not checked out of the vecPool, it was restored twice");
+  }
+
+  int ierr;
+  layout l;
+  ierr = getLayout(v, l); CHKERRQ(ierr);
+
+  m_checkedOut.erase(v);
+  m_pool[l].push_back(v);
+  m_counters.pooled++;
+  m_counters.returns++;
+  m_counters.outstanding--;
+
+  return(0);
+}
+
+int vecPool::restore(std::vector<Vec> &vecs)
+{
+  int ierr;
+  for (unsigned int i=0; i<vecs.size(); i++) {
+    ierr = restore(vecs[i]); CHKERRQ(ierr);
+  }
+  vecs.clear();
+  return(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "vecPool_clear"
+int vecPool::clear()
+{
+  int ierr;
+  for (std::map<layout, std::vector<Vec> >::iterator it = m_pool.begin(); it != m_pool.end(); it++) {
+    for (unsigned int i=0; i<it->second.size(); i++) {
+      m_owned.erase(it->second[i]);
+      ierr = VecDestroy(it->second[i]); CHKERRQ(ierr);
+    }
+  }
+  m_pool.clear();
+  m_counters.pooled = 0;
+  return(0);
+}
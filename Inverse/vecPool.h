@@ -0,0 +1,111 @@
+/**
+ *  @file   vecPool.h
+ *  @brief  Pool of work vectors for the time steppers and the inverse solvers.
+ *  @author Hari Sundar
+ *  @date   2/26/08
+ *
+ *  The forward and adjoint solves store a Vec per timestep, and the
+ *  inverse solvers create the activations and the temporary vectors of every
+ *  gradient and Hessian matvec. Instead of creating and destroying these
+ *  Vecs every time, they are checked out of and returned to a pool.
+ *
+ *  Vecs are pooled by their layout (communicator, Vec type, local size,
+ *  global size and block size), so all Vecs of the same DA (or of DAs with
+ *  the same partition) share a pool, for both the regular grid and the octree
+ *  DAs. get() mirrors VecDuplicate() and restore() mirrors VecDestroy(). A
+ *  Vec obtained from the pool is not initialized. Only Vecs obtained from
+ *  get() can be returned, restore() fails for any other Vec (use VecDestroy()
+ *  for those), and for a Vec that is not checked out, e.g., restored twice. A
+ *  returned Vec is reused for the next get() with the same
+ *  layout. Nothing is freed until clear() is called.
+ *
+ *  The counters show how many Vecs were actually created, once the pool is
+ *  warm (after the first Gauss-Newton iteration) no new Vecs should be
+ *  created.
+ **/
+
+#ifndef _VEC_POOL_H_
+#define _VEC_POOL_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "petscvec.h"
+
+class vecPool {
+  public:
+    struct counters {
+      long  created;      // VecDuplicate calls
+      long  checkouts;    // get() calls
+      long  returns;      // restore() calls
+      long  outstanding;  // checked out and not returned
+      long  peak;         // maximum outstanding
+      long  pooled;       // Vecs held by the pool
+    };
+
+    /**
+     *  @brief gets a Vec with the same layout as templ, creates one only if the pool is empty.
+     **/
+    static int get(Vec templ, Vec *v);
+
+    /**
+     *  @brief returns a Vec to the pool, v should not be used afterwards.
+     *  v must have been obtained from get() and not restored since.
+     **/
+    static int restore(Vec v);
+
+    /**
+     *  @brief returns all Vecs and clears the vector.
+     **/
+    static int restore(std::vector<Vec> &vecs);
+
+    /**
+     *  @brief destroys all Vecs held by the pool, call before PetscFinalize.
+     **/
+    static int clear();
+
+    static const counters& getCounters() {
+      return m_counters;
+    }
+
+    /**
+     *  @brief number of Vecs created so far, the difference across an iteration should be zero in steady state.
+     **/
+    static long getNumCreated() {
+      return m_counters.created;
+    }
+
+  protected:
+    struct layout {
+      MPI_Comm    comm;
+      std::string type;
+      PetscInt    local;
+      PetscInt    global;
+      PetscInt    bs;
+
+      bool operator<(const layout &other) const {
+        if (comm != other.comm)
+          return (comm < other.comm);
+        if (type != other.type)
+          return (type < other.type);
+        if (local != other.local)
+          return (local < other.local);
+        if (global != other.global)
+          return (global < other.global);
+        return (bs < other.bs);
+      }
+    };
+
+    static int getLayout(Vec v, layout &l);
+
+    static std::map<layout, std::vector<Vec> >  m_pool;
+    static counters                             m_counters;
+    // the Vecs created by get() and not yet destroyed by clear()
+    static std::set<Vec>                        m_owned;
+    // the Vecs handed out by get() and not yet restored
+    static std::set<Vec>                        m_checkedOut;
+};
+
+#endif